@@ -1,6 +1,7 @@
 #include "bitfields.h"
 #include "bitstream.h"
 #include "defines.h"
+#include "nal.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -40,11 +41,35 @@ namespace Utils{
 
   void bitstream::append(const std::string &input){append((char *)input.c_str(), input.size());}
 
+  /// Appends a NAL unit payload, removing emulation prevention bytes on the way in.
+  void bitstream::appendRBSP(const char *input, size_t bytes){
+    if (checkBufferSize(dataSize + bytes)){
+      dataSize += nalu::removeEmulationPrevention(input, bytes, data + dataSize);
+    }
+  }
+
   bool bitstream::peekOffset(size_t peekOffset){
     peekOffset += offset;
     return ((data[peekOffset >> 3]) >> (7 - (peekOffset & 7))) & 1;
   }
 
+  /// Reads up to 56 bits starting at bit position pos, using a single big-endian word load.
+  /// Bytes past the end of the data read as zero.
+  long long unsigned int bitstream::peekBits(size_t pos, size_t count){
+    if (!count){return 0;}
+    size_t byte = pos >> 3;
+    uint64_t word;
+    if (byte + 8 <= dataSize){
+      word = Bit::btohll(data + byte);
+    }else{
+      word = 0;
+      for (size_t i = 0; i < 8; ++i){
+        word = (word << 8) | (byte + i < dataSize ? (unsigned char)data[byte + i] : 0);
+      }
+    }
+    return (word << (pos & 7)) >> (64 - count);
+  }
+
   long long unsigned int bitstream::peek(size_t count){
     if (count > 64){
       DEBUG_MSG(DLVL_WARN, "Can not read %d bits into a long long unsigned int!", (int)count);
@@ -55,32 +80,15 @@ namespace Utils{
       return 0;
     }
     long long unsigned int retval = 0;
-    size_t curPlace = 0;
-    size_t readSize;
-    size_t readOff;
-    char readBuff;
-    while (curPlace < count){
-      readBuff = data[(int)((offset + curPlace) / 8)];
-      readSize = 8;
-      readOff = (offset + curPlace) % 8; // the reading offset within the byte
-      if (readOff != 0){
-        // if we start our read not on the start of a byte
-        // curplace and retval should both be 0
-        // this should be the first read that aligns reading to bytes, if we read over the end of
-        // read byte we cut the MSb off of the buffer by bit mask
-        readSize -= readOff;                         // defining starting bit
-        readBuff = readBuff & ((1 << readSize) - 1); // bitmasking
-      }
-      // up until here we assume we read to the end of the byte
-      if (count - curPlace < readSize){// if we do not read to the end of the byte
-        // we cut off the LSb off of the read buffer by bitshift
-        readSize = count - curPlace;
-        readBuff = readBuff >> (8 - readSize - readOff);
-      }
-      retval = (retval << readSize) + readBuff;
-      curPlace += readSize;
+    size_t pos = offset;
+    // Wide reads are split; anything beyond 64 bits shifts out the top, as it always has
+    while (count > 56){
+      retval = (retval << 32) | peekBits(pos, 32);
+      pos += 32;
+      count -= 32;
     }
-    return retval;
+    if (!count){return retval;}
+    return (retval << count) | peekBits(pos, count);
   }
 
   long long unsigned int bitstream::get(size_t count){
@@ -115,18 +123,23 @@ namespace Utils{
     offset %= 8;
   }
 
+  /// Returns the amount of leading zero bits within the next 64, or -1 if they are all zero.
+  int bitstream::golombZeros(){
+    size_t window = size() < 64 ? size() : 64;
+    if (!window){return -1;}
+    long long unsigned int bits = peek(window) << (64 - window);
+    if (!bits){return -1;}
+    return __builtin_clzll(bits);
+  }
+
   long long unsigned int bitstream::golombPeeker(){
-    for (size_t i = 0; i < 64 && i < size(); i++){
-      if (peekOffset(i)){return peek((i * 2) + 1);}
-    }
-    return 0;
+    int zeros = golombZeros();
+    return zeros < 0 ? 0 : peek((zeros * 2) + 1);
   }
 
   long long unsigned int bitstream::golombGetter(){
-    for (size_t i = 0; i < 64 && i < size(); i++){
-      if (peekOffset(i)){return get((i * 2) + 1);}
-    }
-    return 0;
+    int zeros = golombZeros();
+    return zeros < 0 ? 0 : get((zeros * 2) + 1);
   }
 
   long long int bitstream::getExpGolomb(){
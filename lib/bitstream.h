@@ -18,6 +18,7 @@ namespace Utils{
     ~bitstream();
     void append(const char *input, size_t bytes);
     void append(const std::string &input);
+    void appendRBSP(const char *input, size_t bytes);
     long long unsigned int size();
     void skip(size_t count);
     long long unsigned int get(size_t count);
@@ -42,6 +43,8 @@ namespace Utils{
 
   private:
     bool checkBufferSize(unsigned int size);
+    long long unsigned int peekBits(size_t pos, size_t count);
+    int golombZeros();
     long long unsigned int golombGetter();
     long long unsigned int golombPeeker();
     char *data;
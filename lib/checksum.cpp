@@ -0,0 +1,145 @@
+#include "bitfields.h"
+#include "checksum.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC_FOLD_SUPPORTED
+#include <cpuid.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+#define CRC_FOLD_TARGET __attribute__((target("pclmul,ssse3")))
+#endif
+
+#define CRC32_POLY 0x04C11DB7u
+
+namespace checksum{
+  /// Returns x^n modulo the CRC32 polynomial, MSB-first.
+  static uint32_t xPowMod(size_t n){
+    uint32_t v = 1;
+    while (n--){v = (v << 1) ^ ((v & 0x80000000u) ? CRC32_POLY : 0);}
+    return v;
+  }
+
+  /// Lookup tables for slicing-by-8, and the folding constants, built once on first use.
+  /// T[0] is the classic byte-at-a-time table; T[k] advances a byte through k more zero bytes.
+  struct CRCTables{
+    uint32_t T[8][256];
+    uint64_t fold128[2]; ///< x^128 and x^192 mod P: fold 128 bits forward by 128 bits
+    uint64_t fold512[2]; ///< x^512 and x^576 mod P: fold 128 bits forward by 512 bits
+    bool canFold;
+    CRCTables(){
+      for (uint32_t i = 0; i < 256; ++i){
+        uint32_t c = i << 24;
+        for (size_t j = 0; j < 8; ++j){c = (c << 1) ^ ((c & 0x80000000u) ? CRC32_POLY : 0);}
+        T[0][i] = c;
+      }
+      for (size_t k = 1; k < 8; ++k){
+        for (size_t i = 0; i < 256; ++i){T[k][i] = (T[k - 1][i] << 8) ^ T[0][T[k - 1][i] >> 24];}
+      }
+      fold128[0] = xPowMod(128);
+      fold128[1] = xPowMod(192);
+      fold512[0] = xPowMod(512);
+      fold512[1] = xPowMod(576);
+      canFold = false;
+#ifdef CRC_FOLD_SUPPORTED
+      unsigned int a, b, c, d;
+      canFold = __get_cpuid(1, &a, &b, &c, &d) && (c & bit_PCLMUL) && (c & bit_SSSE3);
+#endif
+    }
+  };
+
+  static const CRCTables &tables(){
+    static CRCTables t;
+    return t;
+  }
+
+  /// Portable MPEG-2 CRC32, eight bytes per step.
+  unsigned int crc32cSlice8(unsigned int crc, const char *data, size_t len){
+    const CRCTables &t = tables();
+    const unsigned char *p = (const unsigned char *)data;
+    while (len >= 8){
+      uint32_t a = crc ^ Bit::btohl((const char *)p);
+      crc = t.T[7][a >> 24] ^ t.T[6][(a >> 16) & 0xFF] ^ t.T[5][(a >> 8) & 0xFF] ^ t.T[4][a & 0xFF] ^
+            t.T[3][p[4]] ^ t.T[2][p[5]] ^ t.T[1][p[6]] ^ t.T[0][p[7]];
+      p += 8;
+      len -= 8;
+    }
+    while (len--){crc = t.T[0][*(p++) ^ (crc >> 24)] ^ (crc << 8);}
+    return crc;
+  }
+
+#ifdef CRC_FOLD_SUPPORTED
+  /// Multiplies the 128-bit polynomial x by the two halves of k and adds the products, which
+  /// moves x forward in the message by the distance k was computed for, modulo P.
+  CRC_FOLD_TARGET static inline __m128i crcFold(__m128i x, __m128i k){
+    return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11), _mm_clmulepi64_si128(x, k, 0x00));
+  }
+
+  /// Folds 16-byte blocks together with carry-less multiplication, four streams at a time while
+  /// there is enough data, then hands the folded remainder and any tail to slicing-by-8.
+  CRC_FOLD_TARGET static unsigned int crcFoldBlocks(unsigned int crc, const char *data, size_t len){
+    const CRCTables &t = tables();
+    // Byte-reverses a block, so the first message byte ends up in the highest bits
+    const __m128i swap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i k1 = _mm_set_epi64x(t.fold128[1], t.fold128[0]);
+    const __m128i k4 = _mm_set_epi64x(t.fold512[1], t.fold512[0]);
+#define CRC_LOAD(p) _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p)), swap)
+    __m128i x0 = _mm_xor_si128(CRC_LOAD(data), _mm_set_epi32(crc, 0, 0, 0));
+    if (len >= 128){
+      __m128i x1 = CRC_LOAD(data + 16);
+      __m128i x2 = CRC_LOAD(data + 32);
+      __m128i x3 = CRC_LOAD(data + 48);
+      data += 64;
+      len -= 64;
+      while (len >= 64){
+        x0 = _mm_xor_si128(crcFold(x0, k4), CRC_LOAD(data));
+        x1 = _mm_xor_si128(crcFold(x1, k4), CRC_LOAD(data + 16));
+        x2 = _mm_xor_si128(crcFold(x2, k4), CRC_LOAD(data + 32));
+        x3 = _mm_xor_si128(crcFold(x3, k4), CRC_LOAD(data + 48));
+        data += 64;
+        len -= 64;
+      }
+      x0 = _mm_xor_si128(crcFold(x0, k1), x1);
+      x0 = _mm_xor_si128(crcFold(x0, k1), x2);
+      x0 = _mm_xor_si128(crcFold(x0, k1), x3);
+    }else{
+      data += 16;
+      len -= 16;
+    }
+    while (len >= 16){
+      x0 = _mm_xor_si128(crcFold(x0, k1), CRC_LOAD(data));
+      data += 16;
+      len -= 16;
+    }
+#undef CRC_LOAD
+    // x0 is now congruent to everything processed so far; its CRC with a zero start value is
+    // the CRC of all of that data, and the tail continues from there.
+    char folded[16];
+    _mm_storeu_si128((__m128i *)folded, _mm_shuffle_epi8(x0, swap));
+    return crc32cSlice8(crc32cSlice8(0, folded, 16), data, len);
+  }
+#endif
+
+  /// Returns true if this CPU can calculate CRCs with carry-less multiplication.
+  bool hasCRCFold(){return tables().canFold;}
+
+  /// MPEG-2 CRC32 using PCLMULQDQ folding where available. Short inputs, and CPUs without
+  /// the instructions, use slicing-by-8 instead.
+  unsigned int crc32cFold(unsigned int crc, const char *data, size_t len){
+#ifdef CRC_FOLD_SUPPORTED
+    if (len >= 64 && hasCRCFold()){return crcFoldBlocks(crc, data, len);}
+#endif
+    return crc32cSlice8(crc, data, len);
+  }
+
+  /// MPEG-2 / Ogg CRC32: polynomial 0x04C11DB7, MSB-first, no final XOR.
+  /// PSI sections start at 0xFFFFFFFF, Ogg pages at 0.
+  unsigned int crc32c(unsigned int crc, const char *data, size_t len){
+    return crc32cFold(crc, data, len);
+  }
+
+  /// The same CRC as crc32c, but with the bytes of the start and result values reversed, so
+  /// that storing the result little-endian writes it in the big-endian order PSI sections use.
+  unsigned int crc32(unsigned int crc, const char *data, size_t len){
+    return __builtin_bswap32(crc32cFold(__builtin_bswap32(crc), data, len));
+  }
+}// namespace checksum
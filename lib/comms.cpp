@@ -79,20 +79,20 @@ namespace Comms{
     return dataAccX.getRCount();
   }
 
-  uint8_t Comms::getStatus() const{return status.uint(index);}
-  uint8_t Comms::getStatus(size_t idx) const{return (master ? status.uint(idx) : 0);}
-  void Comms::setStatus(uint8_t _status){status.set(_status, index);}
+  uint8_t Comms::getStatus() const{return status.get<uint8_t>(index);}
+  uint8_t Comms::getStatus(size_t idx) const{return (master ? status.get<uint8_t>(idx) : 0);}
+  void Comms::setStatus(uint8_t _status){status.set<uint8_t>(_status, index);}
   void Comms::setStatus(uint8_t _status, size_t idx){
     if (!master){return;}
-    status.set(_status, idx);
+    status.set<uint8_t>(_status, idx);
   }
 
-  uint32_t Comms::getPid() const{return pid.uint(index);}
-  uint32_t Comms::getPid(size_t idx) const{return (master ? pid.uint(idx) : 0);}
-  void Comms::setPid(uint32_t _pid){pid.set(_pid, index);}
+  uint32_t Comms::getPid() const{return pid.get<uint64_t>(index);}
+  uint32_t Comms::getPid(size_t idx) const{return (master ? pid.get<uint64_t>(idx) : 0);}
+  void Comms::setPid(uint32_t _pid){pid.set<uint64_t>(_pid, index);}
   void Comms::setPid(uint32_t _pid, size_t idx){
     if (!master){return;}
-    pid.set(_pid, idx);
+    pid.set<uint64_t>(_pid, idx);
   }
 
   void Comms::finishAll(){
@@ -280,20 +280,20 @@ namespace Comms{
     }
   }
 
-  uint32_t Users::getTrack() const{return track.uint(index);}
-  uint32_t Users::getTrack(size_t idx) const{return (master ? track.uint(idx) : 0);}
-  void Users::setTrack(uint32_t _track){track.set(_track, index);}
+  uint32_t Users::getTrack() const{return track.get<uint64_t>(index);}
+  uint32_t Users::getTrack(size_t idx) const{return (master ? track.get<uint64_t>(idx) : 0);}
+  void Users::setTrack(uint32_t _track){track.set<uint64_t>(_track, index);}
   void Users::setTrack(uint32_t _track, size_t idx){
     if (!master){return;}
-    track.set(_track, idx);
+    track.set<uint64_t>(_track, idx);
   }
 
-  size_t Users::getKeyNum() const{return keyNum.uint(index);}
-  size_t Users::getKeyNum(size_t idx) const{return (master ? keyNum.uint(idx) : 0);}
-  void Users::setKeyNum(size_t _keyNum){keyNum.set(_keyNum, index);}
+  size_t Users::getKeyNum() const{return keyNum.get<uint64_t>(index);}
+  size_t Users::getKeyNum(size_t idx) const{return (master ? keyNum.get<uint64_t>(idx) : 0);}
+  void Users::setKeyNum(size_t _keyNum){keyNum.set<uint64_t>(_keyNum, index);}
   void Users::setKeyNum(size_t _keyNum, size_t idx){
     if (!master){return;}
-    keyNum.set(_keyNum, idx);
+    keyNum.set<uint64_t>(_keyNum, idx);
   }
 
 
@@ -412,6 +412,31 @@ namespace Comms{
     }
   }
 
+  /// \brief Claims a spot on the connections page of a viewer session that is already running,
+  ///        without starting MistSession for it. Used where a viewer must not wait for a new
+  ///        session to start; the caller falls back to reload if this returns false.
+  /// \param protocol: Protocol of the connection; must not be HTTP itself
+  /// \return True if the session is running and accepts this connection
+  bool Connections::attach(const std::string & streamName, const std::string & ip, const std::string & tkn, const std::string & protocol){
+    initialTkn = tkn;
+    sessionId = generateSession(streamName, ip, tkn, protocol, sessionViewerMode);
+    char userPageName[NAME_BUFFER_SIZE];
+    snprintf(userPageName, NAME_BUFFER_SIZE, COMMS_SESSIONS, sessionId.c_str());
+    {
+      IPC::sharedPage running(userPageName, 0, false, false);
+      if (!running){return false;}
+    }
+    reload(sessionId);
+    if (!*this || getExit()){
+      unload();
+      return false;
+    }
+    setConnector(protocol);
+    setHost(ip);
+    setStream(streamName);
+    return true;
+  }
+
   /// \brief Marks the data page as closed, so that we longer write any new data to is
   void Connections::setExit(){
     if (!master){return;}
@@ -473,46 +498,46 @@ namespace Comms{
     pktretrans = dataAccX.getFieldAccX("pktretrans");
   }
 
-  uint64_t Connections::getNow() const{return now.uint(index);}
-  uint64_t Connections::getNow(size_t idx) const{return (master ? now.uint(idx) : 0);}
-  void Connections::setNow(uint64_t _now){now.set(_now, index);}
+  uint64_t Connections::getNow() const{return now.get<uint64_t>(index);}
+  uint64_t Connections::getNow(size_t idx) const{return (master ? now.get<uint64_t>(idx) : 0);}
+  void Connections::setNow(uint64_t _now){now.set<uint64_t>(_now, index);}
   void Connections::setNow(uint64_t _now, size_t idx){
     if (!master){return;}
-    now.set(_now, idx);
+    now.set<uint64_t>(_now, idx);
   }
 
-  uint64_t Connections::getTime() const{return time.uint(index);}
-  uint64_t Connections::getTime(size_t idx) const{return (master ? time.uint(idx) : 0);}
-  void Connections::setTime(uint64_t _time){time.set(_time, index);}
+  uint64_t Connections::getTime() const{return time.get<uint64_t>(index);}
+  uint64_t Connections::getTime(size_t idx) const{return (master ? time.get<uint64_t>(idx) : 0);}
+  void Connections::setTime(uint64_t _time){time.set<uint64_t>(_time, index);}
   void Connections::setTime(uint64_t _time, size_t idx){
     if (!master){return;}
-    time.set(_time, idx);
+    time.set<uint64_t>(_time, idx);
   }
 
-  uint64_t Connections::getLastSecond() const{return lastSecond.uint(index);}
+  uint64_t Connections::getLastSecond() const{return lastSecond.get<uint64_t>(index);}
   uint64_t Connections::getLastSecond(size_t idx) const{
-    return (master ? lastSecond.uint(idx) : 0);
+    return (master ? lastSecond.get<uint64_t>(idx) : 0);
   }
-  void Connections::setLastSecond(uint64_t _lastSecond){lastSecond.set(_lastSecond, index);}
+  void Connections::setLastSecond(uint64_t _lastSecond){lastSecond.set<uint64_t>(_lastSecond, index);}
   void Connections::setLastSecond(uint64_t _lastSecond, size_t idx){
     if (!master){return;}
-    lastSecond.set(_lastSecond, idx);
+    lastSecond.set<uint64_t>(_lastSecond, idx);
   }
 
-  uint64_t Connections::getDown() const{return down.uint(index);}
-  uint64_t Connections::getDown(size_t idx) const{return (master ? down.uint(idx) : 0);}
-  void Connections::setDown(uint64_t _down){down.set(_down, index);}
+  uint64_t Connections::getDown() const{return down.get<uint64_t>(index);}
+  uint64_t Connections::getDown(size_t idx) const{return (master ? down.get<uint64_t>(idx) : 0);}
+  void Connections::setDown(uint64_t _down){down.set<uint64_t>(_down, index);}
   void Connections::setDown(uint64_t _down, size_t idx){
     if (!master){return;}
-    down.set(_down, idx);
+    down.set<uint64_t>(_down, idx);
   }
 
-  uint64_t Connections::getUp() const{return up.uint(index);}
-  uint64_t Connections::getUp(size_t idx) const{return (master ? up.uint(idx) : 0);}
-  void Connections::setUp(uint64_t _up){up.set(_up, index);}
+  uint64_t Connections::getUp() const{return up.get<uint64_t>(index);}
+  uint64_t Connections::getUp(size_t idx) const{return (master ? up.get<uint64_t>(idx) : 0);}
+  void Connections::setUp(uint64_t _up){up.set<uint64_t>(_up, index);}
   void Connections::setUp(uint64_t _up, size_t idx){
     if (!master){return;}
-    up.set(_up, idx);
+    up.set<uint64_t>(_up, idx);
   }
 
   std::string Connections::getHost() const{return std::string(host.ptr(index), 16);}
@@ -555,34 +580,34 @@ namespace Comms{
     return false;
   }
 
-  uint64_t Connections::getPacketCount() const{return pktcount.uint(index);}
+  uint64_t Connections::getPacketCount() const{return pktcount.get<uint64_t>(index);}
   uint64_t Connections::getPacketCount(size_t idx) const{
-    return (master ? pktcount.uint(idx) : 0);
+    return (master ? pktcount.get<uint64_t>(idx) : 0);
   }
-  void Connections::setPacketCount(uint64_t _count){pktcount.set(_count, index);}
+  void Connections::setPacketCount(uint64_t _count){pktcount.set<uint64_t>(_count, index);}
   void Connections::setPacketCount(uint64_t _count, size_t idx){
     if (!master){return;}
-    pktcount.set(_count, idx);
+    pktcount.set<uint64_t>(_count, idx);
   }
 
-  uint64_t Connections::getPacketLostCount() const{return pktloss.uint(index);}
+  uint64_t Connections::getPacketLostCount() const{return pktloss.get<uint64_t>(index);}
   uint64_t Connections::getPacketLostCount(size_t idx) const{
-    return (master ? pktloss.uint(idx) : 0);
+    return (master ? pktloss.get<uint64_t>(idx) : 0);
   }
-  void Connections::setPacketLostCount(uint64_t _lost){pktloss.set(_lost, index);}
+  void Connections::setPacketLostCount(uint64_t _lost){pktloss.set<uint64_t>(_lost, index);}
   void Connections::setPacketLostCount(uint64_t _lost, size_t idx){
     if (!master){return;}
-    pktloss.set(_lost, idx);
+    pktloss.set<uint64_t>(_lost, idx);
   }
 
-  uint64_t Connections::getPacketRetransmitCount() const{return pktretrans.uint(index);}
+  uint64_t Connections::getPacketRetransmitCount() const{return pktretrans.get<uint64_t>(index);}
   uint64_t Connections::getPacketRetransmitCount(size_t idx) const{
-    return (master ? pktretrans.uint(idx) : 0);
+    return (master ? pktretrans.get<uint64_t>(idx) : 0);
   }
-  void Connections::setPacketRetransmitCount(uint64_t _retrans){pktretrans.set(_retrans, index);}
+  void Connections::setPacketRetransmitCount(uint64_t _retrans){pktretrans.set<uint64_t>(_retrans, index);}
   void Connections::setPacketRetransmitCount(uint64_t _retrans, size_t idx){
     if (!master){return;}
-    pktretrans.set(_retrans, idx);
+    pktretrans.set<uint64_t>(_retrans, idx);
   }
 
   /// \brief Generates a session ID which is unique per viewer
@@ -615,4 +640,841 @@ namespace Comms{
     VERYHIGH_MSG("%s", debugMsg.c_str());
     return Secure::sha256(concat.c_str(), concat.length());
   }
+  PageCache::PageCache(){
+    master = false;
+    sem.open(SEM_PAGE_CACHE, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+  }
+
+  PageCache::~PageCache(){
+    if (master){
+      if (dataPage.mapped){dataPage.master = true;}
+      sem.unlink();
+    }
+    sem.close();
+  }
+
+  /// Opens the page cache accounting page. Only the master (the controller) creates it if it does
+  /// not exist yet; inputs simply run without global accounting in that case.
+  void PageCache::reload(bool _master){
+    master = _master;
+    dataPage.init(SHM_PAGE_CACHE, SHM_PAGE_CACHE_LEN, false, false);
+    if (!dataPage){
+      if (!master){return;}
+      dataPage.init(SHM_PAGE_CACHE, SHM_PAGE_CACHE_LEN, true);
+      if (!dataPage){
+        FAIL_MSG("Could not create page cache accounting page");
+        return;
+      }
+      totalAccX = Util::RelAccX(dataPage.mapped, false);
+      totalAccX.addField("budget", RAX_64UINT);
+      totalAccX.addField("used", RAX_64UINT);
+      totalAccX.addField("hits", RAX_64UINT);
+      totalAccX.addField("misses", RAX_64UINT);
+      totalAccX.addField("evictions", RAX_64UINT);
+      totalAccX.addField("hugerequested", RAX_64UINT);
+      totalAccX.addField("hugetlbfs", RAX_64UINT);
+      totalAccX.addField("hugethp", RAX_64UINT);
+      totalAccX.addField("hugefallback", RAX_64UINT);
+      totalAccX.addField("unmarked", RAX_64UINT);
+      totalAccX.addField("freehint", RAX_64UINT);
+      totalAccX.addField("segbudget", RAX_64UINT);
+      totalAccX.addField("segused", RAX_64UINT);
+      totalAccX.addField("pages", RAX_NESTED, SHM_PAGE_CACHE_LEN - 1024);
+      totalAccX.setRCount(1);
+      totalAccX.setPresent(1);
+      totalAccX.setEndPos(1);
+      pageAccX = Util::RelAccX(totalAccX.getPointer("pages"), false);
+      pageAccX.addField("stream", RAX_128STRING);
+      pageAccX.addField("track", RAX_32UINT);
+      pageAccX.addField("page", RAX_32UINT);
+      pageAccX.addField("size", RAX_64UINT);
+      pageAccX.addField("pid", RAX_32UINT);
+      pageAccX.addField("lastuse", RAX_64UINT);
+      pageAccX.addField("evict", RAX_UINT);
+      pageAccX.addField("shared", RAX_64STRING);
+      pageAccX.addField("held", RAX_UINT);
+      size_t reqCount = (SHM_PAGE_CACHE_LEN - 1024 - pageAccX.getOffset()) / pageAccX.getRSize();
+      pageAccX.setRCount(reqCount);
+      pageAccX.setPresent(reqCount);
+      pageAccX.setEndPos(reqCount);
+      pageAccX.setReady();
+      totalAccX.setReady();
+      fieldAccess();
+      return;
+    }
+    dataPage.master = master;
+    totalAccX = Util::RelAccX(dataPage.mapped, false);
+    if (!totalAccX.isReady() || totalAccX.isExit()){
+      dataPage.close();
+      return;
+    }
+    pageAccX = Util::RelAccX(totalAccX.getPointer("pages"), false);
+    fieldAccess();
+  }
+
+  void PageCache::fieldAccess(){
+    budget = totalAccX.getFieldAccX("budget");
+    used = totalAccX.getFieldAccX("used");
+    hits = totalAccX.getFieldAccX("hits");
+    misses = totalAccX.getFieldAccX("misses");
+    evictions = totalAccX.getFieldAccX("evictions");
+    hugeRequested = totalAccX.getFieldAccX("hugerequested");
+    hugeTLB = totalAccX.getFieldAccX("hugetlbfs");
+    hugeTHP = totalAccX.getFieldAccX("hugethp");
+    hugeFallback = totalAccX.getFieldAccX("hugefallback");
+    unmarked = totalAccX.getFieldAccX("unmarked");
+    freeHint = totalAccX.getFieldAccX("freehint");
+    segBudget = totalAccX.getFieldAccX("segbudget");
+    segUsed = totalAccX.getFieldAccX("segused");
+    stream = pageAccX.getFieldAccX("stream");
+    track = pageAccX.getFieldAccX("track");
+    page = pageAccX.getFieldAccX("page");
+    size = pageAccX.getFieldAccX("size");
+    pid = pageAccX.getFieldAccX("pid");
+    lastUse = pageAccX.getFieldAccX("lastuse");
+    evict = pageAccX.getFieldAccX("evict");
+    shared = pageAccX.getFieldAccX("shared");
+    held = pageAccX.getFieldAccX("held");
+  }
+
+  void PageCache::setMaster(bool _master){
+    master = _master;
+    dataPage.master = _master;
+  }
+
+  uint64_t PageCache::getBudget() const{return *this ? budget.uint(0) : 0;}
+  uint64_t PageCache::getUsed() const{return *this ? used.uint(0) : 0;}
+  uint64_t PageCache::getHits() const{return *this ? hits.uint(0) : 0;}
+  uint64_t PageCache::getMisses() const{return *this ? misses.uint(0) : 0;}
+  uint64_t PageCache::getEvictions() const{return *this ? evictions.uint(0) : 0;}
+
+  /// Sets the total budget in bytes, marking pages for eviction if they no longer fit.
+  void PageCache::setBudget(uint64_t _budget){
+    if (!master || !*this){return;}
+    IPC::semGuard G(&sem);
+    budget.set(_budget);
+    markVictims();
+  }
+
+  void PageCache::addHits(uint64_t count){
+    if (!*this){return;}
+    IPC::semGuard G(&sem);
+    hits.set(hits.uint(0) + count);
+  }
+
+  IPC::hugePageCounters PageCache::getHugePages() const{
+    IPC::hugePageCounters ret = {0, 0, 0, 0};
+    if (!*this || !hugeRequested){return ret;}
+    ret.requested = hugeRequested.uint(0);
+    ret.hugetlb = hugeTLB.uint(0);
+    ret.thp = hugeTHP.uint(0);
+    ret.fallback = hugeFallback.uint(0);
+    return ret;
+  }
+
+  /// Adds the given amounts of created data pages to the host-wide huge page totals.
+  void PageCache::addHugePages(const IPC::hugePageCounters &delta){
+    if (!*this || !hugeRequested){return;}
+    IPC::semGuard G(&sem);
+    hugeRequested.set(hugeRequested.uint(0) + delta.requested);
+    hugeTLB.set(hugeTLB.uint(0) + delta.hugetlb);
+    hugeTHP.set(hugeTHP.uint(0) + delta.thp);
+    hugeFallback.set(hugeFallback.uint(0) + delta.fallback);
+  }
+
+  uint64_t PageCache::getSegmentBudget() const{return *this ? segBudget.uint(0) : 0;}
+  uint64_t PageCache::getSegmentBytes() const{return *this ? segUsed.uint(0) : 0;}
+
+  /// Sets the host-wide budget in bytes for cached output segments; zero means unlimited.
+  /// Stream inputs enforce it when removing expired segments.
+  void PageCache::setSegmentBudget(uint64_t _budget){
+    if (!master || !*this){return;}
+    segBudget.set(_budget);
+  }
+
+  /// Adds the given amount of bytes (negative to release them) to the host-wide segment total.
+  void PageCache::addSegmentBytes(int64_t delta){
+    if (!*this || !delta){return;}
+    IPC::semGuard G(&sem);
+    uint64_t total = segUsed.uint(0);
+    if (delta < 0 && (uint64_t)-delta > total){
+      segUsed.set(0);
+    }else{
+      segUsed.set(total + delta);
+    }
+  }
+
+  size_t PageCache::recordCount() const{return *this ? pageAccX.getRCount() : 0;}
+  std::string PageCache::getStream(size_t idx) const{return stream.string(idx);}
+  uint64_t PageCache::getSize(size_t idx) const{return size.uint(idx);}
+  uint32_t PageCache::getPid(size_t idx) const{return pid.uint(idx);}
+  /// Returns true if the page was attached from the input of another stream.
+  bool PageCache::isShared(size_t idx) const{return shared.string(idx).size();}
+
+  /// Registers a page of the calling process. Pages that were loaded count as a cache miss; pages
+  /// attached from another stream's input (attached set) count as a hit and add no bytes, since
+  /// the input that loaded them already accounts for the memory. Shared pages pass their data page
+  /// name as sharedName, so the bytes can move to another user when the loading input drops them.
+  /// Returns the record index to use for touchPage, mustEvict and removePage, or
+  /// INVALID_RECORD_INDEX if the page is not accounted for.
+  size_t PageCache::addPage(const std::string &_stream, size_t _track, uint32_t _page, uint64_t _size,
+                            const std::string &sharedName, bool attached){
+    if (!*this){return INVALID_RECORD_INDEX;}
+    IPC::semGuard G(&sem);
+    if (attached){
+      hits.set(hits.uint(0) + 1);
+    }else{
+      misses.set(misses.uint(0) + 1);
+    }
+    size_t count = recordCount();
+    size_t hint = freeHint.uint(0);
+    for (size_t n = 0; n < count; ++n){
+      size_t i = (hint + n) % count;
+      if (pid.uint(i)){continue;}
+      stream.set(_stream, i);
+      track.set(_track, i);
+      page.set(_page, i);
+      size.set(_size, i);
+      lastUse.set(Util::bootMS(), i);
+      evict.set(0, i);
+      shared.set(sharedName, i);
+      held.set(attached ? 0 : 1, i);
+      pid.set(getpid(), i);
+      freeHint.set((i + 1) % count);
+      if (!attached){
+        used.set(used.uint(0) + _size);
+        unmarked.set(unmarked.uint(0) + _size);
+        markVictims(i);
+      }
+      return i;
+    }
+    WARN_MSG("Page cache accounting is full; not tracking page %" PRIu32 " of track %zu in %s", _page,
+             _track, _stream.c_str());
+    return INVALID_RECORD_INDEX;
+  }
+
+  /// Marks a page as used right now, moving it to the back of the eviction order.
+  void PageCache::touchPage(size_t idx){
+    if (idx >= recordCount()){return;}
+    IPC::semGuard G(&sem);
+    lastUse.set(Util::bootMS(), idx);
+  }
+
+  /// Returns true if the page must be removed to keep the total within the budget.
+  bool PageCache::mustEvict(size_t idx) const{
+    if (idx >= recordCount()){return false;}
+    return evict.uint(idx);
+  }
+
+  /// Releases the record of a page that was removed from memory.
+  /// Only the owning process or the master may remove a page. If the record accounted for the bytes
+  /// of a shared page, and other streams still use that page, the bytes move to one of their records
+  /// instead of being released.
+  void PageCache::removePage(size_t idx, bool evicted){
+    if (idx >= recordCount()){return;}
+    IPC::semGuard G(&sem);
+    uint32_t owner = pid.uint(idx);
+    if (!owner || (!master && owner != (uint32_t)getpid())){return;}
+    uint64_t pageSize = size.uint(idx);
+    bool wasHeld = held.uint(idx);
+    bool wasMarked = evict.uint(idx);
+    std::string sharedName = shared.string(idx);
+    pid.set(0, idx);
+    size.set(0, idx);
+    evict.set(0, idx);
+    held.set(0, idx);
+    stream.set("", idx);
+    shared.set("", idx);
+    freeHint.set(idx);
+    if (evicted){evictions.set(evictions.uint(0) + 1);}
+    if (!wasHeld){return;}
+    if (sharedName.size()){
+      size_t count = recordCount();
+      for (size_t i = 0; i < count; ++i){
+        if (!pid.uint(i) || shared.string(i) != sharedName){continue;}
+        held.set(1, i);
+        if (wasMarked){
+          uint64_t total = unmarked.uint(0);
+          unmarked.set(total + pageSize);
+          markVictims(i);
+        }
+        return;
+      }
+    }
+    uint64_t total = used.uint(0);
+    used.set(total > pageSize ? total - pageSize : 0);
+    if (!wasMarked){
+      total = unmarked.uint(0);
+      unmarked.set(total > pageSize ? total - pageSize : 0);
+    }
+  }
+
+  /// Releases the records of pages whose owning input is no longer running.
+  void PageCache::removeDead(){
+    if (!master){return;}
+    size_t count = recordCount();
+    for (size_t i = 0; i < count; ++i){
+      uint32_t owner = pid.uint(i);
+      if (owner && !Util::Procs::isRunning(owner)){removePage(i, false);}
+    }
+  }
+
+  /// Marks least recently used pages for eviction until the unmarked pages fit in the budget.
+  /// The record at index keep (the page that was just added) is never picked.
+  /// Must be called with the semaphore locked.
+  void PageCache::markVictims(size_t keep){
+    uint64_t limit = budget.uint(0);
+    uint64_t remaining = unmarked.uint(0);
+    if (!limit || remaining <= limit){return;}
+    // Over budget: order the candidates by last use once, then mark the oldest ones
+    std::multimap<uint64_t, size_t> candidates;
+    size_t count = recordCount();
+    for (size_t i = 0; i < count; ++i){
+      if (i == keep || !pid.uint(i) || !held.uint(i) || evict.uint(i)){continue;}
+      candidates.insert(std::pair<uint64_t, size_t>(lastUse.uint(i), i));
+    }
+    for (std::multimap<uint64_t, size_t>::iterator it = candidates.begin();
+         it != candidates.end() && remaining > limit; ++it){
+      uint64_t victimSize = size.uint(it->second);
+      evict.set(1, it->second);
+      remaining = remaining > victimSize ? remaining - victimSize : 0;
+    }
+    unmarked.set(remaining);
+  }
+
+  ListenerStats::ListenerStats(){
+    master = false;
+    lastUpdate = 0;
+    sem.open(SEM_LISTENERS, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+  }
+
+  ListenerStats::~ListenerStats(){
+    if (master){
+      if (dataPage.mapped){dataPage.master = true;}
+      sem.unlink();
+    }
+    sem.close();
+  }
+
+  /// Opens the listener statistics page. Only the master (the controller) creates it if it does
+  /// not exist yet; listeners simply run without statistics in that case.
+  void ListenerStats::reload(bool _master){
+    master = _master;
+    dataPage.init(SHM_LISTENERS, SHM_LISTENERS_LEN, false, false);
+    if (!dataPage){
+      if (!master){return;}
+      dataPage.init(SHM_LISTENERS, SHM_LISTENERS_LEN, true);
+      if (!dataPage){
+        FAIL_MSG("Could not create listener statistics page");
+        return;
+      }
+      listenAccX = Util::RelAccX(dataPage.mapped, false);
+      listenAccX.addField("connector", RAX_32STRING);
+      listenAccX.addField("port", RAX_32UINT);
+      listenAccX.addField("shard", RAX_32UINT);
+      listenAccX.addField("cpu", RAX_32UINT);
+      listenAccX.addField("pid", RAX_32UINT);
+      listenAccX.addField("accepts", RAX_64UINT);
+      listenAccX.addField("prevaccepts", RAX_64UINT);
+      listenAccX.addField("rate", RAX_64UINT);
+      listenAccX.addField("forks", RAX_64UINT);
+      listenAccX.addField("prevforks", RAX_64UINT);
+      listenAccX.addField("forkrate", RAX_64UINT);
+      listenAccX.addField("replies", RAX_64UINT);
+      size_t reqCount = (SHM_LISTENERS_LEN - listenAccX.getOffset()) / listenAccX.getRSize();
+      listenAccX.setRCount(reqCount);
+      listenAccX.setPresent(reqCount);
+      listenAccX.setEndPos(reqCount);
+      listenAccX.setReady();
+      fieldAccess();
+      return;
+    }
+    dataPage.master = master;
+    listenAccX = Util::RelAccX(dataPage.mapped, false);
+    if (!listenAccX.isReady() || listenAccX.isExit()){
+      dataPage.close();
+      return;
+    }
+    fieldAccess();
+  }
+
+  void ListenerStats::fieldAccess(){
+    connector = listenAccX.getFieldAccX("connector");
+    port = listenAccX.getFieldAccX("port");
+    shard = listenAccX.getFieldAccX("shard");
+    cpu = listenAccX.getFieldAccX("cpu");
+    pid = listenAccX.getFieldAccX("pid");
+    accepts = listenAccX.getFieldAccX("accepts");
+    prevAccepts = listenAccX.getFieldAccX("prevaccepts");
+    rate = listenAccX.getFieldAccX("rate");
+    forks = listenAccX.getFieldAccX("forks");
+    prevForks = listenAccX.getFieldAccX("prevforks");
+    forkRate = listenAccX.getFieldAccX("forkrate");
+    replies = listenAccX.getFieldAccX("replies");
+  }
+
+  void ListenerStats::setMaster(bool _master){
+    master = _master;
+    dataPage.master = _master;
+  }
+
+  size_t ListenerStats::recordCount() const{return *this ? listenAccX.getRCount() : 0;}
+  uint32_t ListenerStats::getPid(size_t idx) const{return pid.uint(idx);}
+  std::string ListenerStats::getConnector(size_t idx) const{return connector.string(idx);}
+  uint32_t ListenerStats::getPort(size_t idx) const{return port.uint(idx);}
+  uint32_t ListenerStats::getShard(size_t idx) const{return shard.uint(idx);}
+  /// Returns the CPU the listener is pinned to, or -1 if it is not pinned.
+  int32_t ListenerStats::getCpu(size_t idx) const{return (int32_t)cpu.uint(idx) - 1;}
+  uint64_t ListenerStats::getAccepts(size_t idx) const{return accepts.uint(idx);}
+  /// Returns the amount of connections accepted per second, as of the last updateRates call.
+  uint64_t ListenerStats::getRate(size_t idx) const{return rate.uint(idx);}
+  /// Returns the amount of processes started to handle a connection.
+  uint64_t ListenerStats::getForks(size_t idx) const{return forks.uint(idx);}
+  /// Returns the amount of processes started per second, as of the last updateRates call.
+  uint64_t ListenerStats::getForkRate(size_t idx) const{return forkRate.uint(idx);}
+  /// Returns the amount of requests the listener answered without starting a process.
+  uint64_t ListenerStats::getReplies(size_t idx) const{return replies.uint(idx);}
+
+  /// Registers the listening socket of the calling process. A cpu of -1 means not pinned.
+  /// Returns the record index to use for setAccepts and removeListener, or INVALID_RECORD_INDEX
+  /// if the listener is not tracked.
+  size_t ListenerStats::addListener(const std::string &_connector, uint32_t _port, uint32_t _shard, int32_t _cpu){
+    if (!*this){return INVALID_RECORD_INDEX;}
+    IPC::semGuard G(&sem);
+    size_t count = recordCount();
+    for (size_t i = 0; i < count; ++i){
+      if (pid.uint(i)){continue;}
+      connector.set(_connector, i);
+      port.set(_port, i);
+      shard.set(_shard, i);
+      cpu.set(_cpu + 1, i);
+      accepts.set(0, i);
+      prevAccepts.set(0, i);
+      rate.set(0, i);
+      forks.set(0, i);
+      prevForks.set(0, i);
+      forkRate.set(0, i);
+      replies.set(0, i);
+      pid.set(getpid(), i);
+      return i;
+    }
+    WARN_MSG("Listener statistics are full; not tracking shard %" PRIu32 " of %s", _shard, _connector.c_str());
+    return INVALID_RECORD_INDEX;
+  }
+
+  void ListenerStats::setAccepts(size_t idx, uint64_t _accepts){
+    if (idx >= recordCount()){return;}
+    accepts.set(_accepts, idx);
+  }
+
+  void ListenerStats::setForks(size_t idx, uint64_t _forks){
+    if (idx >= recordCount()){return;}
+    forks.set(_forks, idx);
+  }
+
+  void ListenerStats::setReplies(size_t idx, uint64_t _replies){
+    if (idx >= recordCount()){return;}
+    replies.set(_replies, idx);
+  }
+
+  /// Releases the record of a listener. Only the owning process or the master may do so.
+  void ListenerStats::removeListener(size_t idx){
+    if (idx >= recordCount()){return;}
+    IPC::semGuard G(&sem);
+    uint32_t owner = pid.uint(idx);
+    if (!owner || (!master && owner != (uint32_t)getpid())){return;}
+    pid.set(0, idx);
+    connector.set("", idx);
+  }
+
+  /// Releases the records of listeners whose process is no longer running.
+  void ListenerStats::removeDead(){
+    if (!master){return;}
+    size_t count = recordCount();
+    for (size_t i = 0; i < count; ++i){
+      uint32_t owner = pid.uint(i);
+      if (owner && !Util::Procs::isRunning(owner)){removeListener(i);}
+    }
+  }
+
+  /// Sets the accept and fork rates of every listener to the average since the previous call.
+  /// Meant to be called by the master about once per second.
+  void ListenerStats::updateRates(){
+    if (!master || !*this){return;}
+    uint64_t now = Util::bootMS();
+    uint64_t elapsed = now - lastUpdate;
+    lastUpdate = now;
+    size_t count = recordCount();
+    for (size_t i = 0; i < count; ++i){
+      if (!pid.uint(i)){continue;}
+      uint64_t total = accepts.uint(i);
+      uint64_t prev = prevAccepts.uint(i);
+      prevAccepts.set(total, i);
+      rate.set((total > prev && elapsed) ? (total - prev) * 1000 / elapsed : 0, i);
+      total = forks.uint(i);
+      prev = prevForks.uint(i);
+      prevForks.set(total, i);
+      forkRate.set((total > prev && elapsed) ? (total - prev) * 1000 / elapsed : 0, i);
+    }
+  }
+
+  SegmentCache::SegmentCache(){
+    master = false;
+    hostBytes = 0;
+  }
+
+  SegmentCache::~SegmentCache(){
+    if (master && dataPage.mapped){dataPage.master = true;}
+    sem.close();
+  }
+
+  /// Opens the segment index of the given stream. Only the master (the stream input) creates it
+  /// if it does not exist; outputs simply run without a segment cache in that case.
+  void SegmentCache::reload(const std::string &_streamName, bool _master){
+    master = _master;
+    streamName = _streamName;
+    char pageName[NAME_BUFFER_SIZE];
+    snprintf(pageName, NAME_BUFFER_SIZE, SHM_SEGMENTS, streamName.c_str());
+    dataPage.init(pageName, SHM_SEGMENTS_LEN, false, false);
+    if (!dataPage){
+      if (!master){return;}
+      dataPage.init(pageName, SHM_SEGMENTS_LEN, true);
+      if (!dataPage){
+        FAIL_MSG("Could not create segment cache index for %s", streamName.c_str());
+        return;
+      }
+      totalAccX = Util::RelAccX(dataPage.mapped, false);
+      totalAccX.addField("hits", RAX_64UINT);
+      totalAccX.addField("misses", RAX_64UINT);
+      totalAccX.addField("evictions", RAX_64UINT);
+      totalAccX.addField("segments", RAX_NESTED, SHM_SEGMENTS_LEN - 1024);
+      totalAccX.setRCount(1);
+      totalAccX.setPresent(1);
+      totalAccX.setEndPos(1);
+      segAccX = Util::RelAccX(totalAccX.getPointer("segments"), false);
+      segAccX.addField("key", RAX_32STRING);
+      segAccX.addField("from", RAX_64UINT);
+      segAccX.addField("until", RAX_64UINT);
+      segAccX.addField("size", RAX_64UINT);
+      segAccX.addField("pid", RAX_32UINT);
+      segAccX.addField("lastuse", RAX_64UINT);
+      segAccX.addField("url", RAX_128STRING);
+      segAccX.addField("type", RAX_32STRING);
+      segAccX.addField("cache", RAX_64STRING);
+      segAccX.addField("connector", RAX_32STRING);
+      size_t reqCount = (SHM_SEGMENTS_LEN - 1024 - segAccX.getOffset()) / segAccX.getRSize();
+      segAccX.setRCount(reqCount);
+      segAccX.setPresent(reqCount);
+      segAccX.setEndPos(reqCount);
+      segAccX.setReady();
+      totalAccX.setReady();
+    }else{
+      dataPage.master = false;
+      totalAccX = Util::RelAccX(dataPage.mapped, false);
+      if (!totalAccX.isReady() || totalAccX.isExit()){
+        dataPage.close();
+        return;
+      }
+      segAccX = Util::RelAccX(totalAccX.getPointer("segments"), false);
+    }
+    fieldAccess();
+    char semName[NAME_BUFFER_SIZE];
+    snprintf(semName, NAME_BUFFER_SIZE, SEM_SEGMENTS, streamName.c_str());
+    sem.open(semName, O_CREAT | O_RDWR, ACCESSPERMS, 1);
+  }
+
+  void SegmentCache::fieldAccess(){
+    hits = totalAccX.getFieldAccX("hits");
+    misses = totalAccX.getFieldAccX("misses");
+    evictions = totalAccX.getFieldAccX("evictions");
+    key = segAccX.getFieldAccX("key");
+    from = segAccX.getFieldAccX("from");
+    until = segAccX.getFieldAccX("until");
+    size = segAccX.getFieldAccX("size");
+    pid = segAccX.getFieldAccX("pid");
+    lastUse = segAccX.getFieldAccX("lastuse");
+    url = segAccX.getFieldAccX("url");
+    type = segAccX.getFieldAccX("type");
+    cache = segAccX.getFieldAccX("cache");
+    connector = segAccX.getFieldAccX("connector");
+  }
+
+  uint64_t SegmentCache::getHits() const{return *this ? hits.uint(0) : 0;}
+  uint64_t SegmentCache::getMisses() const{return *this ? misses.uint(0) : 0;}
+  uint64_t SegmentCache::getEvictions() const{return *this ? evictions.uint(0) : 0;}
+
+  /// Returns the amount of segments currently in the cache.
+  size_t SegmentCache::getCount() const{
+    if (!*this){return 0;}
+    size_t res = 0;
+    for (size_t i = 0; i < segAccX.getRCount(); ++i){
+      if (size.uint(i)){++res;}
+    }
+    return res;
+  }
+
+  /// Returns the total size of the data pages of all segments currently in the cache.
+  uint64_t SegmentCache::getBytes() const{
+    if (!*this){return 0;}
+    uint64_t res = 0;
+    for (size_t i = 0; i < segAccX.getRCount(); ++i){res += size.uint(i);}
+    return res;
+  }
+
+  std::string SegmentCache::pageName(size_t idx) const{
+    char name[NAME_BUFFER_SIZE];
+    snprintf(name, NAME_BUFFER_SIZE, SHM_SEGMENT_DATA, streamName.c_str(), key.string(idx).c_str());
+    return name;
+  }
+
+  /// Looks up the segment with the given key, which must identify the stream, format, track
+  /// selection and time range. If it is cached (or being produced), its page is opened and
+  /// SEGMENT_HIT is returned. Otherwise a page of capacity bytes is created for the caller to
+  /// fill using append and finish, and SEGMENT_MISS is returned. Returns 0 if the segment can not
+  /// be cached at all, in which case the caller should mux it without the cache.
+  int SegmentCache::open(const std::string &_key, uint64_t _from, uint64_t _until, uint64_t capacity,
+                         IPC::sharedPage &page, size_t &slot){
+    if (!*this){return 0;}
+    IPC::semGuard G(&sem);
+    size_t count = segAccX.getRCount();
+    size_t freeSlot = INVALID_RECORD_INDEX;
+    size_t oldest = INVALID_RECORD_INDEX;
+    for (size_t i = 0; i < count; ++i){
+      if (!size.uint(i)){
+        if (freeSlot == INVALID_RECORD_INDEX){freeSlot = i;}
+        continue;
+      }
+      if (key.string(i) == _key){
+        page.init(pageName(i), 0, false, false);
+        if (!page || state(page) == SEGMENT_ABORTED){
+          // The data page went missing or its producer died; produce the segment again in the same slot
+          removeSegment(i, false);
+          freeSlot = i;
+          break;
+        }
+        lastUse.set(Util::bootMS(), i);
+        hits.set(hits.uint(0) + 1);
+        slot = i;
+        return SEGMENT_HIT;
+      }
+      if (!pid.uint(i) && (oldest == INVALID_RECORD_INDEX || lastUse.uint(i) < lastUse.uint(oldest))){oldest = i;}
+    }
+    misses.set(misses.uint(0) + 1);
+    if (freeSlot == INVALID_RECORD_INDEX){
+      // Full: make room by dropping the least recently used complete segment
+      if (oldest == INVALID_RECORD_INDEX){return 0;}
+      removeSegment(oldest, true);
+      freeSlot = oldest;
+    }
+    key.set(_key, freeSlot);
+    url.set("", freeSlot);
+    page.init(pageName(freeSlot), capacity + SEGMENT_HEADER_SIZE, true);
+    if (!page){
+      key.set("", freeSlot);
+      return 0;
+    }
+    page.master = false;
+    memset(page.mapped, 0, SEGMENT_HEADER_SIZE);
+    *(uint32_t *)(page.mapped + 8) = getpid();
+    page.mapped[12] = SEGMENT_PRODUCING;
+    from.set(_from, freeSlot);
+    until.set(_until, freeSlot);
+    pid.set(getpid(), freeSlot);
+    lastUse.set(Util::bootMS(), freeSlot);
+    size.set(capacity + SEGMENT_HEADER_SIZE, freeSlot);
+    slot = freeSlot;
+    return SEGMENT_MISS;
+  }
+
+  /// Ends production of a segment that open returned SEGMENT_MISS for. Complete segments are kept
+  /// for later requests; incomplete ones are marked aborted for current readers and removed.
+  void SegmentCache::finish(IPC::sharedPage &page, size_t slot, bool complete){
+    if (!page.mapped){return;}
+    page.mapped[12] = complete ? SEGMENT_COMPLETE : SEGMENT_ABORTED;
+    signal(page.mapped);
+    page.close();
+    if (!*this || slot >= segAccX.getRCount()){return;}
+    IPC::semGuard G(&sem);
+    if (pid.uint(slot) != (uint32_t)getpid()){return;}
+    if (complete){
+      pid.set(0, slot);
+    }else{
+      removeSegment(slot, false);
+    }
+  }
+
+  /// Marks a segment that open returned SEGMENT_MISS for as publicly cacheable: once complete,
+  /// requests for exactly this URL may be answered from the cache with the given Content-Type and
+  /// Cache-Control headers, without involving the output that produced it.
+  void SegmentCache::setPublic(size_t slot, const std::string &_url, const std::string &_type,
+                               const std::string &_cache, const std::string &_connector){
+    if (!*this || slot >= segAccX.getRCount()){return;}
+    // Values that do not fit would be truncated; such segments are simply not served by URL
+    if (_url.size() >= 128 || _type.size() >= 32 || _cache.size() >= 64 || _connector.size() >= 32){return;}
+    IPC::semGuard G(&sem);
+    if (pid.uint(slot) != (uint32_t)getpid()){return;}
+    type.set(_type, slot);
+    cache.set(_cache, slot);
+    connector.set(_connector, slot);
+    url.set(_url, slot);
+  }
+
+  /// Looks up a complete, publicly cacheable segment by the URL it was requested with. If found,
+  /// its page is opened and its Content-Type and Cache-Control headers are returned, as well as
+  /// the name of the connector that produced it (which viewers of it are accounted to).
+  bool SegmentCache::findPublic(const std::string &_url, IPC::sharedPage &page, std::string &_type,
+                                std::string &_cache, std::string &_connector){
+    if (!*this || !_url.size()){return false;}
+    IPC::semGuard G(&sem);
+    size_t count = segAccX.getRCount();
+    for (size_t i = 0; i < count; ++i){
+      if (!size.uint(i) || pid.uint(i) || url.string(i) != _url){continue;}
+      page.init(pageName(i), 0, false, false);
+      if (!page){return false;}
+      if (state(page) != SEGMENT_COMPLETE){
+        page.close();
+        return false;
+      }
+      _type = type.string(i);
+      _cache = cache.string(i);
+      _connector = connector.string(i);
+      lastUse.set(Util::bootMS(), i);
+      hits.set(hits.uint(0) + 1);
+      return true;
+    }
+    return false;
+  }
+
+  /// Removes segments that end before firstms (pass zero to skip this), segments nobody requested
+  /// for idleMs (pass zero to keep them), as well as segments whose producer went away before
+  /// finishing them. Then adds the size of this stream's segments to the host-wide total in host,
+  /// and evicts the least recently used complete segments for as long as that total exceeds the
+  /// host-wide segment budget. Only the master removes segments here.
+  void SegmentCache::removeExpired(uint64_t firstms, uint64_t idleMs, PageCache &host){
+    if (!master || !*this){return;}
+    IPC::semGuard G(&sem);
+    uint64_t now = Util::bootMS();
+    uint64_t bytes = 0;
+    std::multimap<uint64_t, size_t> complete;
+    size_t count = segAccX.getRCount();
+    for (size_t i = 0; i < count; ++i){
+      if (!size.uint(i)){continue;}
+      uint32_t owner = pid.uint(i);
+      if (owner && !Util::Procs::isRunning(owner)){
+        removeSegment(i, false);
+        continue;
+      }
+      if (firstms && until.uint(i) <= firstms){
+        removeSegment(i, true);
+        continue;
+      }
+      if (!owner && idleMs && now > lastUse.uint(i) + idleMs){
+        removeSegment(i, true);
+        continue;
+      }
+      bytes += size.uint(i);
+      if (!owner){complete.insert(std::pair<uint64_t, size_t>(lastUse.uint(i), i));}
+    }
+    if (!host){host.reload();}
+    uint64_t budget = host.getSegmentBudget();
+    if (budget){
+      uint64_t total = host.getSegmentBytes() + bytes - hostBytes;
+      for (std::multimap<uint64_t, size_t>::iterator it = complete.begin(); it != complete.end() && total > budget; ++it){
+        uint64_t segSize = size.uint(it->second);
+        removeSegment(it->second, true);
+        bytes -= segSize;
+        total -= segSize;
+      }
+    }
+    host.addSegmentBytes((int64_t)bytes - (int64_t)hostBytes);
+    hostBytes = bytes;
+  }
+
+  /// Removes all segments and the index itself, releasing their bytes from the host-wide total.
+  /// Only the master may do this.
+  void SegmentCache::clear(PageCache &host){
+    if (!master || !*this){return;}
+    {
+      IPC::semGuard G(&sem);
+      size_t count = segAccX.getRCount();
+      for (size_t i = 0; i < count; ++i){
+        if (size.uint(i)){removeSegment(i, false);}
+      }
+      totalAccX.setExit();
+    }
+    host.addSegmentBytes(-(int64_t)hostBytes);
+    hostBytes = 0;
+    sem.unlink();
+    dataPage.master = true;
+    dataPage.close();
+  }
+
+  /// Unlinks the data page of a segment and frees its slot. Readers that still have the page
+  /// open can finish reading it. Must be called with the semaphore locked.
+  void SegmentCache::removeSegment(size_t idx, bool evicted){
+    IPC::sharedPage segPage(pageName(idx), 0, false, false);
+    if (segPage){
+      // Mark unfinished segments as aborted, so their readers do not wait forever
+      if (segPage.mapped[12] == SEGMENT_PRODUCING){
+        segPage.mapped[12] = SEGMENT_ABORTED;
+        signal(segPage.mapped);
+      }
+      segPage.master = true;
+    }
+    if (evicted){evictions.set(evictions.uint(0) + 1);}
+    key.set("", idx);
+    url.set("", idx);
+    size.set(0, idx);
+    pid.set(0, idx);
+  }
+
+  /// Appends data to a segment that is being produced. Returns false if it does not fit, in
+  /// which case the segment must be finished as incomplete.
+  bool SegmentCache::append(IPC::sharedPage &page, const char *data, size_t len){
+    if (!page.mapped){return false;}
+    uint64_t written = *(volatile uint64_t *)page.mapped;
+    if (SEGMENT_HEADER_SIZE + written + len > page.len){return false;}
+    memcpy(page.mapped + SEGMENT_HEADER_SIZE + written, data, len);
+    // Readers may only see the new length once the data itself is in place
+    __sync_synchronize();
+    *(volatile uint64_t *)page.mapped = written + len;
+    signal(page.mapped);
+    return true;
+  }
+
+  /// Returns the amount of segment data available for reading.
+  uint64_t SegmentCache::available(const IPC::sharedPage &page){
+    if (!page.mapped){return 0;}
+    uint64_t res = *(volatile uint64_t *)page.mapped;
+    __sync_synchronize();
+    return res;
+  }
+
+  /// Returns the state of a segment: SEGMENT_PRODUCING, SEGMENT_COMPLETE or SEGMENT_ABORTED.
+  /// Segments whose producer is no longer running are reported as aborted.
+  uint8_t SegmentCache::state(const IPC::sharedPage &page){
+    if (!page.mapped){return SEGMENT_ABORTED;}
+    uint8_t res = *(volatile char *)(page.mapped + 12);
+    if (res == SEGMENT_PRODUCING && !Util::Procs::isRunning(*(uint32_t *)(page.mapped + 8))){return SEGMENT_ABORTED;}
+    return res;
+  }
+
+  /// Wakes up readers of a segment waiting in waitSignal, after its data or state changed.
+  void SegmentCache::signal(char *header){
+    IPC::wordWake((volatile uint32_t *)(header + 16), (volatile uint32_t *)(header + 20));
+  }
+
+  /// Returns the current value of the signal word of a segment, for use with waitSignal.
+  uint32_t SegmentCache::getSignal(const IPC::sharedPage &page){
+    if (!page.mapped){return 0;}
+    return *(volatile uint32_t *)(page.mapped + 16);
+  }
+
+  /// Waits for at most millis milliseconds for the producer to append data to the segment or
+  /// finish it, if that has not already happened since getSignal returned lastSignal.
+  void SegmentCache::waitSignal(const IPC::sharedPage &page, uint32_t lastSignal, uint64_t millis){
+    if (!page.mapped){return;}
+    IPC::wordWait((volatile uint32_t *)(page.mapped + 16), lastSignal, millis,
+                  (volatile uint32_t *)(page.mapped + 20));
+  }
 }// namespace Comms
@@ -70,6 +70,7 @@ namespace Comms{
   public:
     void reload(const std::string & streamName, const std::string & ip, const std::string & tkn, const std::string & protocol, const std::string & reqUrl, bool _master = false, bool reIssue = false);
     void reload(const std::string & sessId, bool _master = false, bool reIssue = false);
+    bool attach(const std::string & streamName, const std::string & ip, const std::string & tkn, const std::string & protocol);
     void unload();
     operator bool() const{return dataPage.mapped && (master || index != INVALID_RECORD_INDEX);}
     std::string generateSession(const std::string & streamName, const std::string & ip, const std::string & tkn, const std::string & connector, uint64_t sessionMode);
@@ -204,4 +205,202 @@ namespace Comms{
       void setTags(std::string _sid);
       void setTags(std::string _sid, size_t idx);
   };
+
+  /// Host-wide accounting of the VoD data pages buffered by all inputs, so that their total shared
+  /// memory use can be kept under a single budget. The controller creates the page and sets the
+  /// budget; inputs register every page they load, keep its last use time up to date and remove
+  /// their pages once they are marked for eviction. Victims are picked least-recently-used over
+  /// the pages of all inputs together. A budget of zero means unlimited.
+  /// The page also holds the host-wide totals of how created data pages were backed when huge
+  /// pages are enabled (see IPC::hugePageCounters), for live and VoD streams alike.
+  class PageCache{
+  public:
+    PageCache();
+    ~PageCache();
+    void reload(bool _master = false);
+    operator bool() const{return dataPage.mapped && pageAccX.isReady();}
+    void setMaster(bool _master);
+
+    uint64_t getBudget() const;
+    void setBudget(uint64_t _budget);
+    uint64_t getUsed() const;
+    uint64_t getHits() const;
+    uint64_t getMisses() const;
+    uint64_t getEvictions() const;
+    void addHits(uint64_t count);
+    IPC::hugePageCounters getHugePages() const;
+    void addHugePages(const IPC::hugePageCounters &delta);
+    uint64_t getSegmentBudget() const;
+    void setSegmentBudget(uint64_t _budget);
+    uint64_t getSegmentBytes() const;
+    void addSegmentBytes(int64_t delta);
+
+    size_t recordCount() const;
+    std::string getStream(size_t idx) const;
+    uint64_t getSize(size_t idx) const;
+    uint32_t getPid(size_t idx) const;
+    bool isShared(size_t idx) const;
+
+    size_t addPage(const std::string &_stream, size_t _track, uint32_t _page, uint64_t _size,
+                   const std::string &sharedName = "", bool attached = false);
+    void touchPage(size_t idx);
+    bool mustEvict(size_t idx) const;
+    void removePage(size_t idx, bool evicted);
+    void removeDead();
+
+  private:
+    void markVictims(size_t keep = INVALID_RECORD_INDEX);
+    void fieldAccess();
+    bool master;
+    IPC::semaphore sem;
+    IPC::sharedPage dataPage;
+    Util::RelAccX totalAccX;
+    Util::RelAccX pageAccX;
+    Util::FieldAccX budget;
+    Util::FieldAccX used;
+    Util::FieldAccX hits;
+    Util::FieldAccX misses;
+    Util::FieldAccX evictions;
+    Util::FieldAccX hugeRequested;
+    Util::FieldAccX hugeTLB;
+    Util::FieldAccX hugeTHP;
+    Util::FieldAccX hugeFallback;
+    Util::FieldAccX unmarked;
+    Util::FieldAccX freeHint;
+    Util::FieldAccX segBudget;
+    Util::FieldAccX segUsed;
+    Util::FieldAccX stream;
+    Util::FieldAccX track;
+    Util::FieldAccX page;
+    Util::FieldAccX size;
+    Util::FieldAccX pid;
+    Util::FieldAccX lastUse;
+    Util::FieldAccX evict;
+    Util::FieldAccX shared;
+    Util::FieldAccX held;
+  };
+
+  /// Host-wide accept statistics of connector listeners. The controller creates the page; every
+  /// listening process (one per SO_REUSEPORT shard) registers a record for its socket and counts
+  /// every connection it accepts, every process it starts to handle one, and every request it
+  /// answers by itself (in the event loop serving mode). The controller turns those counts into
+  /// accept and fork rates and releases the records of listeners that are gone.
+  class ListenerStats{
+  public:
+    ListenerStats();
+    ~ListenerStats();
+    void reload(bool _master = false);
+    operator bool() const{return dataPage.mapped && listenAccX.isReady();}
+    void setMaster(bool _master);
+
+    size_t recordCount() const;
+    uint32_t getPid(size_t idx) const;
+    std::string getConnector(size_t idx) const;
+    uint32_t getPort(size_t idx) const;
+    uint32_t getShard(size_t idx) const;
+    int32_t getCpu(size_t idx) const;
+    uint64_t getAccepts(size_t idx) const;
+    uint64_t getRate(size_t idx) const;
+    uint64_t getForks(size_t idx) const;
+    uint64_t getForkRate(size_t idx) const;
+    uint64_t getReplies(size_t idx) const;
+
+    size_t addListener(const std::string &_connector, uint32_t _port, uint32_t _shard, int32_t _cpu);
+    void setAccepts(size_t idx, uint64_t _accepts);
+    void setForks(size_t idx, uint64_t _forks);
+    void setReplies(size_t idx, uint64_t _replies);
+    void removeListener(size_t idx);
+    void removeDead();
+    void updateRates();
+
+  private:
+    void fieldAccess();
+    bool master;
+    uint64_t lastUpdate;
+    IPC::semaphore sem;
+    IPC::sharedPage dataPage;
+    Util::RelAccX listenAccX;
+    Util::FieldAccX connector;
+    Util::FieldAccX port;
+    Util::FieldAccX shard;
+    Util::FieldAccX cpu;
+    Util::FieldAccX pid;
+    Util::FieldAccX accepts;
+    Util::FieldAccX prevAccepts;
+    Util::FieldAccX rate;
+    Util::FieldAccX forks;
+    Util::FieldAccX prevForks;
+    Util::FieldAccX forkRate;
+    Util::FieldAccX replies;
+  };
+
+#define SEGMENT_MISS 1 ///< Returned by SegmentCache::open: the caller must produce the segment
+#define SEGMENT_HIT 2  ///< Returned by SegmentCache::open: the segment can be read from the page
+#define SEGMENT_PRODUCING 0
+#define SEGMENT_COMPLETE 1
+#define SEGMENT_ABORTED 2
+
+  /// Muxed output segments of a single stream, shared between all outputs of that stream, so
+  /// identical segment requests are muxed only once. Every segment lives in its own data page,
+  /// which starts with a SEGMENT_HEADER_SIZE header holding the amount of bytes written so far,
+  /// the pid of the producing process, the segment state and a futex word (plus its waiter count)
+  /// that is signalled on every change. Outputs can read a segment while it is still being
+  /// produced. The stream input is the master: it creates the index, removes segments that left
+  /// the live buffer window, went unused or do not fit the host-wide segment budget, and removes
+  /// everything when it shuts down.
+  class SegmentCache{
+  public:
+    SegmentCache();
+    ~SegmentCache();
+    void reload(const std::string &_streamName, bool _master = false);
+    operator bool() const{return dataPage.mapped && segAccX.isReady();}
+
+    uint64_t getHits() const;
+    uint64_t getMisses() const;
+    uint64_t getEvictions() const;
+    size_t getCount() const;
+    uint64_t getBytes() const;
+
+    int open(const std::string &key, uint64_t from, uint64_t until, uint64_t capacity,
+             IPC::sharedPage &page, size_t &slot);
+    void finish(IPC::sharedPage &page, size_t slot, bool complete);
+    void setPublic(size_t slot, const std::string &_url, const std::string &_type, const std::string &_cache,
+                   const std::string &_connector);
+    bool findPublic(const std::string &_url, IPC::sharedPage &page, std::string &_type, std::string &_cache,
+                    std::string &_connector);
+    void removeExpired(uint64_t firstms, uint64_t idleMs, PageCache &host);
+    void clear(PageCache &host);
+
+    static bool append(IPC::sharedPage &page, const char *data, size_t len);
+    static uint64_t available(const IPC::sharedPage &page);
+    static uint8_t state(const IPC::sharedPage &page);
+    static uint32_t getSignal(const IPC::sharedPage &page);
+    static void waitSignal(const IPC::sharedPage &page, uint32_t lastSignal, uint64_t millis);
+
+  private:
+    std::string pageName(size_t idx) const;
+    void removeSegment(size_t idx, bool evicted);
+    void fieldAccess();
+    static void signal(char *header);
+    bool master;
+    std::string streamName;
+    uint64_t hostBytes; ///< Bytes of this stream last added to the host-wide segment total
+    IPC::semaphore sem;
+    IPC::sharedPage dataPage;
+    Util::RelAccX totalAccX;
+    Util::RelAccX segAccX;
+    Util::FieldAccX hits;
+    Util::FieldAccX misses;
+    Util::FieldAccX evictions;
+    Util::FieldAccX key;
+    Util::FieldAccX from;
+    Util::FieldAccX until;
+    Util::FieldAccX size;
+    Util::FieldAccX pid;
+    Util::FieldAccX lastUse;
+    Util::FieldAccX url;
+    Util::FieldAccX type;
+    Util::FieldAccX cache;
+    Util::FieldAccX connector;
+  };
 }// namespace Comms
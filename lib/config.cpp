@@ -21,6 +21,12 @@
 #if defined(__APPLE__)
 #include <mach-o/dyld.h>
 #endif
+#ifdef __linux__
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#endif
+#include "comms.h"
 #include "procs.h"
 #include <dirent.h> //for getMyExec
 #include <errno.h>
@@ -28,6 +34,9 @@
 #include <fstream>
 #include <getopt.h>
 #include <iostream>
+#include <map>
+#include <deque>
+#include <set>
 #include <pwd.h>
 #include <signal.h>
 #include <string.h>
@@ -430,6 +439,160 @@ bool Util::Config::getBool(std::string optname){
   return getOption(optname).asBool();
 }
 
+static Comms::ListenerStats *listenStats = 0; ///< Accept statistics page, if this listener is tracked
+static size_t listenStatsIdx = INVALID_RECORD_INDEX;
+static uint64_t listenAccepts = 0;   ///< Connections accepted by this listener in total
+static uint64_t listenForks = 0;     ///< Processes started by this listener to handle a connection
+static uint64_t listenReplies = 0;   ///< Requests answered by this listener itself
+static pid_t shardOwner = 0;      ///< Process that started the listener shards in shardPids
+static std::set<pid_t> shardPids; ///< Listener shards started by this process
+
+/// Counts an accepted connection and publishes the total in the listener statistics.
+static void countAccept(){
+  ++listenAccepts;
+  if (listenStats){listenStats->setAccepts(listenStatsIdx, listenAccepts);}
+}
+
+/// Counts a process started to handle a connection and publishes the total.
+static void countFork(){
+  ++listenForks;
+  if (listenStats){listenStats->setForks(listenStatsIdx, listenForks);}
+}
+
+/// Counts a request answered without starting a process and publishes the total.
+static void countReply(){
+  ++listenReplies;
+  if (listenStats){listenStats->setReplies(listenStatsIdx, listenReplies);}
+}
+
+/// Registers the listener of this process in the listener statistics page, if it exists.
+static void trackListener(const std::string &cmd, uint32_t shard, int32_t cpu){
+  std::string name = cmd.substr(cmd.rfind('/') == std::string::npos ? 0 : cmd.rfind('/') + 1);
+  if (name.substr(0, 7) == "MistOut"){name.erase(0, 7);}
+  if (name.substr(0, 8) == "MistConn"){name.erase(0, 8);}
+  if (!listenStats){listenStats = new Comms::ListenerStats();}
+  listenStats->reload();
+  listenStatsIdx = listenStats->addListener(name, Util::listenPort, shard, cpu);
+  if (listenStatsIdx == INVALID_RECORD_INDEX){
+    delete listenStats;
+    listenStats = 0;
+    return;
+  }
+  listenAccepts = 0;
+  listenForks = 0;
+  listenReplies = 0;
+}
+
+/// Releases the statistics record of this listener and stops the listener shards this process
+/// started, if any. Does nothing in processes that only inherited these from their parent.
+static void stopListener(){
+  if (listenStats && listenStats->getPid(listenStatsIdx) == (uint32_t)getpid()){
+    listenStats->removeListener(listenStatsIdx);
+  }
+  if (shardOwner != getpid()){return;}
+  for (std::set<pid_t>::iterator it = shardPids.begin(); it != shardPids.end(); ++it){
+    kill(*it, SIGTERM);
+  }
+  shardPids.clear();
+}
+
+/// Returns the amount of listener shards requested by the "listeners" option, at least 1.
+/// Only TCP listeners opened from the port option can be sharded.
+size_t Util::Config::listenerShards(){
+  if (!vals.isMember("listeners") || !vals.isMember("port") || vals.isMember("socket")){return 1;}
+  int64_t shards = getInteger("listeners");
+  return shards > 1 ? shards : 1;
+}
+
+/// Opens the listening socket for the serve*Socket functions, splitting it into listenerShards()
+/// SO_REUSEPORT sockets served by as many processes, with the kernel spreading new connections
+/// over them. If the "listener_cpus" option holds a comma-separated list of CPU numbers, shard N
+/// and the connections it accepts are pinned to the Nth CPU in that list (wrapping around).
+/// Returns false if the socket could not be opened; otherwise returns true in every shard
+/// process, with server_socket holding that shard's socket, ready to be served.
+bool Util::Config::openListener(Socket::Server &server_socket){
+  size_t shards = listenerShards();
+  if (Socket::checkTrueSocket(0)){
+    server_socket = Socket::Server(0);
+  }else if (vals.isMember("socket")){
+    server_socket = Socket::Server(Util::getTmpFolder() + getString("socket"));
+  }else if (vals.isMember("port") && vals.isMember("interface")){
+    server_socket = Socket::Server(getInteger("port"), getString("interface"), false, shards > 1);
+  }
+  if (!server_socket.connected()){
+    DEVEL_MSG("Failure to open socket");
+    return false;
+  }
+  Socket::getSocketName(server_socket.getSocket(), Util::listenInterface, Util::listenPort);
+
+  std::deque<int> cpus;
+  if (vals.isMember("listener_cpus")){
+    std::string cpuList = getString("listener_cpus");
+    size_t pos = 0;
+    while (pos < cpuList.size()){
+      size_t end = cpuList.find(',', pos);
+      if (end == std::string::npos){end = cpuList.size();}
+      if (end > pos){cpus.push_back(atoi(cpuList.substr(pos, end - pos).c_str()));}
+      pos = end + 1;
+    }
+  }
+  size_t shard = 0;
+  shardOwner = getpid();
+  for (size_t i = 1; i < shards; ++i){
+    // Bind in this process, so that a shard that cannot bind is never started
+    Socket::Server shardSock(getInteger("port"), getString("interface"), false, true);
+    if (!shardSock.connected()){
+      WARN_MSG("Could not open listener shard %zu of %zu; continuing with fewer shards", i, shards);
+      break;
+    }
+    pid_t pid = fork();
+    if (pid == 0){
+      shardPids.clear();
+      server_socket.drop();
+      server_socket = shardSock;
+      shard = i;
+#ifdef __linux__
+      prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+      break;
+    }
+    if (pid < 0){
+      FAIL_MSG("Could not fork listener shard %zu: %s", i, strerror(errno));
+    }else{
+      shardPids.insert(pid);
+    }
+    shardSock.drop();
+  }
+  int cpu = -1;
+  if (cpus.size()){
+    cpu = cpus[shard % cpus.size()];
+#ifdef __linux__
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    if (sched_setaffinity(0, sizeof(mask), &mask)){
+      WARN_MSG("Could not pin listener shard %zu to CPU %d: %s", shard, cpu, strerror(errno));
+      cpu = -1;
+    }
+#else
+    cpu = -1;
+#endif
+  }
+  if (shards > 1){INFO_MSG("Listener shard %zu of %zu started on port %" PRIu32, shard, shards, Util::listenPort);}
+  trackListener(getString("cmd"), shard, cpu);
+
+  serv_sock_pointer = &server_socket;
+  activate();
+  if (server_socket.getSocket()){
+    int oldSock = server_socket.getSocket();
+    if (!dup2(oldSock, 0)){
+      server_socket = Socket::Server(0);
+      close(oldSock);
+    }
+  }
+  return true;
+}
+
 struct callbackData{
   Socket::Connection *sock;
   int (*cb)(Socket::Connection &);
@@ -450,6 +613,7 @@ int Util::Config::threadServer(Socket::Server &server_socket, int (*callback)(So
   while (is_active && server_socket.connected()){
     Socket::Connection S = server_socket.accept();
     if (S.connected()){// check if the new connection is valid
+      countAccept();
       callbackData *cData = new callbackData;
       cData->sock = new Socket::Connection(S);
       cData->cb = callback;
@@ -472,11 +636,13 @@ int Util::Config::forkServer(Socket::Server &server_socket, int (*callback)(Sock
   while (is_active && server_socket.connected()){
     Socket::Connection S = server_socket.accept();
     if (S.connected()){// check if the new connection is valid
+      countAccept();
       pid_t myid = fork();
       if (myid == 0){// if new child, start MAINHANDLER
         server_socket.drop();
         return callback(S);
       }else{// otherwise, do nothing or output debugging text
+        if (myid > 0){countFork();}
         HIGH_MSG("Forked new process %i for socket %i", (int)myid, S.getSocket());
         S.drop();
       }
@@ -491,56 +657,238 @@ int Util::Config::forkServer(Socket::Server &server_socket, int (*callback)(Sock
 
 int Util::Config::serveThreadedSocket(int (*callback)(Socket::Connection &)){
   Socket::Server server_socket;
-  if (Socket::checkTrueSocket(0)){
-    server_socket = Socket::Server(0);
-  }else if (vals.isMember("socket")){
-    server_socket = Socket::Server(Util::getTmpFolder() + getString("socket"));
-  }else if (vals.isMember("port") && vals.isMember("interface")){
-    server_socket = Socket::Server(getInteger("port"), getString("interface"), false);
-  }
-  if (!server_socket.connected()){
-    DEVEL_MSG("Failure to open socket");
-    return 1;
-  }
-  Socket::getSocketName(server_socket.getSocket(), Util::listenInterface, Util::listenPort);
-  serv_sock_pointer = &server_socket;
-  activate();
-  if (server_socket.getSocket()){
-    int oldSock = server_socket.getSocket();
-    if (!dup2(oldSock, 0)){
-      server_socket = Socket::Server(0);
-      close(oldSock);
-    }
-  }
+  if (!openListener(server_socket)){return 1;}
   int r = threadServer(server_socket, callback);
+  stopListener();
   serv_sock_pointer = 0;
   return r;
 }
 
 int Util::Config::serveForkedSocket(int (*callback)(Socket::Connection &S)){
   Socket::Server server_socket;
-  if (Socket::checkTrueSocket(0)){
-    server_socket = Socket::Server(0);
-  }else if (vals.isMember("socket")){
-    server_socket = Socket::Server(Util::getTmpFolder() + getString("socket"));
-  }else if (vals.isMember("port") && vals.isMember("interface")){
-    server_socket = Socket::Server(getInteger("port"), getString("interface"), false);
+  if (!openListener(server_socket)){return 1;}
+  int r = forkServer(server_socket, callback);
+  stopListener();
+  serv_sock_pointer = 0;
+  return r;
+}
+
+#ifdef __linux__
+#define EVENT_MAX_EVENTS 64
+#define EVENT_IDLE_TIMEOUT 30 // seconds a connection may be idle before it is closed
+
+/// State of a single connection held by the event loop
+struct eventConnection{
+  Socket::Connection *sock;
+  std::string reply;     ///< Reply (or its headers, if there is a body) currently being sent
+  Util::EventBody *body; ///< Body sent after reply without copying it, if any
+  size_t sent;           ///< Bytes of reply and body already accepted by the kernel
+  uint64_t lastActive;
+  bool closeAfter;
+  bool wantWrite; ///< Whether EPOLLOUT is currently requested for this connection
+};
+
+/// Returns true if part of the current reply of C still has to be sent
+static bool eventPending(const eventConnection &C){
+  return C.sent < C.reply.size() + (C.body ? C.body->len : 0);
+}
+
+/// Forgets the current reply of C, releasing its body
+static void eventClear(eventConnection &C){
+  C.reply.clear();
+  delete C.body;
+  C.body = 0;
+  C.sent = 0;
+}
+
+/// Sends as much of the pending reply as the socket accepts without blocking.
+/// Returns false if the connection should be closed.
+static bool eventFlush(eventConnection &C){
+  while (eventPending(C) && C.sock->connected()){
+    struct iovec vec[2];
+    int n = 0;
+    if (C.sent < C.reply.size()){
+      vec[n].iov_base = (void *)(C.reply.data() + C.sent);
+      vec[n].iov_len = C.reply.size() - C.sent;
+      ++n;
+    }
+    if (C.body){
+      size_t bodySent = (C.sent > C.reply.size()) ? C.sent - C.reply.size() : 0;
+      vec[n].iov_base = (void *)(C.body->data + bodySent);
+      vec[n].iov_len = C.body->len - bodySent;
+      ++n;
+    }
+    unsigned int w = C.sock->iwrite(vec, n);
+    if (!w){break;}
+    C.sent += w;
+    C.lastActive = Util::bootSecs();
   }
-  if (!server_socket.connected()){
-    DEVEL_MSG("Failure to open socket");
-    return 1;
+  if (!C.sock->connected()){return false;}
+  return !(C.closeAfter && !eventPending(C));
+}
+#endif
+
+/// Serves connections from a single process using epoll, until a request arrives that the
+/// dispatch function cannot answer by itself. The dispatcher is called whenever new data
+/// arrives and no reply is pending; it may fill reply (optionally followed by a body that is
+/// sent without copying it) and return EVENT_REPLY or EVENT_REPLY_CLOSE, return EVENT_NEED_DATA to wait for more, or return EVENT_FORK to run
+/// callback on the connection in a child process, exactly like forkServer would.
+/// Idle connections are closed after EVENT_IDLE_TIMEOUT seconds.
+/// On systems without epoll, this simply calls forkServer.
+int Util::Config::eventServer(Socket::Server &server_socket, int (*callback)(Socket::Connection &),
+                              int (*dispatch)(Socket::Connection &, std::string &, EventBody *&)){
+#ifndef __linux__
+  return forkServer(server_socket, callback);
+#else
+  int epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd < 0){
+    WARN_MSG("Could not create epoll instance (%s), falling back to one process per connection", strerror(errno));
+    return forkServer(server_socket, callback);
   }
-  Socket::getSocketName(server_socket.getSocket(), Util::listenInterface, Util::listenPort);
-  serv_sock_pointer = &server_socket;
-  activate();
-  if (server_socket.getSocket()){
-    int oldSock = server_socket.getSocket();
-    if (!dup2(oldSock, 0)){
-      server_socket = Socket::Server(0);
-      close(oldSock);
+  Util::Procs::socketList.insert(server_socket.getSocket());
+  int lSock = server_socket.getSocket();
+  server_socket.setBlocking(false);
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = lSock;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, lSock, &ev);
+
+  std::map<int, eventConnection> conns;
+  struct epoll_event events[EVENT_MAX_EVENTS];
+  uint64_t lastCheck = Util::bootSecs();
+  while (is_active && server_socket.connected()){
+    int n = epoll_wait(epfd, events, EVENT_MAX_EVENTS, 1000);
+    if (n < 0 && errno != EINTR){
+      FAIL_MSG("Event loop failure: %s", strerror(errno));
+      break;
+    }
+    for (int i = 0; i < n; ++i){
+      int fd = events[i].data.fd;
+      if (fd == lSock){
+        while (is_active){
+          Socket::Connection S = server_socket.accept(true);
+          if (!S.connected()){break;}
+          countAccept();
+          eventConnection C;
+          C.sock = new Socket::Connection(S);
+          C.body = 0;
+          C.sent = 0;
+          C.lastActive = Util::bootSecs();
+          C.closeAfter = false;
+          C.wantWrite = false;
+          ev.events = EPOLLIN;
+          ev.data.fd = C.sock->getSocket();
+          if (epoll_ctl(epfd, EPOLL_CTL_ADD, ev.data.fd, &ev)){
+            C.sock->close();
+            delete C.sock;
+            continue;
+          }
+          conns[ev.data.fd] = C;
+          HIGH_MSG("Accepted socket %d into event loop (%zu connections)", ev.data.fd, conns.size());
+        }
+        continue;
+      }
+      std::map<int, eventConnection>::iterator it = conns.find(fd);
+      if (it == conns.end()){continue;}
+      eventConnection &C = it->second;
+      bool keep = true;
+      if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)){
+        if (C.sock->spool(true)){C.lastActive = Util::bootSecs();}
+      }
+      if (eventPending(C)){keep = eventFlush(C);}
+      // Replies are sent in order: only dispatch when the previous one has been sent in full
+      int action = EVENT_NEED_DATA;
+      while (keep && C.sock->connected() && !eventPending(C) && C.sock->Received().size()){
+        eventClear(C);
+        action = dispatch(*C.sock, C.reply, C.body);
+        if (action == EVENT_NEED_DATA && C.sock->Received().bytes(EVENT_MAX_REQUEST) >= EVENT_MAX_REQUEST){
+          action = EVENT_FORK;
+        }
+        if (action != EVENT_REPLY && action != EVENT_REPLY_CLOSE){break;}
+        if (action == EVENT_REPLY_CLOSE){C.closeAfter = true;}
+        countReply();
+        keep = eventFlush(C);
+      }
+      if (!C.sock->connected()){keep = false;}
+      if (keep && action == EVENT_FORK){
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, 0);
+        pid_t myid = fork();
+        if (myid == 0){// if new child, start MAINHANDLER
+          close(epfd);
+          server_socket.drop();
+          for (std::map<int, eventConnection>::iterator oIt = conns.begin(); oIt != conns.end(); ++oIt){
+            if (oIt->first != fd){oIt->second.sock->drop();}
+          }
+          C.sock->setBlocking(true);
+          return callback(*C.sock);
+        }
+        if (myid < 0){
+          FAIL_MSG("Could not fork connection handler: %s", strerror(errno));
+          C.sock->close();
+        }else{
+          countFork();
+          HIGH_MSG("Forked new process %i for socket %i", (int)myid, fd);
+          C.sock->drop();
+        }
+        eventClear(C);
+        delete C.sock;
+        conns.erase(it);
+        continue;
+      }
+      if (!keep){
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, 0);
+        C.sock->close();
+        eventClear(C);
+        delete C.sock;
+        conns.erase(it);
+        continue;
+      }
+      bool wantWrite = eventPending(C);
+      if (wantWrite != C.wantWrite){
+        ev.events = wantWrite ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+        C.wantWrite = wantWrite;
+      }
+    }
+    // Close connections that have not done anything for too long
+    uint64_t now = Util::bootSecs();
+    if (now != lastCheck){
+      lastCheck = now;
+      std::map<int, eventConnection>::iterator it = conns.begin();
+      while (it != conns.end()){
+        if (it->second.lastActive + EVENT_IDLE_TIMEOUT < now){
+          HIGH_MSG("Closing idle socket %d", it->first);
+          epoll_ctl(epfd, EPOLL_CTL_DEL, it->first, 0);
+          it->second.sock->close();
+          eventClear(it->second);
+          delete it->second.sock;
+          conns.erase(it++);
+        }else{
+          ++it;
+        }
+      }
     }
   }
-  int r = forkServer(server_socket, callback);
+  for (std::map<int, eventConnection>::iterator it = conns.begin(); it != conns.end(); ++it){
+    it->second.sock->close();
+    eventClear(it->second);
+    delete it->second.sock;
+  }
+  close(epfd);
+  Util::Procs::socketList.erase(server_socket.getSocket());
+  if (!is_restarting){server_socket.close();}
+  return 0;
+#endif
+}
+
+int Util::Config::serveEventSocket(int (*callback)(Socket::Connection &S),
+                                   int (*dispatch)(Socket::Connection &S, std::string &reply, EventBody *&body)){
+  Socket::Server server_socket;
+  if (!openListener(server_socket)){return 1;}
+  int r = eventServer(server_socket, callback, dispatch);
+  stopListener();
   serv_sock_pointer = 0;
   return r;
 }
@@ -704,6 +1052,24 @@ void Util::Config::addConnectorOptions(int port, JSON::Value &capabilities){
   capabilities["optional"]["interface"]["short"] = "i";
   capabilities["optional"]["interface"]["type"] = "str";
 
+  capabilities["optional"]["listeners"]["name"] = "Listener shards";
+  capabilities["optional"]["listeners"]["help"] =
+      "Amount of processes listening on the port with SO_REUSEPORT, with the kernel spreading new "
+      "connections over them. Raise this if accepting connections becomes a bottleneck.";
+  capabilities["optional"]["listeners"]["type"] = "uint";
+  capabilities["optional"]["listeners"]["short"] = "Q";
+  capabilities["optional"]["listeners"]["option"] = "--listeners";
+  capabilities["optional"]["listeners"]["default"] = 1;
+
+  capabilities["optional"]["listener_cpus"]["name"] = "Listener CPUs";
+  capabilities["optional"]["listener_cpus"]["help"] =
+      "Comma-separated list of CPU numbers to pin listener shards to, in order. Connections are "
+      "handled on the CPU of the shard that accepted them. Default is to not pin listeners.";
+  capabilities["optional"]["listener_cpus"]["type"] = "str";
+  capabilities["optional"]["listener_cpus"]["short"] = "Y";
+  capabilities["optional"]["listener_cpus"]["option"] = "--listener_cpus";
+  capabilities["optional"]["listener_cpus"]["default"] = "";
+
   addBasicConnectorOptions(capabilities);
 }// addConnectorOptions
 
@@ -11,6 +11,14 @@
 #include <signal.h>
 #include <string>
 
+// Return values for the request dispatcher used by Util::Config::eventServer
+#define EVENT_NEED_DATA 0   ///< No complete request is buffered yet, keep waiting for data
+#define EVENT_FORK 1        ///< Hand the connection to a forked child running the regular callback
+#define EVENT_REPLY 2       ///< Send the reply and keep the connection open for further requests
+#define EVENT_REPLY_CLOSE 3 ///< Send the reply, then close the connection
+/// Connections buffering this many bytes without a reply are always handed off by eventServer
+#define EVENT_MAX_REQUEST 16384
+
 /// Contains utility code, not directly related to streaming media
 namespace Util{
   extern uint32_t printDebugLevel;
@@ -20,6 +28,17 @@ namespace Util{
   extern __thread char* mRExitReason;
   void logExitReason(const char* shortString, const char *format, ...);
 
+  /// Reply body that the event loop sends straight from memory the dispatcher keeps valid, so
+  /// it is never copied. Dispatchers subclass this to keep that memory (e.g. a shared page)
+  /// around; the event loop deletes the body once it is sent or the connection is gone.
+  class EventBody{
+  public:
+    EventBody() : data(0), len(0){}
+    virtual ~EventBody(){}
+    const char *data;
+    size_t len;
+  };
+
   enum binType {
     UNSET,
     INPUT,
@@ -34,6 +53,8 @@ namespace Util{
     JSON::Value vals; ///< Holds all current config values
     int long_count;
     static void signal_handler(int signum, siginfo_t *sigInfo, void *ignore);
+    size_t listenerShards();
+    bool openListener(Socket::Server &server_socket);
 
   public:
     // variables
@@ -56,6 +77,10 @@ namespace Util{
     int forkServer(Socket::Server &server_socket, int (*callback)(Socket::Connection &S));
     int serveThreadedSocket(int (*callback)(Socket::Connection &S));
     int serveForkedSocket(int (*callback)(Socket::Connection &S));
+    int eventServer(Socket::Server &server_socket, int (*callback)(Socket::Connection &S),
+                    int (*dispatch)(Socket::Connection &S, std::string &reply, EventBody *&body));
+    int serveEventSocket(int (*callback)(Socket::Connection &S),
+                         int (*dispatch)(Socket::Connection &S, std::string &reply, EventBody *&body));
     int servePlainSocket(int (*callback)(Socket::Connection &S));
     void addOptionsFromCapabilities(const JSON::Value &capabilities);
     void addBasicConnectorOptions(JSON::Value &capabilities);
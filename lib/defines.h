@@ -174,8 +174,8 @@ static inline void show_stackframe(){}
 #define DEFAULT_PAGE_TIMEOUT 15
 
 /// \TODO These values are hardcoded for now, but the dtsc_sizing_test binary can calculate them accurately.
-#define META_META_OFFSET 138
-#define META_META_RECORDSIZE 548
+#define META_META_OFFSET 175
+#define META_META_RECORDSIZE 596
 
 #define META_TRACK_OFFSET 148
 #define META_TRACK_RECORDSIZE 1893
@@ -210,6 +210,23 @@ static inline void show_stackframe(){}
 
 #define EXTWRITERS_INITSIZE 1 * 1024 * 1024
 
+#define SHM_PAGE_CACHE "MstPageCache"
+#define SHM_PAGE_CACHE_LEN 2 * 1024 * 1024
+#define SEM_PAGE_CACHE "/MstPageCache"
+
+#define SHM_LISTENERS "MstListeners"
+#define SHM_LISTENERS_LEN 64 * 1024
+#define SEM_LISTENERS "/MstListeners"
+
+#define SHM_SEGMENTS "MstSegs%s" //%s stream name
+#define SHM_SEGMENTS_LEN 512 * 1024
+#define SEM_SEGMENTS "/MstSegs%s" //%s stream name
+#define SHM_SEGMENT_DATA "MstSgmt%s@%s" //%s stream name, %s segment key
+#define SEGMENT_HEADER_SIZE 24
+
+#define SHM_PUSH_TARGETS "MstPshT%" PRIu32 //%PRIu32 PID of a fan-out push; one byte per target, set to stop it
+#define SHM_PUSH_TARGETS_LEN 256
+
 #define SEM_STATISTICS "/MstStat"
 #define SEM_USERS "/MstUser%s" //%s stream name
 
@@ -217,6 +234,12 @@ static inline void show_stackframe(){}
 // End new meta
 
 #define INPUT_USER_INTERVAL 250
+#define INPUT_READAHEAD_DEFAULT 120000 ///< VoD read-ahead in ms while the read speed is still unknown
+#define INPUT_READAHEAD_MIN 30000      ///< Shortest VoD read-ahead in ms, no matter how fast reads are
+#define INPUT_READAHEAD_MAX 600000     ///< Longest VoD read-ahead in ms, no matter how slow reads are
+#define INPUT_PAGE_LOADERS 4           ///< Default number of VoD page loader threads
+#define FLV_TRACK_SCAN_TAGS 100        ///< Tags read to find the tracks of an FLV file for passthrough
+#define TS_TRACK_SCAN_PACKETS 5000     ///< Packets read to find the PMT of a TS file for passthrough
 
 #define SHM_STREAM_STATE "MstSTATE%s" //%s stream name
 #define SHM_STREAM_CONF "MstSCnf%s"   //%s stream name
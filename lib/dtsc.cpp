@@ -9,10 +9,16 @@
 #include "util.h"
 #include "stream.h"
 #include <arpa/inet.h> //for htonl/ntohl
+#include <cerrno>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <fcntl.h>
 #include <fstream>
 #include <iomanip>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace DTSC{
   char Magic_Header[] = "DTSC";
@@ -132,18 +138,26 @@ namespace DTSC{
     int sleepCount = 0;
     null();
     Util::ResizeablePointer ptr;
+    Socket::Buffer &buf = src.Received();
     while (src.connected()){
-      if (!ptr.rsize() && src.Received().available(8)){
-        if (src.Received().copy(2) != "DT"){
-          WARN_MSG("Invalid DTSC Packet header encountered (%s)",
-                   Encodings::Hex::encode(src.Received().copy(4)).c_str());
+      if (!ptr.rsize() && buf.available(8)){
+        const char *hdr = buf.peek(8);
+        if (hdr[0] != 'D' || hdr[1] != 'T'){
+          WARN_MSG("Invalid DTSC Packet header encountered (%s)", Encodings::Hex::encode(std::string(hdr, 4)).c_str());
           break;
         }
-        ptr.allocate(Bit::btohl(src.Received().copy(8).data() + 4) + 8);
+        uint32_t pktLen = Bit::btohl(hdr + 4) + 8;
+        // Packets that were received whole are copied straight out of the socket buffer
+        if (buf.available(pktLen)){
+          reInit(buf.peek(pktLen), pktLen);
+          buf.consume(pktLen);
+          return;
+        }
+        ptr.allocate(pktLen);
       }
-      unsigned int readable = src.Received().bytes(ptr.rsize() - ptr.size());
+      unsigned int readable = buf.bytes(ptr.rsize() - ptr.size());
       if (ptr.rsize() && readable){
-        src.Received().remove(ptr, readable);
+        buf.remove(ptr, readable);
         if (ptr.size() == ptr.rsize()){
           reInit(ptr, ptr.size());
           return;
@@ -997,8 +1011,8 @@ namespace DTSC{
       MEDIUM_MSG("No member \'unixzero\' found in DTSC::Scan. Calculating locally.");
       int64_t nowMs = 0;
       for (std::map<size_t, Track>::iterator it = tracks.begin(); it != tracks.end(); it++){
-        if (it->second.track.getInt(it->second.trackNowmsField) > nowMs){
-          nowMs = it->second.track.getInt(it->second.trackNowmsField);
+        if (it->second.track.get<uint64_t>(it->second.trackNowmsField) > nowMs){
+          nowMs = it->second.track.get<uint64_t>(it->second.trackNowmsField);
         }
       }
       setBootMsOffset(Util::bootMS() - nowMs);
@@ -1174,6 +1188,9 @@ namespace DTSC{
       stream.addField("bootmsoffset", RAX_64INT);
       stream.addField("utcoffset", RAX_64INT);
       stream.addField("minfragduration", RAX_64UINT);
+      stream.addField("pagesignal", RAX_64UINT);
+      stream.addField("pagewaiters", RAX_64UINT);
+      stream.addField("pageprefix", RAX_32STRING);
       stream.setRCount(1);
       stream.setReady();
       stream.addRecords(1);
@@ -1207,6 +1224,9 @@ namespace DTSC{
     streamBootMsOffsetField = stream.getFieldData("bootmsoffset");
     streamUTCOffsetField = stream.getFieldData("utcoffset");
     streamMinimumFragmentDurationField = stream.getFieldData("minfragduration");
+    streamPageSignalField = stream.getFieldData("pagesignal");
+    streamPageWaitersField = stream.getFieldData("pagewaiters");
+    streamPagePrefixField = stream.getFieldData("pageprefix");
 
     trackValidField = trackList.getFieldData("valid");
     trackIdField = trackList.getFieldData("id");
@@ -1555,24 +1575,24 @@ namespace DTSC{
     t.track.setInt(t.trackIdField, origAccess.getInt("id"));
     t.track.setString(t.trackTypeField, origAccess.getPointer("type"));
     t.track.setString(t.trackCodecField, origAccess.getPointer("codec"));
-    t.track.setInt(t.trackFirstmsField, origAccess.getInt("firstms"));
-    t.track.setInt(t.trackLastmsField, origAccess.getInt("lastms"));
+    t.track.set<uint64_t>(t.trackFirstmsField, origAccess.getInt("firstms"));
+    t.track.set<uint64_t>(t.trackLastmsField, origAccess.getInt("lastms"));
     if (origAccess.hasField("nowms")){
-      t.track.setInt(t.trackNowmsField, origAccess.getInt("nowms"));
+      t.track.set<uint64_t>(t.trackNowmsField, origAccess.getInt("nowms"));
     }else{
-      t.track.setInt(t.trackNowmsField, origAccess.getInt("lastms"));
+      t.track.set<uint64_t>(t.trackNowmsField, origAccess.getInt("lastms"));
     }
-    t.track.setInt(t.trackBpsField, origAccess.getInt("bps"));
-    t.track.setInt(t.trackMaxbpsField, origAccess.getInt("maxbps"));
+    t.track.set<uint32_t>(t.trackBpsField, origAccess.getInt("bps"));
+    t.track.set<uint32_t>(t.trackMaxbpsField, origAccess.getInt("maxbps"));
     t.track.setString(t.trackLangField, origAccess.getPointer("lang"));
     memcpy(t.track.getPointer(t.trackInitField), origAccess.getPointer("init"), 1024 * 1024);
-    t.track.setInt(t.trackRateField, origAccess.getInt("rate"));
-    t.track.setInt(t.trackSizeField, origAccess.getInt("size"));
-    t.track.setInt(t.trackChannelsField, origAccess.getInt("channels"));
-    t.track.setInt(t.trackWidthField, origAccess.getInt("width"));
-    t.track.setInt(t.trackHeightField, origAccess.getInt("height"));
-    t.track.setInt(t.trackFpksField, origAccess.getInt("fpks"));
-    t.track.setInt(t.trackMissedFragsField, origAccess.getInt("missedFrags"));
+    t.track.set<uint16_t>(t.trackRateField, origAccess.getInt("rate"));
+    t.track.set<uint16_t>(t.trackSizeField, origAccess.getInt("size"));
+    t.track.set<uint16_t>(t.trackChannelsField, origAccess.getInt("channels"));
+    t.track.set<uint32_t>(t.trackWidthField, origAccess.getInt("width"));
+    t.track.set<uint32_t>(t.trackHeightField, origAccess.getInt("height"));
+    t.track.set<uint16_t>(t.trackFpksField, origAccess.getInt("fpks"));
+    t.track.set<uint32_t>(t.trackMissedFragsField, origAccess.getInt("missedFrags"));
 
     t.parts.setEndPos(origParts.getEndPos());
     t.parts.setStartPos(origParts.getStartPos());
@@ -1694,6 +1714,15 @@ namespace DTSC{
     return addTrack(fragCount, keyCount, partCount, pageCount, false);
   }
 
+  /// Returns the size of the memory structure for a track with the given record counts
+  static size_t trackPageSize(size_t fragCount, size_t keyCount, size_t partCount, size_t pageCount){
+    return TRACK_TRACK_OFFSET + TRACK_TRACK_RECORDSIZE +
+           (TRACK_FRAGMENT_OFFSET + (TRACK_FRAGMENT_RECORDSIZE * fragCount)) +
+           (TRACK_KEY_OFFSET + (TRACK_KEY_RECORDSIZE * keyCount)) +
+           (TRACK_PART_OFFSET + (TRACK_PART_RECORDSIZE * partCount)) +
+           (TRACK_PAGE_OFFSET + (TRACK_PAGE_RECORDSIZE * pageCount));
+  }
+
   /// Adds a track to the metadata structure.
   /// To be called from the various inputs/outputs whenever they want to add a track.
   size_t Meta::addTrack(size_t fragCount, size_t keyCount, size_t partCount, size_t pageCount, bool setValid){
@@ -1714,11 +1743,7 @@ namespace DTSC{
       }
     }
 
-    size_t pageSize = TRACK_TRACK_OFFSET + TRACK_TRACK_RECORDSIZE +
-                      (TRACK_FRAGMENT_OFFSET + (TRACK_FRAGMENT_RECORDSIZE * fragCount)) +
-                      (TRACK_KEY_OFFSET + (TRACK_KEY_RECORDSIZE * keyCount)) +
-                      (TRACK_PART_OFFSET + (TRACK_PART_RECORDSIZE * partCount)) +
-                      (TRACK_PAGE_OFFSET + (TRACK_PAGE_RECORDSIZE * pageCount));
+    size_t pageSize = trackPageSize(fragCount, keyCount, partCount, pageCount);
 
     size_t tNumber = trackList.getPresent();
 
@@ -1902,6 +1927,27 @@ namespace DTSC{
   void Meta::setSource(const std::string &src){stream.setString(streamSourceField, src);}
   std::string Meta::getSource() const{return stream.getPointer(streamSourceField);}
 
+  /// Sets the name data pages are stored under instead of the stream name, so that streams backed
+  /// by the same content can share their pages. An empty prefix means the stream name is used.
+  void Meta::setPagePrefix(const std::string &prefix){
+    if (!streamPagePrefixField){return;}
+    stream.setString(streamPagePrefixField, prefix);
+  }
+
+  std::string Meta::getPagePrefix() const{
+    if (!streamPagePrefixField || !stream.isReady()){return "";}
+    return stream.getPointer(streamPagePrefixField);
+  }
+
+  /// Returns the shared memory name of the given data page of the given track.
+  std::string Meta::getDataPageName(size_t trackIdx, uint32_t pageNumber) const{
+    std::string prefix = getPagePrefix();
+    char pageName[NAME_BUFFER_SIZE];
+    snprintf(pageName, NAME_BUFFER_SIZE, SHM_TRACK_DATA, (prefix.size() ? prefix : streamName).c_str(), trackIdx,
+             pageNumber);
+    return pageName;
+  }
+
   void Meta::setID(size_t trackIdx, size_t id){
     trackList.setInt(trackIdField, id, trackIdx);
     DTSC::Track &t = tracks.at(trackIdx);
@@ -1934,47 +1980,47 @@ namespace DTSC{
 
   void Meta::setChannels(size_t trackIdx, uint16_t channels){
     DTSC::Track &t = tracks.at(trackIdx);
-    t.track.setInt(t.trackChannelsField, channels);
+    t.track.set<uint16_t>(t.trackChannelsField, channels);
   }
   uint16_t Meta::getChannels(size_t trackIdx) const{
     const DTSC::Track &t = tracks.at(trackIdx);
-    return t.track.getInt(t.trackChannelsField);
+    return t.track.get<uint16_t>(t.trackChannelsField);
   }
 
   void Meta::setWidth(size_t trackIdx, uint32_t width){
     DTSC::Track &t = tracks.at(trackIdx);
-    t.track.setInt(t.trackWidthField, width);
+    t.track.set<uint32_t>(t.trackWidthField, width);
   }
   uint32_t Meta::getWidth(size_t trackIdx) const{
     const DTSC::Track &t = tracks.at(trackIdx);
-    return t.track.getInt(t.trackWidthField);
+    return t.track.get<uint32_t>(t.trackWidthField);
   }
 
   void Meta::setHeight(size_t trackIdx, uint32_t height){
     DTSC::Track &t = tracks.at(trackIdx);
-    t.track.setInt(t.trackHeightField, height);
+    t.track.set<uint32_t>(t.trackHeightField, height);
   }
   uint32_t Meta::getHeight(size_t trackIdx) const{
     const DTSC::Track &t = tracks.at(trackIdx);
-    return t.track.getInt(t.trackHeightField);
+    return t.track.get<uint32_t>(t.trackHeightField);
   }
 
   void Meta::setRate(size_t trackIdx, uint32_t rate){
     DTSC::Track &t = tracks.at(trackIdx);
-    t.track.setInt(t.trackRateField, rate);
+    t.track.set<uint16_t>(t.trackRateField, rate);
   }
   uint32_t Meta::getRate(size_t trackIdx) const{
     const DTSC::Track &t = tracks.at(trackIdx);
-    return t.track.getInt(t.trackRateField);
+    return t.track.get<uint16_t>(t.trackRateField);
   }
 
   void Meta::setSize(size_t trackIdx, uint16_t size){
     DTSC::Track &t = tracks.at(trackIdx);
-    t.track.setInt(t.trackSizeField, size);
+    t.track.set<uint16_t>(t.trackSizeField, size);
   }
   uint16_t Meta::getSize(size_t trackIdx) const{
     const DTSC::Track &t = tracks.at(trackIdx);
-    return t.track.getInt(t.trackSizeField);
+    return t.track.get<uint16_t>(t.trackSizeField);
   }
 
   void Meta::setType(size_t trackIdx, const std::string &type){
@@ -2007,76 +2053,76 @@ namespace DTSC{
 
   void Meta::setFirstms(size_t trackIdx, uint64_t firstms){
     DTSC::Track &t = tracks.at(trackIdx);
-    t.track.setInt(t.trackFirstmsField, firstms);
+    t.track.set<uint64_t>(t.trackFirstmsField, firstms);
   }
   uint64_t Meta::getFirstms(size_t trackIdx) const{
     const DTSC::Track &t = tracks.at(trackIdx);
-    if (isLimited && limitMin > t.track.getInt(t.trackFirstmsField)){return limitMin;}
-    return t.track.getInt(t.trackFirstmsField);
+    if (isLimited && limitMin > t.track.get<uint64_t>(t.trackFirstmsField)){return limitMin;}
+    return t.track.get<uint64_t>(t.trackFirstmsField);
   }
 
   void Meta::setLastms(size_t trackIdx, uint64_t lastms){
     DTSC::Track &t = tracks.at(trackIdx);
-    t.track.setInt(t.trackLastmsField, lastms);
-    if (t.trackNowmsField && t.track.getInt(t.trackNowmsField) < lastms){
-      t.track.setInt(t.trackNowmsField, lastms);
+    t.track.set<uint64_t>(t.trackLastmsField, lastms);
+    if (t.trackNowmsField && t.track.get<uint64_t>(t.trackNowmsField) < lastms){
+      t.track.set<uint64_t>(t.trackNowmsField, lastms);
     }
   }
   uint64_t Meta::getLastms(size_t trackIdx) const{
     const DTSC::Track &t = tracks.find(trackIdx)->second;
-    if (isLimited && limitMax < t.track.getInt(t.trackLastmsField)){return limitMax;}
-    return t.track.getInt(t.trackLastmsField);
+    if (isLimited && limitMax < t.track.get<uint64_t>(t.trackLastmsField)){return limitMax;}
+    return t.track.get<uint64_t>(t.trackLastmsField);
   }
 
   void Meta::setNowms(size_t trackIdx, uint64_t nowms){
     DTSC::Track &t = tracks.at(trackIdx);
-    t.track.setInt(t.trackNowmsField, nowms);
+    t.track.set<uint64_t>(t.trackNowmsField, nowms);
   }
   uint64_t Meta::getNowms(size_t trackIdx) const{
     const DTSC::Track &t = tracks.find(trackIdx)->second;
-    return t.track.getInt(t.trackNowmsField);
+    return t.track.get<uint64_t>(t.trackNowmsField);
   }
 
   uint64_t Meta::getDuration(size_t trackIdx) const{
     if (isLimited){return getLastms(trackIdx) - getFirstms(trackIdx);}
     const DTSC::Track &t = tracks.at(trackIdx);
-    return t.track.getInt(t.trackLastmsField) - t.track.getInt(t.trackFirstmsField);
+    return t.track.get<uint64_t>(t.trackLastmsField) - t.track.get<uint64_t>(t.trackFirstmsField);
   }
 
   void Meta::setBps(size_t trackIdx, uint64_t bps){
     DTSC::Track &t = tracks.at(trackIdx);
-    t.track.setInt(t.trackBpsField, bps);
+    t.track.set<uint32_t>(t.trackBpsField, bps);
   }
   uint64_t Meta::getBps(size_t trackIdx) const{
     const DTSC::Track &t = tracks.at(trackIdx);
-    return t.track.getInt(t.trackBpsField);
+    return t.track.get<uint32_t>(t.trackBpsField);
   }
 
   void Meta::setMaxBps(size_t trackIdx, uint64_t bps){
     DTSC::Track &t = tracks.at(trackIdx);
-    t.track.setInt(t.trackMaxbpsField, bps);
+    t.track.set<uint32_t>(t.trackMaxbpsField, bps);
   }
   uint64_t Meta::getMaxBps(size_t trackIdx) const{
     const DTSC::Track &t = tracks.at(trackIdx);
-    return t.track.getInt(t.trackMaxbpsField);
+    return t.track.get<uint32_t>(t.trackMaxbpsField);
   }
 
   void Meta::setFpks(size_t trackIdx, uint64_t bps){
     DTSC::Track &t = tracks.at(trackIdx);
-    t.track.setInt(t.trackFpksField, bps);
+    t.track.set<uint16_t>(t.trackFpksField, bps);
   }
   uint64_t Meta::getFpks(size_t trackIdx) const{
     const DTSC::Track &t = tracks.at(trackIdx);
-    return t.track.getInt(t.trackFpksField);
+    return t.track.get<uint16_t>(t.trackFpksField);
   }
 
   void Meta::setMissedFragments(size_t trackIdx, uint32_t bps){
     DTSC::Track &t = tracks.at(trackIdx);
-    t.track.setInt(t.trackMissedFragsField, bps);
+    t.track.set<uint32_t>(t.trackMissedFragsField, bps);
   }
   uint32_t Meta::getMissedFragments(size_t trackIdx) const{
     const DTSC::Track &t = tracks.at(trackIdx);
-    return t.track.getInt(t.trackMissedFragsField);
+    return t.track.get<uint32_t>(t.trackMissedFragsField);
   }
 
   void Meta::setMinKeepAway(size_t trackIdx, uint64_t minKeepAway){
@@ -2192,6 +2238,39 @@ namespace DTSC{
   }
   /*LTS-END*/
 
+  /// Returns a 4-byte aligned word inside the given field of the stream record, or null if the
+  /// metadata has no such field. The signal fields are 8 bytes wide, so they always contain a 4-byte
+  /// aligned word regardless of where the record happens to start.
+  volatile uint32_t *Meta::streamWord(const Util::RelAccXFieldData &fd) const{
+    if (!fd || !stream.isReady()){return 0;}
+    char *ptr = stream.getPointer(fd);
+    return (volatile uint32_t *)(ptr + ((4 - ((uintptr_t)ptr & 3)) & 3));
+  }
+
+  /// Returns the current value of the page signal counter, for use with waitPageSignal.
+  uint32_t Meta::getPageSignal() const{
+    volatile uint32_t *word = streamWord(streamPageSignalField);
+    return word ? *word : 0;
+  }
+
+  /// Signals all processes waiting in waitPageSignal that a data page or key became available.
+  /// Skips the wakeup system call if no process is waiting.
+  void Meta::signalPageReady(){
+    volatile uint32_t *word = streamWord(streamPageSignalField);
+    if (word){IPC::wordWake(word, streamWord(streamPageWaitersField));}
+  }
+
+  /// Waits for at most millis milliseconds for a signalPageReady call, if one has not already
+  /// happened since getPageSignal returned lastSignal. Returns true if signalled.
+  bool Meta::waitPageSignal(uint32_t lastSignal, uint64_t millis) const{
+    volatile uint32_t *word = streamWord(streamPageSignalField);
+    if (!word){
+      Util::sleep(millis);
+      return false;
+    }
+    return IPC::wordWait(word, lastSignal, millis, streamWord(streamPageWaitersField));
+  }
+
   std::set<size_t> Meta::getValidTracks(bool skipEmpty) const{
     std::set<size_t> res;
     if (!(*this) && !isMemBuf){
@@ -2245,12 +2324,11 @@ namespace DTSC{
   void Meta::removeTrack(size_t trackIdx){
     if (!getValidTracks().count(trackIdx)){return;}
     Track &t = tracks[trackIdx];
+    // Pages under a page prefix may be in use by other streams; the inputs holding them remove them
+    bool sharedPages = getPagePrefix().size();
     for (uint64_t i = t.pages.getDeleted(); i < t.pages.getEndPos(); i++){
-      if (t.pages.getInt("avail", i) == 0){continue;}
-      char thisPageName[NAME_BUFFER_SIZE];
-      snprintf(thisPageName, NAME_BUFFER_SIZE, SHM_TRACK_DATA, streamName.c_str(), trackIdx,
-               (uint32_t)t.pages.getInt("firstkey", i));
-      IPC::sharedPage p(thisPageName, 20971520);
+      if (sharedPages || t.pages.getInt("avail", i) == 0){continue;}
+      IPC::sharedPage p(getDataPageName(trackIdx, t.pages.getInt("firstkey", i)), 20971520);
       p.master = true;
     }
     tM[trackIdx].master = true;
@@ -2279,19 +2357,19 @@ namespace DTSC{
       }
     }
     Track &t = tracks[trackIdx];
-    uint64_t deletedPartCount = t.keys.getInt(t.keyPartsField, t.keys.getDeleted());
+    uint64_t deletedPartCount = t.keys.get<uint32_t>(t.keyPartsField, t.keys.getDeleted());
     DONTEVEN_MSG("Deleting parts: %" PRIu64 "->%" PRIu64 " del'd, %zu pres", t.parts.getDeleted(), t.parts.getDeleted()+deletedPartCount, t.parts.getPresent());
     t.parts.deleteRecords(deletedPartCount);
     uint64_t deletedKeyNum = t.keys.getDeleted();
     DONTEVEN_MSG("Deleting key: %" PRIu64 "->%" PRIu64 " del'd, %zu pres", deletedKeyNum, deletedKeyNum+1, t.keys.getPresent());
     t.keys.deleteRecords(1);
-    if (t.fragments.getInt(t.fragmentFirstKeyField, t.fragments.getDeleted()) < t.keys.getDeleted()){
+    if (t.fragments.get<uint32_t>(t.fragmentFirstKeyField, t.fragments.getDeleted()) < t.keys.getDeleted()){
       t.fragments.deleteRecords(1);
       setMissedFragments(trackIdx, getMissedFragments(trackIdx) + 1);
     }
     // Note: pages are not deleted here, but instead deleted by Input::removeUnused (or a child-override)
     // This is fine, as pages can (and will, at least temporarily) exist for data we no longer fully have in stream metadata
-    setFirstms(trackIdx, t.keys.getInt(t.keyTimeField, t.keys.getDeleted()));
+    setFirstms(trackIdx, t.keys.get<uint64_t>(t.keyTimeField, t.keys.getDeleted()));
 
     // Update page info
     Util::RelAccX &tPages = pages(trackIdx);
@@ -2302,9 +2380,7 @@ namespace DTSC{
     if (firstKey + keyCount <= deletedKeyNum + 1){
       if (tPages.getInt("avail", firstPage)){
         // Open the correct page
-        char pageId[NAME_BUFFER_SIZE];
-        snprintf(pageId, NAME_BUFFER_SIZE, SHM_TRACK_DATA, streamName.c_str(), trackIdx, firstKey);
-        std::string pageName(pageId);
+        std::string pageName = getDataPageName(trackIdx, firstKey);
         IPC::sharedPage toErase;
         toErase.init(pageName, 0, false, false);
         // Set the master flag so that the page will be destroyed once it leaves scope
@@ -2456,13 +2532,13 @@ namespace DTSC{
     if ((newPartNum - t.parts.getDeleted()) >= t.parts.getRCount()){
       resizeTrack(tNumber, t.fragments.getRCount(), t.keys.getRCount(), t.parts.getRCount() * 2, t.pages.getRCount(), "not enough parts");
     }
-    t.parts.setInt(t.partSizeField, packDataSize, newPartNum);
-    t.parts.setInt(t.partOffsetField, packOffset, newPartNum);
+    t.parts.set<uint32_t>(t.partSizeField, packDataSize, newPartNum);
+    t.parts.set<int16_t>(t.partOffsetField, packOffset, newPartNum);
     if (newPartNum){
-      t.parts.setInt(t.partDurationField, packTime - getLastms(tNumber), newPartNum - 1);
-      t.parts.setInt(t.partDurationField, packTime - getLastms(tNumber), newPartNum);
+      t.parts.set<uint16_t>(t.partDurationField, packTime - getLastms(tNumber), newPartNum - 1);
+      t.parts.set<uint16_t>(t.partDurationField, packTime - getLastms(tNumber), newPartNum);
     }else{
-      t.parts.setInt(t.partDurationField, 0, newPartNum);
+      t.parts.set<uint16_t>(t.partDurationField, 0, newPartNum);
       setFirstms(tNumber, packTime);
     }
     t.parts.addRecords(1);
@@ -2470,41 +2546,41 @@ namespace DTSC{
     uint64_t newKeyNum = t.keys.getEndPos();
     if (isKeyframe || newKeyNum == 0 ||
         (getType(tNumber) != "video" && packTime >= AUDIO_KEY_INTERVAL &&
-         packTime - t.keys.getInt(t.keyTimeField, newKeyNum - 1) >= AUDIO_KEY_INTERVAL)){
+         packTime - t.keys.get<uint64_t>(t.keyTimeField, newKeyNum - 1) >= AUDIO_KEY_INTERVAL)){
       if ((newKeyNum - t.keys.getDeleted()) >= t.keys.getRCount()){
         resizeTrack(tNumber, t.fragments.getRCount(), t.keys.getRCount() * 2, t.parts.getRCount(), t.pages.getRCount(), "not enough keys");
       }
-      t.keys.setInt(t.keyBposField, packBytePos, newKeyNum);
-      t.keys.setInt(t.keyTimeField, packTime, newKeyNum);
-      t.keys.setInt(t.keyPartsField, 0, newKeyNum);
-      t.keys.setInt(t.keyDurationField, 0, newKeyNum);
-      t.keys.setInt(t.keySizeField, 0, newKeyNum);
-      t.keys.setInt(t.keyNumberField, newKeyNum, newKeyNum);
+      t.keys.set<uint64_t>(t.keyBposField, packBytePos, newKeyNum);
+      t.keys.set<uint64_t>(t.keyTimeField, packTime, newKeyNum);
+      t.keys.set<uint32_t>(t.keyPartsField, 0, newKeyNum);
+      t.keys.set<uint32_t>(t.keyDurationField, 0, newKeyNum);
+      t.keys.set<uint32_t>(t.keySizeField, 0, newKeyNum);
+      t.keys.set<uint32_t>(t.keyNumberField, newKeyNum, newKeyNum);
       if (newKeyNum){
-        t.keys.setInt(t.keyFirstPartField,
-                      t.keys.getInt(t.keyFirstPartField, newKeyNum - 1) +
-                          t.keys.getInt(t.keyPartsField, newKeyNum - 1),
+        t.keys.set<uint64_t>(t.keyFirstPartField,
+                      t.keys.get<uint64_t>(t.keyFirstPartField, newKeyNum - 1) +
+                          t.keys.get<uint32_t>(t.keyPartsField, newKeyNum - 1),
                       newKeyNum);
         // Update duration of previous key too
-        t.keys.setInt(t.keyDurationField, packTime - t.keys.getInt(t.keyTimeField, newKeyNum - 1),
+        t.keys.set<uint32_t>(t.keyDurationField, packTime - t.keys.get<uint64_t>(t.keyTimeField, newKeyNum - 1),
                       newKeyNum - 1);
       }else{
-        t.keys.setInt(t.keyFirstPartField, 0, newKeyNum);
+        t.keys.set<uint64_t>(t.keyFirstPartField, 0, newKeyNum);
       }
       t.keys.addRecords(1);
-      t.track.setInt(t.trackFirstmsField, t.keys.getInt(t.keyTimeField, t.keys.getDeleted()));
+      t.track.set<uint64_t>(t.trackFirstmsField, t.keys.get<uint64_t>(t.keyTimeField, t.keys.getDeleted()));
 
       uint64_t newFragNum = t.fragments.getEndPos();
       if (newFragNum == 0 ||
           (packTime >= getMinimumFragmentDuration() &&
            (packTime - getMinimumFragmentDuration()) >=
-               t.keys.getInt(t.keyTimeField, t.fragments.getInt(t.fragmentFirstKeyField, newFragNum - 1)))){
+               t.keys.get<uint64_t>(t.keyTimeField, t.fragments.get<uint32_t>(t.fragmentFirstKeyField, newFragNum - 1)))){
         if ((newFragNum - t.fragments.getDeleted()) >= t.fragments.getRCount()){
           resizeTrack(tNumber, t.fragments.getRCount() * 2, t.keys.getRCount(), t.parts.getRCount(), t.pages.getRCount(), "not enough frags");
         }
         if (newFragNum){
-          t.fragments.setInt(t.fragmentDurationField,
-                             packTime - t.keys.getInt(t.keyTimeField, t.fragments.getInt(t.fragmentFirstKeyField,
+          t.fragments.set<uint32_t>(t.fragmentDurationField,
+                             packTime - t.keys.get<uint64_t>(t.keyTimeField, t.fragments.get<uint32_t>(t.fragmentFirstKeyField,
                                                                                          newFragNum - 1)),
                              newFragNum - 1);
 
@@ -2512,41 +2588,41 @@ namespace DTSC{
           uint64_t totalDuration = 0;
 
           for (size_t fragIdx = t.fragments.getStartPos(); fragIdx < newFragNum; fragIdx++){
-            totalBytes += t.fragments.getInt(t.fragmentSizeField, fragIdx);
-            totalDuration += t.fragments.getInt(t.fragmentDurationField, fragIdx);
+            totalBytes += t.fragments.get<uint32_t>(t.fragmentSizeField, fragIdx);
+            totalDuration += t.fragments.get<uint32_t>(t.fragmentDurationField, fragIdx);
           }
           setBps(tNumber, (totalDuration ? (totalBytes * 1000) / totalDuration : 0));
 
           setMaxBps(tNumber, std::max(getMaxBps(tNumber),
-                                      (t.fragments.getInt(t.fragmentSizeField, newFragNum - 1) * 1000) /
-                                          t.fragments.getInt(t.fragmentDurationField, newFragNum - 1)));
+                                      ((uint64_t)t.fragments.get<uint32_t>(t.fragmentSizeField, newFragNum - 1) * 1000) /
+                                          t.fragments.get<uint32_t>(t.fragmentDurationField, newFragNum - 1)));
         }
-        t.fragments.setInt(t.fragmentFirstKeyField, newKeyNum, newFragNum);
-        t.fragments.setInt(t.fragmentDurationField, 0, newFragNum);
-        t.fragments.setInt(t.fragmentSizeField, 0, newFragNum);
-        t.fragments.setInt(t.fragmentKeysField, 1, newFragNum);
-        t.fragments.setInt(t.fragmentFirstKeyField, t.keys.getInt(t.keyNumberField, newKeyNum), newFragNum);
+        t.fragments.set<uint32_t>(t.fragmentFirstKeyField, newKeyNum, newFragNum);
+        t.fragments.set<uint32_t>(t.fragmentDurationField, 0, newFragNum);
+        t.fragments.set<uint32_t>(t.fragmentSizeField, 0, newFragNum);
+        t.fragments.set<uint16_t>(t.fragmentKeysField, 1, newFragNum);
+        t.fragments.set<uint32_t>(t.fragmentFirstKeyField, t.keys.get<uint32_t>(t.keyNumberField, newKeyNum), newFragNum);
         t.fragments.addRecords(1);
       }else{
-        t.fragments.setInt(t.fragmentKeysField,
-                           t.fragments.getInt(t.fragmentKeysField, newFragNum - 1) + 1, newFragNum - 1);
+        t.fragments.set<uint16_t>(t.fragmentKeysField,
+                           t.fragments.get<uint16_t>(t.fragmentKeysField, newFragNum - 1) + 1, newFragNum - 1);
       }
     }else{
       uint64_t lastKeyNum = t.keys.getEndPos() - 1;
-      t.keys.setInt(t.keyDurationField,
-                    t.keys.getInt(t.keyDurationField, lastKeyNum) +
-                        t.parts.getInt(t.partDurationField, newPartNum - 1),
+      t.keys.set<uint32_t>(t.keyDurationField,
+                    t.keys.get<uint32_t>(t.keyDurationField, lastKeyNum) +
+                        t.parts.get<uint16_t>(t.partDurationField, newPartNum - 1),
                     lastKeyNum);
     }
 
     uint64_t lastKeyNum = t.keys.getEndPos() - 1;
-    t.keys.setInt(t.keyPartsField, t.keys.getInt(t.keyPartsField, lastKeyNum) + 1, lastKeyNum);
-    t.keys.setInt(t.keySizeField, t.keys.getInt(t.keySizeField, lastKeyNum) + packSendSize, lastKeyNum);
+    t.keys.set<uint32_t>(t.keyPartsField, t.keys.get<uint32_t>(t.keyPartsField, lastKeyNum) + 1, lastKeyNum);
+    t.keys.set<uint32_t>(t.keySizeField, t.keys.get<uint32_t>(t.keySizeField, lastKeyNum) + packSendSize, lastKeyNum);
     uint64_t lastFragNum = t.fragments.getEndPos() - 1;
-    t.fragments.setInt(t.fragmentSizeField,
-                       t.fragments.getInt(t.fragmentSizeField, lastFragNum) + packDataSize, lastFragNum);
-    t.track.setInt(t.trackLastmsField, packTime);
-    t.track.setInt(t.trackNowmsField, packTime);
+    t.fragments.set<uint32_t>(t.fragmentSizeField,
+                       t.fragments.get<uint32_t>(t.fragmentSizeField, lastFragNum) + packDataSize, lastFragNum);
+    t.track.set<uint64_t>(t.trackLastmsField, packTime);
+    t.track.set<uint64_t>(t.trackNowmsField, packTime);
     markUpdated(tNumber);
   }
 
@@ -2852,6 +2928,229 @@ namespace DTSC{
     }
   }
 
+  /// Header of a DTSM memory image file. All values are in host byte order: images are a local
+  /// cache, and are simply regenerated from the DTSH if they do not match.
+  struct imageHeader{
+    char magic[4];      ///< "DTSM"
+    uint32_t version;   ///< DTSM_VERSION
+    uint32_t byteOrder; ///< 0x01020304 in host order
+    uint32_t dtshVersion;
+    uint32_t trackCount;
+    uint32_t flags;     ///< 1 = vod, 2 = live
+    int64_t utcOffset;
+    uint64_t localVarsLen;
+  };
+
+  /// Header of every track in a DTSM memory image file, followed by extentCount extents.
+  /// Each extent is a 64-bit offset and length, followed by that many bytes of the track structure;
+  /// everything not covered by an extent is zero.
+  struct imageTrack{
+    uint32_t fragCount;
+    uint32_t keyCount;
+    uint32_t partCount;
+    uint32_t pageCount;
+    uint64_t pageSize;
+    uint64_t extentCount;
+  };
+
+  /// Runs of zero bytes at least this long are left out of DTSM memory images
+  #define DTSM_ZERO_RUN 4096
+
+  /// Returns the memory structure of the given track
+  char *Meta::trackPage(size_t trackIdx) const{
+    if (isMemBuf){return tMemBuf.count(trackIdx) ? tMemBuf.at(trackIdx) : 0;}
+    return tM.count(trackIdx) ? tM.at(trackIdx).mapped : 0;
+  }
+
+  /// Returns the record counts, record sizes and field definitions of all RelAccX structures of a
+  /// track. Two tracks with equal layouts can be copied into each other byte for byte.
+  std::string Meta::trackLayout(size_t trackIdx) const{
+    const Track &t = tracks.at(trackIdx);
+    const char *bases[5] ={trackPage(trackIdx), t.track.getPointer("parts"), t.track.getPointer("keys"),
+                            t.track.getPointer("fragments"), t.track.getPointer("pages")};
+    std::string res;
+    for (size_t i = 0; i < 5; ++i){
+      if (!bases[i]){return "";}
+      Util::RelAccX r((char *)bases[i], false);
+      res.append(bases[i] + 2, 8); // record count and size
+      res.append(bases[i] + (uint8_t)bases[i][1], r.getOffset() - (uint8_t)bases[i][1]);
+    }
+    return res;
+  }
+
+  /// Writes the metadata as a DTSM memory image, which reInitFromImage can load with little more
+  /// than a memcpy per track. Returns true on success.
+  bool Meta::toImage(const std::string &fileName) const{
+    std::string tmpName = fileName + ".tmp";
+    FILE *outFile = fopen(tmpName.c_str(), "wb");
+    if (!outFile){
+      WARN_MSG("Could not write memory image %s: %s", tmpName.c_str(), strerror(errno));
+      return false;
+    }
+    std::set<size_t> validTracks = getValidTracks();
+    std::string lVars = inputLocalVars.size() ? inputLocalVars.toString() : "";
+    imageHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, "DTSM", 4);
+    hdr.version = DTSM_VERSION;
+    hdr.byteOrder = 0x01020304;
+    hdr.dtshVersion = DTSH_VERSION;
+    hdr.trackCount = validTracks.size();
+    hdr.flags = (getVod() ? 1 : 0) | (getLive() ? 2 : 0);
+    hdr.utcOffset = getUTCOffset();
+    hdr.localVarsLen = lVars.size();
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, outFile) == 1;
+    if (ok && lVars.size()){ok = fwrite(lVars.data(), lVars.size(), 1, outFile) == 1;}
+    for (std::set<size_t>::iterator it = validTracks.begin(); ok && it != validTracks.end(); ++it){
+      const Track &t = tracks.at(*it);
+      imageTrack trk;
+      trk.fragCount = t.fragments.getRCount();
+      trk.keyCount = t.keys.getRCount();
+      trk.partCount = t.parts.getRCount();
+      trk.pageCount = t.pages.getRCount();
+      trk.pageSize = trackPageSize(trk.fragCount, trk.keyCount, trk.partCount, trk.pageCount);
+      // Collect the non-zero extents of the track structure
+      const char *base = trackPage(*it);
+      std::deque<std::pair<uint64_t, uint64_t> > extents;
+      uint64_t pos = 0;
+      while (pos < trk.pageSize){
+        while (pos < trk.pageSize && !base[pos]){++pos;}
+        if (pos >= trk.pageSize){break;}
+        uint64_t start = pos, zeroes = 0;
+        while (pos < trk.pageSize && zeroes < DTSM_ZERO_RUN){
+          zeroes = base[pos] ? 0 : zeroes + 1;
+          ++pos;
+        }
+        extents.push_back(std::pair<uint64_t, uint64_t>(start, pos - start - zeroes));
+      }
+      trk.extentCount = extents.size();
+      ok = fwrite(&trk, sizeof(trk), 1, outFile) == 1;
+      for (size_t i = 0; ok && i < extents.size(); ++i){
+        ok = fwrite(&(extents[i].first), 8, 1, outFile) == 1 && fwrite(&(extents[i].second), 8, 1, outFile) == 1 &&
+             fwrite(base + extents[i].first, extents[i].second, 1, outFile) == 1;
+      }
+    }
+    if (fclose(outFile)){ok = false;}
+    if (!ok || rename(tmpName.c_str(), fileName.c_str())){
+      WARN_MSG("Could not write memory image %s: %s", fileName.c_str(), strerror(errno));
+      unlink(tmpName.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  /// Calls clear(), then initializes from the given DTSM memory image file in master mode.
+  /// Returns false (leaving the object cleared) if the file does not exist or does not match the
+  /// structures of this build, in which case the DTSH header should be used instead.
+  /// If stream name is set, uses shared memory backing.
+  /// If stream name is empty, uses non-shared memory backing.
+  bool Meta::reInitFromImage(const std::string &_streamName, const std::string &fileName){
+    clear();
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd == -1){return false;}
+    struct stat st;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(imageHeader)){
+      close(fd);
+      return false;
+    }
+    size_t len = st.st_size;
+    char *img = (char *)mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (img == MAP_FAILED){return false;}
+    imageHeader hdr;
+    memcpy(&hdr, img, sizeof(hdr));
+    if (memcmp(hdr.magic, "DTSM", 4) || hdr.version != DTSM_VERSION || hdr.byteOrder != 0x01020304 ||
+        hdr.dtshVersion != DTSH_VERSION || sizeof(hdr) + hdr.localVarsLen > len){
+      INFO_MSG("Memory image %s is outdated, ignoring it", fileName.c_str());
+      munmap(img, len);
+      return false;
+    }
+
+    if (_streamName == ""){
+      sBufMem();
+    }else{
+      sBufShm(_streamName, DEFAULT_TRACK_COUNT, true);
+    }
+    streamInit();
+    setVod(hdr.flags & 1);
+    setLive(hdr.flags & 2);
+    version = DTSH_VERSION;
+    size_t pos = sizeof(hdr);
+    if (hdr.localVarsLen){inputLocalVars = JSON::fromString(img + pos, hdr.localVarsLen);}
+    pos += hdr.localVarsLen;
+
+    bool ok = true;
+    for (uint32_t i = 0; ok && i < hdr.trackCount; ++i){
+      if (pos + sizeof(imageTrack) > len){
+        ok = false;
+        break;
+      }
+      imageTrack trk;
+      memcpy(&trk, img + pos, sizeof(trk));
+      pos += sizeof(trk);
+      if (trk.pageSize != trackPageSize(trk.fragCount, trk.keyCount, trk.partCount, trk.pageCount)){
+        ok = false;
+        break;
+      }
+      size_t tIdx = addTrack(trk.fragCount, trk.keyCount, trk.partCount, trk.pageCount);
+      char *base = trackPage(tIdx);
+      if (tIdx == INVALID_TRACK_ID || !base){
+        ok = false;
+        break;
+      }
+      std::string layout = trackLayout(tIdx);
+      memset(base, 0, trk.pageSize);
+      for (uint64_t e = 0; e < trk.extentCount; ++e){
+        if (pos + 16 > len){
+          ok = false;
+          break;
+        }
+        uint64_t extOffset, extLen;
+        memcpy(&extOffset, img + pos, 8);
+        memcpy(&extLen, img + pos + 8, 8);
+        pos += 16;
+        if (pos + extLen > len || extOffset + extLen > trk.pageSize){
+          ok = false;
+          break;
+        }
+        memcpy(base + extOffset, img + pos, extLen);
+        pos += extLen;
+      }
+      if (!ok || trackLayout(tIdx) != layout){
+        INFO_MSG("Memory image %s does not match the current metadata layout, ignoring it", fileName.c_str());
+        ok = false;
+        break;
+      }
+      // Copy the track list values from the track itself, and mark all data pages as not loaded
+      Track &t = tracks[tIdx];
+      setID(tIdx, t.track.getInt(t.trackIdField));
+      setType(tIdx, t.track.getPointer(t.trackTypeField));
+      setCodec(tIdx, t.track.getPointer(t.trackCodecField));
+      Util::RelAccXFieldData availField = t.pages.getFieldData("avail");
+      for (uint64_t j = t.pages.getDeleted(); j < t.pages.getEndPos(); ++j){t.pages.setInt(availField, 0, j);}
+    }
+    munmap(img, len);
+    if (!ok){
+      clear();
+      return false;
+    }
+
+    // Unix Time at zero point of a stream, same as when loading from DTSH
+    if (hdr.utcOffset){
+      setBootMsOffset(hdr.utcOffset - Util::unixMS() + Util::bootMS());
+      setUTCOffset(hdr.utcOffset);
+    }else{
+      int64_t nowMs = 0;
+      for (std::map<size_t, Track>::iterator it = tracks.begin(); it != tracks.end(); it++){
+        if (it->second.track.get<uint64_t>(it->second.trackNowmsField) > nowMs){
+          nowMs = it->second.track.get<uint64_t>(it->second.trackNowmsField);
+        }
+      }
+      setBootMsOffset(Util::bootMS() - nowMs);
+    }
+    return true;
+  }
+
   /// Sends the current Meta object through a socket in DTSH format
   void Meta::send(Socket::Connection &conn, bool skipDynamic, std::set<size_t> selectedTracks, bool reID) const{
     std::string lVars;
@@ -3110,15 +3409,21 @@ namespace DTSC{
   }
 
   /// Returns indice of the key containing timestamp, or last key if nowhere.
+  /// Key end times are monotonic, so this is a binary search over the valid keys.
   uint32_t Meta::getKeyIndexForTime(uint32_t idx, uint64_t timestamp) const{
-    DTSC::Keys keys(tracks.at(idx).keys);
-    uint32_t firstKey = keys.getFirstValid();
-    uint32_t endKey = keys.getEndValid();
-
-    for (size_t i = firstKey; i < endKey; i++){
-      if (keys.getTime(i) + keys.getDuration(i) > timestamp){return i;}
+    const Track &trk = tracks.at(idx);
+    const Util::RelAccX &keys = trk.keys;
+    uint64_t lo = keys.getDeleted();
+    uint64_t hi = keys.getEndPos();
+    while (lo < hi){
+      uint64_t mid = lo + (hi - lo) / 2;
+      if (keys.get<uint64_t>(trk.keyTimeField, mid) + keys.get<uint32_t>(trk.keyDurationField, mid) > timestamp){
+        hi = mid;
+      }else{
+        lo = mid + 1;
+      }
     }
-    return endKey;
+    return lo;
   }
 
   /// Returns the tiestamp for the given fragment index in the given track index.
@@ -3176,28 +3481,51 @@ namespace DTSC{
     return 0;
   }
 
+  /// Returns the index of the last record in [first, end) of the given RelAccX for which the given
+  /// (monotonically increasing) integer field is at most val, or first if there is no such record.
+  /// Used to binary search the time and key number columns of the metadata rings.
+  static uint64_t findLastNotAbove(const Util::RelAccX &acc, const Util::RelAccXFieldData &fd,
+                                   uint64_t first, uint64_t end, uint64_t val){
+    uint64_t lo = first;
+    uint64_t hi = end;
+    while (lo < hi){
+      uint64_t mid = lo + (hi - lo) / 2;
+      if (acc.getInt(fd, mid) > val){
+        hi = mid;
+      }else{
+        lo = mid + 1;
+      }
+    }
+    return lo > first ? lo - 1 : first;
+  }
+
+  /// Returns the index of the last available page record in [first, end) for which the given field
+  /// is at most val. Pages that are not (or no longer) available are skipped over.
+  /// If there is no such page, returns first.
+  static uint64_t findAvailPage(const Util::RelAccX &pages, const Util::RelAccXFieldData &fd,
+                                uint64_t first, uint64_t end, uint64_t val){
+    if (first >= end){return first;}
+    Util::RelAccXFieldData avail = pages.getFieldData("avail");
+    uint64_t res = findLastNotAbove(pages, fd, first, end, val);
+    while (res > first && !pages.getInt(avail, res)){--res;}
+    return res;
+  }
+
   /// Given the current page, check if the next page is available. Returns true if it is.
   bool Meta::nextPageAvailable(uint32_t idx, size_t currentPage) const{
     const Util::RelAccX &pages = tracks.at(idx).pages;
-    for (size_t i = pages.getStartPos(); i + 1 < pages.getEndPos(); ++i){
-      if (pages.getInt("firstkey", i) == currentPage){return pages.getInt("avail", i + 1);}
-    }
-    return false;
+    Util::RelAccXFieldData firstkey = pages.getFieldData("firstkey");
+    uint64_t i = findLastNotAbove(pages, firstkey, pages.getStartPos(), pages.getEndPos(), currentPage);
+    if (i + 1 >= pages.getEndPos() || pages.getInt(firstkey, i) != currentPage){return false;}
+    return pages.getInt("avail", i + 1);
   }
 
   /// Given a timestamp, returns the page number that timestamp can be found on.
   /// If the timestamp is not available, returns the closest page number that is.
   size_t Meta::getPageNumberForTime(uint32_t idx, uint64_t time) const{
     const Util::RelAccX &pages = tracks.at(idx).pages;
-    Util::RelAccXFieldData avail = pages.getFieldData("avail");
     Util::RelAccXFieldData firsttime = pages.getFieldData("firsttime");
-    uint32_t res = pages.getStartPos();
-    uint64_t endPos = pages.getEndPos();
-    for (uint64_t i = res; i < endPos; ++i){
-      if (pages.getInt(avail, i) == 0){continue;}
-      if (pages.getInt(firsttime, i) > time){break;}
-      res = i;
-    }
+    uint64_t res = findAvailPage(pages, firsttime, pages.getStartPos(), pages.getEndPos(), time);
     DONTEVEN_MSG("Page number for time %" PRIu64 " on track %" PRIu32 " can be found on page %" PRIu64, time, idx, pages.getInt("firstkey", res));
     return pages.getInt("firstkey", res);
   }
@@ -3206,13 +3534,8 @@ namespace DTSC{
   /// If the key is not available, returns the closest page that is.
   size_t Meta::getPageNumberForKey(uint32_t idx, uint64_t keyNum) const{
     const Util::RelAccX &pages = tracks.at(idx).pages;
-    size_t res = pages.getStartPos();
-    for (size_t i = pages.getStartPos(); i < pages.getEndPos(); ++i){
-      if (pages.getInt("avail", i) == 0){continue;}
-      if (pages.getInt("firstkey", i) > keyNum){break;}
-      res = i;
-    }
-    return pages.getInt("firstkey", res);
+    Util::RelAccXFieldData firstkey = pages.getFieldData("firstkey");
+    return pages.getInt(firstkey, findAvailPage(pages, firstkey, pages.getStartPos(), pages.getEndPos(), keyNum));
   }
 
   /// Returns the key number containing a given time.
@@ -3224,21 +3547,19 @@ namespace DTSC{
     const Util::RelAccX &keys = trk.keys;
     const Util::RelAccX &parts = trk.parts;
     if (!keys.getEndPos()){return INVALID_KEY_NUM;}
-    size_t res = keys.getDeleted();
-    for (size_t i = res; i < keys.getEndPos(); i++){
-      if (keys.getInt(trk.keyTimeField, i) > time){
-        //It's possible we overshot our timestamp, but the previous key does not contain it.
-        //This happens when seeking to a timestamp past the last part of the previous key, but
-        //before the first part of the next key.
-        //In this case, we should _not_ return the previous key, but the current key.
-        //That prevents getting stuck at the end of the page, waiting for a part to show up that never will.
-        if (keys.getInt(trk.keyFirstPartField, i) > parts.getStartPos()){
-          uint64_t dur = parts.getInt(trk.partDurationField, keys.getInt(trk.keyFirstPartField, i)-1);
-          if (keys.getInt(trk.keyTimeField, i) - dur < time){res = i;}
-        }
-        continue;
+    size_t res = findLastNotAbove(keys, trk.keyTimeField, keys.getDeleted(), keys.getEndPos(), time);
+    // The first key starting after the requested time
+    size_t i = (keys.get<uint64_t>(trk.keyTimeField, res) > time) ? res : res + 1;
+    if (i < keys.getEndPos()){
+      //It's possible we overshot our timestamp, but the previous key does not contain it.
+      //This happens when seeking to a timestamp past the last part of the previous key, but
+      //before the first part of the next key.
+      //In this case, we should _not_ return the previous key, but the current key.
+      //That prevents getting stuck at the end of the page, waiting for a part to show up that never will.
+      if (keys.get<uint64_t>(trk.keyFirstPartField, i) > parts.getStartPos()){
+        uint64_t dur = parts.get<uint16_t>(trk.partDurationField, keys.get<uint64_t>(trk.keyFirstPartField, i)-1);
+        if (keys.get<uint64_t>(trk.keyTimeField, i) - dur < time){res = i;}
       }
-      res = i;
     }
     DONTEVEN_MSG("Key number for time %" PRIu64 " on track %" PRIu32 " is %zu", time, idx, res);
     return res;
@@ -3357,12 +3678,12 @@ namespace DTSC{
   bool Meta::keyTimingsMatch(size_t idx1, size_t idx2) const {
     const DTSC::Track &t1 = tracks.at(idx1);
     const DTSC::Track &t2 = tracks.at(idx2);
-    uint64_t t1Firstms = t1.track.getInt(t1.trackFirstmsField);
-    uint64_t t2Firstms = t2.track.getInt(t2.trackFirstmsField);
+    uint64_t t1Firstms = t1.track.get<uint64_t>(t1.trackFirstmsField);
+    uint64_t t2Firstms = t2.track.get<uint64_t>(t2.trackFirstmsField);
     uint64_t firstms = t1Firstms > t2Firstms ? t1Firstms : t2Firstms;
 
-    uint64_t t1Lastms = t1.track.getInt(t1.trackFirstmsField);
-    uint64_t t2Lastms = t2.track.getInt(t2.trackFirstmsField);
+    uint64_t t1Lastms = t1.track.get<uint64_t>(t1.trackFirstmsField);
+    uint64_t t2Lastms = t2.track.get<uint64_t>(t2.trackFirstmsField);
     uint64_t lastms = t1Lastms > t2Lastms ? t1Lastms : t2Lastms;
 
     if (firstms > lastms) {
@@ -3394,9 +3715,9 @@ namespace DTSC{
   size_t Parts::getFirstValid() const{return parts.getDeleted();}
   size_t Parts::getEndValid() const{return parts.getEndPos();}
   size_t Parts::getValidCount() const{return getEndValid() - getFirstValid();}
-  size_t Parts::getSize(size_t idx) const{return parts.getInt(sizeField, idx);}
-  uint64_t Parts::getDuration(size_t idx) const{return parts.getInt(durationField, idx);}
-  int64_t Parts::getOffset(size_t idx) const{return parts.getInt(offsetField, idx);}
+  size_t Parts::getSize(size_t idx) const{return parts.get<uint32_t>(sizeField, idx);}
+  uint64_t Parts::getDuration(size_t idx) const{return parts.get<uint16_t>(durationField, idx);}
+  int64_t Parts::getOffset(size_t idx) const{return parts.get<int16_t>(offsetField, idx);}
 
   Keys::Keys(Util::RelAccX &_keys) : isConst(false), keys(_keys), cKeys(_keys){
     firstPartField = cKeys.getFieldData("firstpart");
@@ -3430,46 +3751,52 @@ namespace DTSC{
 
   size_t Keys::getFirstPart(size_t idx) const{
     if (isLimited && idx == limMin){return limMinFirstPart;}
-    return cKeys.getInt(firstPartField, idx);
+    return cKeys.get<uint64_t>(firstPartField, idx);
   }
-  size_t Keys::getBpos(size_t idx) const{return cKeys.getInt(bposField, idx);}
+  size_t Keys::getBpos(size_t idx) const{return cKeys.get<uint64_t>(bposField, idx);}
   uint64_t Keys::getDuration(size_t idx) const{
     if (isLimited && idx + 1 == limMax){return limMaxDuration;}
     if (isLimited && idx == limMin){return limMinDuration;}
-    return cKeys.getInt(durationField, idx);
+    return cKeys.get<uint32_t>(durationField, idx);
   }
-  size_t Keys::getNumber(size_t idx) const{return cKeys.getInt(numberField, idx);}
+  size_t Keys::getNumber(size_t idx) const{return cKeys.get<uint32_t>(numberField, idx);}
   size_t Keys::getParts(size_t idx) const{
     if (isLimited && idx + 1 == limMax){return limMaxParts;}
     if (isLimited && idx == limMin){return limMinParts;}
-    return cKeys.getInt(partsField, idx);
+    return cKeys.get<uint32_t>(partsField, idx);
   }
   uint64_t Keys::getTime(size_t idx) const{
     if (isLimited && idx == limMin){return limMinTime;}
-    return cKeys.getInt(timeField, idx);
+    return cKeys.get<uint64_t>(timeField, idx);
   }
   void Keys::setSize(size_t idx, size_t _size){
     if (isConst){return;}
-    keys.setInt(sizeField, _size, idx);
+    keys.set<uint32_t>(sizeField, _size, idx);
   }
   size_t Keys::getSize(size_t idx) const{
     if (isLimited && idx + 1 == limMax){return limMaxSize;}
     if (isLimited && idx == limMin){return limMinSize;}
-    return cKeys.getInt(sizeField, idx);
+    return cKeys.get<uint32_t>(sizeField, idx);
   }
 
   uint64_t Keys::getTotalPartCount(){
     return getParts(getEndValid()-1) + getFirstPart(getEndValid()-1) - getFirstPart(getFirstValid());
   }
   
+  /// Returns indice of the key containing timestamp, or the end key if nowhere.
+  /// Binary searches the (monotonic) key end times, taking the limiter into account.
   uint32_t Keys::getIndexForTime(uint64_t timestamp){
-    uint32_t firstKey = getFirstValid();
-    uint32_t endKey = getEndValid();
-
-    for (size_t i = firstKey; i < endKey; i++){
-      if (getTime(i) + getDuration(i) > timestamp){return i;}
+    size_t lo = getFirstValid();
+    size_t hi = getEndValid();
+    while (lo < hi){
+      size_t mid = lo + (hi - lo) / 2;
+      if (getTime(mid) + getDuration(mid) > timestamp){
+        hi = mid;
+      }else{
+        lo = mid + 1;
+      }
     }
-    return endKey;
+    return lo;
   }
 
   void Keys::applyLimiter(uint64_t _min, uint64_t _max, DTSC::Parts _p){
@@ -3554,12 +3881,17 @@ namespace DTSC{
     isLimited = true;
   }
 
-  Fragments::Fragments(const Util::RelAccX &_fragments) : fragments(_fragments){}
+  Fragments::Fragments(const Util::RelAccX &_fragments) : fragments(_fragments){
+    durationField = fragments.getFieldData("duration");
+    keysField = fragments.getFieldData("keys");
+    firstKeyField = fragments.getFieldData("firstkey");
+    sizeField = fragments.getFieldData("size");
+  }
   size_t Fragments::getFirstValid() const{return fragments.getDeleted();}
   size_t Fragments::getEndValid() const{return fragments.getEndPos();}
   size_t Fragments::getValidCount() const{return getEndValid() - getFirstValid();}
-  uint64_t Fragments::getDuration(size_t idx) const{return fragments.getInt("duration", idx);}
-  size_t Fragments::getKeycount(size_t idx) const{return fragments.getInt("keys", idx);}
-  size_t Fragments::getFirstKey(size_t idx) const{return fragments.getInt("firstkey", idx);}
-  size_t Fragments::getSize(size_t idx) const{return fragments.getInt("size", idx);}
+  uint64_t Fragments::getDuration(size_t idx) const{return fragments.get<uint32_t>(durationField, idx);}
+  size_t Fragments::getKeycount(size_t idx) const{return fragments.get<uint16_t>(keysField, idx);}
+  size_t Fragments::getFirstKey(size_t idx) const{return fragments.get<uint32_t>(firstKeyField, idx);}
+  size_t Fragments::getSize(size_t idx) const{return fragments.get<uint32_t>(sizeField, idx);}
 }// namespace DTSC
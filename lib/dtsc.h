@@ -34,6 +34,12 @@
 //  Version 4: renamed bps to maxbps (peak bit rate) and added new value bps (average bit rate)
 #define DTSH_VERSION 4
 
+// Increase this value every time the layout of DTSM memory image files changes.
+// Changes to the RelAccX structures themselves are detected when loading an image and need no bump.
+// Changelog:
+//  Version 1: initial version
+#define DTSM_VERSION 1
+
 namespace DTSC{
 
   extern uint64_t veryUglyJitterOverride;
@@ -239,6 +245,10 @@ namespace DTSC{
 
   private:
     const Util::RelAccX &fragments;
+    Util::RelAccXFieldData durationField;
+    Util::RelAccXFieldData keysField;
+    Util::RelAccXFieldData firstKeyField;
+    Util::RelAccXFieldData sizeField;
   };
 
   class Track{
@@ -311,6 +321,7 @@ namespace DTSC{
     void reInit(const std::string &_streamName, bool master = true, bool autoBackOff = true);
     void reInit(const std::string &_streamName, const std::string &fileName);
     void reInit(const std::string &_streamName, const DTSC::Scan &src);
+    bool reInitFromImage(const std::string &_streamName, const std::string &fileName);
     void addTrackFrom(const DTSC::Scan &src);
 
     void refresh();
@@ -359,6 +370,10 @@ namespace DTSC{
     void setSource(const std::string &src);
     std::string getSource() const;
 
+    void setPagePrefix(const std::string &prefix);
+    std::string getPagePrefix() const;
+    std::string getDataPageName(size_t trackIdx, uint32_t pageNumber) const;
+
     void setID(size_t trackIdx, size_t id);
     size_t getID(size_t trackIdx) const;
 
@@ -485,6 +500,10 @@ namespace DTSC{
     uint64_t getPartTime(uint32_t partIndex, size_t idx) const;
 
     bool nextPageAvailable(uint32_t idx, size_t currentPage) const;
+
+    uint32_t getPageSignal() const;
+    void signalPageReady();
+    bool waitPageSignal(uint32_t lastSignal, uint64_t millis) const;
     size_t getPageNumberForTime(uint32_t idx, uint64_t time) const;
     size_t getPageNumberForKey(uint32_t idx, uint64_t keynumber) const;
     size_t getKeyNumForTime(uint32_t idx, uint64_t time) const;
@@ -505,6 +524,7 @@ namespace DTSC{
 
     uint64_t getSendLen(bool skipDynamic = false, std::set<size_t> selectedTracks = std::set<size_t>()) const;
     void toFile(const std::string &uri) const;
+    bool toImage(const std::string &fileName) const;
     void send(Socket::Connection &conn, bool skypDynamic = false,
               std::set<size_t> selectedTracks = std::set<size_t>(), bool reID = false) const;
     void toJSON(JSON::Value &res, bool skipDynamic = true, bool tracksOnly = false) const;
@@ -544,6 +564,9 @@ namespace DTSC{
     std::map<size_t, size_t> sizeMemBuf;
 
   private:
+    volatile uint32_t *streamWord(const Util::RelAccXFieldData &fd) const;
+    char *trackPage(size_t trackIdx) const;
+    std::string trackLayout(size_t trackIdx) const;
     std::map<size_t, jitterTimer> theJitters;
     // Internal buffers so we don't always need to search for everything
     Util::RelAccXFieldData streamVodField;
@@ -554,6 +577,9 @@ namespace DTSC{
     Util::RelAccXFieldData streamBootMsOffsetField;
     Util::RelAccXFieldData streamUTCOffsetField;
     Util::RelAccXFieldData streamMinimumFragmentDurationField;
+    Util::RelAccXFieldData streamPageSignalField;
+    Util::RelAccXFieldData streamPageWaitersField;
+    Util::RelAccXFieldData streamPagePrefixField;
 
     Util::RelAccXFieldData trackValidField;
     Util::RelAccXFieldData trackIdField;
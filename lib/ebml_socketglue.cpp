@@ -135,20 +135,35 @@ namespace EBML{
                                       (duration > 0 ? sizeElemDbl(EID_DURATION, duration) : 0));
   }
 
-  void sendSimpleBlock(Socket::Connection &C, DTSC::Packet &pkt, uint64_t clusterTime, bool forceKeyframe){
+  /// Sends the packet as a SimpleBlock, as track number trackNo or the packet's own track ID if 0.
+  /// The block header is sent in the same write as the packet data, straight from the packet.
+  void sendSimpleBlock(Socket::Connection &C, DTSC::Packet &pkt, uint64_t clusterTime,
+                       bool forceKeyframe, uint64_t trackNo){
     size_t dataLen = 0;
     char *dataPointer = 0;
     pkt.getString("data", dataPointer, dataLen);
-    uint32_t blockSize = UniInt::writeSize(pkt.getTrackId()) + 3 + dataLen;
-    sendElemHead(C, EID_SIMPLEBLOCK, blockSize);
-    sendUniInt(C, pkt.getTrackId());
-    char blockHead[3] ={0, 0, 0};
-    if (pkt.hasMember("keyframe") || forceKeyframe){blockHead[2] = 0x80;}
+    if (!trackNo){trackNo = pkt.getTrackId();}
+    uint32_t blockSize = UniInt::writeSize(trackNo) + 3 + dataLen;
+    // Element ID and size, track number and the 3 byte block header: at most 4 + 8 + 8 + 3 bytes
+    char blockHead[23];
+    size_t headLen = 0;
+    UniInt::writeInt(blockHead, EID_SIMPLEBLOCK);
+    headLen += UniInt::writeSize(EID_SIMPLEBLOCK);
+    UniInt::writeInt(blockHead + headLen, blockSize);
+    headLen += UniInt::writeSize(blockSize);
+    UniInt::writeInt(blockHead + headLen, trackNo);
+    headLen += UniInt::writeSize(trackNo);
     int offset = 0;
     if (pkt.hasMember("offset")){offset = pkt.getInt("offset");}
-    Bit::htobs(blockHead, (int16_t)(pkt.getTime() + offset - clusterTime));
-    C.SendNow(blockHead, 3);
-    C.SendNow(dataPointer, dataLen);
+    Bit::htobs(blockHead + headLen, (int16_t)(pkt.getTime() + offset - clusterTime));
+    blockHead[headLen + 2] = (pkt.hasMember("keyframe") || forceKeyframe) ? 0x80 : 0;
+    headLen += 3;
+    struct iovec vec[2];
+    vec[0].iov_base = blockHead;
+    vec[0].iov_len = headLen;
+    vec[1].iov_base = dataPointer;
+    vec[1].iov_len = dataLen;
+    C.SendNow(vec, 2);
   }
 
   uint32_t sizeSimpleBlock(uint64_t trackId, uint32_t dataSize){
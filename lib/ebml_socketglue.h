@@ -27,6 +27,7 @@ namespace EBML{
   uint32_t sizeElemDbl(uint32_t ID, const double val);
   uint32_t sizeElemStr(uint32_t ID, const std::string &val);
 
-  void sendSimpleBlock(Socket::Connection &C, DTSC::Packet &pkt, uint64_t clusterTime, bool forceKeyframe = false);
+  void sendSimpleBlock(Socket::Connection &C, DTSC::Packet &pkt, uint64_t clusterTime,
+                       bool forceKeyframe = false, uint64_t trackNo = 0);
   uint32_t sizeSimpleBlock(uint64_t trackId, uint32_t dataSize);
 }// namespace EBML
@@ -3,16 +3,191 @@
 #include "encryption.h"
 #include "h264.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AESNI_SUPPORTED
+#include <cpuid.h>
+#include <wmmintrin.h>
+#define AESNI_TARGET __attribute__((target("aes,sse2")))
+#endif
+
 namespace Encryption{
-  AES::AES(){mbedtls_aes_init(&ctx);}
+#ifdef AESNI_SUPPORTED
+  /// One step of the AES-128 key schedule; gen is the aeskeygenassist result for the previous round key.
+  AESNI_TARGET static inline __m128i aesniExpandStep(__m128i key, __m128i gen){
+    gen = _mm_shuffle_epi32(gen, 0xff);
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, gen);
+  }
+#define AESNI_EXPAND(i, rcon)                                                                        \
+  k[i] = aesniExpandStep(k[i - 1], _mm_aeskeygenassist_si128(k[i - 1], rcon))
+
+  /// Expands a 128-bit key into the 11 round keys used by the other aesni functions.
+  AESNI_TARGET static void aesniSetKey(const char *key, unsigned char *roundKeys){
+    __m128i k[11];
+    k[0] = _mm_loadu_si128((const __m128i *)key);
+    AESNI_EXPAND(1, 0x01);
+    AESNI_EXPAND(2, 0x02);
+    AESNI_EXPAND(3, 0x04);
+    AESNI_EXPAND(4, 0x08);
+    AESNI_EXPAND(5, 0x10);
+    AESNI_EXPAND(6, 0x20);
+    AESNI_EXPAND(7, 0x40);
+    AESNI_EXPAND(8, 0x80);
+    AESNI_EXPAND(9, 0x1b);
+    AESNI_EXPAND(10, 0x36);
+    for (size_t i = 0; i < 11; ++i){_mm_storeu_si128((__m128i *)(roundKeys + i * 16), k[i]);}
+  }
+#undef AESNI_EXPAND
+
+  /// Encrypts a single block in place.
+  AESNI_TARGET static inline __m128i aesniBlock(__m128i b, const __m128i *k){
+    b = _mm_xor_si128(b, k[0]);
+    for (size_t r = 1; r < 10; ++r){b = _mm_aesenc_si128(b, k[r]);}
+    return _mm_aesenclast_si128(b, k[10]);
+  }
+
+  /// Returns the big-endian 128-bit counter block hi:lo as loaded from memory.
+  AESNI_TARGET static inline __m128i aesniCounter(uint64_t hi, uint64_t lo){
+    return _mm_set_epi64x(__builtin_bswap64(lo), __builtin_bswap64(hi));
+  }
+
+  /// AES-CTR with a counter block of hi:lo, compatible with mbedtls_aes_crypt_ctr.
+  /// Runs eight independent blocks through each round at a time, so the AES unit stays busy
+  /// instead of waiting for the latency of a single block.
+  AESNI_TARGET static void aesniCTR(const unsigned char *roundKeys, uint64_t hi, uint64_t lo,
+                                    const char *src, char *dest, size_t len){
+    __m128i k[11];
+    for (size_t i = 0; i < 11; ++i){k[i] = _mm_loadu_si128((const __m128i *)(roundKeys + i * 16));}
+    while (len >= 128){
+      __m128i b0, b1, b2, b3, b4, b5, b6, b7;
+#define AESNI_LANES(op)                                                                              \
+  op(b0, 0);                                                                                         \
+  op(b1, 1);                                                                                         \
+  op(b2, 2);                                                                                         \
+  op(b3, 3);                                                                                         \
+  op(b4, 4);                                                                                         \
+  op(b5, 5);                                                                                         \
+  op(b6, 6);                                                                                         \
+  op(b7, 7)
+#define AESNI_START(b, i)                                                                            \
+  b = _mm_xor_si128(aesniCounter(hi, lo), k[0]);                                                     \
+  if (!++lo){++hi;}
+#define AESNI_ROUND(b, i) b = _mm_aesenc_si128(b, k[r])
+#define AESNI_FINISH(b, i)                                                                           \
+  b = _mm_xor_si128(_mm_aesenclast_si128(b, k[10]), _mm_loadu_si128((const __m128i *)src + i));     \
+  _mm_storeu_si128((__m128i *)dest + i, b)
+      AESNI_LANES(AESNI_START);
+      for (size_t r = 1; r < 10; ++r){AESNI_LANES(AESNI_ROUND);}
+      AESNI_LANES(AESNI_FINISH);
+#undef AESNI_FINISH
+#undef AESNI_ROUND
+#undef AESNI_START
+#undef AESNI_LANES
+      src += 128;
+      dest += 128;
+      len -= 128;
+    }
+    while (len){
+      __m128i b = aesniBlock(aesniCounter(hi, lo), k);
+      if (!++lo){++hi;}
+      if (len < 16){
+        char stream[16];
+        _mm_storeu_si128((__m128i *)stream, b);
+        for (size_t i = 0; i < len; ++i){dest[i] = src[i] ^ stream[i];}
+        return;
+      }
+      _mm_storeu_si128((__m128i *)dest, _mm_xor_si128(b, _mm_loadu_si128((const __m128i *)src)));
+      src += 16;
+      dest += 16;
+      len -= 16;
+    }
+  }
+
+  /// AES-CBC encryption of whole blocks, compatible with mbedtls_aes_crypt_cbc: ivec is updated
+  /// to the last ciphertext block. If pattern is set, only the first block of every 160 bytes is
+  /// encrypted and the rest is copied, as the Fairplay/SAMPLE-AES 1:9 pattern requires; a final
+  /// block of exactly 16 bytes is left in the clear.
+  AESNI_TARGET static void aesniCBC(const unsigned char *roundKeys, char *ivec, const char *src,
+                                    char *dest, size_t len, bool pattern){
+    __m128i k[11];
+    for (size_t i = 0; i < 11; ++i){k[i] = _mm_loadu_si128((const __m128i *)(roundKeys + i * 16));}
+    __m128i c = _mm_loadu_si128((const __m128i *)ivec);
+    while (len >= 16 && (!pattern || len > 16)){
+      c = aesniBlock(_mm_xor_si128(c, _mm_loadu_si128((const __m128i *)src)), k);
+      _mm_storeu_si128((__m128i *)dest, c);
+      src += 16;
+      dest += 16;
+      len -= 16;
+      if (pattern){
+        size_t clear = std::min(len, (size_t)144);
+        memcpy(dest, src, clear);
+        src += clear;
+        dest += clear;
+        len -= clear;
+      }
+    }
+    if (pattern && len){memcpy(dest, src, len);}
+    _mm_storeu_si128((__m128i *)ivec, c);
+  }
+#endif
+
+  /// Returns true if this CPU has the AES-NI instructions, and the library was built to use them.
+  bool AES::hasAESNI(){
+#ifdef AESNI_SUPPORTED
+    static int detected = -1;
+    if (detected == -1){
+      unsigned int a, b, c, d;
+      detected = (__get_cpuid(1, &a, &b, &c, &d) && (c & bit_AES) && (d & bit_SSE2)) ? 1 : 0;
+    }
+    return detected;
+#else
+    return false;
+#endif
+  }
+
+  /// Clears the expanded AES-NI key, through a volatile pointer so the stores are not optimized away.
+  static void clearRoundKeys(unsigned char *roundKeys){
+    volatile unsigned char *p = roundKeys;
+    for (size_t i = 0; i < 176; ++i){p[i] = 0;}
+  }
+
+  AES::AES(){
+    mbedtls_aes_init(&ctx);
+    haveEncKey = false;
+    accel = hasAESNI();
+    memset(roundKeys, 0, sizeof(roundKeys));
+  }
 
-  AES::~AES(){mbedtls_aes_free(&ctx);}
+  AES::~AES(){
+    mbedtls_aes_free(&ctx);
+    clearRoundKeys(roundKeys);
+  }
+
+  /// Turns the AES-NI code path on or off, for comparing against the portable mbedtls path.
+  /// Returns whether the AES-NI path is now in use.
+  bool AES::setAccelerated(bool enable){
+    accel = enable && hasAESNI();
+    return accel;
+  }
+
+  bool AES::isAccelerated() const{return accel;}
 
   void AES::setEncryptKey(const char *key){
     mbedtls_aes_setkey_enc(&ctx, (const unsigned char *)key, 128);
+#ifdef AESNI_SUPPORTED
+    if (hasAESNI()){
+      aesniSetKey(key, roundKeys);
+      haveEncKey = true;
+    }
+#endif
   }
   void AES::setDecryptKey(const char *key){
     mbedtls_aes_setkey_dec(&ctx, (const unsigned char *)key, 128);
+    // The previous encryption key is no longer used, so do not leave it in memory
+    if (haveEncKey){clearRoundKeys(roundKeys);}
+    haveEncKey = false;
   }
 
   DTSC::Packet AES::encryptPacketCTR(const DTSC::Meta &M, const DTSC::Packet &src, uint64_t ivec, size_t newTrack){
@@ -60,6 +235,12 @@ namespace Encryption{
   }
 
   bool AES::encryptBlockCTR(uint64_t ivec, const char *src, char *dest, size_t dataLen){
+#ifdef AESNI_SUPPORTED
+    if (accel && haveEncKey){
+      aesniCTR(roundKeys, ivec, 0, src, dest, dataLen);
+      return true;
+    }
+#endif
     size_t ncOff = 0;
     unsigned char streamBlock[] ={0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
@@ -131,22 +312,39 @@ namespace Encryption{
       }
       memcpy(dest + offset, src + offset, 36);
       offset += 36;
-      size_t encryptedBlocks = 0;
-      size_t lenToGo = it->nalSize - 32;
-      while (lenToGo){
-        if (lenToGo > 16){
-          if (!encryptBlockCBC(ivec, src + offset, dest + offset, 16)){
-            ERROR_MSG("Failed to encrypt a block of 16 bytes!");
-            return false;
-          }
-          offset += 16;
-          lenToGo -= 16;
-          ++encryptedBlocks;
+      if (!encryptPatternCBC(ivec, src + offset, dest + offset, it->nalSize - 32)){
+        ERROR_MSG("Failed to encrypt a block of 16 bytes!");
+        return false;
+      }
+      offset += it->nalSize - 32;
+    }
+    return true;
+  }
+
+  /// Encrypts the first 16 bytes of every 160, copying the rest, with the CBC chain running
+  /// across the encrypted blocks. A final block of exactly 16 bytes is not encrypted.
+  bool AES::encryptPatternCBC(char *ivec, const char *src, char *dest, size_t dataLen){
+#ifdef AESNI_SUPPORTED
+    if (accel && haveEncKey){
+      aesniCBC(roundKeys, ivec, src, dest, dataLen, true);
+      return true;
+    }
+#endif
+    while (dataLen){
+      if (dataLen > 16){
+        if (mbedtls_aes_crypt_cbc(&ctx, MBEDTLS_AES_ENCRYPT, 16, (unsigned char *)ivec,
+                                  (const unsigned char *)src, (unsigned char *)dest)){
+          return false;
         }
-        memcpy(dest + offset, src + offset, std::min(lenToGo, (size_t)144));
-        offset += std::min(lenToGo, (size_t)144);
-        lenToGo -= std::min(lenToGo, (size_t)144);
+        src += 16;
+        dest += 16;
+        dataLen -= 16;
       }
+      size_t clear = std::min(dataLen, (size_t)144);
+      memcpy(dest, src, clear);
+      src += clear;
+      dest += clear;
+      dataLen -= clear;
     }
     return true;
   }
@@ -164,6 +362,12 @@ namespace Encryption{
 
   bool AES::encryptBlockCBC(char *ivec, const char *src, char *dest, size_t dataLen){
     if (dataLen % 16){WARN_MSG("Encrypting a non-multiple of 16 bytes: %zu", dataLen);}
+#ifdef AESNI_SUPPORTED
+    if (accel && haveEncKey && !(dataLen % 16)){
+      aesniCBC(roundKeys, ivec, src, dest, dataLen, false);
+      return true;
+    }
+#endif
     return mbedtls_aes_crypt_cbc(&ctx, MBEDTLS_AES_ENCRYPT, dataLen, (unsigned char *)ivec,
                                  (const unsigned char *)src, (unsigned char *)dest) == 0;
   }
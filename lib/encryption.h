@@ -22,7 +22,15 @@ namespace Encryption{
     std::string encryptBlockCBC(char *ivec, const std::string &inp);
     bool encryptBlockCBC(char *ivec, const char *src, char *dest, size_t dataLen);
 
+    static bool hasAESNI();
+    bool setAccelerated(bool enable);
+    bool isAccelerated() const;
+
   protected:
+    bool encryptPatternCBC(char *ivec, const char *src, char *dest, size_t dataLen);
     mbedtls_aes_context ctx;
+    bool accel;      ///< True if encryption calls use the AES-NI code instead of mbedtls
+    bool haveEncKey; ///< True if roundKeys holds an expanded encryption key
+    unsigned char roundKeys[176];
   };
 }// namespace Encryption
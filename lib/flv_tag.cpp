@@ -2,6 +2,7 @@
 /// Holds all code for the FLV namespace.
 
 #include "adts.h"
+#include "bitfields.h"
 #include "defines.h"
 #include "flv_tag.h"
 #include "mp4_generic.h"
@@ -10,6 +11,7 @@
 #include "util.h"
 #include "adts.h"
 #include <fcntl.h> //for Tag::FileLoader
+#include <set>
 #include <sstream>
 #include <stdio.h>  //for Tag::FileLoader
 #include <stdlib.h> //malloc
@@ -89,6 +91,23 @@ bool FLV::seekToTagType(FILE *f, uint8_t t){
   return false;
 }
 
+/// Returns the amount of distinct tag types (audio, video, meta) in the first FLV_TRACK_SCAN_TAGS
+/// tags of an FLV file, which is the amount of tracks an FLV input would make for it.
+/// Returns zero if the file is not a valid FLV file.
+size_t FLV::fileTracks(int fd, uint64_t fileSize){
+  char buf[11];
+  if (fileSize < 13 || pread(fd, buf, 9, 0) != 9 || !is_header(buf)){return 0;}
+  std::set<uint8_t> types;
+  uint64_t pos = Bit::btohl(buf + 5) + 4;
+  for (size_t i = 0; i < FLV_TRACK_SCAN_TAGS && pos + 11 <= fileSize; ++i){
+    if (pread(fd, buf, 11, pos) != 11){return 0;}
+    if (buf[0] != 0x08 && buf[0] != 0x09 && buf[0] != 0x12){return 0;}
+    types.insert(buf[0]);
+    pos += Bit::btoh24(buf + 1) + 15;
+  }
+  return types.size();
+}
+
 /// True if this media type requires init data.
 /// Will always return false if the tag type is not 0x08 or 0x09.
 /// Returns true for H263, AVC (H264), AAC.
@@ -325,7 +344,10 @@ FLV::Tag &FLV::Tag::operator=(const FLV::Tag &O){
   return *this;
 }// assignment operator
 
-bool FLV::Tag::DTSCLoader(DTSC::Packet &packData, const DTSC::Meta &M, size_t idx){
+/// Loads a DTSC packet into this tag.
+/// If headerOnly is set, the packet data is not copied: only the bytes before and after it are
+/// filled, so the caller can send the data straight from the packet in between those.
+bool FLV::Tag::DTSCLoader(DTSC::Packet &packData, const DTSC::Meta &M, size_t idx, bool headerOnly){
   std::string meta_str;
   len = 0;
   if (idx == INVALID_TRACK_ID){
@@ -342,11 +364,11 @@ bool FLV::Tag::DTSCLoader(DTSC::Packet &packData, const DTSC::Meta &M, size_t id
     if (codec == "H264"){len += 4;}
     if (!checkBufferSize()){return false;}
     if (codec == "H264"){
-      memcpy(data + 16, tmpData, len - 20);
+      if (!headerOnly){memcpy(data + 16, tmpData, len - 20);}
       data[12] = 1;
       offset(packData.getInt("offset"));
     }else{
-      memcpy(data + 12, tmpData, len - 16);
+      if (!headerOnly){memcpy(data + 12, tmpData, len - 16);}
     }
     data[11] = 0;
     if (codec == "H264"){data[11] |= 7;}
@@ -371,10 +393,10 @@ bool FLV::Tag::DTSCLoader(DTSC::Packet &packData, const DTSC::Meta &M, size_t id
     if (codec == "AAC"){len++;}
     if (!checkBufferSize()){return false;}
     if (codec == "AAC"){
-      memcpy(data + 13, tmpData, len - 17);
+      if (!headerOnly){memcpy(data + 13, tmpData, len - 17);}
       data[12] = 1; // raw AAC data, not sequence header
     }else{
-      memcpy(data + 12, tmpData, len - 16);
+      if (!headerOnly){memcpy(data + 12, tmpData, len - 16);}
     }
     unsigned int datarate = M.getRate(idx);
     data[11] = 0;
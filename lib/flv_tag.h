@@ -27,6 +27,9 @@ namespace FLV{
   /// Helper function that can quickly skip through a file looking for a particular tag type
   bool seekToTagType(FILE *f, uint8_t type);
 
+  /// Returns the amount of distinct tag types (audio, video, meta) at the start of an FLV file
+  size_t fileTracks(int fd, uint64_t fileSize);
+
   /// This class is used to hold, work with and get information about a single FLV tag.
   class Tag{
   public:
@@ -49,7 +52,7 @@ namespace FLV{
     ~Tag();                          ///< Generic destructor.
     // loader functions
     bool ChunkLoader(const RTMPStream::Chunk &O);
-    bool DTSCLoader(DTSC::Packet &packData, const DTSC::Meta &M, size_t idx);
+    bool DTSCLoader(DTSC::Packet &packData, const DTSC::Meta &M, size_t idx, bool headerOnly = false);
     bool DTSCVideoInit(DTSC::Meta &meta, uint32_t vTrack);
     bool DTSCAudioInit(const std::string & codec, unsigned int sampleRate, unsigned int sampleSize, unsigned int channels, const std::string & initData);
     bool DTSCMetaInit(const DTSC::Meta &M, std::set<size_t> &selTracks);
@@ -17,14 +17,7 @@ namespace h264{
     if (nalType == 0x05){return true;}
     if (nalType != 0x01){return false;}
     Utils::bitstream bs;
-    for (size_t i = 1; i < 10 && i < len; ++i){
-      if (i + 2 < len && (memcmp(data + i, "\000\000\003", 3) == 0)){// Emulation prevention bytes
-        bs.append(data + i, 2);
-        i += 2;
-      }else{
-        bs.append(data + i, 1);
-      }
-    }
+    if (len > 1){bs.appendRBSP(data + 1, (len < 10 ? len : 10) - 1);}
     bs.getExpGolomb(); // Discard first_mb_in_slice
     uint64_t sliceType = bs.getUExpGolomb();
     // Slice types:
@@ -77,16 +70,7 @@ namespace h264{
 
   bool sequenceParameterSet::validate() const{
     Utils::bitstream bs;
-    for (size_t i = 1; i < dataLen; i++){
-      if (i + 2 < dataLen && (memcmp(data + i, "\000\000\003", 3) == 0)){// Emulation prevention bytes
-        // Yes, we increase i here
-        bs.append(data + i, 2);
-        i += 2;
-      }else{
-        // No we don't increase i here
-        bs.append(data + i, 1);
-      }
-    }
+    if (dataLen > 1){bs.appendRBSP(data + 1, dataLen - 1);}
     if (bs.size() < 24){return false;}//static size data
     char profileIdc = bs.get(8);
     bs.skip(16);
@@ -177,16 +161,7 @@ namespace h264{
 
     // Fill the bitstream
     Utils::bitstream bs;
-    for (size_t i = 1; i < dataLen; i++){
-      if (i + 2 < dataLen && (memcmp(data + i, "\000\000\003", 3) == 0)){// Emulation prevention bytes
-        // Yes, we increase i here
-        bs.append(data + i, 2);
-        i += 2;
-      }else{
-        // No we don't increase i here
-        bs.append(data + i, 1);
-      }
-    }
+    if (dataLen > 1){bs.appendRBSP(data + 1, dataLen - 1);}
 
     char profileIdc = bs.get(8);
     result.profile = profileIdc;
@@ -378,16 +353,7 @@ namespace h264{
 
     // Fill the bitstream
     Utils::bitstream bs;
-    for (size_t i = 1; i < len; i++){
-      if (i + 2 < len && (memcmp(data + i, "\000\000\003", 3) == 0)){// Emulation prevention bytes
-        // Yes, we increase i here
-        bs.append(data + i, 2);
-        i += 2;
-      }else{
-        // No we don't increase i here
-        bs.append(data + i, 1);
-      }
-    }
+    bs.appendRBSP(data + 1, len - 1);
     profileIdc = bs.get(8);
     constraintSet0Flag = bs.get(1);
     constraintSet1Flag = bs.get(1);
@@ -750,16 +716,7 @@ namespace h264{
 
   bool ppsValidate(const char *data, size_t len){
     Utils::bitstream bs;
-    for (size_t i = 1; i < len; i++){
-      if (i + 2 < len && (memcmp(data + i, "\000\000\003", 3) == 0)){// Emulation prevention bytes
-        // Yes, we increase i here
-        bs.append(data + i, 2);
-        i += 2;
-      }else{
-        // No we don't increase i here
-        bs.append(data + i, 1);
-      }
-    }
+    if (len > 1){bs.appendRBSP(data + 1, len - 1);}
     bs.getUExpGolomb();
     bs.getUExpGolomb();
     bs.get(2);
@@ -789,16 +746,7 @@ namespace h264{
   ppsUnit::ppsUnit(const char *data, size_t len, uint8_t chromaFormatIdc) : nalUnit(data, len){
     picScalingMatrixPresentFlags = NULL;
     Utils::bitstream bs;
-    for (size_t i = 1; i < len; i++){
-      if (i + 2 < len && (memcmp(data + i, "\000\000\003", 3) == 0)){// Emulation prevention bytes
-        // Yes, we increase i here
-        bs.append(data + i, 2);
-        i += 2;
-      }else{
-        // No we don't increase i here
-        bs.append(data + i, 1);
-      }
-    }
+    bs.appendRBSP(data + 1, len - 1);
     picParameterSetId = bs.getUExpGolomb();
     seqParameterSetId = bs.getUExpGolomb();
     entropyCodingModeFlag = bs.get(1);
@@ -974,16 +922,7 @@ namespace h264{
 
   codedSliceUnit::codedSliceUnit(const char *data, size_t len) : nalUnit(data, len){
     Utils::bitstream bs;
-    for (size_t i = 1; i < len; i++){
-      if (i + 2 < len && (memcmp(data + i, "\000\000\003", 3) == 0)){// Emulation prevention bytes
-        // Yes, we increase i here
-        bs.append(data + i, 2);
-        i += 2;
-      }else{
-        // No we don't increase i here
-        bs.append(data + i, 1);
-      }
-    }
+    bs.appendRBSP(data + 1, len - 1);
     firstMbInSlice = bs.getUExpGolomb();
     sliceType = bs.getUExpGolomb();
     picParameterSetId = bs.getUExpGolomb();
@@ -1035,16 +974,7 @@ namespace h264{
   seiUnit::seiUnit(const char *data, size_t len) : nalUnit(data, len){
     Utils::bitstream bs;
     payloadOffset = 1;
-    for (size_t i = 1; i < len; i++){
-      if (i + 2 < len && (memcmp(data + i, "\000\000\003", 3) == 0)){// Emulation prevention bytes
-        // Yes, we increase i here
-        bs.append(data + i, 2);
-        i += 2;
-      }else{
-        // No we don't increase i here
-        bs.append(data + i, 1);
-      }
-    }
+    bs.appendRBSP(data + 1, len - 1);
     uint8_t tmp = bs.get(8);
     ++payloadOffset;
     payloadType = 0;
@@ -1122,13 +1052,12 @@ namespace h264{
     size_t len = _len - offset;
     if (annexb){
       // search for the next start marker
-      for (size_t i = 1; i < len - 2; ++i){
-        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1){
-          while (i && !data[i]){--i;}
-          pktLen = i + 1;
-          offset += pktLen;
-          break;
-        }
+      const char *next = nalu::scanAnnexB(data + 1, len - 1);
+      if (next){
+        size_t i = next - data;
+        while (i && !data[i]){--i;}
+        pktLen = i + 1;
+        offset += pktLen;
       }
     }else{
       offset += pktLen;
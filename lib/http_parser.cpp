@@ -12,6 +12,8 @@
 #include <iomanip>
 #include <strings.h>
 
+#define CHUNKIFY_IOVECS 16 // buffers above this count are sent apart from the chunk framing
+
 /// This constructor creates an empty HTTP::Parser, ready for use for either reading or writing.
 /// All this constructor does is call HTTP::Parser::Clean().
 HTTP::Parser::Parser(){
@@ -338,19 +340,10 @@ void HTTP::Parser::Proxy(Socket::Connection &from, Socket::Connection &to){
           }
         }else{
           // Make sure the received data ends in a newline (\n).
+          // get() already absorbs anything received after a partial line, so just wait for more.
           if (*(from.Received().get().rbegin()) != '\n'){
-            if (from.Received().size() > 1){
-              // make a copy of the first part
-              std::string tmp = from.Received().get();
-              // clear the first part, wiping it from the partlist
-              from.Received().get().clear();
-              from.Received().size();
-              // take the now first (was second) part, insert the stored part in front of it
-              from.Received().get().insert(0, tmp);
-            }else{
-              Util::sleep(100);
-            }
-            if (*(from.Received().get().rbegin()) != '\n'){continue;}
+            Util::sleep(100);
+            continue;
           }
           // forward the size and any empty lines
           to.SendNow(from.Received().get());
@@ -515,25 +508,36 @@ bool HTTP::Parser::Read(Socket::Connection &conn, Util::DataCallback &cb){
   if (!conn.Received().size()){
     return (parse(conn.Received().get(), cb) && (!possiblyComplete || !conn || !JSON::Value(url).asInt()));
   }
-  while (conn.Received().size()){
-    // Make sure the received data ends in a newline (\n).
-    while ((!seenHeaders || (getChunks && !doingChunk)) && conn.Received().get().size() &&
-           *(conn.Received().get().rbegin()) != '\n'){
-      if (conn.Received().size() > 1){
-        // make a copy of the first part
-        std::string tmp = conn.Received().get();
-        // clear the first part, wiping it from the partlist
-        conn.Received().get().clear();
-        conn.Received().size();
-        // take the now first (was second) part, insert the stored part in front of it
-        conn.Received().get().insert(0, tmp);
-      }else{
-        return false;
+  Socket::Buffer &buf = conn.Received();
+  while (buf.size()){
+    // Body data is handed on straight from the socket buffer, without copying it to a string first
+    if (seenHeaders && !headerOnly && !bodyless()){
+      if (knownLength && !getChunks && length > body.length()){
+        size_t toappend = buf.bytes(length - body.length());
+        if (!bodyData(buf.peek(toappend), toappend, cb)){length -= toappend;}
+        buf.consume(toappend);
+        currentLength += toappend;
+        if (length != body.length()){continue;}
+        if (method == "POST" && GetHeader("Content-Type") == "application/x-www-form-urlencoded"){parseVars(body, vars);}
+        return true;
+      }
+      if (getChunks && doingChunk){
+        size_t toappend = buf.bytes(doingChunk);
+        bodyData(buf.peek(toappend), toappend, cb);
+        buf.consume(toappend);
+        currentLength += toappend;
+        doingChunk -= toappend;
+        continue;
       }
     }
+    // Make sure the received data ends in a newline (\n).
+    // The buffer already appends all data received since to a line that does not.
+    if ((!seenHeaders || (getChunks && !doingChunk)) && buf.get().size() && *(buf.get().rbegin()) != '\n'){
+      return false;
+    }
 
     // return true if a parse succeeds, and is not a request
-    if (parse(conn.Received().get(), cb) && (!possiblyComplete || !conn || !JSON::Value(url).asInt())){
+    if (parse(buf.get(), cb) && (!possiblyComplete || !conn || !JSON::Value(url).asInt())){
       return true;
     }
   }
@@ -643,11 +647,7 @@ bool HTTP::Parser::parse(std::string &HTTPbuffer, Util::DataCallback &cb){
     }
     if (seenHeaders){
       if (headerOnly){return true;}
-      //Check if we have a response code that may never have a body
-      if (url.size() && url[0] >= '0' && url[0] <= '9'){
-        unsigned int code = atoi(url.data());
-        if ((code >= 100 && code < 200) || code == 204 || code == 304){return true;}
-      }
+      if (bodyless()){return true;}
       if (knownLength && !getChunks){
         unsigned int toappend = length - body.length();
 
@@ -656,22 +656,8 @@ bool HTTP::Parser::parse(std::string &HTTPbuffer, Util::DataCallback &cb){
         if (toappend > HTTPbuffer.size()){toappend = HTTPbuffer.size();}
 
         if (toappend > 0){
-          bool shouldAppend = true;
-          // check if pointer callback function is set and run callback. remove partial data from buffer
-          if (bodyCallback){
-            bodyCallback(HTTPbuffer.data(), toappend);
-            length -= toappend;
-            shouldAppend = false;
-          }
-
-          // check if reference callback function is set and run callback. remove partial data from buffer
-          if (&cb != &Util::defaultDataCallback){
-            cb.dataCallback(HTTPbuffer.data(), toappend);
-            length -= toappend;
-            shouldAppend = false;
-          }
-
-          if (shouldAppend){body.append(HTTPbuffer, 0, toappend);}
+          // data passed to a callback is not kept, so it counts down the length instead
+          if (!bodyData(HTTPbuffer.data(), toappend, cb)){length -= toappend;}
           HTTPbuffer.erase(0, toappend);
           currentLength += toappend;
         }
@@ -689,18 +675,7 @@ bool HTTP::Parser::parse(std::string &HTTPbuffer, Util::DataCallback &cb){
             unsigned int toappend = HTTPbuffer.size();
             if (toappend > doingChunk){toappend = doingChunk;}
 
-            bool shouldAppend = true;
-            if (bodyCallback){
-              bodyCallback(HTTPbuffer.data(), toappend);
-              shouldAppend = false;
-            }
-
-            if (&cb != &Util::defaultDataCallback){
-              cb.dataCallback(HTTPbuffer.data(), toappend);
-              shouldAppend = false;
-            }
-
-            if (shouldAppend){body.append(HTTPbuffer, 0, toappend);}
+            bodyData(HTTPbuffer.data(), toappend, cb);
             HTTPbuffer.erase(0, toappend);
             doingChunk -= toappend;
           }else{
@@ -729,18 +704,7 @@ bool HTTP::Parser::parse(std::string &HTTPbuffer, Util::DataCallback &cb){
         }else{
           if (protocol.substr(0, 4) == "RTSP" || method.substr(0, 4) == "RTSP"){return true;}
           unsigned int toappend = HTTPbuffer.size();
-          bool shouldAppend = true;
-          if (bodyCallback){
-            bodyCallback(HTTPbuffer.data(), toappend);
-            shouldAppend = false;
-          }
-
-          if (&cb != &Util::defaultDataCallback){
-            cb.dataCallback(HTTPbuffer.data(), toappend);
-            shouldAppend = false;
-          }
-
-          if (shouldAppend){body.append(HTTPbuffer, 0, toappend);}
+          bodyData(HTTPbuffer.data(), toappend, cb);
           HTTPbuffer.erase(0, toappend);
 
           // return true if there is no body, otherwise we only stop when the connection is dropped
@@ -753,6 +717,98 @@ bool HTTP::Parser::parse(std::string &HTTPbuffer, Util::DataCallback &cb){
   return possiblyComplete; // empty input
 }// HTTPReader::parse
 
+/// Hands a piece of body data to the body callbacks, or appends it to the body if none are set.
+/// Returns true if the data was appended to the body.
+bool HTTP::Parser::bodyData(const char *data, size_t len, Util::DataCallback &cb){
+  bool shouldAppend = true;
+  if (bodyCallback){
+    bodyCallback(data, len);
+    shouldAppend = false;
+  }
+  if (&cb != &Util::defaultDataCallback){
+    cb.dataCallback(data, len);
+    shouldAppend = false;
+  }
+  if (shouldAppend){body.append(data, len);}
+  return shouldAppend;
+}
+
+/// Returns true if this is a response with a code that may never have a body.
+bool HTTP::Parser::bodyless() const{
+  if (!url.size() || url[0] < '0' || url[0] > '9'){return false;}
+  unsigned int code = atoi(url.data());
+  return (code >= 100 && code < 200) || code == 204 || code == 304;
+}
+
+/// Parses a "Range: " header, setting byteStart and byteEnd.
+/// Assumes byteStart and byteEnd are initialized to their minimum respectively maximum values
+/// when the function is called. On error, byteEnd is set to zero and the function return false.
+bool HTTP::parseRange(std::string header, uint64_t &byteStart, uint64_t &byteEnd){
+  if (header.size() < 6 || header.substr(0, 6) != "bytes="){
+    byteEnd = 0;
+    WARN_MSG("Invalid range header: %s", header.c_str());
+    return false;
+  }
+  header.erase(0, 6);
+  // Do parsing of the rest of the header...
+  if (header.size() && header[0] == '-'){
+    // negative range = count from end
+    byteStart = 0;
+    for (unsigned int i = 1; i < header.size(); ++i){
+      if (header[i] >= '0' && header[i] <= '9'){
+        byteStart *= 10;
+        byteStart += header[i] - '0';
+        continue;
+      }
+      break;
+    }
+    if (byteStart > byteEnd){
+      // entire file if starting before byte zero
+      byteStart = 0;
+    }else{
+      // the last byteStart bytes, up to and including byteEnd
+      byteStart = byteEnd + 1 - byteStart;
+    }
+    MEDIUM_MSG("Range request: %" PRIu64 "-%" PRIu64 " (%s)", byteStart, byteEnd, header.c_str());
+    return true;
+  }
+
+  // Positive range
+  long long size = byteEnd;
+  byteEnd = 0;
+  byteStart = 0;
+  unsigned int i = 0;
+  for (; i < header.size(); ++i){
+    if (header[i] >= '0' && header[i] <= '9'){
+      byteStart *= 10;
+      byteStart += header[i] - '0';
+      continue;
+    }
+    break;
+  }
+  if (i >= header.size() || header[i] != '-'){
+    WARN_MSG("Invalid range header: %s", header.c_str());
+    byteEnd = 0;
+    return false;
+  }
+  ++i;
+  if (i < header.size()){
+    for (; i < header.size(); ++i){
+      if (header[i] >= '0' && header[i] <= '9'){
+        byteEnd *= 10;
+        byteEnd += header[i] - '0';
+        continue;
+      }
+      break;
+    }
+    if (byteEnd > size){byteEnd = size;}
+  }else{
+    byteEnd = size;
+  }
+  MEDIUM_MSG("Range request: %" PRIu64 "-%" PRIu64 " (%s)", byteStart, byteEnd, header.c_str());
+  return true;
+}
+
 /// HTTP variable parser to std::map<std::string, std::string> structure.
 /// Reads variables from data, decodes and stores them to storage.
 void HTTP::parseVars(const std::string &data, std::map<std::string, std::string> &storage, const std::string & separator){
@@ -798,10 +854,25 @@ void HTTP::Parser::Chunkify(const std::string &bodypart, Socket::Connection &con
 /// \param size The size of the data to send.
 /// \param conn The connection to use for sending.
 void HTTP::Parser::Chunkify(const char *data, unsigned int size, Socket::Connection &conn){
+  struct iovec vec;
+  vec.iov_base = (void *)data;
+  vec.iov_len = size;
+  Chunkify(&vec, 1, conn);
+}
+
+/// Sends the given buffers as one chunk if protocol is HTTP/1.1, sends them as-is otherwise.
+/// The chunk size, the buffers and the trailing newline are written together, so that headers
+/// built on the stack can be sent along with payload that still lives in a data page.
+/// \param vec The buffers to send, in order.
+/// \param count The amount of buffers in vec.
+/// \param conn The connection to use for sending.
+void HTTP::Parser::Chunkify(const struct iovec *vec, size_t count, Socket::Connection &conn){
   static char hexa[] = "0123456789abcdef";
+  size_t size = 0;
+  for (size_t i = 0; i < count; ++i){size += vec[i].iov_len;}
   if (bufferChunks){
     if (size){
-      body.append(data, size);
+      for (size_t i = 0; i < count; ++i){body.append((const char *)vec[i].iov_base, vec[i].iov_len);}
     }else{
       SetHeader("Content-Length", body.length());
       SendResponse("200", "OK", conn);
@@ -810,23 +881,35 @@ void HTTP::Parser::Chunkify(const char *data, unsigned int size, Socket::Connect
     return;
   }
   if (sendingChunks){
+    if (!size){
+      conn.SendNow("0\r\n\r\n", 5);
+      return;
+    }
     // prepend the chunk size and \r\n
-    if (!size){conn.SendNow("0\r\n\r\n", 5);}
     size_t offset = 8;
-    unsigned int t_size = size;
+    size_t t_size = size;
     char len[] = "\000\000\000\000\000\000\0000\r\n";
     while (t_size && offset < 9){
       len[--offset] = hexa[t_size & 0xf];
       t_size >>= 4;
     }
-    conn.SendNow(len + offset, 10 - offset);
-    // send the chunk itself
-    conn.SendNow(data, size);
+    struct iovec chunk[CHUNKIFY_IOVECS];
+    if (count + 2 > CHUNKIFY_IOVECS){
+      conn.SendNow(len + offset, 10 - offset);
+      conn.SendNow(vec, count);
+      conn.SendNow("\r\n", 2);
+      return;
+    }
+    chunk[0].iov_base = len + offset;
+    chunk[0].iov_len = 10 - offset;
+    for (size_t i = 0; i < count; ++i){chunk[i + 1] = vec[i];}
     // append \r\n
-    conn.SendNow("\r\n", 2);
+    chunk[count + 1].iov_base = (void *)"\r\n";
+    chunk[count + 1].iov_len = 2;
+    conn.SendNow(chunk, count + 2);
   }else{
     // just send the chunk itself
-    conn.SendNow(data, size);
+    conn.SendNow(vec, count);
     // close the connection if this was the end of the file
     if (!size){
       conn.close();
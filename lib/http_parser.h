@@ -16,6 +16,9 @@ namespace HTTP{
   /// Reads variables from data, decodes and stores them to storage.
   void parseVars(const std::string &data, std::map<std::string, std::string> &storage, const std::string & separator = "&");
 
+  /// Parses the value of a "Range" header against a resource of byteEnd+1 bytes.
+  bool parseRange(std::string header, uint64_t &byteStart, uint64_t &byteEnd);
+
   /// Simple class for reading and writing HTTP 1.0 and 1.1.
   class Parser{
   public:
@@ -47,6 +50,7 @@ namespace HTTP{
     void StartResponse(Parser &request, Socket::Connection &conn, bool bufferAllChunks = false);
     void Chunkify(const std::string &bodypart, Socket::Connection &conn);
     void Chunkify(const char *data, unsigned int size, Socket::Connection &conn);
+    void Chunkify(const struct iovec *vec, size_t count, Socket::Connection &conn);
     void Proxy(Socket::Connection &from, Socket::Connection &to);
     void Clean();
     void CleanPreserveHeaders();
@@ -73,6 +77,8 @@ namespace HTTP{
     bool possiblyComplete;
     unsigned int doingChunk;
     bool parse(std::string &HTTPbuffer, Util::DataCallback &cb = Util::defaultDataCallback);
+    bool bodyData(const char *data, size_t len, Util::DataCallback &cb);
+    bool bodyless() const;
     std::string builder;
     std::string read_buffer;
     std::map<std::string, std::string> headers;
@@ -8,6 +8,7 @@
 #include <arpa/inet.h> //for htonl and friends
 #include <stdlib.h>    //for malloc and free
 #include <string.h>    //for memcpy
+#include <unistd.h>    //for pread
 
 #include "bitfields.h"
 #include "defines.h"
@@ -121,6 +122,54 @@ namespace MP4{
     }
   }
 
+  /// Reads the header of the box at pos in fd, which must end before end.
+  /// Sets the box type, its total size and the size of its header.
+  static bool readBoxHeader(int fd, uint64_t pos, uint64_t end, std::string &type, uint64_t &size, uint64_t &hdrSize){
+    char hdr[16];
+    if (pos + 8 > end || pread(fd, hdr, 8, pos) != 8){return false;}
+    type.assign(hdr + 4, 4);
+    size = Bit::btohl(hdr);
+    hdrSize = 8;
+    if (size == 1){
+      if (pos + 16 > end || pread(fd, hdr + 8, 8, pos + 8) != 8){return false;}
+      size = Bit::btohll(hdr + 8);
+      hdrSize = 16;
+    }else if (size == 0){
+      size = end - pos;
+    }
+    return size >= hdrSize && pos + size <= end;
+  }
+
+  /// Returns the amount of tracks in a progressive MP4 file: one with its moov box before the mdat
+  /// box and no movie fragments. Returns zero for any other file, or if it could not be read.
+  /// Only box headers are read, so this is cheap even for large files.
+  size_t progressiveTracks(int fd, uint64_t fileSize){
+    size_t tracks = 0;
+    bool haveMoov = false;
+    uint64_t pos = 0;
+    while (pos < fileSize){
+      std::string type;
+      uint64_t size, hdrSize;
+      if (!readBoxHeader(fd, pos, fileSize, type, size, hdrSize)){return 0;}
+      if (type == "moof" || (type == "mdat" && !haveMoov)){return 0;}
+      if (type == "moov"){
+        if (haveMoov){return 0;}
+        haveMoov = true;
+        uint64_t subPos = pos + hdrSize;
+        while (subPos < pos + size){
+          std::string subType;
+          uint64_t subSize, subHdrSize;
+          if (!readBoxHeader(fd, subPos, pos + size, subType, subSize, subHdrSize)){return 0;}
+          if (subType == "mvex"){return 0;}
+          if (subType == "trak"){++tracks;}
+          subPos += subSize;
+        }
+      }
+      pos += size;
+    }
+    return haveMoov ? tracks : 0;
+  }
+
   bool Box::read(FILE *newData){
     char readVal[16];
     long long unsigned int pos = ftell(newData);
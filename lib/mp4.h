@@ -17,6 +17,7 @@ namespace MP4{
   std::string readBoxType(FILE *newData);
   bool skipBox(FILE *newData);
   uint64_t calcBoxSize(const char *p);
+  size_t progressiveTracks(int fd, uint64_t fileSize);
 
   class Box{
   public:
@@ -10,6 +10,11 @@
 #include "defines.h"
 #include "nal.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NAL_SIMD_SUPPORTED
+#include <immintrin.h>
+#endif
+
 namespace nalu{
   std::deque<int> parseNalSizes(DTSC::Packet &pack){
     std::deque<int> result;
@@ -28,23 +33,8 @@ namespace nalu{
   std::string removeEmulationPrevention(const std::string &data){
     std::string result;
     result.resize(data.size());
-    result[0] = data[0];
-    result[1] = data[1];
-    size_t dataPtr = 2;
-    size_t dataLen = data.size();
-    size_t resPtr = 2;
-    while (dataPtr + 2 < dataLen){
-      if (!data[dataPtr] && !data[dataPtr + 1] && data[dataPtr + 2] == 3){// We have found an emulation prevention
-        result[resPtr++] = data[dataPtr++];
-        result[resPtr++] = data[dataPtr++];
-        dataPtr++; // Skip the emulation prevention byte
-      }else{
-        result[resPtr++] = data[dataPtr++];
-      }
-    }
-
-    while (dataPtr < dataLen){result[resPtr++] = data[dataPtr++];}
-    return result.substr(0, resPtr);
+    result.resize(removeEmulationPrevention(data.data(), data.size(), (char *)result.data()));
+    return result;
   }
 
   unsigned long toAnnexB(const char *data, unsigned long dataSize, char *&result){
@@ -71,12 +61,14 @@ namespace nalu{
     return data + dataSize;
   }
 
-  /// Scan data for Annex B start code. Returns pointer to it when found, null otherwise.
-  const char *scanAnnexB(const char *data, uint32_t dataSize){
+  /// Scans byte by byte for two zero bytes followed by marker, returning a pointer to the first
+  /// zero byte or null. With a marker of 1 this is an Annex B start code, with 3 it is an
+  /// emulation prevention sequence.
+  static const char *scanZeroZeroScalar(const char *data, uint32_t dataSize, char marker){
     char *offset = (char *)data;
     const char *maxData = data + dataSize - 2;
     while (offset < maxData){
-      if (offset[2] > 1){
+      if (offset[2] && offset[2] != marker){
         // We have no zero in the third byte, so we need to skip at least 3 bytes forward
         offset += 3;
         continue;
@@ -95,35 +87,101 @@ namespace nalu{
     return 0;
   }
 
+#ifdef NAL_SIMD_SUPPORTED
+  /// Returns the widest usable SIMD scanner: 2 for AVX2, 1 for SSE2 (always there on x86_64, not
+  /// on every i386 CPU) or 0 for none.
+  static int simdLevel(){
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")){return 2;}
+    return __builtin_cpu_supports("sse2") ? 1 : 0;
+  }
+
+  /// Checks 16 positions per step: three overlapping loads are compared against 00, 00 and the
+  /// marker, and the first position where all three match is returned. The last few bytes that
+  /// don't fill a full step are left to the scalar scanner.
+  __attribute__((target("sse2"))) static const char *scanZeroZeroSSE2(const char *data, uint32_t dataSize, char marker){
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mark = _mm_set1_epi8(marker);
+    uint32_t i = 0;
+    for (; i + 18 <= dataSize; i += 16){
+      __m128i third = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i + 2)), mark);
+      if (!_mm_movemask_epi8(third)){continue;}
+      __m128i first = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i)), zero);
+      __m128i second = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i + 1)), zero);
+      int mask = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(first, second), third));
+      if (mask){return data + i + __builtin_ctz(mask);}
+    }
+    return scanZeroZeroScalar(data + i, dataSize - i, marker);
+  }
+
+  /// As scanZeroZeroSSE2, but 32 positions per step.
+  __attribute__((target("avx2"))) static const char *scanZeroZeroAVX2(const char *data, uint32_t dataSize, char marker){
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i mark = _mm256_set1_epi8(marker);
+    uint32_t i = 0;
+    for (; i + 34 <= dataSize; i += 32){
+      __m256i third = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i + 2)), mark);
+      if (!_mm256_movemask_epi8(third)){continue;}
+      __m256i first = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i)), zero);
+      __m256i second = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i + 1)), zero);
+      unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(first, second), third));
+      if (mask){return data + i + __builtin_ctz(mask);}
+    }
+    return scanZeroZeroSSE2(data + i, dataSize - i, marker);
+  }
+#endif
+
+  /// Finds the first 00 00 <marker> sequence, using AVX2 or SSE2 where available. All of them
+  /// check every position, so the result is always the same as the scalar scanner's.
+  static const char *scanZeroZero(const char *data, uint32_t dataSize, char marker){
+#ifdef NAL_SIMD_SUPPORTED
+    static const int simd = simdLevel();
+    if (simd && dataSize >= 64){
+      return simd == 2 ? scanZeroZeroAVX2(data, dataSize, marker) : scanZeroZeroSSE2(data, dataSize, marker);
+    }
+#endif
+    return scanZeroZeroScalar(data, dataSize, marker);
+  }
+
+  /// Scan data for Annex B start code. Returns pointer to it when found, null otherwise.
+  const char *scanAnnexB(const char *data, uint32_t dataSize){return scanZeroZero(data, dataSize, 1);}
+
+  /// Copies data to out, leaving out the emulation prevention byte of every 00 00 03 sequence.
+  /// Returns the amount of bytes written; out must have room for dataLen bytes.
+  size_t removeEmulationPrevention(const char *data, size_t dataLen, char *out){
+    const char *end = data + dataLen;
+    char *dest = out;
+    while (data < end){
+      const char *epb = scanZeroZero(data, end - data, 3);
+      size_t copy = epb ? epb + 2 - data : end - data;
+      memcpy(dest, data, copy);
+      dest += copy;
+      data += copy + (epb ? 1 : 0);
+    }
+    return dest - out;
+  }
+
   unsigned long fromAnnexB(const char *data, unsigned long dataSize, char *&result){
-    const char *lastCheck = data + dataSize - 3;
     if (!result){
       FAIL_MSG("No output buffer given to FromAnnexB");
       return 0;
     }
-    int offset = 0;
+    const char *dataEnd = data + dataSize;
     int newOffset = 0;
-    while (offset < dataSize){
-      const char *begin = data + offset;
-      while (begin < lastCheck && !(!begin[0] && !begin[1] && begin[2] == 0x01)){
-        begin++;
-        if (begin < lastCheck && begin[0]){begin++;}
-      }
-      begin += 3; // Initialize begin after the first 0x000001 pattern.
-      if (begin > data + dataSize){
-        offset = dataSize;
-        continue;
-      }
-      const char *end = (const char *)memmem(begin, dataSize - (begin - data), "\000\000\001", 3);
-      if (!end){end = data + dataSize;}
-      // Check for 4-byte lead in's. Yes, we access -1 here
-      if (end > begin && (end - data) != dataSize && end[-1] == 0x00){end--;}
+    // Find the first 0x000001 pattern; anything before it is not part of a NAL unit
+    const char *begin = scanAnnexB(data, dataSize);
+    while (begin){
+      begin += 3;
+      const char *end = scanAnnexB(begin, dataEnd - begin);
+      const char *next = end;
+      if (!end){end = dataEnd;}
+      // Check for 4-byte lead in's
+      if (next && end > begin && end[-1] == 0x00){end--;}
       unsigned int nalSize = end - begin;
       Bit::htobl(result + newOffset, nalSize);
       memcpy(result + newOffset + 4, begin, nalSize);
-
       newOffset += 4 + nalSize;
-      offset = end - data;
+      begin = next;
     }
     return newOffset;
   }
@@ -12,6 +12,7 @@ namespace nalu{
 
   std::deque<int> parseNalSizes(DTSC::Packet &pack);
   std::string removeEmulationPrevention(const std::string &data);
+  size_t removeEmulationPrevention(const char *data, size_t dataLen, char *out);
 
   unsigned long toAnnexB(const char *data, unsigned long dataSize, char *&result);
   unsigned long fromAnnexB(const char *data, unsigned long dataSize, char *&result);
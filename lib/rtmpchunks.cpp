@@ -6,6 +6,7 @@
 #include "flv_tag.h"
 #include "rtmpchunks.h"
 #include "timing.h"
+#include <algorithm>
 
 std::string RTMPStream::handshake_in;  ///< Input for the handshake.
 std::string RTMPStream::handshake_out; ///< Output for the handshake.
@@ -335,7 +336,8 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
   gettimeofday(&RTMPStream::lastrec, 0);
   unsigned int i = 0;
   if (!buffer.available(3)){return false;}// we want at least 3 bytes
-  std::string indata = buffer.copy(3);
+  // The header is read in place; every peek may move the data, so indata is refreshed each time
+  const char *indata = buffer.peek(3);
 
   unsigned char chunktype = indata[i++];
   // read the chunkstream ID properly
@@ -349,7 +351,7 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
   }
 
   bool allow_short = lastrecv.count(cs_id);
-  RTMPStream::Chunk prev = lastrecv[cs_id];
+  const RTMPStream::Chunk &prev = lastrecv[cs_id];
 
   // process the rest of the header, for each chunk type
   headertype = chunktype & 0xC0;
@@ -362,7 +364,7 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
       DONTEVEN_MSG("Cannot read whole header");
       return false;
     }// can't read whole header
-    indata = buffer.copy(i + 11);
+    indata = buffer.peek(i + 11);
     timestamp = indata[i++] * 256 * 256;
     timestamp += indata[i++] * 256;
     timestamp += indata[i++];
@@ -383,7 +385,7 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
       DONTEVEN_MSG("Cannot read whole header");
       return false;
     }// can't read whole header
-    indata = buffer.copy(i + 7);
+    indata = buffer.peek(i + 7);
     if (!allow_short){WARN_MSG("Warning: Header type 0x40 with no valid previous chunk!");}
     timestamp = indata[i++] * 256 * 256;
     timestamp += indata[i++] * 256;
@@ -405,7 +407,7 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
       DONTEVEN_MSG("Cannot read whole header");
       return false;
     }// can't read whole header
-    indata = buffer.copy(i + 3);
+    indata = buffer.peek(i + 3);
     if (!allow_short){WARN_MSG("Warning: Header type 0x80 with no valid previous chunk!");}
     timestamp = indata[i++] * 256 * 256;
     timestamp += indata[i++] * 256;
@@ -452,7 +454,7 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
       DONTEVEN_MSG("Cannot read timestamp");
       return false;
     }// can't read timestamp
-    indata = buffer.copy(i + 4);
+    indata = buffer.peek(i + 4);
     timestamp = indata[i++] * 256 * 256 * 256;
     timestamp += indata[i++] * 256 * 256;
     timestamp += indata[i++] * 256;
@@ -467,12 +469,14 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
       DONTEVEN_MSG("Cannot read all data yet");
       return false;
     }// can't read all data (yet)
-    buffer.remove(i);                                      // remove the header
+    const char *payload = buffer.peek(i + real_len) + i;
     if (prev.len_left > 0){
-      data = prev.data + buffer.remove(real_len); // append the data and remove from buffer
+      data.assign(prev.data); // continue the previous chunk
+      data.append(payload, real_len);
     }else{
-      data = buffer.remove(real_len); // append the data and remove from buffer
+      data.assign(payload, real_len);
     }
+    buffer.consume(i + real_len); // remove the header and data
     lastrecv[cs_id] = *this;
     RTMPStream::rec_cnt += i + real_len;
     if (RTMPStream::rec_cnt >= 0xf0000000){
@@ -486,9 +490,8 @@ bool RTMPStream::Chunk::Parse(Socket::Buffer &buffer){
       return Parse(buffer);
     }
   }else{
-    buffer.remove(i); // remove the header
-    data = "";
-    indata = indata.substr(i + real_len);
+    buffer.consume(i); // remove the header
+    data.clear();
     lastrecv[cs_id] = *this;
     RTMPStream::rec_cnt += i + real_len;
     return true;
@@ -549,3 +552,44 @@ bool RTMPStream::doHandshake(){
   RTMPStream::snd_cnt += 3073;
   return true;
 }
+
+/// Creates the state of a new connection, with the default chunk and window sizes.
+RTMPStream::Session::Session(){
+  reset();
+}
+
+/// Returns this session to the state of a new connection.
+void RTMPStream::Session::reset(){
+  chunk_rec_max = 128;
+  chunk_snd_max = 128;
+  rec_window_size = 2500000;
+  snd_window_size = 2500000;
+  rec_window_at = 0;
+  snd_window_at = 0;
+  rec_cnt = 0;
+  snd_cnt = 0;
+  lastrec.tv_sec = 0;
+  lastrec.tv_usec = 0;
+  lastsend.clear();
+  lastrecv.clear();
+  handshake_in.clear();
+  handshake_out.clear();
+}
+
+/// Exchanges this session with the process-wide state, without copying the chunk maps.
+/// Calling it again restores both.
+void RTMPStream::Session::swap(){
+  std::swap(chunk_rec_max, RTMPStream::chunk_rec_max);
+  std::swap(chunk_snd_max, RTMPStream::chunk_snd_max);
+  std::swap(rec_window_size, RTMPStream::rec_window_size);
+  std::swap(snd_window_size, RTMPStream::snd_window_size);
+  std::swap(rec_window_at, RTMPStream::rec_window_at);
+  std::swap(snd_window_at, RTMPStream::snd_window_at);
+  std::swap(rec_cnt, RTMPStream::rec_cnt);
+  std::swap(snd_cnt, RTMPStream::snd_cnt);
+  std::swap(lastrec, RTMPStream::lastrec);
+  lastsend.swap(RTMPStream::lastsend);
+  lastrecv.swap(RTMPStream::lastrecv);
+  handshake_in.swap(RTMPStream::handshake_in);
+  handshake_out.swap(RTMPStream::handshake_out);
+}
@@ -85,4 +85,27 @@ namespace RTMPStream{
   extern std::string handshake_out;
   /// Does the handshake. Expects handshake_in to be filled, and fills handshake_out.
   bool doHandshake();
+
+  /// Chunk and window state of a single RTMP connection.
+  /// The functions above work on the process-wide state; a process talking to several peers keeps
+  /// a Session per peer and swaps it in before handling that peer.
+  class Session{
+  public:
+    Session();
+    void reset();
+    void swap();
+    size_t chunk_rec_max;
+    size_t chunk_snd_max;
+    size_t rec_window_size;
+    size_t snd_window_size;
+    size_t rec_window_at;
+    size_t snd_window_at;
+    size_t rec_cnt;
+    size_t snd_cnt;
+    timeval lastrec;
+    std::map<unsigned int, Chunk> lastsend;
+    std::map<unsigned int, Chunk> lastrecv;
+    std::string handshake_in;
+    std::string handshake_out;
+  };
 }// namespace RTMPStream
@@ -268,8 +268,8 @@ namespace RTP{
     INSANE_MSG("Sending RTP packet with header size %u and payload size %u", getHsize(), payloadlen);
     // Set timestamp to current time
     setTimestamp(Util::bootMS()*90);
-    // Send RTP packet itself
-    ((Socket::UDPConnection *)socket)->SendNow(data, getHsize() + payloadlen);
+    // Queue RTP packet itself; the caller flushes the socket once it is done sending
+    ((Socket::UDPConnection *)socket)->sendBatched(data, getHsize() + payloadlen);
     // Increment counters
     sentPackets++;
     sentBytes += payloadlen + getHsize();
@@ -1341,15 +1341,20 @@ namespace RTP{
   /// whole payload.
   void toDTSC::handleH264Multi(uint64_t ts, char *buffer, const uint32_t len){
     uint32_t lastStart = 0;
-    for (uint32_t i = 0; i < len - 4; ++i){
-      // search for start code
-      if (buffer[i] == 0 && buffer[i + 1] == 0 && buffer[i + 2] == 0 && buffer[i + 3] == 1){
+    uint32_t i = 0;
+    while (i + 4 < len){
+      // search for a 3-byte start code that is preceded by a zero byte
+      const char *code = nalu::scanAnnexB(buffer + i + 1, len - i - 2);
+      if (!code){break;}
+      i = code - buffer - 1;
+      if (buffer[i] == 0){
         // if found, handle a packet from the last start code up to this start code
         Bit::htobl(buffer + lastStart, (i - lastStart - 1) - 4); // size-prepend
         handleH264Single(ts, buffer + lastStart, (i - lastStart - 1),
                          h264::isKeyframe(buffer + lastStart + 4, i - lastStart - 5));
         lastStart = i;
       }
+      ++i;
     }
     // Last packet (might be first, if no start codes found)
     Bit::htobl(buffer + lastStart, (len - lastStart) - 4); // size-prepend
@@ -6,11 +6,13 @@
 #include "stream.h"
 #include "timing.h"
 #include <cerrno>
+#include <climits>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <fcntl.h>
 #include <iostream>
+#include <sys/file.h>
 #include <sys/mman.h>
 #include <sys/sem.h>
 #include <unistd.h>
@@ -21,6 +23,13 @@
 #include <windows.h>
 #endif
 
+#ifdef __linux__
+#include <linux/futex.h>
+#include <linux/magic.h>
+#include <sys/syscall.h>
+#include <sys/vfs.h>
+#endif
+
 namespace IPC{
 
 #if defined(__CYGWIN__) || defined(_WIN32)
@@ -29,6 +38,43 @@ namespace IPC{
   void releasePage(std::string p){preservedPages.erase(p);}
 #endif
 
+  /// Waits for at most millis milliseconds for the value of word to differ from expected.
+  /// Returns true if the value changed (or may have changed), false if it timed out.
+  /// The word must be 4-byte aligned; if it is not (or futexes are unavailable), simply sleeps for
+  /// the full duration and reports whether the value changed in the mean time.
+  /// If waiters is given, it counts this process as waiting for the duration of the call, so that
+  /// wordWake can skip the wakeup system call when nobody is waiting.
+  bool wordWait(volatile uint32_t *word, uint32_t expected, uint64_t millis, volatile uint32_t *waiters){
+    if (*word != expected){return true;}
+#ifdef __linux__
+    if (!((uintptr_t)word & 3)){
+      struct timespec ts;
+      ts.tv_sec = millis / 1000;
+      ts.tv_nsec = (millis % 1000) * 1000000;
+      if (waiters){__sync_add_and_fetch(waiters, 1);}
+      int r = syscall(SYS_futex, word, FUTEX_WAIT, expected, &ts, 0, 0);
+      int err = errno;
+      if (waiters){__sync_sub_and_fetch(waiters, 1);}
+      if (!r){return true;}
+      if (err == EAGAIN || err == EINTR){return true;}
+      if (err == ETIMEDOUT){return *word != expected;}
+    }
+#endif
+    Util::sleep(millis);
+    return *word != expected;
+  }
+
+  /// Increases the value of word by one, and wakes up all processes waiting on it in wordWait.
+  /// If waiters is given and no process is counted in it, the wakeup system call is skipped.
+  void wordWake(volatile uint32_t *word, volatile uint32_t *waiters){
+    // Full barrier: either a waiter sees the new value, or we see its waiter count
+    __sync_add_and_fetch(word, 1);
+#ifdef __linux__
+    if (waiters && !__sync_fetch_and_add(waiters, 0)){return;}
+    if (!((uintptr_t)word & 3)){syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, 0, 0, 0);}
+#endif
+  }
+
   ///\brief Empty semaphore constructor, clears all values
   semaphore::semaphore(){
 #if defined(__CYGWIN__) || defined(_WIN32)
@@ -393,6 +439,213 @@ namespace IPC{
 
 #ifdef SHM_ENABLED
 
+  hugePageCounters hugePageStats = {0, 0, 0, 0};
+
+  /// Returns the MIST_HUGEPAGES setting: a hugetlbfs mount point, "thp", or empty if disabled.
+  static const std::string &hugePageSetting(){
+    static std::string setting;
+    static bool checked = false;
+    if (!checked){
+      checked = true;
+      char *env = getenv("MIST_HUGEPAGES");
+      if (env){setting = env;}
+      while (setting.size() > 1 && setting[setting.size() - 1] == '/'){setting.erase(setting.size() - 1);}
+    }
+    return setting;
+  }
+
+  /// Returns true if the named page is a track data page, and huge pages are enabled for those.
+  static bool isHugeDataPage(const std::string &name){
+    return hugePageSetting().size() && !strncmp(name.c_str(), "MstData", 7);
+  }
+
+  /// Returns the path of the named data page on the hugetlbfs mount, or an empty string if
+  /// the page does not go on hugetlbfs.
+  static std::string hugetlbfsPath(const std::string &name){
+    if (!isHugeDataPage(name) || hugePageSetting() == "thp"){return "";}
+    return hugePageSetting() + "/" + name;
+  }
+
+  /// Returns the huge page size of the configured hugetlbfs mount, or zero if it is not one.
+  static uint64_t hugetlbfsPageSize(){
+    static uint64_t pageSize = 0;
+    static bool checked = false;
+    if (!checked){
+      checked = true;
+#ifdef __linux__
+      struct statfs fsInfo;
+      if (!statfs(hugePageSetting().c_str(), &fsInfo) && fsInfo.f_type == HUGETLBFS_MAGIC){
+        pageSize = fsInfo.f_bsize;
+      }
+#endif
+      if (!pageSize){
+        WARN_MSG("%s is not a hugetlbfs mount; data pages will use regular pages", hugePageSetting().c_str());
+      }
+    }
+    return pageSize;
+  }
+
+  /// Returns true if transparent huge pages can be requested for pages in /dev/shm.
+  /// Shared memory only honours madvise(MADV_HUGEPAGE) if it is mounted with a huge= option.
+  static bool shmAllowsTHP(){
+    static bool allowed = false;
+    static bool checked = false;
+    if (!checked){
+      checked = true;
+#ifdef MADV_HUGEPAGE
+      FILE *mounts = fopen("/proc/self/mounts", "r");
+      if (mounts){
+        char mountPoint[256], options[768];
+        while (fscanf(mounts, "%*s %255s %*s %767s %*[^\n]", mountPoint, options) == 2){
+          if (strcmp(mountPoint, "/dev/shm")){continue;}
+          allowed = (strstr(options, "huge=always") || strstr(options, "huge=within_size") || strstr(options, "huge=advise"));
+        }
+        fclose(mounts);
+      }
+#endif
+      if (!allowed){
+        WARN_MSG("/dev/shm is not mounted with a huge= option; data pages will use regular pages");
+      }
+    }
+    return allowed;
+  }
+
+  /// Creates the data page at path on the hugetlbfs mount and maps it, rounding len up to a
+  /// multiple of the huge page size. Returns the file descriptor, or -1 without leaving anything
+  /// behind if the page could not be created, for example because no huge pages are free.
+  /// Like regular pages, a stale page that already exists is overwritten with an error message.
+  static int hugetlbfsCreate(const std::string &path, uint64_t &len, char *&mapped){
+    uint64_t pageSize = hugetlbfsPageSize();
+    if (!pageSize){return -1;}
+    int fd = open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, ACCESSPERMS);
+    if (fd == -1 && errno == EEXIST){
+      ERROR_MSG("Overwriting old page for %s", path.c_str());
+      fd = open(path.c_str(), O_CREAT | O_RDWR, ACCESSPERMS);
+    }
+    if (fd == -1){
+      HIGH_MSG("Could not create %s: %s", path.c_str(), strerror(errno));
+      return -1;
+    }
+    uint64_t hugeLen = ((len ? len : 1) + pageSize - 1) / pageSize * pageSize;
+    if (ftruncate(fd, hugeLen) < 0){
+      HIGH_MSG("truncate of %s failed: %s", path.c_str(), strerror(errno));
+      ::close(fd);
+      unlink(path.c_str());
+      return -1;
+    }
+    char *ptr = (char *)mmap(0, hugeLen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED){
+      HIGH_MSG("mmap of %s failed: %s", path.c_str(), strerror(errno));
+      ::close(fd);
+      unlink(path.c_str());
+      return -1;
+    }
+    len = hugeLen;
+    mapped = ptr;
+    return fd;
+  }
+
+#if !defined(__CYGWIN__) && !defined(_WIN32)
+  /// Opens the page file at path (on the hugetlbfs mount if huge is set, in shared memory otherwise)
+  /// for initLocked, holding an exclusive flock on it. A new file is created empty, so nobody can map
+  /// it before the lock is in place. An existing file is only reused if nobody holds a lock on it.
+  /// Sets created if this call created the file, and inUse if someone else holds a lock on it.
+  /// Returns the file descriptor, or -1.
+  static int openLockedPage(const std::string &path, bool huge, bool &created, bool &inUse){
+    inUse = false;
+    int fd = huge ? open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, ACCESSPERMS)
+                  : shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, ACCESSPERMS);
+    created = (fd != -1);
+    if (fd == -1 && errno == EEXIST){
+      fd = huge ? open(path.c_str(), O_RDWR) : shm_open(path.c_str(), O_RDWR, ACCESSPERMS);
+    }
+    if (fd == -1){
+      HIGH_MSG("Could not create %s: %s", path.c_str(), strerror(errno));
+      return -1;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB)){
+      HIGH_MSG("Page %s is in use by another process", path.c_str());
+      inUse = true;
+      ::close(fd);
+      if (created){huge ? unlink(path.c_str()) : shm_unlink(path.c_str());}
+      return -1;
+    }
+    if (!created){WARN_MSG("Taking over abandoned page %s", path.c_str());}
+    return fd;
+  }
+#endif
+
+  /// Creates the page as master like init does, but exclusively locked (flock) from the moment its
+  /// name appears. Unlike init, it never overwrites a page another process holds a lock on: that
+  /// page is being loaded or used by someone else, and this function fails instead. An unlocked
+  /// leftover page is taken over. The page is only unlinked on close if this call created it.
+  /// Returns true if the page is mapped; the lock is held until the page is closed.
+  bool sharedPage::initLocked(const std::string &name_, uint64_t len_){
+#if defined(__CYGWIN__) || defined(_WIN32)
+    init(name_, len_, true);
+    return mapped;
+#else
+    close();
+    name = name_;
+    len = len_;
+    master = false;
+    mapped = 0;
+    hugetlb = false;
+    handle = -1;
+    bool created = false;
+    bool inUse = false;
+    std::string hugePath = hugetlbfsPath(name);
+    if (isHugeDataPage(name)){++hugePageStats.requested;}
+    uint64_t pageSize = hugePath.size() ? hugetlbfsPageSize() : 0;
+    if (pageSize){
+      handle = openLockedPage(hugePath, true, created, inUse);
+      if (inUse){return false;}
+      if (handle != -1){
+        uint64_t hugeLen = ((len ? len : 1) + pageSize - 1) / pageSize * pageSize;
+        if (!ftruncate(handle, hugeLen)){
+          mapped = (char *)mmap(0, hugeLen, PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0);
+          if (mapped == MAP_FAILED){mapped = 0;}
+        }
+        if (mapped){
+          len = hugeLen;
+          hugetlb = true;
+          master = created;
+          ++hugePageStats.hugetlb;
+          return true;
+        }
+        // No huge pages available; fall back to regular shared memory
+        HIGH_MSG("Could not map %s: %s", hugePath.c_str(), strerror(errno));
+        ::close(handle);
+        if (created){unlink(hugePath.c_str());}
+        handle = -1;
+      }
+    }
+    handle = openLockedPage(name, false, created, inUse);
+    if (handle == -1){return false;}
+    master = created;
+    if (ftruncate(handle, len) < 0){
+      FAIL_MSG("truncate to %" PRIu64 " for page %s failed: %s", len, name.c_str(), strerror(errno));
+      close();
+      return false;
+    }
+    mapped = (char *)mmap(0, len, PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0);
+    if (mapped == MAP_FAILED){
+      FAIL_MSG("mmap for page %s failed: %s", name.c_str(), strerror(errno));
+      mapped = 0;
+      close();
+      return false;
+    }
+    if (isHugeDataPage(name)){
+      bool thp = false;
+#ifdef MADV_HUGEPAGE
+      thp = (hugePageSetting() == "thp" && shmAllowsTHP() && !madvise(mapped, len, MADV_HUGEPAGE));
+#endif
+      ++(thp ? hugePageStats.thp : hugePageStats.fallback);
+    }
+    return true;
+#endif
+  }
+
   /// Returns true if the open file still exists.
   bool sharedPage::exists(){
 #if defined(__CYGWIN__) || defined(_WIN32)
@@ -427,10 +680,17 @@ namespace IPC{
       CloseHandle(handle);
 #else
       ::close(handle);
-      if (master && name != ""){shm_unlink(name.c_str());}
+      if (master && name != ""){
+        if (hugetlb){
+          unlink(hugetlbfsPath(name).c_str());
+        }else{
+          shm_unlink(name.c_str());
+        }
+      }
 #endif
       handle = 0;
     }
+    hugetlb = false;
   }
 
   ///\brief Returns whether the shared page is valid or not
@@ -454,6 +714,7 @@ namespace IPC{
     len = len_;
     master = master_;
     mapped = 0;
+    hugetlb = false;
     if (name.size()){
       INSANE_MSG("Opening page %s in %s mode %s auto-backoff", name.c_str(),
                  master ? "master" : "client", autoBackoff ? "with" : "without");
@@ -488,7 +749,27 @@ namespace IPC{
       // Now shift by those 4 bytes.
       mapped += 4;
 #else
-      handle = shm_open(name.c_str(), (master ? O_CREAT | O_EXCL : 0) | O_RDWR, ACCESSPERMS);
+      std::string hugePath = hugetlbfsPath(name);
+      if (master && isHugeDataPage(name)){
+        ++hugePageStats.requested;
+        if (hugePath.size()){
+          handle = hugetlbfsCreate(hugePath, len, mapped);
+          if (handle != -1){
+            hugetlb = true;
+            ++hugePageStats.hugetlb;
+            // Make sure no stale regular page shadows this one for clients
+            shm_unlink(name.c_str());
+            return;
+          }
+        }
+      }
+      // Clients look on the hugetlbfs mount first, as that is where masters try to create the page
+      handle = -1;
+      if (!master && hugePath.size()){
+        handle = open(hugePath.c_str(), O_RDWR);
+        hugetlb = (handle != -1);
+      }
+      if (handle == -1){handle = shm_open(name.c_str(), (master ? O_CREAT | O_EXCL : 0) | O_RDWR, ACCESSPERMS);}
       if (handle == -1){
         if (master){
           if (len > 1){ERROR_MSG("Overwriting old page for %s", name.c_str());}
@@ -498,6 +779,11 @@ namespace IPC{
           while (i < 11 && handle == -1 && autoBackoff){
             i++;
             Util::wait(Util::expBackoffMs(i-1, 10, 10000));
+            if (hugePath.size()){
+              handle = open(hugePath.c_str(), O_RDWR);
+              hugetlb = (handle != -1);
+              if (hugetlb){break;}
+            }
             handle = shm_open(name.c_str(), O_RDWR, ACCESSPERMS);
           }
         }
@@ -537,12 +823,35 @@ namespace IPC{
         mapped = 0;
         return;
       }
+      if (!hugetlb && isHugeDataPage(name)){
+        // Clients need to madvise their own mapping too, or they map the huge pages as 4KiB ones
+        bool thp = false;
+#ifdef MADV_HUGEPAGE
+        thp = (hugePageSetting() == "thp" && shmAllowsTHP() && !madvise(mapped, len, MADV_HUGEPAGE));
+#endif
+        if (master){++(thp ? hugePageStats.thp : hugePageStats.fallback);}
+      }
 #endif
     }
   }
 
 #endif
 
+#ifndef SHM_ENABLED
+  /// Creates the page as master, holding an exclusive flock on it. Without shared memory, pages are
+  /// plain files that are not created exclusively; fails without removing the file if someone else
+  /// holds a lock on it.
+  bool sharedPage::initLocked(const std::string &name_, uint64_t len_){
+    init(name_, len_, true);
+    master = false;
+    if (!mapped || flock(handle, LOCK_EX | LOCK_NB)){
+      close();
+      return false;
+    }
+    return true;
+  }
+#endif
+
   /// brief Creates a shared file
   ///\param name_ The name of the file to be created
   ///\param len_ The size to make the file
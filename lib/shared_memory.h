@@ -90,6 +90,23 @@ namespace IPC{
     char *mapped;
   };
 
+  /// Cross-process wakeup primitives on a 32-bit word in shared memory.
+  /// Uses futexes where available, and falls back to plain sleeping/polling otherwise.
+  bool wordWait(volatile uint32_t *word, uint32_t expected, uint64_t millis, volatile uint32_t *waiters = 0);
+  void wordWake(volatile uint32_t *word, volatile uint32_t *waiters = 0);
+
+  /// Counts how the track data pages created by this process were backed.
+  /// Huge pages are only used for data pages, and only if requested through the MIST_HUGEPAGES
+  /// environment variable: either the path of a hugetlbfs mount, or "thp" to request transparent
+  /// huge pages for data pages in regular shared memory (requires /dev/shm mounted with huge=).
+  struct hugePageCounters{
+    uint64_t requested; ///< Data pages created while huge pages were enabled
+    uint64_t hugetlb;   ///< Data pages backed by hugetlbfs
+    uint64_t thp;       ///< Data pages with transparent huge pages requested successfully
+    uint64_t fallback;  ///< Data pages that fell back to regular pages
+  };
+  extern hugePageCounters hugePageStats;
+
 #if defined(__CYGWIN__) || defined(_WIN32)
   void preservePage(std::string);
   void releasePage(std::string);
@@ -104,6 +121,7 @@ namespace IPC{
     ~sharedPage();
     operator bool() const;
     void init(const std::string &name_, uint64_t len_, bool master_ = false, bool autoBackoff = true);
+    bool initLocked(const std::string &name_, uint64_t len_);
     void operator=(sharedPage &rhs);
     bool operator<(const sharedPage &rhs) const{return name < rhs.name;}
     void unmap();
@@ -124,6 +142,8 @@ namespace IPC{
     bool master;
     ///\brief A pointer to the payload of the page
     char *mapped;
+    ///\brief Whether the page lives on a hugetlbfs mount instead of in regular shared memory
+    bool hugetlb;
   };
 #else
   ///\brief A class for handling shared memory pages.
@@ -133,6 +153,7 @@ namespace IPC{
     sharedPage(const std::string &name_ = "", uint64_t len_ = 0, bool master_ = false, bool autoBackoff = true);
     sharedPage(const sharedPage &rhs);
     ~sharedPage();
+    bool initLocked(const std::string &name_, uint64_t len_);
   };
 #endif
 }// namespace IPC
@@ -6,6 +6,7 @@
 #include "socket.h"
 #include "timing.h"
 #include "json.h"
+#include <algorithm>
 #include <cstdlib>
 #include <ifaddrs.h>
 #include <netdb.h>
@@ -14,8 +15,41 @@
 #include <sstream>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#ifdef __linux__
+#include <netinet/udp.h>
+#include <sys/sendfile.h>
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#if defined(SSL) && defined(MBEDTLS_SSL_EXPORT_KEYS)
+#include <linux/tls.h>
+#include <netinet/tcp.h>
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#define KTLS_SUPPORTED
+#endif
+#endif
 
 #define BUFFER_BLOCKSIZE 4096 // set buffer blocksize to 4KiB
+#define BUFFER_RING_MIN 16384 // initial size of the Socket::Buffer storage
+#define BUFFER_RING_KEEP 1048576 // Socket::Buffer storage above this size is freed when emptied
+#define SPOOL_MAX_BUFFERED (10000 * BUFFER_BLOCKSIZE) // spool() stops reading above this
+#define SENDNOW_IOVECS 64     // maximum amount of buffers passed to a single scatter-gather write
+#define SSL_GATHER_SIZE 16384 // small buffers are gathered up to this size before encrypting them
+#define UDP_RECV_SLOT 2048 // initial packet buffer size for batched UDP receives
+#define UDP_GRO_SLOT 65536 // packet buffer size when the kernel may coalesce received UDP packets
+#define UDP_GSO_SEGMENTS 64 // maximum amount of segments in a single segmentation offload send
+#define UDP_GSO_BYTES 65000 // maximum amount of bytes in a single segmentation offload send
 
 #ifdef __CYGWIN__
 #define SOCKETSIZE 8092ul
@@ -332,200 +366,276 @@ std::string uint2string(unsigned int i){
 }
 
 Socket::Buffer::Buffer(){
+  ring = 0;
+  cap = 0;
+  head = 0;
+  len = 0;
   splitter = "\n";
 }
 
-/// Returns the amount of elements in the internal std::deque of std::string objects.
-/// The back is popped as long as it is empty, first - this way this function is
-/// guaranteed to return 0 if the buffer is empty.
+Socket::Buffer::Buffer(const Buffer &rhs){
+  ring = 0;
+  cap = 0;
+  head = 0;
+  len = 0;
+  *this = rhs;
+}
+
+/// Makes this buffer hold a copy of the contents of the given buffer.
+Socket::Buffer &Socket::Buffer::operator=(const Buffer &rhs){
+  if (this == &rhs){return *this;}
+  clear();
+  splitter = rhs.splitter;
+  elem = rhs.elem;
+  if (rhs.len){
+    grow(rhs.len);
+    size_t first = rhs.cap - rhs.head;
+    if (first > rhs.len){first = rhs.len;}
+    memcpy(ring, rhs.ring + rhs.head, first);
+    memcpy(ring + first, rhs.ring, rhs.len - first);
+    len = rhs.len;
+  }
+  return *this;
+}
+
+Socket::Buffer::~Buffer(){
+  free(ring);
+}
+
+/// Frees the backing storage if it is empty and was grown beyond BUFFER_RING_KEEP bytes, so that
+/// a single burst of data does not keep a large allocation around for the rest of the connection.
+void Socket::Buffer::release(){
+  if (len || cap <= BUFFER_RING_KEEP){return;}
+  free(ring);
+  ring = 0;
+  cap = 0;
+  head = 0;
+}
+
+/// Makes sure at least count bytes of free space are available in the backing storage.
+/// When growing, the buffered data is moved to the start of the new storage.
+void Socket::Buffer::grow(size_t count){
+  if (cap - len >= count){return;}
+  size_t newCap = cap ? cap * 2 : BUFFER_RING_MIN;
+  while (newCap - len < count){newCap *= 2;}
+  char *newRing = (char *)malloc(newCap);
+  if (!newRing){
+    FAIL_MSG("Could not allocate %zu bytes of socket buffer", newCap);
+    return;
+  }
+  if (len){
+    size_t first = cap - head;
+    if (first > len){first = len;}
+    memcpy(newRing, ring + head, first);
+    memcpy(newRing + first, ring, len - first);
+  }
+  free(ring);
+  ring = newRing;
+  cap = newCap;
+  head = 0;
+}
+
+/// Rotates the backing storage in place so the buffered data no longer wraps around its end.
+void Socket::Buffer::linearize(){
+  if (head + len <= cap){return;}
+  std::rotate(ring, ring + head, ring + cap);
+  head = 0;
+}
+
+/// Puts whatever is left of the element handed out by get() back in front of the ring data.
+void Socket::Buffer::unget(){
+  if (elem.empty()){return;}
+  size_t n = elem.size();
+  grow(n);
+  if (cap - len < n){return;}
+  head = (head + cap - n) % cap;
+  size_t first = cap - head;
+  if (first > n){first = n;}
+  memcpy(ring + head, elem.data(), first);
+  memcpy(ring, elem.data() + first, n - first);
+  len += n;
+  elem.clear();
+}
+
+/// Returns 0 if the buffer is empty, non-zero otherwise.
+/// The element handed out by get() and the data behind it are counted as one element each, so a
+/// return value above 1 means get() can still be extended with more data.
 unsigned int Socket::Buffer::size(){
-  while (data.size() > 0 && data.back().empty()){data.pop_back();}
-  return data.size();
+  return (elem.size() ? 1 : 0) + (len ? 1 : 0);
 }
 
 /// Returns either the amount of total bytes available in the buffer or max, whichever is smaller.
 unsigned int Socket::Buffer::bytes(unsigned int max){
-  unsigned int i = 0;
-  for (std::deque<std::string>::iterator it = data.begin(); it != data.end(); ++it){
-    i += (*it).size();
-    if (i >= max){return max;}
-  }
-  return i;
+  if (elem.size() + len < max){return elem.size() + len;}
+  return max;
 }
 
-/// Returns how many bytes to read until the next splitter, or 0 if none found.
+/// Returns how many bytes to read until and including the next splitter, or 0 if none found.
 unsigned int Socket::Buffer::bytesToSplit(){
-  unsigned int i = 0;
-  for (std::deque<std::string>::reverse_iterator it = data.rbegin(); it != data.rend(); ++it){
-    i += (*it).size();
-    if ((*it).size() >= splitter.size() && (*it).substr((*it).size() - splitter.size()) == splitter){
-      return i;
-    }
-  }
-  return 0;
+  if (splitter.empty()){return 0;}
+  unget();
+  if (!len){return 0;}
+  linearize();
+  const char *start = ring + head;
+  const char *found = std::search(start, start + len, splitter.data(), splitter.data() + splitter.size());
+  if (found == start + len){return 0;}
+  return (found - start) + splitter.size();
 }
 
-/// Appends this string to the internal std::deque of std::string objects.
-/// It is automatically split every BUFFER_BLOCKSIZE bytes and when the splitter string is
-/// encountered.
+/// Appends this string to the end of the buffer.
 void Socket::Buffer::append(const std::string &newdata){
   append(newdata.data(), newdata.size());
 }
 
-/// Helper function that does a short-circuiting string compare
-inline bool string_compare(const char *a, const char *b, const size_t len){
-  for (size_t i = 0; i < len; ++i){
-    if (a[i] != b[i]){return false;}
-  }
-  return true;
-}
-
-/// Appends this data block to the internal std::deque of std::string objects.
-/// It is automatically split every BUFFER_BLOCKSIZE bytes and when the splitter string is
-/// encountered.
+/// Appends this data block to the end of the buffer.
 void Socket::Buffer::append(const char *newdata, const unsigned int newdatasize){
-  uint32_t i = 0;
-  while (i < newdatasize){
-    uint32_t j = 0;
-    if (!splitter.size()){
-      if (newdatasize - i > BUFFER_BLOCKSIZE){
-        j = BUFFER_BLOCKSIZE;
-      }else{
-        j = newdatasize - i;
-      }
-    }else{
-      while (j + i < newdatasize && j < BUFFER_BLOCKSIZE){
-        j++;
-        if (j >= splitter.size()){
-          if (string_compare(newdata + i + j - splitter.size(), splitter.data(), splitter.size())){
-            break;
-          }
-        }
-      }
-    }
-    if (j){
-      data.push_front("");
-      data.front().assign(newdata + i, (size_t)j);
-      i += j;
-    }else{
-      FAIL_MSG("Appended an empty string to buffer: aborting!");
-      break;
-    }
-  }
-  if (data.size() > 5000){
-    WARN_MSG("Warning: After %d new bytes, buffer has %d parts containing over %u bytes!",
-             newdatasize, (int)data.size(), bytes(9000));
-  }
+  if (!newdatasize){return;}
+  size_t count = newdatasize;
+  char *dest = space(count);
+  if (!dest){return;}
+  memcpy(dest, newdata, newdatasize);
+  len += newdatasize;
 }
 
-/// Prepends this data block to the internal std::deque of std::string objects.
-/// It is _not_ automatically split every BUFFER_BLOCKSIZE bytes.
+/// Prepends this string to the front of the buffer.
 void Socket::Buffer::prepend(const std::string &newdata){
-  data.push_back(newdata);
+  prepend(newdata.data(), newdata.size());
 }
 
-/// Prepends this data block to the internal std::deque of std::string objects.
-/// It is _not_ automatically split every BUFFER_BLOCKSIZE bytes.
+/// Prepends this data block to the front of the buffer.
 void Socket::Buffer::prepend(const char *newdata, const unsigned int newdatasize){
-  data.push_back(std::string(newdata, (size_t)newdatasize));
+  if (!newdatasize){return;}
+  unget();
+  grow(newdatasize);
+  if (cap - len < newdatasize){return;}
+  head = (head + cap - newdatasize) % cap;
+  size_t first = cap - head;
+  if (first > newdatasize){first = newdatasize;}
+  memcpy(ring + head, newdata, first);
+  memcpy(ring, newdata + first, newdatasize - first);
+  len += newdatasize;
 }
 
 /// Returns true if at least count bytes are available in this buffer.
 bool Socket::Buffer::available(unsigned int count){
-  size();
-  unsigned int i = 0;
-  for (std::deque<std::string>::iterator it = data.begin(); it != data.end(); ++it){
-    i += (*it).size();
-    if (i >= count){return true;}
-  }
-  return false;
+  return elem.size() + len >= count;
 }
 
 /// Returns true if at least count bytes are available in this buffer.
 bool Socket::Buffer::available(unsigned int count) const{
-  unsigned int i = 0;
-  for (std::deque<std::string>::const_iterator it = data.begin(); it != data.end(); ++it){
-    i += (*it).size();
-    if (i >= count){return true;}
-  }
-  return false;
+  return elem.size() + len >= count;
 }
 
 /// Removes count bytes from the buffer, returning them by value.
 /// Returns an empty string if not all count bytes are available.
 std::string Socket::Buffer::remove(unsigned int count){
-  size();
   if (!available(count)){return "";}
-  unsigned int i = 0;
-  std::string ret;
-  ret.reserve(count);
-  for (std::deque<std::string>::reverse_iterator it = data.rbegin(); it != data.rend(); ++it){
-    if (i + (*it).size() < count){
-      ret.append(*it);
-      i += (*it).size();
-      (*it).clear();
-    }else{
-      ret.append(*it, 0, count - i);
-      (*it).erase(0, count - i);
-      break;
-    }
-  }
+  std::string ret(peek(count), count);
+  consume(count);
   return ret;
 }
 
 /// Removes count bytes from the buffer, appending them to the given ptr.
 /// Does nothing if not all count bytes are available.
 void Socket::Buffer::remove(Util::ResizeablePointer & ptr, unsigned int count){
-  size();
   if (!available(count)){return;}
-  unsigned int i = 0;
-  for (std::deque<std::string>::reverse_iterator it = data.rbegin(); it != data.rend(); ++it){
-    if (i + (*it).size() < count){
-      ptr.append(*it);
-      i += (*it).size();
-      (*it).clear();
-    }else{
-      ptr.append(it->data(), count - i);
-      (*it).erase(0, count - i);
-      break;
-    }
-  }
+  ptr.append(peek(count), count);
+  consume(count);
 }
 
 /// Copies count bytes from the buffer, returning them by value.
 /// Returns an empty string if not all count bytes are available.
 std::string Socket::Buffer::copy(unsigned int count){
-  size();
   if (!available(count)){return "";}
-  unsigned int i = 0;
-  std::string ret;
-  ret.reserve(count);
-  for (std::deque<std::string>::reverse_iterator it = data.rbegin(); it != data.rend(); ++it){
-    if (i + (*it).size() < count){
-      ret.append(*it);
-      i += (*it).size();
-    }else{
-      ret.append(*it, 0, count - i);
-      break;
-    }
+  return std::string(peek(count), count);
+}
+
+/// Returns a pointer to the first count bytes in the buffer, without copying or removing them.
+/// Returns a null pointer if not all count bytes are available.
+/// The pointer stays valid until the buffer is next changed, by any call other than peek().
+const char *Socket::Buffer::peek(size_t count){
+  if (!available(count)){return 0;}
+  unget();
+  if (!len){return ring;}
+  if (head + count > cap){linearize();}
+  return ring + head;
+}
+
+/// Removes count bytes from the front of the buffer, or everything if less is available.
+void Socket::Buffer::consume(size_t count){
+  unget();
+  if (count >= len){
+    len = 0;
+    head = 0;
+    release();
+    return;
   }
-  return ret;
+  head = (head + count) % cap;
+  len -= count;
+}
+
+/// Returns a pointer to free space at the end of the buffer, for receiving data into directly.
+/// At least count contiguous bytes are made available, growing the buffer if needed; count is
+/// then set to the full size of the contiguous free space at the returned pointer.
+/// Call commit() with the amount of bytes actually written afterwards.
+char *Socket::Buffer::space(size_t &count){
+  grow(count);
+  if (!cap || cap - len < count){
+    count = 0;
+    return 0;
+  }
+  size_t tail = (head + len) % cap;
+  size_t gap = (tail < head || (len && tail == head)) ? head - tail : cap - tail;
+  if (gap < count){
+    // Move the data to the start of the storage, so all free space is in one piece
+    linearize();
+    memmove(ring, ring + head, len);
+    head = 0;
+    tail = len;
+    gap = cap - len;
+  }
+  count = gap;
+  return ring + tail;
+}
+
+/// Marks count bytes written into the space returned by space() as buffered data.
+void Socket::Buffer::commit(size_t count){
+  if (count > cap - len){count = cap - len;}
+  len += count;
 }
 
-/// Gets a reference to the back of the internal std::deque of std::string objects.
+/// Hands out the next element from the front of the buffer: the data up to and including the
+/// next occurrence of the splitter, or everything buffered if there is none.
+/// The returned string may be altered; whatever is left in it stays in front of the buffer.
+/// If the element does not end in the splitter, any data received since is appended to it.
 std::string &Socket::Buffer::get(){
-  size();
-  static std::string empty;
-  if (data.size() > 0){
-    return data.back();
+  if (!len){return elem;}
+  if (elem.size() && (splitter.empty() || (elem.size() >= splitter.size() &&
+                                           !elem.compare(elem.size() - splitter.size(), splitter.size(), splitter)))){
+    return elem;
+  }
+  unget();
+  size_t count = bytesToSplit();
+  if (!count){count = len;}
+  linearize();
+  elem.assign(ring + head, count);
+  if (count >= len){
+    len = 0;
+    head = 0;
+    release();
   }else{
-    return empty;
+    head += count;
+    len -= count;
   }
+  return elem;
 }
 
 /// Completely empties the buffer
 void Socket::Buffer::clear(){
-  data.clear();
+  elem.clear();
+  len = 0;
+  head = 0;
+  release();
 }
 
 void Socket::Connection::setBoundAddr(){
@@ -798,6 +908,138 @@ void Socket::Connection::open(std::string address, bool nonblock){
 }
 
 #ifdef SSL
+#ifdef KTLS_SUPPORTED
+/// Export callback for mbedtls, storing the key block of the session in a Socket::TLSKeys.
+static int storeTLSKeys(void *p_keys, const unsigned char *ms, const unsigned char *kb, size_t maclen,
+                        size_t keylen, size_t ivlen){
+  Socket::TLSKeys *keys = (Socket::TLSKeys *)p_keys;
+  size_t len = 2 * (maclen + keylen + ivlen);
+  keys->valid = (len <= sizeof(keys->block));
+  if (!keys->valid){return 0;}
+  memcpy(keys->block, kb, len);
+  keys->macLen = maclen;
+  keys->keyLen = keylen;
+  keys->ivLen = ivlen;
+  return 0;
+}
+#endif
+
+/// Makes every handshake using the given configuration store its keys in the given structure,
+/// so that enableKTLS can hand them to the kernel afterwards. Without mbedtls key export or
+/// kernel TLS support compiled in, this does nothing.
+void Socket::exportTLSKeys(mbedtls_ssl_config *conf, TLSKeys *keys){
+  keys->valid = false;
+#ifdef KTLS_SUPPORTED
+  mbedtls_ssl_conf_export_keys_cb(conf, storeTLSKeys, keys);
+#endif
+}
+
+#ifdef KTLS_SUPPORTED
+/// Fills a kernel TLS 1.2 crypto_info structure for the given cipher, returning its size.
+static size_t fillCryptoInfo(char *info, uint16_t cipher, const unsigned char *key,
+                             const unsigned char *iv, const unsigned char *seq){
+  switch (cipher){
+  case TLS_CIPHER_AES_GCM_128:{
+    struct tls12_crypto_info_aes_gcm_128 *I = (struct tls12_crypto_info_aes_gcm_128 *)info;
+    memset(I, 0, sizeof(*I));
+    I->info.version = TLS_1_2_VERSION;
+    I->info.cipher_type = cipher;
+    memcpy(I->key, key, sizeof(I->key));
+    memcpy(I->salt, iv, sizeof(I->salt));
+    memcpy(I->iv, seq, sizeof(I->iv));
+    memcpy(I->rec_seq, seq, sizeof(I->rec_seq));
+    return sizeof(*I);
+  }
+#ifdef TLS_CIPHER_AES_GCM_256
+  case TLS_CIPHER_AES_GCM_256:{
+    struct tls12_crypto_info_aes_gcm_256 *I = (struct tls12_crypto_info_aes_gcm_256 *)info;
+    memset(I, 0, sizeof(*I));
+    I->info.version = TLS_1_2_VERSION;
+    I->info.cipher_type = cipher;
+    memcpy(I->key, key, sizeof(I->key));
+    memcpy(I->salt, iv, sizeof(I->salt));
+    memcpy(I->iv, seq, sizeof(I->iv));
+    memcpy(I->rec_seq, seq, sizeof(I->rec_seq));
+    return sizeof(*I);
+  }
+#endif
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+  case TLS_CIPHER_CHACHA20_POLY1305:{
+    struct tls12_crypto_info_chacha20_poly1305 *I = (struct tls12_crypto_info_chacha20_poly1305 *)info;
+    memset(I, 0, sizeof(*I));
+    I->info.version = TLS_1_2_VERSION;
+    I->info.cipher_type = cipher;
+    memcpy(I->key, key, sizeof(I->key));
+    memcpy(I->iv, iv, sizeof(I->iv));
+    memcpy(I->rec_seq, seq, sizeof(I->rec_seq));
+    return sizeof(*I);
+  }
+#endif
+  }
+  return 0;
+}
+#endif
+
+/// Moves the record encryption of a freshly handshaked TLS session into the kernel, so that
+/// plain reads, writes and sendfile calls on sock carry application data from then on.
+/// Must be called right after the handshake completes, before any application data is
+/// exchanged through mbedtls, with keys filled through exportTLSKeys.
+/// Only TLS 1.2 with AES-GCM or ChaCha20-Poly1305 can be offloaded; anything else returns
+/// KTLS_OFF and mbedtls should keep handling the connection. After KTLS_ON, mbedtls must no
+/// longer touch the socket (not even to send a close notification). KTLS_BROKEN means
+/// receiving was offloaded but sending was not, which leaves the connection unusable.
+int Socket::enableKTLS(int sock, const mbedtls_ssl_context *ssl, const TLSKeys &keys, bool isServer){
+#ifndef KTLS_SUPPORTED
+  return KTLS_OFF;
+#else
+  if (!keys.valid || keys.macLen){return KTLS_OFF;}
+  if (strcmp(mbedtls_ssl_get_version(ssl), "TLSv1.2")){return KTLS_OFF;}
+  std::string suite = mbedtls_ssl_get_ciphersuite(ssl);
+  uint16_t cipher = 0;
+  if (suite.find("-GCM-") != std::string::npos && keys.ivLen == 4){
+    if (keys.keyLen == 16){cipher = TLS_CIPHER_AES_GCM_128;}
+#ifdef TLS_CIPHER_AES_GCM_256
+    if (keys.keyLen == 32){cipher = TLS_CIPHER_AES_GCM_256;}
+#endif
+  }
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+  if (suite.find("-CHACHA20-") != std::string::npos && keys.keyLen == 32 && keys.ivLen == 12){
+    cipher = TLS_CIPHER_CHACHA20_POLY1305;
+  }
+#endif
+  if (!cipher){
+    HIGH_MSG("Cipher suite %s cannot be offloaded to the kernel", suite.c_str());
+    return KTLS_OFF;
+  }
+  const unsigned char *clientKey = keys.block;
+  const unsigned char *serverKey = clientKey + keys.keyLen;
+  const unsigned char *clientIV = serverKey + keys.keyLen;
+  const unsigned char *serverIV = clientIV + keys.ivLen;
+  // Each side's Finished message was the only record sent under the new keys so far
+  const unsigned char seq[8] ={0, 0, 0, 0, 0, 0, 0, 1};
+  char txInfo[128], rxInfo[128];
+  size_t txLen = fillCryptoInfo(txInfo, cipher, isServer ? serverKey : clientKey, isServer ? serverIV : clientIV, seq);
+  size_t rxLen = fillCryptoInfo(rxInfo, cipher, isServer ? clientKey : serverKey, isServer ? clientIV : serverIV, seq);
+  int ret = KTLS_OFF;
+  // Receiving goes first: a socket without any keys installed still behaves like plain TCP,
+  // so if the kernel cannot decrypt, mbedtls can simply carry on.
+  if (setsockopt(sock, SOL_TCP, TCP_ULP, "tls", sizeof("tls"))){
+    HIGH_MSG("Kernel TLS not available: %s", strerror(errno));
+  }else if (setsockopt(sock, SOL_TLS, TLS_RX, rxInfo, rxLen)){
+    HIGH_MSG("Kernel TLS receive offload not available: %s", strerror(errno));
+  }else if (setsockopt(sock, SOL_TLS, TLS_TX, txInfo, txLen)){
+    FAIL_MSG("Kernel TLS send offload failed after enabling receive offload: %s", strerror(errno));
+    ret = KTLS_BROKEN;
+  }else{
+    HIGH_MSG("Kernel TLS enabled for %s", suite.c_str());
+    ret = KTLS_ON;
+  }
+  memset(txInfo, 0, sizeof(txInfo));
+  memset(rxInfo, 0, sizeof(rxInfo));
+  return ret;
+#endif
+}
+
 /// Local-only function for debugging SSL sockets
 static void my_debug(void *ctx, int level, const char *file, int line, const char *str){
   ((void)level);
@@ -983,7 +1225,7 @@ uint64_t Socket::Connection::dataDown(){
 /// Returns true if new data was received, false otherwise.
 bool Socket::Connection::spool(bool strictMode){
   /// \todo Provide better mechanism to prevent overbuffering.
-  if (!strictMode && downbuffer.size() > 10000){
+  if (!strictMode && downbuffer.available(SPOOL_MAX_BUFFERED)){
     return true;
   }else{
     return iread(downbuffer);
@@ -1031,6 +1273,106 @@ void Socket::Connection::SendNow(const std::string &data){
   SendNow(data.data(), data.size());
 }
 
+/// Sends len bytes of the file fd, starting at offset. Where possible, the kernel copies the data
+/// straight from the page cache to the socket; SSL connections and other platforms read it into
+/// a buffer first. Blocks until all data is sent, the file ends or the connection is severed.
+/// Returns the amount of bytes sent.
+size_t Socket::Connection::sendFile(int fd, uint64_t offset, size_t len){
+  size_t sent = 0;
+  bool bing = isBlocking();
+  if (!bing){setBlocking(true);}
+#ifdef __linux__
+  bool useSendfile = !skipCount;
+#ifdef SSL
+  if (sslConnected){useSendfile = false;}
+#endif
+  while (useSendfile && sent < len && connected()){
+    off_t off = offset + sent;
+    ssize_t r = sendfile(sSend, fd, &off, len - sent);
+    if (r < 0){
+      if (errno == EINTR || errno == EAGAIN){continue;}
+      // Not supported for this kind of socket or file: use the regular path for the rest
+      if (errno == EINVAL || errno == ENOSYS){break;}
+      Error = true;
+      lastErr = strerror(errno);
+      INSANE_MSG("Could not sendfile data! Error: %s", lastErr.c_str());
+      close();
+      break;
+    }
+    if (r == 0){
+      if (!bing){setBlocking(false);}
+      return sent;
+    }
+    sent += r;
+    up += r;
+  }
+#endif
+  char buffer[SOCKETSIZE];
+  while (sent < len && connected()){
+    ssize_t r = pread(fd, buffer, std::min((unsigned long)(len - sent), SOCKETSIZE), offset + sent);
+    if (r < 0 && errno == EINTR){continue;}
+    if (r <= 0){break;}
+    SendNow(buffer, r);
+    sent += r;
+  }
+  if (!bing){setBlocking(false);}
+  return sent;
+}
+
+/// Will not buffer anything but always send right away. Blocks.
+/// Sends count buffers in order, using as few system calls as possible.
+/// Any data that could not be send will block until it can be send or the connection is severed.
+void Socket::Connection::SendNow(const struct iovec *vec, size_t count){
+#ifdef SSL
+  if (sslConnected){
+    // Gather small buffers, so they are not each encrypted into a record of their own
+    char gather[SSL_GATHER_SIZE];
+    size_t gathered = 0;
+    for (size_t i = 0; i < count; ++i){
+      if (gathered + vec[i].iov_len > SSL_GATHER_SIZE){
+        if (gathered){SendNow(gather, gathered);}
+        gathered = 0;
+      }
+      if (vec[i].iov_len >= SSL_GATHER_SIZE){
+        SendNow((const char *)vec[i].iov_base, vec[i].iov_len);
+        continue;
+      }
+      memcpy(gather + gathered, vec[i].iov_base, vec[i].iov_len);
+      gathered += vec[i].iov_len;
+    }
+    if (gathered){SendNow(gather, gathered);}
+    return;
+  }
+#endif
+  if (skipCount){
+    for (size_t i = 0; i < count; ++i){SendNow((const char *)vec[i].iov_base, vec[i].iov_len);}
+    return;
+  }
+  bool bing = isBlocking();
+  if (!bing){setBlocking(true);}
+  size_t idx = 0;    // first buffer not yet (fully) sent
+  size_t offset = 0; // bytes of buffer idx already sent
+  while (idx < count && connected()){
+    struct iovec batch[SENDNOW_IOVECS];
+    int n = 0;
+    for (size_t i = idx; i < count && n < SENDNOW_IOVECS; ++i){
+      batch[n].iov_base = (char *)vec[i].iov_base + (i == idx ? offset : 0);
+      batch[n].iov_len = vec[i].iov_len - (i == idx ? offset : 0);
+      if (batch[n].iov_len){++n;}
+    }
+    if (!n){break;}
+    size_t w = iwrite(batch, n);
+    // Skip over everything that was written
+    w += offset;
+    while (idx < count && w >= vec[idx].iov_len){
+      w -= vec[idx].iov_len;
+      ++idx;
+    }
+    offset = w;
+  }
+  if (!bing){setBlocking(false);}
+}
+
 void Socket::Connection::skipBytes(uint32_t byteCount){
   INFO_MSG("Skipping first %" PRIu32 " bytes going to socket", byteCount);
   skipCount = byteCount;
@@ -1111,6 +1453,40 @@ unsigned int Socket::Connection::iwrite(const void *buffer, int len){
   return r;
 }// Socket::Connection::iwrite
 
+/// Incremental scatter-gather write call. This function tries to write count buffers to the socket
+/// in a single system call, returning the amount of bytes it actually wrote.
+/// \param vec The buffers to write from, in order.
+/// \param count Amount of buffers in vec.
+/// \returns The amount of bytes actually written.
+unsigned int Socket::Connection::iwrite(const struct iovec *vec, int count){
+  if (count < 1){return 0;}
+#ifdef SSL
+  if (sslConnected){return iwrite(vec[0].iov_base, vec[0].iov_len);}
+#endif
+  if (skipCount){return iwrite(vec[0].iov_base, vec[0].iov_len);}
+  if (!connected()){return 0;}
+  int r = writev(sSend, vec, count);
+  if (r < 0){
+    switch (errno){
+    case EWOULDBLOCK: return 0; break;
+    case EINTR: return 0; break;
+    default:
+      Error = true;
+      lastErr = strerror(errno);
+      INSANE_MSG("Could not iwrite data! Error: %s", lastErr.c_str());
+      close();
+      return 0;
+      break;
+    }
+  }
+  if (r == 0 && (sSend >= 0)){
+    DONTEVEN_MSG("Socket closed by remote");
+    close();
+  }
+  up += r;
+  return r;
+}
+
 /// Incremental read call. This function tries to read len bytes to the buffer from the socket,
 /// returning the amount of bytes it actually read.
 /// \param buffer Location of the buffer to read to.
@@ -1184,15 +1560,17 @@ int Socket::Connection::iread(void *buffer, int len, int flags){
 
 /// Read call that is compatible with Socket::Buffer.
 /// Data is read using iread (which is nonblocking if the Socket::Connection itself is),
-/// then appended to end of buffer.
+/// straight into the free space at the end of the buffer.
 /// \param buffer Socket::Buffer to append data to.
 /// \param flags Flags to use in the recv call. Ignored on fake sockets.
 /// \return True if new data arrived, false otherwise.
 bool Socket::Connection::iread(Buffer &buffer, int flags){
-  char cbuffer[BUFFER_BLOCKSIZE];
-  int num = iread(cbuffer, BUFFER_BLOCKSIZE, flags);
+  size_t count = BUFFER_BLOCKSIZE;
+  char *dest = buffer.space(count);
+  if (!dest){return false;}
+  int num = iread(dest, count, flags);
   if (num < 1){return false;}
-  buffer.append(cbuffer, num);
+  buffer.commit(num);
   return true;
 }// iread
 
@@ -1360,8 +1738,10 @@ Socket::Server::Server(int fromSock){
 /// \param hostname (optional) The interface to bind to. The default is 0.0.0.0 (all interfaces).
 /// \param nonblock (optional) Whether accept() calls will be nonblocking. Default is false
 /// (blocking).
-Socket::Server::Server(int port, std::string hostname, bool nonblock){
-  if (!IPv6bind(port, hostname, nonblock) && !IPv4bind(port, hostname, nonblock)){
+/// \param reusePort (optional) Whether to set SO_REUSEPORT, so that several sockets (in several
+/// processes) can listen on the same port, with the kernel spreading connections over them.
+Socket::Server::Server(int port, std::string hostname, bool nonblock, bool reusePort){
+  if (!IPv6bind(port, hostname, nonblock, reusePort) && !IPv4bind(port, hostname, nonblock, reusePort)){
     FAIL_MSG("Could not create socket %s:%i! Error: %s", hostname.c_str(), port, errors.c_str());
     sock = -1;
   }
@@ -1371,8 +1751,9 @@ Socket::Server::Server(int port, std::string hostname, bool nonblock){
 /// \param port The TCP port to listen on
 /// \param hostname The interface to bind to. The default is 0.0.0.0 (all interfaces).
 /// \param nonblock Whether accept() calls will be nonblocking. Default is false (blocking).
+/// \param reusePort Whether to set SO_REUSEPORT before binding.
 /// \return True if successful, false otherwise.
-bool Socket::Server::IPv6bind(int port, std::string hostname, bool nonblock){
+bool Socket::Server::IPv6bind(int port, std::string hostname, bool nonblock, bool reusePort){
   sock = socket(AF_INET6, SOCK_STREAM, 0);
   if (sock < 0){
     errors = strerror(errno);
@@ -1381,6 +1762,11 @@ bool Socket::Server::IPv6bind(int port, std::string hostname, bool nonblock){
   }
   int on = 1;
   setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+#ifdef SO_REUSEPORT
+  if (reusePort && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on))){
+    WARN_MSG("Could not set SO_REUSEPORT on %s:%i: %s", hostname.c_str(), port, strerror(errno));
+  }
+#endif
 #ifdef __CYGWIN__
   on = 0;
   setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
@@ -1429,8 +1815,9 @@ bool Socket::Server::IPv6bind(int port, std::string hostname, bool nonblock){
 /// \param port The TCP port to listen on
 /// \param hostname The interface to bind to. The default is 0.0.0.0 (all interfaces).
 /// \param nonblock Whether accept() calls will be nonblocking. Default is false (blocking).
+/// \param reusePort Whether to set SO_REUSEPORT before binding.
 /// \return True if successful, false otherwise.
-bool Socket::Server::IPv4bind(int port, std::string hostname, bool nonblock){
+bool Socket::Server::IPv4bind(int port, std::string hostname, bool nonblock, bool reusePort){
   sock = socket(AF_INET, SOCK_STREAM, 0);
   if (sock < 0){
     errors = strerror(errno);
@@ -1439,6 +1826,11 @@ bool Socket::Server::IPv4bind(int port, std::string hostname, bool nonblock){
   }
   int on = 1;
   setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+#ifdef SO_REUSEPORT
+  if (reusePort && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on))){
+    WARN_MSG("Could not set SO_REUSEPORT on %s:%i: %s", hostname.c_str(), port, strerror(errno));
+  }
+#endif
   if (nonblock){
     int flags = fcntl(sock, F_GETFL, 0);
     flags |= O_NONBLOCK;
@@ -1608,6 +2000,7 @@ int Socket::Server::getSocket(){
 /// If both fail, prints an DLVL_FAIL debug message.
 /// \param nonblock Whether the socket should be nonblocking.
 Socket::UDPConnection::UDPConnection(bool nonblock){
+  initBatching();
   lastPace = 0;
   boundPort = 0;
   family = AF_INET6;
@@ -1681,6 +2074,7 @@ void Socket::UDPConnection::checkRecvBuf(){
 /// Copies a UDP socket, re-allocating local copies of any needed structures.
 /// The data/data_size/data_len variables are *not* copied over.
 Socket::UDPConnection::UDPConnection(const UDPConnection &o){
+  initBatching();
   lastPace = 0;
   boundPort = 0;
   family = AF_INET6;
@@ -1704,8 +2098,24 @@ Socket::UDPConnection::UDPConnection(const UDPConnection &o){
   data.allocate(2048);
 }
 
-/// Close the UDP socket
+/// Resets the batched sending and receiving state, for use in constructors.
+void Socket::UDPConnection::initBatching(){
+  recvSlot = UDP_RECV_SLOT;
+  recvCount = 0;
+  recvPos = 0;
+  recvOffset = 0;
+  gro = false;
+  sendCount = 0;
+  gsoFailed = false;
+}
+
+/// Close the UDP socket, sending any datagrams still queued by sendBatched first.
 void Socket::UDPConnection::close(){
+  flush();
+  recvCount = 0;
+  recvPos = 0;
+  recvOffset = 0;
+  gro = false;
   if (sock != -1){
     errno = EINTR;
     while (::close(sock) != 0 && errno == EINTR){}
@@ -1748,6 +2158,8 @@ void Socket::UDPConnection::allocateDestination(){
 /// This will be the receiving end for all SendNow calls.
 void Socket::UDPConnection::SetDestination(std::string destIp, uint32_t port){
   DONTEVEN_MSG("Setting destination to %s:%u", destIp.c_str(), port);
+  // Queued datagrams are meant for the old destination
+  flush();
   // UDP sockets can switch between IPv4 and IPv6 on demand.
   // We change IPv4-mapped IPv6 addresses into IPv4 addresses for Windows-sillyness reasons.
   if (destIp.substr(0, 7) == "::ffff:"){destIp = destIp.substr(7);}
@@ -1894,6 +2306,149 @@ void Socket::UDPConnection::SendNow(const char *sdata, size_t len){
   }
 }
 
+/// Sends len bytes from sdata as consecutive UDP datagrams of segment bytes each; the last one
+/// may be shorter. Where the kernel supports it, the datagrams are split by UDP segmentation
+/// offload, otherwise they are sent UDP_BATCH_SIZE at a time. Any datagrams queued by
+/// sendBatched are sent first.
+void Socket::UDPConnection::SendNow(const char *sdata, size_t len, size_t segment){
+  if (!segment || len <= segment){
+    flush();
+    SendNow(sdata, len);
+    return;
+  }
+  flush();
+#ifdef __linux__
+  while (len){
+    size_t chunk = UDP_GSO_BYTES / segment;
+    if (chunk > UDP_GSO_SEGMENTS){chunk = UDP_GSO_SEGMENTS;}
+    chunk *= segment;
+    if (chunk > len){chunk = len;}
+    if (!gsoFailed && chunk > segment){
+      struct iovec vec;
+      vec.iov_base = (void *)sdata;
+      vec.iov_len = chunk;
+      char control[CMSG_SPACE(sizeof(uint16_t))];
+      memset(control, 0, sizeof(control));
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_name = destAddr;
+      msg.msg_namelen = destAddr_size;
+      msg.msg_iov = &vec;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+      cm->cmsg_level = SOL_UDP;
+      cm->cmsg_type = UDP_SEGMENT;
+      cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      uint16_t segSize = segment;
+      memcpy(CMSG_DATA(cm), &segSize, sizeof(segSize));
+      int r = sendmsg(sock, &msg, 0);
+      if (r == (int)chunk){
+        up += r;
+        sdata += chunk;
+        len -= chunk;
+        continue;
+      }
+      if (r >= 0){
+        // Partial send: count what went out, and send the rest of it as a batch of datagrams
+        up += r;
+        sdata += r;
+        len -= r;
+        if (!len){return;}
+      }else{
+        if (errno != EINVAL && errno != EIO && errno != ENOPROTOOPT && errno != EOPNOTSUPP){
+          FAIL_MSG("Could not send UDP data through %d: %s", sock, strerror(errno));
+          return;
+        }
+        INFO_MSG("UDP segmentation offload unavailable (%s), sending datagrams in batches instead",
+                 strerror(errno));
+        gsoFailed = true;
+      }
+    }
+    struct mmsghdr msgs[UDP_BATCH_SIZE];
+    struct iovec vecs[UDP_BATCH_SIZE];
+    size_t count = 0;
+    for (size_t off = 0; count < UDP_BATCH_SIZE && off < len; off += segment){
+      vecs[count].iov_base = (void *)(sdata + off);
+      vecs[count].iov_len = (len - off < segment) ? len - off : segment;
+      memset(&msgs[count], 0, sizeof(struct mmsghdr));
+      msgs[count].msg_hdr.msg_name = destAddr;
+      msgs[count].msg_hdr.msg_namelen = destAddr_size;
+      msgs[count].msg_hdr.msg_iov = vecs + count;
+      msgs[count].msg_hdr.msg_iovlen = 1;
+      ++count;
+    }
+    int r = sendmmsg(sock, msgs, count, 0);
+    if (r < 1){
+      FAIL_MSG("Could not send UDP data through %d: %s", sock, strerror(errno));
+      return;
+    }
+    for (int i = 0; i < r; ++i){
+      up += msgs[i].msg_len;
+      sdata += vecs[i].iov_len;
+      len -= vecs[i].iov_len;
+    }
+  }
+#else
+  for (size_t off = 0; off < len; off += segment){
+    SendNow(sdata + off, (len - off < segment) ? len - off : segment);
+  }
+#endif
+}
+
+/// Queues a copy of the UDP datagram sdata, len for sending over this socket.
+/// Queued datagrams are sent together by flush(), which is called automatically when
+/// UDP_BATCH_SIZE datagrams are queued, when the destination changes and when closing.
+void Socket::UDPConnection::sendBatched(const char *sdata, size_t len){
+  if (len < 1){return;}
+  if (!sendPool.append(sdata, len)){
+    flush();
+    SendNow(sdata, len);
+    return;
+  }
+  sendLens[sendCount++] = len;
+  if (sendCount == UDP_BATCH_SIZE){flush();}
+}
+
+/// Sends all datagrams queued by sendBatched, using as few system calls as possible.
+void Socket::UDPConnection::flush(){
+  if (!sendCount){return;}
+#ifdef __linux__
+  struct mmsghdr msgs[UDP_BATCH_SIZE];
+  struct iovec vecs[UDP_BATCH_SIZE];
+  char *ptr = sendPool;
+  for (size_t i = 0; i < sendCount; ++i){
+    vecs[i].iov_base = ptr;
+    vecs[i].iov_len = sendLens[i];
+    ptr += sendLens[i];
+    memset(&msgs[i], 0, sizeof(struct mmsghdr));
+    msgs[i].msg_hdr.msg_name = destAddr;
+    msgs[i].msg_hdr.msg_namelen = destAddr_size;
+    msgs[i].msg_hdr.msg_iov = vecs + i;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  size_t sent = 0;
+  while (sent < sendCount){
+    int r = sendmmsg(sock, msgs + sent, sendCount - sent, 0);
+    if (r < 1){
+      FAIL_MSG("Could not send %zu UDP datagrams through %d: %s", sendCount - sent, sock, strerror(errno));
+      break;
+    }
+    for (int i = 0; i < r; ++i){up += msgs[sent + i].msg_len;}
+    sent += r;
+  }
+#else
+  char *ptr = sendPool;
+  for (size_t i = 0; i < sendCount; ++i){
+    SendNow(ptr, sendLens[i]);
+    ptr += sendLens[i];
+  }
+#endif
+  sendCount = 0;
+  sendPool.truncate(0);
+}
+
 /// Queues sdata, len for sending over this socket.
 /// If there has been enough time since the last packet, sends immediately.
 /// Warning: never call sendPaced for the same socket from a different thread!
@@ -2144,13 +2699,111 @@ uint16_t Socket::UDPConnection::bind(int port, std::string iface, const std::str
   return portNo;
 }
 
+#ifdef __linux__
+/// Per-message state for batched UDP receives, stored in the receive pool after the headers
+struct udpRecvMsg{
+  sockaddr_in6 addr;
+  struct iovec vec;
+  char control[CMSG_SPACE(sizeof(int))];
+};
+#endif
+
+/// Lets the kernel coalesce received packets of equal size from the same sender, where
+/// supported. Receive() still hands out the original packets one by one.
+/// Must be called again after binding, as that opens a new socket.
+void Socket::UDPConnection::enableGRO(){
+#ifdef __linux__
+  int on = 1;
+  if (sock != -1 && !setsockopt(sock, SOL_UDP, UDP_GRO, &on, sizeof(on))){gro = true;}
+#endif
+}
+
+/// Receives as many UDP packets as are waiting, up to UDP_BATCH_SIZE, in a single system call.
+/// Returns true if at least one packet was received.
+bool Socket::UDPConnection::receiveBatch(){
+#ifdef __linux__
+  size_t slot = gro ? UDP_GRO_SLOT : recvSlot;
+  size_t hdrLen = UDP_BATCH_SIZE * (sizeof(struct mmsghdr) + sizeof(udpRecvMsg));
+  if (recvPool.rsize() < hdrLen + UDP_BATCH_SIZE * slot && !recvPool.allocate(hdrLen + UDP_BATCH_SIZE * slot)){
+    return false;
+  }
+  struct mmsghdr *msgs = (struct mmsghdr *)(char *)recvPool;
+  udpRecvMsg *info = (udpRecvMsg *)(msgs + UDP_BATCH_SIZE);
+  char *bufs = (char *)recvPool + hdrLen;
+  for (size_t i = 0; i < UDP_BATCH_SIZE; ++i){
+    info[i].vec.iov_base = bufs + i * slot;
+    info[i].vec.iov_len = slot;
+    memset(&msgs[i], 0, sizeof(struct mmsghdr));
+    msgs[i].msg_hdr.msg_name = &info[i].addr;
+    msgs[i].msg_hdr.msg_namelen = sizeof(info[i].addr);
+    msgs[i].msg_hdr.msg_iov = &info[i].vec;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    if (gro){
+      msgs[i].msg_hdr.msg_control = info[i].control;
+      msgs[i].msg_hdr.msg_controllen = sizeof(info[i].control);
+    }
+  }
+  int r = recvmmsg(sock, msgs, UDP_BATCH_SIZE, MSG_TRUNC | MSG_DONTWAIT, 0);
+  if (r < 1){
+    if (r == -1 && errno != EAGAIN && errno != EWOULDBLOCK){
+      INFO_MSG("UDP receive: %d (%s)", errno, strerror(errno));
+    }
+    return false;
+  }
+  recvCount = r;
+  recvPos = 0;
+  recvOffset = 0;
+  return true;
+#else
+  return false;
+#endif
+}
+
 /// Attempt to receive a UDP packet.
+/// Packets are received from the kernel in batches; this hands them out one at a time.
 /// This will automatically allocate or resize the internal data buffer if needed.
 /// If a packet is received, it will be placed in the "data" member, with it's length in "data_len".
 /// \return True if a packet was received, false otherwise.
 bool Socket::UDPConnection::Receive(){
   if (sock == -1){return false;}
   data.truncate(0);
+#ifdef __linux__
+  if (recvPos >= recvCount && !receiveBatch()){return false;}
+  struct mmsghdr &msg = ((struct mmsghdr *)(char *)recvPool)[recvPos];
+  udpRecvMsg &info = ((udpRecvMsg *)((struct mmsghdr *)(char *)recvPool + UDP_BATCH_SIZE))[recvPos];
+  size_t len = msg.msg_len;
+  //Handle UDP packets that are too large
+  if (len > info.vec.iov_len){
+    if (!gro){
+      INFO_MSG("Doubling UDP socket buffer from %zu to %zu", recvSlot, recvSlot * 2);
+      recvSlot *= 2;
+    }
+    len = info.vec.iov_len;
+  }
+  // Coalesced packets are handed out one segment at a time
+  size_t segment = len;
+  if (gro){
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg.msg_hdr); cm; cm = CMSG_NXTHDR(&msg.msg_hdr, cm)){
+      if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO){
+        int gsoSize = 0;
+        memcpy(&gsoSize, CMSG_DATA(cm), sizeof(gsoSize));
+        if (gsoSize > 0){segment = gsoSize;}
+      }
+    }
+  }
+  size_t pktLen = len - recvOffset;
+  if (pktLen > segment){pktLen = segment;}
+  data.assign((char *)info.vec.iov_base + recvOffset, pktLen);
+  socklen_t destsize = msg.msg_hdr.msg_namelen;
+  if (destAddr && destsize && destAddr_size >= destsize){memcpy(destAddr, &info.addr, destsize);}
+  recvOffset += pktLen;
+  if (recvOffset >= len){
+    ++recvPos;
+    recvOffset = 0;
+  }
+  down += pktLen;
+  return (pktLen > 0);
+#else
   sockaddr_in6 addr;
   socklen_t destsize = sizeof(addr);
   int r = recvfrom(sock, data, data.rsize(), MSG_TRUNC | MSG_DONTWAIT, (sockaddr *)&addr, &destsize);
@@ -2167,6 +2820,7 @@ bool Socket::UDPConnection::Receive(){
     data.allocate(data.rsize()*2);
   }
   return (r > 0);
+#endif
 }
 
 int Socket::UDPConnection::getSock(){
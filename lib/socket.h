@@ -13,6 +13,7 @@
 #include <string>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
 #include "util.h"
@@ -28,6 +29,8 @@
 
 #include "util.h"
 
+#define UDP_BATCH_SIZE 32 // maximum amount of datagrams moved per system call by Socket::UDPConnection
+
 // for being friendly with Socket::Connection down below
 namespace Buffer{
   class user;
@@ -51,14 +54,44 @@ namespace Socket{
   bool getPeerName(int fd, std::string &host, uint32_t &port);
   bool getPeerName(int fd, std::string &host, uint32_t &port, sockaddr * tmpaddr, socklen_t * addrlen);
 
-  /// A buffer made out of std::string objects that can be efficiently read from and written to.
+#ifdef SSL
+#define KTLS_OFF 0    ///< Returned by enableKTLS: nothing changed, keep using mbedtls
+#define KTLS_ON 1     ///< Returned by enableKTLS: the kernel now encrypts and decrypts all data
+#define KTLS_BROKEN 2 ///< Returned by enableKTLS: offload failed halfway, the connection is unusable
+
+  /// Key block of a TLS session, as exported by mbedtls while handshaking.
+  struct TLSKeys{
+    unsigned char block[256]; ///< Client and server MAC keys, keys and IVs, in that order.
+    size_t macLen;
+    size_t keyLen;
+    size_t ivLen;
+    bool valid;
+  };
+  void exportTLSKeys(mbedtls_ssl_config *conf, TLSKeys *keys);
+  int enableKTLS(int sock, const mbedtls_ssl_context *ssl, const TLSKeys &keys, bool isServer);
+#endif
+
+  /// A contiguous, growable ring buffer that can be efficiently read from and written to.
+  /// Binary parsers use peek() and consume() to look at and drop data without copying it,
+  /// line-based users use get() which hands out the next splitter-terminated element.
   class Buffer{
   private:
-    std::deque<std::string> data;
+    char *ring;       ///< Backing storage, holds len bytes starting at head, wrapping at cap.
+    size_t cap;       ///< Size of the backing storage.
+    size_t head;      ///< Offset of the first buffered byte.
+    size_t len;       ///< Amount of buffered bytes in the backing storage.
+    std::string elem; ///< Element handed out by get(), logically in front of the ring data.
+    void grow(size_t count);
+    void linearize();
+    void unget();
+    void release();
 
   public:
     std::string splitter; ///< String to automatically split on if encountered. \n by default
     Buffer();
+    Buffer(const Buffer &rhs);
+    Buffer &operator=(const Buffer &rhs);
+    ~Buffer();
     unsigned int size();
     unsigned int bytes(unsigned int max);
     unsigned int bytesToSplit();
@@ -72,6 +105,10 @@ namespace Socket{
     std::string remove(unsigned int count);
     void remove(Util::ResizeablePointer & ptr, unsigned int count);
     std::string copy(unsigned int count);
+    const char *peek(size_t count);
+    void consume(size_t count);
+    char *space(size_t &count);
+    void commit(size_t count);
     void clear();
   };
   // Buffer
@@ -152,10 +189,13 @@ namespace Socket{
     void SendNow(const char *data); ///< Will not buffer anything but always send right away. Blocks.
     void SendNow(const char *data,
                  size_t len); ///< Will not buffer anything but always send right away. Blocks.
+    void SendNow(const struct iovec *vec, size_t count); ///< Sends all buffers in order right away. Blocks.
+    size_t sendFile(int fd, uint64_t offset, size_t len); ///< Sends part of a file right away. Blocks.
     void skipBytes(uint32_t byteCount);
     uint32_t skipCount;
     // unbuffered i/o methods
     unsigned int iwrite(const void *buffer, int len); ///< Incremental write call.
+    unsigned int iwrite(const struct iovec *vec, int count); ///< Incremental scatter-gather write call.
     bool iwrite(std::string &buffer); ///< Write call that is compatible with std::string.
     // stats related methods
     unsigned int connTime(); ///< Returns the time this socket has been connected.
@@ -178,12 +218,12 @@ namespace Socket{
   private:
     std::string errors; ///< Stores errors that may have occured.
     int sock;           ///< Internally saved socket number.
-    bool IPv6bind(int port, std::string hostname, bool nonblock); ///< Attempt to bind an IPv6 socket
-    bool IPv4bind(int port, std::string hostname, bool nonblock); ///< Attempt to bind an IPv4 socket
+    bool IPv6bind(int port, std::string hostname, bool nonblock, bool reusePort); ///< Attempt to bind an IPv6 socket
+    bool IPv4bind(int port, std::string hostname, bool nonblock, bool reusePort); ///< Attempt to bind an IPv4 socket
   public:
     Server();                 ///< Create a new base Server.
     Server(int existingSock); ///< Create a new Server from existing socket.
-    Server(int port, std::string hostname, bool nonblock = false); ///< Create a new TCP Server.
+    Server(int port, std::string hostname, bool nonblock = false, bool reusePort = false); ///< Create a new TCP Server.
     Server(std::string adres, bool nonblock = false);              ///< Create a new Unix Server.
     Connection accept(bool nonblock = false); ///< Accept any waiting connections.
     void setBlocking(bool blocking); ///< Set this socket to be blocking (true) or nonblocking (false).
@@ -208,6 +248,18 @@ namespace Socket{
     void checkRecvBuf();
     std::deque<Util::ResizeablePointer> paceQueue;
     uint64_t lastPace;
+    Util::ResizeablePointer recvPool; ///< Message headers and packet buffers for batched receiving.
+    size_t recvSlot;                  ///< Size of a single packet buffer in recvPool.
+    size_t recvCount;                 ///< Amount of messages in the current receive batch.
+    size_t recvPos;                   ///< Message in the current receive batch to hand out next.
+    size_t recvOffset;                ///< Offset within that message, when it holds coalesced packets.
+    bool gro;                         ///< True if the kernel may coalesce received packets.
+    Util::ResizeablePointer sendPool; ///< Datagrams queued by sendBatched, stored back to back.
+    size_t sendLens[UDP_BATCH_SIZE];  ///< Lengths of the datagrams in sendPool.
+    size_t sendCount;                 ///< Amount of datagrams in sendPool.
+    bool gsoFailed;                   ///< True if segmentation offload was refused by the kernel.
+    void initBatching();
+    bool receiveBatch();
 
   public:
     Util::ResizeablePointer data;
@@ -227,9 +279,13 @@ namespace Socket{
     std::string getBoundAddress();
     uint32_t getDestPort() const;
     bool Receive();
+    void enableGRO();
     void SendNow(const std::string &data);
     void SendNow(const char *data);
     void SendNow(const char *data, size_t len);
+    void SendNow(const char *data, size_t len, size_t segment);
+    void sendBatched(const char *data, size_t len);
+    void flush();
     void sendPaced(const char * data, size_t len);
     void sendPaced(uint64_t uSendWindow);
     void setSocketFamily(int AF_TYPE);
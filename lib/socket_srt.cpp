@@ -316,6 +316,17 @@ namespace Socket{
     ERROR_MSG("Invalid mode parameter. Use 'client' or 'server'");
   }
 
+  /// Returns true while the handshake of a caller or rendezvous connection is still in progress.
+  /// Since connect does not wait for the handshake, call this until it returns false before
+  /// sending. If the handshake failed, the socket is closed.
+  bool SRTConnection::isConnecting(){
+    if (sock == -1){return false;}
+    SRT_SOCKSTATUS state = srt_getsockstate(sock);
+    if (state == SRTS_CONNECTING){return true;}
+    if (state != SRTS_CONNECTED){close();}
+    return false;
+  }
+
   void SRTConnection::setupAdapter(const std::string &_host, int _port){
     sockaddr_in localsa = createInetAddr(_host, _port);
     sockaddr *psa = (sockaddr *)&localsa;
@@ -324,9 +335,9 @@ namespace Socket{
     }
   }
 
-  void SRTConnection::SendNow(const std::string &data){SendNow(data.data(), data.size());}
+  bool SRTConnection::SendNow(const std::string &data){return SendNow(data.data(), data.size());}
 
-  void SRTConnection::SendNow(const char *data, size_t len){
+  bool SRTConnection::SendNow(const char *data, size_t len){
     srt_clearlasterror();
     int res = srt_sendmsg2(sock, data, len, NULL);
 
@@ -335,14 +346,14 @@ namespace Socket{
       //Do not report normal connection lost errors
       if (err == SRT_ECONNLOST){
         close();
-        return;
+        return false;
       }
       if (err == SRT_ENOCONN){
         if (Util::bootMS() > lastGood + 5000){
           ERROR_MSG("SRT connection timed out - closing");
           close();
         }
-        return;
+        return false;
       }
 //      ERROR_MSG("Unable to send data over socket %" PRId32 ": %s", sock, srt_getlasterror_str());
       if (srt_getsockstate(sock) != SRTS_CONNECTED){close();}
@@ -350,6 +361,7 @@ namespace Socket{
       lastGood = Util::bootMS();
     }
     srt_bstats(sock, &performanceMonitor, false);
+    return res != SRT_ERROR;
   }
 
   unsigned int SRTConnection::connTime(){
@@ -437,6 +449,7 @@ namespace Socket{
     if (!tsbpdMode){
       if (srt_setsockopt(sock, 0, SRTO_TSBPDMODE, &no, sizeof no) == -1){return -1;}
     }
+    // Non-blocking receiving also makes srt_connect return without waiting for the handshake
     if (srt_setsockopt(sock, 0, SRTO_RCVSYN, &no, sizeof no) == -1){return -1;}
 
     if (params.count("linger")){
@@ -42,6 +42,7 @@ namespace Socket{
                  const paramList &_params = paramList());
     void close();
     bool connected() const{return sock != -1;}
+    bool isConnecting();
     operator bool() const{return connected();}
 
     void setBlocking(bool blocking); ///< Set this socket to be blocking (true) or nonblocking (false).
@@ -51,8 +52,8 @@ namespace Socket{
     size_t Recv();
     char recvbuf[5000]; ///< Buffer where received data is stored in
 
-    void SendNow(const std::string &data);
-    void SendNow(const char *data, size_t len);
+    bool SendNow(const std::string &data);
+    bool SendNow(const char *data, size_t len); ///< Returns false if the data was not accepted for sending.
 
     SRTSOCKET getSocket(){return sock;}
 
@@ -15,6 +15,7 @@
 #include "url.h"
 #include "stream.h"
 #include "triggers.h" //LTS
+#include <algorithm>
 #include <semaphore.h>
 #include <stdlib.h>
 #include <sys/stat.h>
@@ -277,11 +278,12 @@ void Util::packetSorter::setSyncMode(bool synced){
       }
       dequeBuffer.clear();
     }else{
-      //we've switched away from set
-      for (std::set<Util::sortedPageInfo>::iterator it = setBuffer.begin(); it != setBuffer.end(); ++it){
+      //we've switched away from the heap; keep playback order in the deque
+      std::sort(heapBuffer.begin(), heapBuffer.end());
+      for (std::vector<Util::sortedPageInfo>::iterator it = heapBuffer.begin(); it != heapBuffer.end(); ++it){
         insert(*it);
       }
-      setBuffer.clear();
+      heapBuffer.clear();
     }
   }
 }
@@ -291,13 +293,13 @@ bool Util::packetSorter::getSyncMode() const{return !dequeMode;}
 
 /// Returns the amount of packets currently in the sorter.
 size_t Util::packetSorter::size() const{
-  if (dequeMode){return dequeBuffer.size();}else{return setBuffer.size();}
+  if (dequeMode){return dequeBuffer.size();}else{return heapBuffer.size();}
 }
 
 /// Clears all packets from the sorter; does not reset mode.
 void Util::packetSorter::clear(){
   dequeBuffer.clear();
-  setBuffer.clear();
+  heapBuffer.clear();
 }
 
 /// Returns a pointer to the first packet in the sorter.
@@ -305,16 +307,48 @@ const Util::sortedPageInfo * Util::packetSorter::begin() const{
   if (dequeMode){
     return &*dequeBuffer.begin();
   }else{
-    return &*setBuffer.begin();
+    return &*heapBuffer.begin();
   }
 }
 
+/// Moves the heap entry at pos towards the top until its parent is not later than it.
+void Util::packetSorter::siftUp(size_t pos){
+  sortedPageInfo entry = heapBuffer[pos];
+  while (pos){
+    size_t parent = (pos - 1) / 2;
+    if (!(entry < heapBuffer[parent])){break;}
+    heapBuffer[pos] = heapBuffer[parent];
+    pos = parent;
+  }
+  heapBuffer[pos] = entry;
+}
+
+/// Moves the heap entry at pos towards the bottom until neither child is earlier than it.
+void Util::packetSorter::siftDown(size_t pos){
+  size_t len = heapBuffer.size();
+  sortedPageInfo entry = heapBuffer[pos];
+  while (true){
+    size_t child = pos * 2 + 1;
+    if (child >= len){break;}
+    if (child + 1 < len && heapBuffer[child + 1] < heapBuffer[child]){++child;}
+    if (!(heapBuffer[child] < entry)){break;}
+    heapBuffer[pos] = heapBuffer[child];
+    pos = child;
+  }
+  heapBuffer[pos] = entry;
+}
+
 /// Inserts a new packet in the sorter.
+/// In sync mode, a packet with the same time and track as one already present is ignored.
 void Util::packetSorter::insert(const sortedPageInfo &pInfo){
   if (dequeMode){
     dequeBuffer.push_back(pInfo);
   }else{
-    setBuffer.insert(pInfo);
+    for (std::vector<Util::sortedPageInfo>::const_iterator it = heapBuffer.begin(); it != heapBuffer.end(); ++it){
+      if (it->tid == pInfo.tid && it->time == pInfo.time){return;}
+    }
+    heapBuffer.push_back(pInfo);
+    siftUp(heapBuffer.size() - 1);
   }
 }
 
@@ -328,11 +362,17 @@ void Util::packetSorter::dropTrack(size_t tid){
       }
     }
   }else{
-    for (std::set<Util::sortedPageInfo>::iterator it = setBuffer.begin(); it != setBuffer.end(); ++it){
-      if (it->tid == tid){
-        setBuffer.erase(it);
-        return;
-      }
+    // Drop the earliest packet for this track, like the ordered set this heap replaced did
+    size_t pos = heapBuffer.size();
+    for (size_t i = 0; i < heapBuffer.size(); ++i){
+      if (heapBuffer[i].tid == tid && (pos == heapBuffer.size() || heapBuffer[i] < heapBuffer[pos])){pos = i;}
+    }
+    if (pos == heapBuffer.size()){return;}
+    heapBuffer[pos] = heapBuffer.back();
+    heapBuffer.pop_back();
+    if (pos < heapBuffer.size()){
+      siftUp(pos);
+      siftDown(pos);
     }
   }
 }
@@ -345,8 +385,8 @@ void Util::packetSorter::replaceFirst(const sortedPageInfo &pInfo){
     dequeBuffer.pop_front();
     dequeBuffer.push_back(pInfo);
   }else{
-    setBuffer.erase(setBuffer.begin());
-    setBuffer.insert(pInfo);
+    heapBuffer[0] = pInfo;
+    siftDown(0);
   }
 }
 
@@ -365,7 +405,7 @@ bool Util::packetSorter::hasEntry(size_t tid) const{
       if (it->tid == tid){return true;}
     }
   }else{
-    for (std::set<Util::sortedPageInfo>::const_iterator it = setBuffer.begin(); it != setBuffer.end(); ++it){
+    for (std::vector<Util::sortedPageInfo>::const_iterator it = heapBuffer.begin(); it != heapBuffer.end(); ++it){
       if (it->tid == tid){return true;}
     }
   }
@@ -380,7 +420,7 @@ void Util::packetSorter::getTrackList(std::set<size_t> &toFill) const{
       toFill.insert(it->tid);
     }
   }else{
-    for (std::set<Util::sortedPageInfo>::const_iterator it = setBuffer.begin(); it != setBuffer.end(); ++it){
+    for (std::vector<Util::sortedPageInfo>::const_iterator it = heapBuffer.begin(); it != heapBuffer.end(); ++it){
       toFill.insert(it->tid);
     }
   }
@@ -394,7 +434,10 @@ void Util::packetSorter::getTrackList(std::map<size_t, uint64_t> &toFill) const{
       toFill[it->tid] = it->time;
     }
   }else{
-    for (std::set<Util::sortedPageInfo>::const_iterator it = setBuffer.begin(); it != setBuffer.end(); ++it){
+    // Match the ordered iteration of the set this heap replaced: the latest entry per track wins
+    std::vector<Util::sortedPageInfo> sorted(heapBuffer);
+    std::sort(sorted.begin(), sorted.end());
+    for (std::vector<Util::sortedPageInfo>::const_iterator it = sorted.begin(); it != sorted.end(); ++it){
       toFill[it->tid] = it->time;
     }
   }
@@ -813,10 +856,97 @@ void Util::sendUDPApi(JSON::Value & cmd){
   uSock.SendNow(cmd.toString());
 }
 
+/// Returns the capabilities of the output that can push to the given target, or an empty
+/// Scan if there is no such output.
+static DTSC::Scan findPushOutput(DTSC::Scan &outputs, const std::string &target){
+  std::string checkTarget = target.substr(0, target.rfind('?'));
+  unsigned int outputs_size = outputs.getSize();
+  for (unsigned int i = 0; i < outputs_size; ++i){
+    DTSC::Scan output = outputs.getIndice(i);
+    if (output.getMember("push_urls")){
+      unsigned int push_count = output.getMember("push_urls").getSize();
+      for (unsigned int j = 0; j < push_count; ++j){
+        std::string tar_match = output.getMember("push_urls").getIndice(j).asString();
+        std::string front = tar_match.substr(0, tar_match.find('*'));
+        std::string back = tar_match.substr(tar_match.find('*') + 1);
+        MEDIUM_MSG("Checking output %s: %s (%s)", outputs.getIndiceName(i).c_str(),
+                   output.getMember("name").asString().c_str(), checkTarget.c_str());
+        if (checkTarget.substr(0, front.size()) == front &&
+            checkTarget.substr(checkTarget.size() - back.size()) == back){
+          return output;
+        }
+        //Check for external writer support
+        if (front == "/" && back.size() && checkTarget.substr(checkTarget.size() - back.size()) == back){
+          HTTP::URL tUri(target);
+          // If it is a remote target, we might need to spawn an external binary
+          if (tUri.isLocalPath()){continue;}
+          // Read configured external writers
+          IPC::sharedPage extwriPage(EXTWRITERS, 0, false, false);
+          if (extwriPage.mapped){
+            Util::RelAccX extWri(extwriPage.mapped, false);
+            if (extWri.isReady()){
+              for (uint64_t i = 0; i < extWri.getEndPos(); i++){
+                Util::RelAccX protocols = Util::RelAccX(extWri.getPointer("protocols", i));
+                uint8_t protocolCount = protocols.getPresent();
+                for (uint8_t idx = 0; idx < protocolCount; idx++){
+                  if (tUri.protocol == protocols.getPointer("protocol", idx)){return output;}
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  return DTSC::Scan();
+}
+
+/// Splits a fan-out push target into the targets it consists of.
+/// A fan-out target lists several targets separated by '|', all of which must be handled by the
+/// same output, and that output must be able to push to several targets at once. Any other target,
+/// including one that merely contains a '|', is returned as the only entry.
+/// Outputs that can not fan out (those without the push_fanout capability) log a warning when
+/// given a fan-out target.
+std::deque<std::string> Util::getPushTargets(const std::string &target){
+  std::deque<std::string> ret;
+  if (target.find('|') != std::string::npos){
+    Util::DTSCShmReader rCapa(SHM_CAPA);
+    DTSC::Scan outputs = rCapa.getMember("connectors");
+    std::string outputName;
+    bool fanOut = true;
+    size_t start = 0;
+    while (outputs){
+      size_t end = target.find('|', start);
+      std::string piece = target.substr(start, end == std::string::npos ? std::string::npos : end - start);
+      DTSC::Scan output = findPushOutput(outputs, piece);
+      if (!output || (outputName.size() && output.getMember("name").asString() != outputName)){
+        ret.clear();
+        break;
+      }
+      if (!output.getMember("push_fanout").asBool()){fanOut = false;}
+      outputName = output.getMember("name").asString();
+      ret.push_back(piece);
+      if (end == std::string::npos){break;}
+      start = end + 1;
+    }
+    if (ret.size() > 1 && !fanOut){
+      WARN_MSG("Output %s can not push to several targets from one process; treating %s as a single target",
+               outputName.c_str(), target.c_str());
+      ret.clear();
+    }
+  }
+  if (ret.size() < 2){
+    ret.clear();
+    ret.push_back(target);
+  }
+  return ret;
+}
+
 /// Attempt to start a push for streamname to target.
 /// streamname MUST be pre-sanitized
 /// target gets variables replaced and may be altered by the PUSH_OUT_START trigger response.
 /// Attempts to match the altered target to an output that can push to it.
+/// A fan-out target (see getPushTargets) starts a single output process for all of its targets.
 pid_t Util::startPush(const std::string &streamname, std::string &target, int debugLvl){
   if (Triggers::shouldTrigger("PUSH_OUT_START", streamname)){
     std::string payload = streamname + "\n" + target;
@@ -839,6 +969,7 @@ pid_t Util::startPush(const std::string &streamname, std::string &target, int de
 
   // Attempt to load up configuration and find this stream
   std::string output_bin = "";
+  std::deque<std::string> targets = getPushTargets(target);
   {
     Util::DTSCShmReader rCapa(SHM_CAPA);
     DTSC::Scan outputs = rCapa.getMember("connectors");
@@ -846,59 +977,20 @@ pid_t Util::startPush(const std::string &streamname, std::string &target, int de
       FAIL_MSG("Capabilities not available, aborting! Is MistController running?");
       return 0;
     }
-    std::string checkTarget = target.substr(0, target.rfind('?'));
-    unsigned int outputs_size = outputs.getSize();
-    for (unsigned int i = 0; i < outputs_size && !output_bin.size(); ++i){
-      DTSC::Scan output = outputs.getIndice(i);
-      if (output.getMember("push_urls")){
-        unsigned int push_count = output.getMember("push_urls").getSize();
-        for (unsigned int j = 0; j < push_count; ++j){
-          std::string tar_match = output.getMember("push_urls").getIndice(j).asString();
-          std::string front = tar_match.substr(0, tar_match.find('*'));
-          std::string back = tar_match.substr(tar_match.find('*') + 1);
-          MEDIUM_MSG("Checking output %s: %s (%s)", outputs.getIndiceName(i).c_str(),
-                     output.getMember("name").asString().c_str(), checkTarget.c_str());
-          if (checkTarget.substr(0, front.size()) == front &&
-              checkTarget.substr(checkTarget.size() - back.size()) == back){
-            output_bin = Util::getMyPath() + "MistOut" + output.getMember("name").asString();
-            break;
-          }
-          //Check for external writer support
-          if (front == "/" && back.size() && checkTarget.substr(checkTarget.size() - back.size()) == back){
-            HTTP::URL tUri(target);
-            // If it is a remote target, we might need to spawn an external binary
-            if (tUri.isLocalPath()){continue;}
-            // Read configured external writers
-            IPC::sharedPage extwriPage(EXTWRITERS, 0, false, false);
-            if (extwriPage.mapped){
-              Util::RelAccX extWri(extwriPage.mapped, false);
-              if (extWri.isReady()){
-                for (uint64_t i = 0; i < extWri.getEndPos(); i++){
-                  Util::RelAccX protocols = Util::RelAccX(extWri.getPointer("protocols", i));
-                  uint8_t protocolCount = protocols.getPresent();
-                  JSON::Value protocolArray;
-                  for (uint8_t idx = 0; idx < protocolCount; idx++){
-                    if (tUri.protocol == protocols.getPointer("protocol", idx)){
-                      output_bin = Util::getMyPath() + "MistOut" + output.getMember("name").asString();
-                      break;
-                    }
-                    if (output_bin.size()){break;}
-                  }
-                  if (output_bin.size()){break;}
-                }
-              }
-            }
-          }
-        }
-      }
-    }
+    DTSC::Scan output = findPushOutput(outputs, targets[0]);
+    if (output){output_bin = Util::getMyPath() + "MistOut" + output.getMember("name").asString();}
   }
 
   if (!output_bin.size()){
     FAIL_MSG("No output found for target %s, aborting push.", target.c_str());
     return 0;
   }
-  INFO_MSG("Pushing %s to %s through %s", streamname.c_str(), target.c_str(), output_bin.c_str());
+  if (targets.size() > 1){
+    INFO_MSG("Pushing %s to %zu targets through %s: %s", streamname.c_str(), targets.size(),
+             output_bin.c_str(), target.c_str());
+  }else{
+    INFO_MSG("Pushing %s to %s through %s", streamname.c_str(), target.c_str(), output_bin.c_str());
+  }
   // Start  output.
   std::string dLvl = JSON::Value(debugLvl).asString();
   char *argv[] ={(char *)output_bin.c_str(), (char *)"--stream", (char *)streamname.c_str(),
@@ -7,8 +7,10 @@
 #include "shared_memory.h"
 #include "socket.h"
 #include "util.h"
+#include <deque>
 #include <string>
 #include <list>
+#include <vector>
 
 const JSON::Value empty;
 
@@ -23,6 +25,7 @@ namespace Util{
                   bool isProvider = false,
                   const std::map<std::string, std::string> &overrides = std::map<std::string, std::string>(),
                   pid_t *spawn_pid = NULL);
+  std::deque<std::string> getPushTargets(const std::string &target);
   int startPush(const std::string &streamname, std::string &target, int debugLvl = -1);
   JSON::Value getStreamConfig(const std::string &streamname);
   JSON::Value getGlobalConfig(const std::string &optionName);
@@ -67,7 +70,9 @@ namespace Util{
     bool ghostPacket;
   };
 
-  /// Packet sorter used to determine which packet should be output next
+  /// Packet sorter used to determine which packet should be output next.
+  /// In sync mode, packets are kept in a binary min-heap ordered by (time, track), so that the
+  /// per-packet replaceFirst is O(log tracks) with no allocations.
   class packetSorter{
     public:
       packetSorter();
@@ -84,9 +89,11 @@ namespace Util{
       void setSyncMode(bool synced);
       bool getSyncMode() const;
     private:
+      void siftUp(size_t pos);
+      void siftDown(size_t pos);
       bool dequeMode;
       std::deque<sortedPageInfo> dequeBuffer;
-      std::set<sortedPageInfo> setBuffer;
+      std::vector<sortedPageInfo> heapBuffer;
   };
 
 
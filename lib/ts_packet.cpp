@@ -10,6 +10,7 @@
 #include <set>
 #include <sstream>
 #include <string.h>
+#include <unistd.h>
 
 #ifndef FILLER_DATA
 #define FILLER_DATA                                                                                \
@@ -1728,4 +1729,42 @@ namespace TS{
     return SDT.checkAndGetBuffer();
   }
 
+  /// Returns the amount of elementary streams in the program of a single-program TS file, which
+  /// is the amount of tracks a TS input would make for it if it supports all of them.
+  /// Only the first TS_TRACK_SCAN_PACKETS packets are searched for the PAT and PMT.
+  /// Returns zero if the file is not a plain 188-byte packet TS file with exactly one program.
+  size_t fileTracks(int fd, uint64_t fileSize){
+    if (!fileSize || fileSize % 188){return 0;}
+    char buf[188];
+    unsigned int pmtPid = 0;
+    for (uint64_t pos = 0; pos < fileSize && pos < 188 * TS_TRACK_SCAN_PACKETS; pos += 188){
+      if (pread(fd, buf, 188, pos) != 188 || buf[0] != 0x47){return 0;}
+      Packet pkt;
+      if (!pkt.FromPointer(buf) || !pkt.getUnitStart()){continue;}
+      if (!pmtPid && pkt.getPID() == 0){
+        ProgramAssociationTable pat;
+        pat = pkt;
+        for (short i = 0; i < pat.getProgramCount(); ++i){
+          if (!pat.getProgramNumber(i)){continue;}// Network information table
+          if (pmtPid){return 0;}
+          pmtPid = pat.getProgramPID(i);
+        }
+        if (!pmtPid){return 0;}
+        continue;
+      }
+      if (pmtPid && pkt.getPID() == pmtPid){
+        ProgramMappingTable pmt;
+        pmt = pkt;
+        size_t tracks = 0;
+        ProgramMappingEntry entry = pmt.getEntry(0);
+        while (entry){
+          ++tracks;
+          entry.advance();
+        }
+        return tracks;
+      }
+    }
+    return 0;
+  }
+
 }// namespace TS
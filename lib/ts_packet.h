@@ -257,5 +257,6 @@ namespace TS{
 
   const char *createPMT(std::set<size_t> &selectedTracks, const DTSC::Meta &M, int contCounter = 0);
   const char *createSDT(const std::string &streamName, int contCounter = 0);
+  size_t fileTracks(int fd, uint64_t fileSize);
 
 }// namespace TS
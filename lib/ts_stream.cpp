@@ -9,6 +9,7 @@
 #include <sys/stat.h>
 #include "tinythread.h"
 #include "opus.h"
+#include <algorithm>
 
 tthread::recursive_mutex tMutex;
 
@@ -24,6 +25,33 @@ namespace TS{
   }
 
   bool Assembler::assemble(Stream & TSStrm, const char * ptr, size_t len, bool parse, uint64_t bytePos){
+    return assemble(&TSStrm, 0, ptr, len, parse, bytePos);
+  }
+
+  /// Assembles whole TS packets like the Stream version, but hands every packet to the callback
+  /// as a 188-byte block instead of adding it to a Stream.
+  bool Assembler::assemble(Util::DataCallback &cb, const char *ptr, size_t len){
+    return assemble(0, &cb, ptr, len, false, 0);
+  }
+
+  /// Passes a whole packet on to the Stream or the callback, whichever is set.
+  /// Returns true if the packet starts a new unit. The callback gets the packet without copying.
+  bool Assembler::handle(Stream *TSStrm, Util::DataCallback *cb, const char *pkt, bool parse, uint64_t bytePos){
+    if (cb){
+      cb->dataCallback(pkt, 188);
+      return pkt[1] & 0x40;
+    }
+    tsBuf.FromPointer(pkt);
+    if (parse){
+      TSStrm->parse(tsBuf, isLive?0:bytePos);
+    }else{
+      TSStrm->add(tsBuf);
+      if (!TSStrm->isDataTrack(tsBuf.getPID())){TSStrm->parse(tsBuf.getPID());}
+    }
+    return tsBuf.getUnitStart();
+  }
+
+  bool Assembler::assemble(Stream *TSStrm, Util::DataCallback *cb, const char *ptr, size_t len, bool parse, uint64_t bytePos){
     bool ret = false;
     size_t offset = 0;
     size_t amount = 188-leftData.size();
@@ -35,14 +63,7 @@ namespace TS{
           //Success!
           bytePos -= leftData.size();
           leftData.append(ptr, amount);
-          tsBuf.FromPointer(leftData);
-          if (!ret && tsBuf.getUnitStart()){ret = true;}
-          if (parse){
-            TSStrm.parse(tsBuf, isLive?0:bytePos);
-          }else{
-            TSStrm.add(tsBuf);
-            if (!TSStrm.isDataTrack(tsBuf.getPID())){TSStrm.parse(tsBuf.getPID());}
-          }
+          if (handle(TSStrm, cb, leftData, parse, bytePos)){ret = true;}
           offset = amount;
           bytePos += 188;
           leftData.truncate(0);
@@ -64,14 +85,7 @@ namespace TS{
           junk = 0;
         }
         if (offset + 188 <= len){
-          tsBuf.FromPointer(ptr + offset);
-          if (!ret && tsBuf.getUnitStart()){ret = true;}
-          if (parse){
-            TSStrm.parse(tsBuf, isLive?0:bytePos);
-          }else{
-            TSStrm.add(tsBuf);
-            if (!TSStrm.isDataTrack(tsBuf.getPID())){TSStrm.parse(tsBuf.getPID());}
-          }
+          if (handle(TSStrm, cb, ptr + offset, parse, bytePos)){ret = true;}
         }else{
           leftData.assign(ptr + offset, len - offset);
         }
@@ -90,6 +104,132 @@ namespace TS{
     leftData.truncate(0);
   }
 
+  /// Creates a ring holding at least the given number of packets, rounded up to a power of two.
+  PacketRing::PacketRing(size_t packets){
+    size_t cap = 1;
+    while (cap < packets){cap <<= 1;}
+    mask = cap - 1;
+    data = (char *)malloc(cap * 188);
+    if (!data){
+      FAIL_MSG("Could not allocate ring for %zu TS packets", cap);
+      mask = 0;
+    }
+    writePos = 0;
+    cachedTail = 0;
+    written = 0;
+    dropped = 0;
+    memset(dropPids, 0, sizeof(dropPids));
+    dropCount = 0;
+    head = 0;
+    tail = 0;
+    cachedHead = 0;
+    peak = 0;
+    closed = false;
+  }
+
+  PacketRing::~PacketRing(){
+    if (data){free(data);}
+  }
+
+  /// Copies a packet into the ring, without making it visible to the consumer yet.
+  /// Returns false if the packet was dropped instead. Once a packet of a PID is dropped, the
+  /// following packets of that PID are dropped too, up to its next unit start; other PIDs sharing
+  /// the ring (such as PAT/PMT copies) do not end that. That unit start is preceded by a drop
+  /// marker: a payload-less packet of the same PID with the transport error flag set.
+  bool PacketRing::write(const char *packet){
+    uint16_t pid = ((packet[1] & 0x1F) << 8) | (unsigned char)packet[2];
+    uint32_t pidBit = 1u << (pid & 31);
+    bool resume = false;
+    if (dropCount && (dropPids[pid >> 5] & pidBit)){
+      if (!(packet[1] & 0x40)){
+        __atomic_store_n(&dropped, dropped + 1, __ATOMIC_RELAXED);
+        return false;
+      }
+      resume = true;
+    }
+    if (!data){
+      __atomic_store_n(&dropped, dropped + 1, __ATOMIC_RELAXED);
+      return false;
+    }
+    // Resuming takes a slot for the drop marker as well
+    size_t maxUsed = resume ? mask : mask + 1;
+    if (writePos - cachedTail >= maxUsed){
+      cachedTail = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+      if (writePos - cachedTail >= maxUsed){
+        if (!resume){
+          dropPids[pid >> 5] |= pidBit;
+          ++dropCount;
+        }
+        __atomic_store_n(&dropped, dropped + 1, __ATOMIC_RELAXED);
+        return false;
+      }
+    }
+    if (resume){
+      dropPids[pid >> 5] &= ~pidBit;
+      --dropCount;
+      char *marker = data + (writePos & mask) * 188;
+      marker[0] = 0x47;
+      marker[1] = 0x80 | (pid >> 8);
+      marker[2] = pid & 0xFF;
+      marker[3] = 0x20 | ((packet[3] - 1) & 0x0F); // Adaptation field only
+      marker[4] = 183;
+      marker[5] = 0;
+      memset(marker + 6, 0xFF, 182);
+      ++writePos;
+    }
+    memcpy(data + (writePos & mask) * 188, packet, 188);
+    ++writePos;
+    __atomic_store_n(&written, written + 1, __ATOMIC_RELAXED);
+    return true;
+  }
+
+  /// Makes all packets written so far visible to the consumer.
+  void PacketRing::publish(){
+    if (head != writePos){__atomic_store_n(&head, writePos, __ATOMIC_RELEASE);}
+  }
+
+  size_t PacketRing::getWritten() const{return __atomic_load_n(&written, __ATOMIC_RELAXED);}
+
+  size_t PacketRing::getDropped() const{return __atomic_load_n(&dropped, __ATOMIC_RELAXED);}
+
+  /// Points packets at the oldest unread packet and returns how many packets follow it
+  /// contiguously in memory, which may be fewer than are waiting when the ring wraps.
+  size_t PacketRing::peek(const char *&packets){
+    size_t avail = cachedHead - tail;
+    if (!avail){
+      cachedHead = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+      avail = cachedHead - tail;
+      if (!avail){return 0;}
+      if (avail > peak){peak = avail;}
+    }
+    size_t idx = tail & mask;
+    if (idx + avail > mask + 1){avail = mask + 1 - idx;}
+    packets = data + idx * 188;
+    return avail;
+  }
+
+  /// Hands the given number of packets returned by peek back to the producer.
+  void PacketRing::consume(size_t count){
+    __atomic_store_n(&tail, tail + count, __ATOMIC_RELEASE);
+  }
+
+  /// Marks the ring as abandoned by the consumer, after which the producer may delete it.
+  void PacketRing::close(){
+    __atomic_store_n(&closed, true, __ATOMIC_RELEASE);
+  }
+
+  size_t PacketRing::getPeak() const{return peak;}
+
+  bool PacketRing::isClosed() const{return __atomic_load_n(&closed, __ATOMIC_ACQUIRE);}
+
+  /// Returns the number of published packets waiting for the consumer.
+  size_t PacketRing::size() const{
+    size_t t = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+    return __atomic_load_n(&head, __ATOMIC_ACQUIRE) - t;
+  }
+
+  size_t PacketRing::capacity() const{return mask + 1;}
+
   void ADTSRemainder::setRemainder(const aac::adts &p, const void *source, uint32_t avail, uint64_t bPos){
     if (!p.getCompleteSize()){return;}
 
@@ -147,15 +287,106 @@ namespace TS{
   uint64_t ADTSRemainder::getTodo(){return len - now;}
   char *ADTSRemainder::getData(){return data;}
 
+  PIDState::PIDState(){
+    codec = 0;
+    lastCC = 0;
+    hasPSI = false;
+    building = false;
+    skipping = false;
+    rolloverCount = 0;
+    lastms = 0;
+    lastPMT = 0;
+  }
+
+  /// Drops all buffered and parsed data, but keeps what is known about the stream itself.
+  void PIDState::partialClear(){
+    skipping = false;
+    pesData.truncate(0);
+    pesStarts.clear();
+    pesPositions.clear();
+    hasPSI = false;
+    outPackets.clear();
+    buildPacket.null();
+    building = false;
+    lastms = 0;
+    rolloverCount = 0;
+  }
+
+  /// Removes the PES packets that were already parsed from the front of the buffer.
+  void PIDState::compact(){
+    size_t used = pesStarts.size() ? pesStarts.front() : pesData.size();
+    if (!used){return;}
+    pesData.shift(used);
+    for (std::deque<size_t>::iterator it = pesStarts.begin(); it != pesStarts.end(); ++it){*it -= used;}
+  }
+
+  /// Locks the demuxer mutex for the lifetime of the object, unless the stream is single-threaded.
+  class StreamLock{
+  public:
+    StreamLock(bool threaded) : locked(threaded){
+      if (locked){tMutex.lock();}
+    }
+    ~StreamLock(){
+      if (locked){tMutex.unlock();}
+    }
+
+  private:
+    bool locked;
+  };
+
   Stream::Stream(){
-    psCache = 0;
-    psCacheTid = 0;
     rParser = NONE;
+    threaded = true;
+    lastPAT = 0;
+    memset(pids, 0, sizeof(pids));
+  }
+
+  /// Copies only the settings of rhs; the copy starts out without any demuxing state.
+  Stream::Stream(const Stream &rhs){
+    rParser = rhs.rParser;
+    threaded = rhs.threaded;
+    lastPAT = 0;
+    memset(pids, 0, sizeof(pids));
+  }
+
+  /// Clears all demuxing state and takes over the settings of rhs.
+  Stream &Stream::operator=(const Stream &rhs){
+    if (this == &rhs){return *this;}
+    clear();
+    rParser = rhs.rParser;
+    threaded = rhs.threaded;
+    return *this;
   }
 
   void Stream::setRawDataParser(rawDataType parser){rParser = parser;}
 
-  Stream::~Stream(){}
+  /// Streams are locked by default, as some inputs access them from several threads at once.
+  /// Streams that are only used by one thread at a time can disable locking entirely.
+  void Stream::setThreaded(bool threaded){this->threaded = threaded;}
+
+  Stream::~Stream(){
+    for (std::vector<size_t>::iterator it = usedPids.begin(); it != usedPids.end(); ++it){
+      delete pids[*it];
+    }
+  }
+
+  /// Returns the state for the given PID, or null if nothing was stored for it yet.
+  PIDState *Stream::getState(size_t tid) const{return tid < 8192 ? pids[tid] : 0;}
+
+  /// Returns the state for the given PID, which must be a valid PID, allocating it if needed.
+  PIDState &Stream::makeState(size_t tid){
+    if (!pids[tid]){
+      pids[tid] = new PIDState();
+      usedPids.insert(std::lower_bound(usedPids.begin(), usedPids.end(), tid), tid);
+    }
+    return *pids[tid];
+  }
+
+  /// Returns the state for the given PID only if it is a known data track, null otherwise.
+  PIDState *Stream::getDataState(size_t tid) const{
+    PIDState *st = getState(tid);
+    return (st && st->codec) ? st : 0;
+  }
 
   void Stream::parse(char *newPack, uint64_t bytePos){
     Packet newPacket;
@@ -164,43 +395,32 @@ namespace TS{
   }
 
   void Stream::partialClear(){
-    tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-    pesStreams.clear();
-    psCacheTid = 0;
-    psCache = 0;
-    pesPositions.clear();
-    outPackets.clear();
-    buildPacket.clear();
-    seenUnitStart.clear();
-    lastms.clear();
-    rolloverCount.clear();
+    StreamLock guard(threaded);
+    for (std::vector<size_t>::iterator it = usedPids.begin(); it != usedPids.end(); ++it){
+      pids[*it]->partialClear();
+    }
   }
 
   void Stream::clear(){
-    tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-    partialClear();
-    pidToCodec.clear();
-    adtsInfo.clear();
-    spsInfo.clear();
-    ppsInfo.clear();
-    hevcInfo.clear();
-    metaInit.clear();
-    descriptors.clear();
-    mappingTable.clear();
-    lastPMT.clear();
+    StreamLock guard(threaded);
+    for (std::vector<size_t>::iterator it = usedPids.begin(); it != usedPids.end(); ++it){
+      delete pids[*it];
+      pids[*it] = 0;
+    }
+    usedPids.clear();
     lastPAT = 0;
     pmtTracks.clear();
-    remainders.clear();
     associationTable = ProgramAssociationTable();
   }
 
   void Stream::finish(){
-    tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-    if (!pesStreams.size()){return;}
-
-    for (std::map<size_t, std::deque<Packet> >::const_iterator i = pesStreams.begin();
-         i != pesStreams.end(); i++){
-      parsePES(i->first, true);
+    StreamLock guard(threaded);
+    for (std::vector<size_t>::iterator it = usedPids.begin(); it != usedPids.end(); ++it){
+      PIDState *st = pids[*it];
+      if (!st->codec || !st->pesStarts.size()){continue;}
+      while (st->pesStarts.size() > 1){parsePES(*it);}
+      parsePES(*it, true);
+      st->compact();
     }
   }
 
@@ -211,52 +431,77 @@ namespace TS{
   }
 
   void Stream::add(Packet &newPack, uint64_t bytePos){
-    tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
+    StreamLock guard(threaded);
     uint32_t tid = newPack.getPID();
     bool unitStart = newPack.getUnitStart();
-    static uint32_t wantPrev = 0;
-    bool isData = pidToCodec.count(tid);
-    bool wantTrack = ((wantPrev == tid) || (tid == 0 || newPack.isPMT(pmtTracks) || isData));
-    if (!wantTrack){return;}
-    if (psCacheTid != tid || !psCache){
-      psCache = &(pesStreams[tid]);
-      psCacheTid = tid;
+    // Tables are parsed from their last packet only
+    if (tid == 0 || newPack.isPMT(pmtTracks)){
+      PIDState &st = makeState(tid);
+      if (unitStart || st.hasPSI){
+        st.psiPacket = newPack;
+        st.hasPSI = true;
+      }
+      return;
+    }
+    PIDState *st = getDataState(tid);
+    if (!st){return;}
+    // A transport error (which PacketRing also signals where it dropped packets) means the PES
+    // packet being assembled is incomplete: discard it, along with the rest of it
+    if (newPack.hasTransportError()){
+      if (!st->skipping && st->pesStarts.size()){
+        INFO_MSG("Discarding incomplete PES on track %" PRIu32, tid);
+        st->pesData.truncate(st->pesStarts.back());
+        st->pesStarts.pop_back();
+        st->pesPositions.pop_back();
+      }
+      st->skipping = true;
+      return;
     }
-    if (unitStart || !psCache->empty()){
-      wantPrev = tid;
-      psCache->push_back(newPack);
-      if (unitStart && isData){
-        pesPositions[tid].push_back(bytePos);
-        ++(seenUnitStart[tid]);
+    int cc = newPack.getContinuityCounter();
+    if (unitStart){
+      st->skipping = false;
+      st->pesStarts.push_back(st->pesData.size());
+      st->pesPositions.push_back(bytePos);
+    }else{
+      // Drop data from before the first unit start, after a transport error, and duplicate packets
+      if (st->skipping || !st->pesStarts.size() || cc == st->lastCC){return;}
+      if (cc - st->lastCC != 1 && cc){
+        INFO_MSG("Assembling PES on track %" PRIu32 ", missed %d packets", tid, cc - st->lastCC - 1);
       }
     }
+    st->lastCC = cc;
+    int payLen = newPack.getPayloadLength();
+    if (payLen > 0){st->pesData.append(newPack.getPayload(), payLen);}
   }
 
   bool Stream::isDataTrack(size_t tid) const{
     if (tid == 0){return false;}
     {
-      tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-      return pidToCodec.count(tid);
+      StreamLock guard(threaded);
+      return getDataState(tid);
     }
   }
 
+  /// Returns true if the PID carries the PAT or a known PMT.
+  bool Stream::isPSITrack(size_t tid) const{
+    if (tid == 0){return true;}
+    StreamLock guard(threaded);
+    return pmtTracks.count(tid);
+  }
+
   void Stream::parse(size_t tid){
-    tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-    if (!pesStreams.count(tid) || pesStreams[tid].size() == 0){return;}
-    if (psCacheTid != tid || !psCache){
-      psCache = &(pesStreams[tid]);
-      psCacheTid = tid;
-    }
+    StreamLock guard(threaded);
+    PIDState *st = getState(tid);
+    if (!st){return;}
 
     // Handle PAT packets
     if (tid == 0){
+      if (!st->hasPSI){return;}
       ///\todo Keep track of updates in PAT instead of keeping only the last PAT as a reference
-      associationTable = psCache->back();
+      associationTable = st->psiPacket;
+      st->hasPSI = false;
       lastPAT = Util::bootSecs();
       associationTable.parsePIDs(pmtTracks);
-      pesStreams.erase(0);
-      psCacheTid = 0;
-      psCache = 0;
       return;
     }
 
@@ -265,11 +510,13 @@ namespace TS{
 
     // Handle PMT packets
     if (pmtTracks.count(tid)){
+      if (!st->hasPSI){return;}
       ///\todo Keep track of updates in PMT instead of keeping only the last PMT per program as a
       /// reference
-      mappingTable[tid] = psCache->back();
-      lastPMT[tid] = Util::bootSecs();
-      ProgramMappingEntry entry = mappingTable[tid].getEntry(0);
+      st->mappingTable = st->psiPacket;
+      st->hasPSI = false;
+      st->lastPMT = Util::bootSecs();
+      ProgramMappingEntry entry = st->mappingTable.getEntry(0);
       while (entry){
         uint32_t pid = entry.getElementaryPid();
         uint32_t sType = entry.getStreamType();
@@ -283,20 +530,21 @@ namespace TS{
         case MPEG2:
         case OPUS:
         case META:{
-          pidToCodec[pid] = sType;
-          std::string & init = metaInit[pid];
+          PIDState &es = makeState(pid);
+          es.codec = sType;
+          std::string & init = es.metaInit;
           init.assign(entry.getESInfo(), entry.getESInfoLength());
           if (sType == META){
             TS::ProgramDescriptors desc(init.data(), init.size());
             std::string reg = desc.getRegistration();
             if (reg == "Opus"){
-              pidToCodec[pid] = OPUS;
+              es.codec = OPUS;
             }else if (reg == "JSON"){
-              pidToCodec[pid] = JSON;
+              es.codec = JSON;
             }else if (rParser == JSON){
-              pidToCodec[pid] = JSON;
+              es.codec = JSON;
             }else{
-              pidToCodec.erase(pid);
+              es.codec = 0;
             }
           }
         } break;
@@ -304,23 +552,16 @@ namespace TS{
         }
         entry.advance();
       }
-
-      pesStreams.erase(tid);
-      psCacheTid = 0;
-      psCache = 0;
       return;
     }
 
-    if (!pidToCodec.count(tid)){
-      pesStreams.erase(tid);
-      pesPositions.erase(tid);
-      seenUnitStart.erase(tid);
-      psCacheTid = 0;
-      psCache = 0;
+    if (!st->codec){
+      st->partialClear();
       return; // skip unknown codecs
     }
 
-    while (seenUnitStart[tid] > 1){parsePES(tid);}
+    while (st->pesStarts.size() > 1){parsePES(tid);}
+    st->compact();
   }
 
   void Stream::parse(Packet &newPack, uint64_t bytePos){
@@ -330,57 +571,44 @@ namespace TS{
   }
 
   bool Stream::hasPacketOnEachTrack() const{
-    tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-    if (!pidToCodec.size()){
-      // INFO_MSG("no packet on each track 1, pidtocodec.size: %d, outpacket.size: %d",
-      // pidToCodec.size(), outPackets.size());
-      return false;
-    }
+    StreamLock guard(threaded);
+    size_t tracks = 0;
     size_t missing = 0;
     uint64_t firstTime = 0xffffffffffffffffull, lastTime = 0;
-    for (std::map<size_t, uint32_t>::const_iterator it = pidToCodec.begin(); it != pidToCodec.end(); it++){
-      if (!hasPacket(it->first) || !outPackets.count(it->first) || !outPackets.at(it->first).size()){
+    for (std::vector<size_t>::const_iterator it = usedPids.begin(); it != usedPids.end(); it++){
+      const PIDState *st = pids[*it];
+      if (!st->codec){continue;}
+      ++tracks;
+      if (!st->outPackets.size()){
         missing++;
       }else{
-        if (outPackets.at(it->first).front().getTime() < firstTime){
-          firstTime = outPackets.at(it->first).front().getTime();
+        if (st->outPackets.front().getTime() < firstTime){
+          firstTime = st->outPackets.front().getTime();
         }
-        if (outPackets.at(it->first).back().getTime() > lastTime){
-          lastTime = outPackets.at(it->first).back().getTime();
+        if (st->outPackets.back().getTime() > lastTime){
+          lastTime = st->outPackets.back().getTime();
         }
       }
     }
+    if (!tracks){return false;}
 
-    return (!missing || (missing != pidToCodec.size() && lastTime - firstTime > 2000));
+    return (!missing || (missing != tracks && lastTime - firstTime > 2000));
   }
 
   bool Stream::hasPacket(size_t tid) const{
-    tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-    if (psCacheTid != tid && pesStreams.find(tid) == pesStreams.end()){return false;}
-    if (outPackets.count(tid) && outPackets.at(tid).size()){return true;}
-    if (pidToCodec.count(tid) && seenUnitStart.count(tid) && seenUnitStart.at(tid) > 1){
-      return true;
-    }
-    return false;
+    StreamLock guard(threaded);
+    const PIDState *st = getState(tid);
+    if (!st){return false;}
+    if (st->outPackets.size()){return true;}
+    return st->codec && st->pesStarts.size() > 1;
   }
 
   bool Stream::hasPacket() const{
-    tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-    if (!pesStreams.size()){return false;}
-
-    if (outPackets.size()){
-      for (std::map<size_t, std::deque<DTSC::Packet> >::const_iterator i = outPackets.begin();
-           i != outPackets.end(); i++){
-        if (i->second.size()){return true;}
-      }
-    }
-
-    for (std::map<size_t, uint32_t>::const_iterator i = seenUnitStart.begin(); i != seenUnitStart.end(); i++){
-      if (pidToCodec.count(i->first) && i->second > 1){
-        return true;
-      }
+    StreamLock guard(threaded);
+    for (std::vector<size_t>::const_iterator it = usedPids.begin(); it != usedPids.end(); it++){
+      const PIDState *st = pids[*it];
+      if (st->outPackets.size() || (st->codec && st->pesStarts.size() > 1)){return true;}
     }
-
     return false;
   }
 
@@ -396,89 +624,24 @@ namespace TS{
   }
 
   void Stream::parsePES(size_t tid, bool finished){
-    if (!pidToCodec.count(tid)){
+    PIDState *st = getDataState(tid);
+    if (!st){
       return; // skip unknown codecs
     }
-    if (psCacheTid != tid || !psCache){
-      psCache = &(pesStreams[tid]);
-      psCacheTid = tid;
-    }
-    if (!psCache->size() || (!finished && psCache->size() <= 1)){
+    if (!st->pesStarts.size() || (!finished && st->pesStarts.size() < 2)){
       if (!finished){FAIL_MSG("No PES packets to parse");}
-      seenUnitStart[tid] = 0;
       return;
     }
-    // Find number of packets before unit Start
-    size_t packNum = 1;
-    std::deque<Packet>::iterator curPack = psCache->begin();
-
-    if (seenUnitStart[tid] == 2 && psCache->begin()->getUnitStart() && psCache->rbegin()->getUnitStart()){
-      packNum = psCache->size() - 1;
-      curPack = psCache->end();
-      curPack--;
-    }else{
-      curPack++;
-      while (curPack != psCache->end() && !curPack->getUnitStart()){
-        curPack++;
-        packNum++;
-      }
-    }
-    if (!finished && curPack == psCache->end()){
-      FAIL_MSG("No PES packets to parse (%" PRIu32 ")", seenUnitStart[tid]);
-      seenUnitStart[tid] = 0;
-      return;
-    }
-
-    // We now know we're deleting 1 UnitStart, so we can pop the pesPositions and lower the seenUnitStart counter.
-    --(seenUnitStart[tid]);
-    std::deque<uint64_t> &inPositions = pesPositions[tid];
-    uint64_t bPos = inPositions.front();
-    inPositions.pop_front();
-
-    // Create a buffer for the current PES, and remove it from the pesStreams buffer.
-    uint32_t paySize = 0;
-
-    // Loop over the packets we need, and calculate the total payload size
-    curPack = psCache->begin();
-    int lastCtr = curPack->getContinuityCounter() - 1;
-    for (size_t i = 0; i < packNum; i++){
-      if (curPack->getContinuityCounter() == lastCtr){
-        curPack++;
-        continue;
-      }
-      lastCtr = curPack->getContinuityCounter();
-      paySize += curPack->getPayloadLength();
-      curPack++;
-    }
+    // The PES packet runs up to the next unit start, or to the end of the buffer when finishing
+    // Parsed packets stay in the buffer until compact() is called
+    size_t pesEnd = (st->pesStarts.size() > 1) ? st->pesStarts[1] : st->pesData.size();
+    const char *payload = (char *)st->pesData + st->pesStarts.front();
+    uint32_t paySize = pesEnd - st->pesStarts.front();
+    st->pesStarts.pop_front();
+    uint64_t bPos = st->pesPositions.front();
+    st->pesPositions.pop_front();
     VERYHIGH_MSG("Parsing PES for track %zu, length %" PRIu32, tid, paySize);
-    // allocate a buffer, do it all again, but this time also copy the data bytes over to char*
-    // payload
-    char *payload = (char *)malloc(paySize);
-    if (!payload){
-      FAIL_MSG("cannot allocate PES packet!");
-      return;
-    }
-
-    paySize = 0;
-    curPack = psCache->begin();
-    lastCtr = curPack->getContinuityCounter() - 1;
-    for (int i = 0; i < packNum; i++){
-      if (curPack->getContinuityCounter() == lastCtr){
-        curPack++;
-        continue;
-      }
-      if (curPack->getContinuityCounter() - lastCtr != 1 && curPack->getContinuityCounter()){
-        INFO_MSG("Parsing PES on track %zu, missed %d packets", tid,
-                 curPack->getContinuityCounter() - lastCtr - 1);
-      }
-      lastCtr = curPack->getContinuityCounter();
-      memcpy(payload + paySize, curPack->getPayload(), curPack->getPayloadLength());
-      paySize += curPack->getPayloadLength();
-      curPack++;
-    }
-    psCache->erase(psCache->begin(), curPack);
-    // we now have the whole PES packet in char* payload, with a total size of paySize (including
-    // headers)
+    // we now have the whole PES packet in payload, with a total size of paySize (including headers)
 
     // Parse the PES header
     uint32_t offset = 0;
@@ -489,7 +652,7 @@ namespace TS{
       // Check for large enough buffer
       if ((paySize - offset) < 9 || (paySize - offset) < 9 + pesHeader[8]){
         INFO_MSG("Not enough data (%d / %d) on track %zu (%" PRIu32 "), discarding remainder of data",
-                 paySize - offset, 9 + pesHeader[8], tid, pidToCodec[tid]);
+                 paySize - offset, 9 + pesHeader[8], tid, st->codec);
         break;
       }
 
@@ -534,11 +697,11 @@ namespace TS{
         }
       }
 
-      timeStamp += (rolloverCount[tid] * TS_PTS_ROLLOVER);
+      timeStamp += (st->rolloverCount * TS_PTS_ROLLOVER);
 
-      if ((timeStamp < lastms[tid]) && ((timeStamp % TS_PTS_ROLLOVER) < 0.1 * TS_PTS_ROLLOVER) &&
-          ((lastms[tid] % TS_PTS_ROLLOVER) > 0.9 * TS_PTS_ROLLOVER)){
-        ++rolloverCount[tid];
+      if ((timeStamp < st->lastms) && ((timeStamp % TS_PTS_ROLLOVER) < 0.1 * TS_PTS_ROLLOVER) &&
+          ((st->lastms % TS_PTS_ROLLOVER) > 0.9 * TS_PTS_ROLLOVER)){
+        ++st->rolloverCount;
         timeStamp += TS_PTS_ROLLOVER;
       }
 
@@ -565,63 +728,69 @@ namespace TS{
       }else{
         const char *pesPayload = pesHeader + pesOffset;
         parseBitstream(tid, pesPayload, realPayloadSize, timeStamp, timeOffset, bPos, pesHeader[6] & 0x04);
-        lastms[tid] = timeStamp;
+        st->lastms = timeStamp;
       }
 
       // Shift the offset by the payload size, the mandatory headers and the optional
       // headers/padding
       offset += realPayloadSize + (9 + pesHeader[8]);
     }
-    if (finished && (pidToCodec[tid] == H264 || pidToCodec[tid] == H265)){
-      if (buildPacket.count(tid) && buildPacket[tid].getDataStringLen()){
-        outPackets[tid].push_back(buildPacket[tid]);
-        buildPacket.erase(tid);
+    if (finished && (st->codec == H264 || st->codec == H265)){
+      if (st->building && st->buildPacket.getDataStringLen()){
+        st->outPackets.push_back(st->buildPacket);
+        st->buildPacket.null();
+        st->building = false;
       }
     }
-    free(payload);
   }
 
   void Stream::setLastms(size_t tid, uint64_t timestamp){
-    lastms[tid] = timestamp;
-    rolloverCount[tid] = timestamp / TS_PTS_ROLLOVER;
+    if (tid >= 8192){return;}
+    StreamLock guard(threaded);
+    PIDState &st = makeState(tid);
+    st.lastms = timestamp;
+    st.rolloverCount = timestamp / TS_PTS_ROLLOVER;
   }
 
   void Stream::parseBitstream(size_t tid, const char *pesPayload, uint64_t realPayloadSize,
                               uint64_t timeStamp, int64_t timeOffset, uint64_t bPos, bool alignment){
 
+    PIDState *st = getDataState(tid);
+    if (!st){return;}
     // Create a new (empty) DTSC Packet at the end of the buffer
-    unsigned long thisCodec = pidToCodec[tid];
-    std::deque<DTSC::Packet> &out = outPackets[tid];
+    unsigned long thisCodec = st->codec;
+    std::deque<DTSC::Packet> &out = st->outPackets;
     if (thisCodec == AAC){
       // Parse all the ADTS packets
       uint64_t offsetInPes = 0;
       uint64_t msRead = 0;
 
-      if (remainders.count(tid) && remainders[tid].getLength()){
-        offsetInPes = std::min(remainders[tid].getTodo(), realPayloadSize);
-        remainders[tid].append(pesPayload, offsetInPes);
+      ADTSRemainder &remainder = st->remainder;
+      if (remainder.getLength()){
+        offsetInPes = std::min(remainder.getTodo(), realPayloadSize);
+        remainder.append(pesPayload, offsetInPes);
 
-        if (remainders[tid].isComplete()){
-          aac::adts adtsPack(remainders[tid].getData(), remainders[tid].getLength());
+        if (remainder.isComplete()){
+          aac::adts adtsPack(remainder.getData(), remainder.getLength());
           if (adtsPack){
-            if (!adtsInfo.count(tid) || !adtsInfo[tid].sameHeader(adtsPack)){
+            if (!st->adtsInfo.sameHeader(adtsPack)){
               MEDIUM_MSG("Setting new ADTS header: %s", adtsPack.toPrettyString().c_str());
-              adtsInfo[tid] = adtsPack;
+              st->adtsInfo = adtsPack;
             }
             out.push_back(DTSC::Packet());
             out.back().genericFill(
                 timeStamp - ((adtsPack.getSampleCount() * 1000) / adtsPack.getFrequency()), timeOffset,
-                tid, adtsPack.getPayload(), adtsPack.getPayloadSize(), remainders[tid].getBpos(), 0);
+                tid, adtsPack.getPayload(), adtsPack.getPayloadSize(), remainder.getBpos(), 0);
           }
-          remainders[tid].clear();
+          remainder.clear();
         }
       }
       while (offsetInPes < realPayloadSize){
         aac::adts adtsPack(pesPayload + offsetInPes, realPayloadSize - offsetInPes);
         if (adtsPack && adtsPack.getCompleteSize() + offsetInPes <= realPayloadSize){
-          if (!adtsInfo.count(tid) || !adtsInfo[tid].sameHeader(adtsPack)){
+          if (!st->adtsInfo.sameHeader(adtsPack)){
             DONTEVEN_MSG("Setting new ADTS header: %s", adtsPack.toPrettyString().c_str());
-            adtsInfo[tid] = adtsPack;
+            st->adtsInfo = adtsPack;
           }
           out.push_back(DTSC::Packet());
           if (adtsPack.getPayloadSize()){
@@ -638,7 +807,7 @@ namespace TS{
             offsetInPes++;
           }else{
             // remainder, keep it, use it next time
-            remainders[tid].setRemainder(adtsPack, pesPayload + offsetInPes, realPayloadSize - offsetInPes, bPos);
+            remainder.setRemainder(adtsPack, pesPayload + offsetInPes, realPayloadSize - offsetInPes, bPos);
             offsetInPes = realPayloadSize; // skip to end of PES
           }
         }
@@ -647,8 +816,8 @@ namespace TS{
     if (thisCodec == ID3 || thisCodec == AC3 || thisCodec == MP2 || thisCodec == META){
       out.push_back(DTSC::Packet());
       out.back().genericFill(timeStamp, timeOffset, tid, pesPayload, realPayloadSize, bPos, 0);
-      if (thisCodec == MP2 && !mp2Hdr.count(tid)){
-        mp2Hdr[tid] = std::string(pesPayload, realPayloadSize);
+      if (thisCodec == MP2 && !st->mp2Hdr.size()){
+        st->mp2Hdr.assign(pesPayload, realPayloadSize);
       }
     }
     if (thisCodec == JSON){
@@ -698,13 +867,14 @@ namespace TS{
       if (!nextPtr){
         nextPtr = pesEnd;
         nalSize = realPayloadSize;
-        if (!alignment && timeStamp && buildPacket.count(tid) && timeStamp != buildPacket[tid].getTime()){
+        if (!alignment && timeStamp && st->building && timeStamp != st->buildPacket.getTime()){
           FAIL_MSG("No startcode in packet @ %" PRIu64 " ms, and time is not equal to %" PRIu64
                    " ms so can't merge",
-                   timeStamp, buildPacket[tid].getTime());
+                   timeStamp, st->buildPacket.getTime());
           return;
         }
-        DTSC::Packet &bp = buildPacket[tid];
+        DTSC::Packet &bp = st->buildPacket;
+        st->building = true;
         if (alignment){
           // If the timestamp differs from current PES timestamp, send the previous packet out and
           // fill a new one.
@@ -744,11 +914,12 @@ namespace TS{
 
         if (nalSize){
           // If we don't have a packet yet, init an empty packet with the key frame bit set to true
-          if (!buildPacket.count(tid)){
-            buildPacket[tid].genericFill(timeStamp, timeOffset, tid, 0, 0, bPos, true);
-            buildPacket[tid].setKeyFrame(false);
+          DTSC::Packet &bp = st->buildPacket;
+          if (!st->building){
+            bp.genericFill(timeStamp, timeOffset, tid, 0, 0, bPos, true);
+            bp.setKeyFrame(false);
+            st->building = true;
           }
-          DTSC::Packet &bp = buildPacket[tid];
 
           // Check if this is a keyframe
           parseNal(tid, pesPayload, pesPayload + nalSize, isKeyFrame);
@@ -812,47 +983,39 @@ namespace TS{
   }
 
   void Stream::getPacket(size_t tid, DTSC::Packet &pack, size_t mappedAs){
-    tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
+    StreamLock guard(threaded);
     pack.null();
     if (!hasPacket(tid)){
       ERROR_MSG("Trying to obtain a packet on track %zu, but no full packet is available", tid);
       return;
     }
 
-    bool packetReady = outPackets.count(tid) && outPackets[tid].size();
-
-    if (!packetReady){
-      parse(tid);
-      packetReady = outPackets.count(tid) && outPackets[tid].size();
-    }
+    std::deque<DTSC::Packet> &out = pids[tid]->outPackets;
+    if (!out.size()){parse(tid);}
 
-    if (!packetReady){
+    if (!out.size()){
       ERROR_MSG("Track %zu: PES without valid packets?", tid);
       return;
     }
 
-    pack = DTSC::Packet(outPackets[tid].front(), mappedAs);
-    outPackets[tid].pop_front();
-
-    if (!outPackets[tid].size()){outPackets.erase(tid);}
+    pack = DTSC::Packet(out.front(), mappedAs);
+    out.pop_front();
   }
 
   void Stream::parseNal(size_t tid, const char *pesPayload, const char *nextPtr, bool &isKeyFrame){
+    PIDState *st = getDataState(tid);
+    if (!st){return;}
     bool firstSlice = true;
     char typeNal;
 
-    if (pidToCodec[tid] == MPEG2){
+    if (st->codec == MPEG2){
       typeNal = pesPayload[0];
       switch (typeNal){
       case 0xB3:
-        if (!mpeg2SeqHdr.count(tid)){
-          mpeg2SeqHdr[tid] = std::string(pesPayload, (nextPtr - pesPayload));
-        }
+        if (!st->mpeg2SeqHdr.size()){st->mpeg2SeqHdr.assign(pesPayload, nextPtr - pesPayload);}
         break;
       case 0xB5:
-        if (!mpeg2SeqExt.count(tid)){
-          mpeg2SeqExt[tid] = std::string(pesPayload, (nextPtr - pesPayload));
-        }
+        if (!st->mpeg2SeqExt.size()){st->mpeg2SeqExt.assign(pesPayload, nextPtr - pesPayload);}
         break;
       case 0xB8: isKeyFrame = true; break;
       }
@@ -860,7 +1023,7 @@ namespace TS{
     }
 
     isKeyFrame = false;
-    if (pidToCodec[tid] == H264){
+    if (st->codec == H264){
       typeNal = pesPayload[0] & 0x1F;
       switch (typeNal){
       case 0x01:{
@@ -868,14 +1031,8 @@ namespace TS{
           firstSlice = false;
           if (!isKeyFrame){
             Utils::bitstream bs;
-            for (size_t i = 1; i < 10 && i < (nextPtr - pesPayload); i++){
-              if (i + 2 < (nextPtr - pesPayload) && (memcmp(pesPayload + i, "\000\000\003", 3) == 0)){// Emulation prevention bytes
-                bs.append(pesPayload + i, 2);
-                i += 2;
-              }else{
-                bs.append(pesPayload + i, 1);
-              }
-            }
+            size_t nalLen = nextPtr - pesPayload;
+            if (nalLen > 1){bs.appendRBSP(pesPayload + 1, (nalLen < 10 ? nalLen : 10) - 1);}
             bs.getExpGolomb(); // Discard first_mb_in_slice
             uint64_t sliceType = bs.getUExpGolomb();
             if (sliceType == 2 || sliceType == 4 || sliceType == 7 || sliceType == 9){
@@ -890,16 +1047,16 @@ namespace TS{
         break;
       }
       case 0x07:{
-        spsInfo[tid] = std::string(pesPayload, (nextPtr - pesPayload));
+        st->spsInfo.assign(pesPayload, nextPtr - pesPayload);
         break;
       }
       case 0x08:{
-        ppsInfo[tid] = std::string(pesPayload, (nextPtr - pesPayload));
+        st->ppsInfo.assign(pesPayload, nextPtr - pesPayload);
         break;
       }
       default: break;
       }
-    }else if (pidToCodec[tid] == H265){
+    }else if (st->codec == H265){
       typeNal = (pesPayload[0] & 0x7E) >> 1;
       switch (typeNal){
       case 2:
@@ -925,8 +1082,8 @@ namespace TS{
       case 32:
       case 33:
       case 34:{
-        tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-        hevcInfo[tid].addUnit(std::string(pesPayload, nextPtr - pesPayload)); // may i convert to (char *)?
+        StreamLock guard(threaded);
+        st->hevcInfo.addUnit(std::string(pesPayload, nextPtr - pesPayload)); // may i convert to (char *)?
         break;
       }
       default: break;
@@ -935,16 +1092,16 @@ namespace TS{
   }
 
   uint32_t Stream::getEarliestPID(){
-    tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
+    StreamLock guard(threaded);
 
     uint64_t packTime = 0xFFFFFFFFull;
     uint32_t packTrack = 0;
 
-    for (std::map<size_t, std::deque<DTSC::Packet> >::iterator it = outPackets.begin();
-         it != outPackets.end(); it++){
-      if (it->second.front().getTime() < packTime){
-        packTrack = it->first;
-        packTime = it->second.front().getTime();
+    for (std::vector<size_t>::iterator it = usedPids.begin(); it != usedPids.end(); it++){
+      std::deque<DTSC::Packet> &out = pids[*it]->outPackets;
+      if (out.size() && out.front().getTime() < packTime){
+        packTrack = *it;
+        packTime = out.front().getTime();
       }
     }
 
@@ -952,17 +1109,17 @@ namespace TS{
   }
 
   void Stream::getEarliestPacket(DTSC::Packet &pack){
-    tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
+    StreamLock guard(threaded);
     pack.null();
 
     uint64_t packTime = 0xFFFFFFFFull;
     uint64_t packTrack = 0;
 
-    for (std::map<size_t, std::deque<DTSC::Packet> >::iterator it = outPackets.begin();
-         it != outPackets.end(); it++){
-      if (it->second.size() && it->second.front().getTime() < packTime){
-        packTrack = it->first;
-        packTime = it->second.front().getTime();
+    for (std::vector<size_t>::iterator it = usedPids.begin(); it != usedPids.end(); it++){
+      std::deque<DTSC::Packet> &out = pids[*it]->outPackets;
+      if (out.size() && out.front().getTime() < packTime){
+        packTrack = *it;
+        packTime = out.front().getTime();
       }
     }
 
@@ -972,11 +1129,12 @@ namespace TS{
     }
 
     //Nothing yet...? Let's see if we can parse something.
-    for (std::map<size_t, uint32_t>::const_iterator i = seenUnitStart.begin(); i != seenUnitStart.end(); i++){
-      if (pidToCodec.count(i->first) && i->second > 1){
-        parse(i->first);
-        if (hasPacket(i->first)){
-          getPacket(packTrack, pack);
+    for (size_t i = 0; i < usedPids.size(); i++){
+      size_t pid = usedPids[i];
+      if (pids[pid]->codec && pids[pid]->pesStarts.size() > 1){
+        parse(pid);
+        if (hasPacket(pid)){
+          getPacket(pid, pack);
           return;
         }
       }
@@ -984,12 +1142,14 @@ namespace TS{
   }
 
   void Stream::initializeMetadata(DTSC::Meta &meta, size_t tid, size_t mappingId){
-    tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
+    StreamLock guard(threaded);
 
-    for (std::map<size_t, uint32_t>::const_iterator it = pidToCodec.begin(); it != pidToCodec.end(); it++){
-      if (tid != INVALID_TRACK_ID && it->first != tid){continue;}
+    for (std::vector<size_t>::iterator it = usedPids.begin(); it != usedPids.end(); it++){
+      PIDState &st = *pids[*it];
+      if (!st.codec){continue;}
+      if (tid != INVALID_TRACK_ID && *it != tid){continue;}
 
-      size_t mId = (mappingId == INVALID_TRACK_ID ? it->first : mappingId);
+      size_t mId = (mappingId == INVALID_TRACK_ID ? *it : mappingId);
 
       size_t idx = meta.trackIDToIndex(mId, getpid());
       if (idx != INVALID_TRACK_ID && meta.getCodec(idx).size()){continue;}
@@ -999,26 +1159,25 @@ namespace TS{
       std::string type, codec, init;
       uint64_t width = 0, height = 0, fpks = 0, size = 0, rate = 0, channels = 0;
 
-      switch (it->second){
+      switch (st.codec){
       case H264:{
-        if (!spsInfo.count(it->first) || !ppsInfo.count(it->first)){
-          MEDIUM_MSG("Aborted meta fill for h264 track %zu: no SPS/PPS", it->first);
+        if (!st.spsInfo.size() || !st.ppsInfo.size()){
+          MEDIUM_MSG("Aborted meta fill for h264 track %zu: no SPS/PPS", *it);
           continue;
         }
         // First generate needed data
-        std::string tmpBuffer = spsInfo[it->first];
-        h264::sequenceParameterSet sps(tmpBuffer.data(), tmpBuffer.size());
+        h264::sequenceParameterSet sps(st.spsInfo.data(), st.spsInfo.size());
         h264::SPSMeta spsChar = sps.getCharacteristics();
 
         MP4::AVCC avccBox;
         avccBox.setVersion(1);
-        avccBox.setProfile(spsInfo[it->first][1]);
-        avccBox.setCompatibleProfiles(spsInfo[it->first][2]);
-        avccBox.setLevel(spsInfo[it->first][3]);
+        avccBox.setProfile(st.spsInfo[1]);
+        avccBox.setCompatibleProfiles(st.spsInfo[2]);
+        avccBox.setLevel(st.spsInfo[3]);
         avccBox.setSPSCount(1);
-        avccBox.setSPS(spsInfo[it->first]);
+        avccBox.setSPS(st.spsInfo);
         avccBox.setPPSCount(1);
-        avccBox.setPPS(ppsInfo[it->first]);
+        avccBox.setPPS(st.ppsInfo);
 
         // Then set all data for track
         addNewTrack = true;
@@ -1030,15 +1189,15 @@ namespace TS{
         init.assign(avccBox.payload(), avccBox.payloadSize());
       }break;
       case H265:{
-        if (!hevcInfo.count(it->first) || !hevcInfo[it->first].haveRequired()){
-          MEDIUM_MSG("Aborted meta fill for hevc track %zu: no info nal unit", it->first);
+        if (!st.hevcInfo.haveRequired()){
+          MEDIUM_MSG("Aborted meta fill for hevc track %zu: no info nal unit", *it);
           continue;
         }
         addNewTrack = true;
         type = "video";
         codec = "HEVC";
-        init = hevcInfo[it->first].generateHVCC();
-        h265::metaInfo metaInfo = hevcInfo[it->first].getMeta();
+        init = st.hevcInfo.generateHVCC();
+        h265::metaInfo metaInfo = st.hevcInfo.getMeta();
         width = metaInfo.width;
         height = metaInfo.height;
         fpks = metaInfo.fps * 1000;
@@ -1047,8 +1206,8 @@ namespace TS{
         addNewTrack = true;
         type = "video";
         codec = "MPEG2";
-        init = std::string("\000\000\001", 3) + mpeg2SeqHdr[it->first] +
-               std::string("\000\000\001", 3) + mpeg2SeqExt[it->first];
+        init = std::string("\000\000\001", 3) + st.mpeg2SeqHdr +
+               std::string("\000\000\001", 3) + st.mpeg2SeqExt;
         Mpeg::MPEG2Info info = Mpeg::parseMPEG2Header(init);
         width = info.width;
         height = info.height;
@@ -1058,13 +1217,13 @@ namespace TS{
         addNewTrack = true;
         type = "meta";
         codec = "ID3";
-        init = metaInit[it->first];
+        init = st.metaInit;
       }break;
       case META:{
         addNewTrack = true;
         type = "meta";
         codec = "RAW";
-        init = metaInit[it->first];
+        init = st.metaInit;
       }break;
       case AC3:{
         addNewTrack = true;
@@ -1084,7 +1243,7 @@ namespace TS{
         size = 16;
         init = std::string("OpusHead\001\002\170\000\200\273\000\000\000\000\001", 19);
         channels = 2;
-        std::string extData = TS::ProgramDescriptors(metaInit[it->first].data(), metaInit[it->first].size()).getExtension();
+        std::string extData = TS::ProgramDescriptors(st.metaInit.data(), st.metaInit.size()).getExtension();
         if (extData.size() > 1){
           channels = extData[1];
           uint8_t channel_map = extData[2];
@@ -1125,7 +1284,7 @@ namespace TS{
       }break;
       case MP2:{
         addNewTrack = true;
-        Mpeg::MP2Info info = Mpeg::parseMP2Header(mp2Hdr[it->first]);
+        Mpeg::MP2Info info = Mpeg::parseMP2Header(st.mp2Hdr);
         type = "audio";
         codec = (info.layer == 3 ? "MP3" : "MP2");
         rate = info.sampleRate;
@@ -1134,17 +1293,17 @@ namespace TS{
       case AAC:{
         addNewTrack = true;
         init.resize(2);
-        init[0] = ((adtsInfo[it->first].getAACProfile() & 0x1F) << 3) |
-                  ((adtsInfo[it->first].getFrequencyIndex() & 0x0E) >> 1);
-        init[1] = ((adtsInfo[it->first].getFrequencyIndex() & 0x01) << 7) |
-                  ((adtsInfo[it->first].getChannelConfig() & 0x0F) << 3);
+        init[0] = ((st.adtsInfo.getAACProfile() & 0x1F) << 3) |
+                  ((st.adtsInfo.getFrequencyIndex() & 0x0E) >> 1);
+        init[1] = ((st.adtsInfo.getFrequencyIndex() & 0x01) << 7) |
+                  ((st.adtsInfo.getChannelConfig() & 0x0F) << 3);
         // Wait with adding the track until we have init data
         if (init[0] == 0 && init[1] == 0){addNewTrack = false;}
         type = "audio";
         codec = "AAC";
         size = 16;
-        rate = adtsInfo[it->first].getFrequency();
-        channels = adtsInfo[it->first].getChannelCount();
+        rate = st.adtsInfo.getFrequency();
+        channels = st.adtsInfo.getChannelCount();
       }break;
       }
 
@@ -1166,8 +1325,9 @@ namespace TS{
 
       size_t pmtCount = associationTable.getProgramCount();
       for (size_t i = 0; i < pmtCount; i++){
-        uint32_t pid = associationTable.getProgramPID(i);
-        ProgramMappingEntry entry = mappingTable[pid].getEntry(0);
+        const PIDState *pmt = getState(associationTable.getProgramPID(i));
+        if (!pmt){continue;}
+        ProgramMappingEntry entry = pmt->mappingTable.getEntry(0);
         while (entry){
           if (entry.getElementaryPid() == tid){
             meta.setLang(idx, ProgramDescriptors(entry.getESInfo(), entry.getESInfoLength()).getLanguage());
@@ -1180,14 +1340,14 @@ namespace TS{
     }
     if (tid != INVALID_TRACK_ID){
       WARN_MSG("Could not init track %zu!", tid);
-      for (std::map<size_t, uint32_t>::const_iterator it = pidToCodec.begin(); it != pidToCodec.end(); it++){
-        INFO_MSG("Track %zu (%" PRIu32 ") no match", it->first, it->second);
+      for (std::vector<size_t>::iterator it = usedPids.begin(); it != usedPids.end(); it++){
+        if (pids[*it]->codec){INFO_MSG("Track %zu (%" PRIu32 ") no match", *it, pids[*it]->codec);}
       }
     }
   }
 
   std::set<size_t> Stream::getActiveTracks(){
-    tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
+    StreamLock guard(threaded);
     std::set<size_t> result;
     // Track 0 is always active
     result.insert(0);
@@ -1200,8 +1360,9 @@ namespace TS{
         // Add PMT track
         result.insert(pid);
         // IF PMT updated in last 5 seconds, check for contents
-        if (Util::bootSecs() - lastPMT[pid] < 5){
-          ProgramMappingEntry entry = mappingTable[pid].getEntry(0);
+        const PIDState *pmt = getState(pid);
+        if (pmt && Util::bootSecs() - pmt->lastPMT < 5){
+          ProgramMappingEntry entry = pmt->mappingTable.getEntry(0);
           // Add all tracks in PMT
           while (entry){
             switch (entry.getStreamType()){
@@ -1225,11 +1386,12 @@ namespace TS{
   }
 
   void Stream::eraseTrack(size_t tid){
-    tthread::lock_guard<tthread::recursive_mutex> guard(tMutex);
-    pesStreams.erase(tid);
-    psCacheTid = 0;
-    psCache = 0;
-    pesPositions.erase(tid);
-    outPackets.erase(tid);
+    StreamLock guard(threaded);
+    PIDState *st = getState(tid);
+    if (!st){return;}
+    st->pesData.truncate(0);
+    st->pesStarts.clear();
+    st->pesPositions.clear();
+    st->outPackets.clear();
   }
 }// namespace TS
@@ -4,6 +4,7 @@
 #include <deque>
 #include <map>
 #include <set>
+#include <vector>
 
 #include "shared_memory.h"
 #define TS_PTS_ROLLOVER 95443718
@@ -52,10 +53,50 @@ namespace TS{
 
   class Assembler;
 
+  /// All demuxing state for a single PID.
+  /// Payloads of consecutive TS packets are appended to one contiguous buffer as they arrive, so a
+  /// complete PES packet can be parsed in place.
+  class PIDState{
+  public:
+    PIDState();
+    uint32_t codec; ///< Stream type of this elementary stream, or 0 if this is not a data track
+    int lastCC;     ///< Continuity counter of the last packet appended to pesData
+    Util::ResizeablePointer pesData;   ///< Payloads of the buffered PES packets, back to back
+    std::deque<size_t> pesStarts;      ///< Offset within pesData of each buffered PES packet
+    std::deque<uint64_t> pesPositions; ///< Byte position of each buffered PES packet
+    Packet psiPacket;                  ///< Last PAT/PMT packet received on this PID
+    bool hasPSI;                       ///< True if psiPacket has not been parsed yet
+    std::deque<DTSC::Packet> outPackets;
+    DTSC::Packet buildPacket;
+    bool building; ///< True if buildPacket holds a frame in progress
+    bool skipping; ///< True after a transport error, until the next unit start
+    ADTSRemainder remainder;
+    aac::adts adtsInfo;
+    std::string spsInfo;
+    std::string ppsInfo;
+    h265::initData hevcInfo;
+    std::string metaInit;
+    std::string mpeg2SeqHdr;
+    std::string mpeg2SeqExt;
+    std::string mp2Hdr;
+    size_t rolloverCount;
+    uint64_t lastms;
+    uint64_t lastPMT;
+    ProgramMappingTable mappingTable;
+    void partialClear();
+    void compact();
+
+  private:
+    PIDState(const PIDState &);
+    PIDState &operator=(const PIDState &);
+  };
+
   class Stream{
   friend class Assembler;
   public:
     Stream();
+    Stream(const Stream &rhs);
+    Stream &operator=(const Stream &rhs);
     ~Stream();
     void add(char *newPack, uint64_t bytePos = 0);
     void add(Packet &newPack, uint64_t bytePos = 0);
@@ -75,44 +116,27 @@ namespace TS{
     void finish();
     void eraseTrack(size_t tid);
     bool isDataTrack(size_t tid) const;
+    bool isPSITrack(size_t tid) const;
     void parseBitstream(size_t tid, const char *pesPayload, uint64_t realPayloadSize,
                         uint64_t timeStamp, int64_t timeOffset, uint64_t bPos, bool alignment);
     std::set<size_t> getActiveTracks();
 
     void setLastms(size_t tid, uint64_t timestamp);
     void setRawDataParser(rawDataType parser);
+    void setThreaded(bool threaded = true);
 
   private:
     uint64_t lastPAT;
     rawDataType rParser;
+    bool threaded; ///< If false, this stream is only used from one thread and never locks
     ProgramAssociationTable associationTable;
-    std::map<size_t, ADTSRemainder> remainders;
-
     std::set<unsigned int> pmtTracks;
 
-    std::map<size_t, uint64_t> lastPMT;
-    std::map<size_t, ProgramMappingTable> mappingTable;
-
-    std::map<size_t, std::deque<Packet> > pesStreams;
-    std::deque<Packet> *psCache; /// Used only for internal speed optimizes.
-    uint32_t psCacheTid;         /// Used only for internal speed optimizes.
-    std::map<size_t, std::deque<uint64_t> > pesPositions;
-    std::map<size_t, std::deque<DTSC::Packet> > outPackets;
-    std::map<size_t, DTSC::Packet> buildPacket;
-    std::map<size_t, uint32_t> pidToCodec;
-    std::map<size_t, aac::adts> adtsInfo;
-    std::map<size_t, std::string> spsInfo;
-    std::map<size_t, std::string> ppsInfo;
-    std::map<size_t, h265::initData> hevcInfo;
-    std::map<size_t, std::string> metaInit;
-    std::map<size_t, std::string> descriptors;
-    std::map<size_t, uint32_t> seenUnitStart;
-    std::map<size_t, std::string> mpeg2SeqHdr;
-    std::map<size_t, std::string> mpeg2SeqExt;
-    std::map<size_t, std::string> mp2Hdr;
-
-    std::map<size_t, size_t> rolloverCount;
-    std::map<size_t, unsigned long long> lastms;
+    PIDState *pids[8192];        ///< Per-PID state, indexed by PID, allocated on first use
+    std::vector<size_t> usedPids; ///< Sorted list of PIDs that have state allocated
+    PIDState *getState(size_t tid) const;
+    PIDState &makeState(size_t tid);
+    PIDState *getDataState(size_t tid) const;
 
     void parsePES(size_t tid, bool finished = false);
   };
@@ -121,12 +145,64 @@ namespace TS{
   public:
     Assembler();
     bool assemble(Stream & TSStrm, const char * ptr, size_t len, bool parse = false, uint64_t bytePos = 0);
+    bool assemble(Util::DataCallback &cb, const char *ptr, size_t len);
     void clear();
     void setLive(bool live = true);
   private:
+    bool assemble(Stream *TSStrm, Util::DataCallback *cb, const char *ptr, size_t len, bool parse, uint64_t bytePos);
+    bool handle(Stream *TSStrm, Util::DataCallback *cb, const char *pkt, bool parse, uint64_t bytePos);
     bool isLive;
     Util::ResizeablePointer leftData;
     TS::Packet tsBuf;
   };
 
+  /// Bounded lock-free queue of raw 188-byte TS packets, handing packets from exactly one producer
+  /// thread to exactly one consumer thread.
+  /// The producer never waits for the consumer. When the ring is full the packet is dropped, and so
+  /// is every following packet up to the next one that starts a new unit, so a consumer that falls
+  /// behind loses whole units instead of receiving a trickle of fragments. Since the start of the
+  /// interrupted unit may already be in the ring, a payload-less packet with the transport error
+  /// flag set is written in front of the next unit start; Stream::add discards the unit on it.
+  class PacketRing{
+  public:
+    PacketRing(size_t packets = 16384);
+    ~PacketRing();
+    // Producer side
+    bool write(const char *packet);
+    void publish();
+    size_t getWritten() const;
+    size_t getDropped() const;
+    // Consumer side
+    size_t peek(const char *&packets);
+    void consume(size_t count);
+    void close();
+    size_t getPeak() const;
+    // Either side
+    bool isClosed() const;
+    size_t size() const;
+    size_t capacity() const;
+
+  private:
+    PacketRing(const PacketRing &);
+    PacketRing &operator=(const PacketRing &);
+    char *data;
+    size_t mask;
+    // Owned by the producer
+    size_t writePos;   ///< Slot for the next packet, handed to the consumer by publish()
+    size_t cachedTail; ///< Last value of tail seen by the producer
+    size_t written;    ///< Packets accepted so far
+    size_t dropped;    ///< Packets dropped so far
+    uint32_t dropPids[256]; ///< Bitmap of PIDs that drop packets up to their next unit start
+    size_t dropCount;       ///< Number of PIDs set in dropPids
+    char padProducer[64];
+    size_t head; ///< Published write position, only written by the producer
+    char padHead[64];
+    size_t tail; ///< Read position, only written by the consumer
+    char padTail[64];
+    // Owned by the consumer
+    size_t cachedHead; ///< Last value of head seen by the consumer
+    size_t peak;       ///< Highest number of packets ever seen waiting by the consumer
+    bool closed;       ///< Set by the consumer once it will never touch the ring again
+  };
+
 }// namespace TS
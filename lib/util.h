@@ -168,6 +168,13 @@ namespace Util{
     uint64_t getInt(const std::string &name, uint64_t recordNo = 0) const;
     uint64_t getInt(const RelAccXFieldData &fd, uint64_t recordNo = 0) const;
 
+    /// Inlined integer read for hot paths: reads the field directly as a T if the field is an
+    /// integer of exactly sizeof(T) bytes, otherwise falls back to the generic getInt.
+    template <typename T> T get(const RelAccXFieldData &fd, uint64_t recordNo = 0) const{
+      if (fd.size != sizeof(T) || !isIntType(fd.type)){return (T)getInt(fd, recordNo);}
+      return *(const T *)recordPointer(fd, recordNo);
+    }
+
     std::string toPrettyString(size_t indent = 0) const;
     std::string toCompactString(size_t indent = 0) const;
     // Read-write functions:
@@ -185,6 +192,14 @@ namespace Util{
     void setInt(const std::string &name, uint64_t val, uint64_t recordNo = 0);
     void setInt(const RelAccXFieldData &fd, uint64_t val, uint64_t recordNo = 0);
     void setInts(const std::string &name, uint64_t *values, size_t len);
+    /// Inlined integer write for hot paths, counterpart of get<T>.
+    template <typename T> void set(const RelAccXFieldData &fd, T val, uint64_t recordNo = 0){
+      if (fd.size != sizeof(T) || !isIntType(fd.type)){
+        setInt(fd, (uint64_t)val, recordNo);
+        return;
+      }
+      *(T *)recordPointer(fd, recordNo) = val;
+    }
     void deleteRecords(uint32_t amount);
     void addRecords(uint32_t amount);
 
@@ -200,6 +215,10 @@ namespace Util{
     std::map<std::string, RelAccXFieldData> fields;
 
   private:
+    static bool isIntType(uint8_t fType){return (fType & 0xF0) == RAX_UINT || (fType & 0xF0) == RAX_INT;}
+    char *recordPointer(const RelAccXFieldData &fd, uint64_t recordNo) const{
+      return p + *hdrOffset + (((*hdrRecordCnt) ? (recordNo % *hdrRecordCnt) : recordNo) * *hdrRecordSize) + fd.offset;
+    }
     uint32_t * hdrRecordCnt;
     uint32_t * hdrRecordSize;
     uint32_t * hdrStartPos;
@@ -218,6 +237,10 @@ namespace Util{
     const char * ptr(size_t recordNo) const;
     void set(uint64_t val, size_t recordNo = 0);
     void set(const std::string &val, size_t recordNo = 0);
+    /// Typed, inlined versions of uint/set; see RelAccX::get<T> and RelAccX::set<T>.
+    /// T is never deduced, so plain set() calls keep using the generic versions above.
+    template <typename T> T get(size_t recordNo) const{return src->get<T>(field, recordNo);}
+    template <typename T> void set(uint64_t val, size_t recordNo){src->set<T>(field, (T)val, recordNo);}
     operator bool() const {return src;}
 
   private:
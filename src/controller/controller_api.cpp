@@ -633,6 +633,8 @@ void Controller::handleAPICommands(JSON::Value &Request, JSON::Value &Response){
     if (in.isMember("sessionStreamInfoMode")){out["sessionStreamInfoMode"] = in["sessionStreamInfoMode"];}
     if (in.isMember("tknMode")){out["tknMode"] = in["tknMode"];}
     if (in.isMember("defaultStream")){out["defaultStream"] = in["defaultStream"];}
+    if (in.isMember("pagecachebudget")){out["pagecachebudget"] = in["pagecachebudget"].asInt();}
+    if (in.isMember("segmentcachebudget")){out["segmentcachebudget"] = in["segmentcachebudget"].asInt();}
     if (in.isMember("location") && in["location"].isObject()){
       out["location"]["lat"] = in["location"]["lat"].asDouble();
       out["location"]["lon"] = in["location"]["lon"].asDouble();
@@ -1065,6 +1067,9 @@ void Controller::handleAPICommands(JSON::Value &Request, JSON::Value &Response){
   if (Request.isMember("stats_streams")){
     Controller::fillHasStats(Request["stats_streams"], Response["stats_streams"]);
   }
+  if (Request.isMember("pagecache")){
+    Controller::fillPageCache(Request["pagecache"], Response["pagecache"]);
+  }
 
   if (Request.isMember("api_endpoint")){
     HTTP::URL url("http://localhost:4242");
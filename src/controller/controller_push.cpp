@@ -5,6 +5,7 @@
 #include <mist/config.h>
 #include <mist/json.h>
 #include <mist/procs.h>
+#include <mist/shared_memory.h>
 #include <mist/stream.h>
 #include <mist/tinythread.h>
 #include <mist/triggers.h>
@@ -18,9 +19,20 @@ namespace Controller{
   /// Internal list of waiting pushes
   std::map<std::string, std::map<std::string, unsigned int> > waitingPushes;
 
+  /// Individual targets of active pushes that fan out to several targets, by PID
+  static std::map<pid_t, std::deque<std::string> > fanOutTargets;
+  /// Targets of fan-out pushes that were stopped while the others keep going, by PID
+  static std::map<pid_t, std::set<size_t> > stoppedTargets;
+
   static bool mustWritePushList = false;
   static bool pushListRead = false;
 
+  /// Remembers the individual targets of a push, if it fans out to several of them.
+  static void setFanOutTargets(pid_t id, const std::string &target){
+    std::deque<std::string> targets = Util::getPushTargets(target);
+    if (targets.size() > 1){fanOutTargets[id] = targets;}
+  }
+
   /// Immediately starts a push for the given stream to the given target.
   /// Simply calls Util::startPush and stores the resulting PID in the local activePushes map.
   void startPush(const std::string &stream, std::string &target){
@@ -35,6 +47,7 @@ namespace Controller{
       push.append(originalTarget);
       push.append(target);
       activePushes[ret] = push;
+      setFanOutTargets(ret, target);
       mustWritePushList = true;
     }
   }
@@ -68,6 +81,8 @@ namespace Controller{
 
     //actually remove, make sure next pass the new list is written out too
     activePushes.erase(id);
+    fanOutTargets.erase(id);
+    stoppedTargets.erase(id);
     mustWritePushList = true;
   }
 
@@ -120,8 +135,29 @@ namespace Controller{
   }
 
   /// Immediately stops a push with the given ID
-  void stopPush(unsigned int ID){
-    if (ID > 1 && activePushes.count(ID)){Util::Procs::Stop(ID);}
+  /// Each target of a fan-out push has its own ID: the PID of the push, with the index of the target
+  /// added in the upper 32 bits. Stopping one tells the push to stop sending to only that target;
+  /// the push process itself stops once all of its targets are stopped.
+  void stopPush(uint64_t ID){
+    pid_t pid = ID & 0xFFFFFFFFull;
+    size_t idx = ID >> 32;
+    if (pid <= 1 || !activePushes.count(pid)){return;}
+    if (fanOutTargets.count(pid) && idx < fanOutTargets[pid].size() && idx < SHM_PUSH_TARGETS_LEN){
+      std::set<size_t> &stopped = stoppedTargets[pid];
+      stopped.insert(idx);
+      if (stopped.size() < fanOutTargets[pid].size()){
+        char pageName[NAME_BUFFER_SIZE];
+        snprintf(pageName, NAME_BUFFER_SIZE, SHM_PUSH_TARGETS, (uint32_t)pid);
+        IPC::sharedPage ctlPage(pageName, SHM_PUSH_TARGETS_LEN, false, false);
+        if (ctlPage){
+          ctlPage.mapped[idx] = 1;
+          INFO_MSG("Stopping target %zu of push %d: %s", idx, (int)pid, fanOutTargets[pid][idx].c_str());
+          return;
+        }
+        WARN_MSG("Could not reach push %d to stop one of its targets; stopping the whole push", (int)pid);
+      }
+    }
+    Util::Procs::Stop(pid);
   }
 
   /// Compactly writes the list of pushes to a pointer, assumed to be 8MiB in size
@@ -150,6 +186,8 @@ namespace Controller{
   /// Reads the list of pushes from a pointer, assumed to end in four zeroes
   static void readPushList(char *pwo){
     activePushes.clear();
+    fanOutTargets.clear();
+    stoppedTargets.clear();
     pid_t p = Bit::btohl(pwo);
     HIGH_MSG("Recovering pushes: %" PRIu32, (uint32_t)p);
     while (p > 1){
@@ -165,6 +203,7 @@ namespace Controller{
       Util::Procs::remember(p);
       mustWritePushList = true;
       activePushes[p] = push;
+      setFanOutTargets(p, push[3u].asStringRef());
       p = Bit::btohl(pwo);
     }
   }
@@ -379,13 +418,53 @@ namespace Controller{
     }
   }
 
+  /// Lists a fan-out push as one entry per target that is not stopped, each with the status of that
+  /// target. The first target is listed under the PID of the push, the others have their index added
+  /// in the upper 32 bits of their ID.
+  static void listFanOut(JSON::Value &output, const JSON::Value &push, const std::deque<std::string> &targets,
+                         const std::set<size_t> &stopped){
+    // The original target only splits up the same way if variables did not add or remove any '|'
+    std::deque<std::string> origTargets;
+    const std::string &origTarget = push[2u].asStringRef();
+    size_t start = 0, end;
+    do{
+      end = origTarget.find('|', start);
+      origTargets.push_back(origTarget.substr(start, end == std::string::npos ? std::string::npos : end - start));
+      start = end + 1;
+    }while (end != std::string::npos);
+    JSON::Value status;
+    if (push.size() > 5){
+      status = push[5u];
+      status.removeMember("targets");
+    }
+    for (size_t i = 0; i < targets.size(); ++i){
+      if (stopped.count(i)){continue;}
+      JSON::Value row;
+      row.append((uint64_t)push[0u].asInt() + ((uint64_t)i << 32));
+      row.append(push[1u]);
+      row.append(origTargets.size() == targets.size() ? origTargets[i] : origTarget);
+      row.append(targets[i]);
+      if (push.size() > 4){
+        row.append(push[4u]);
+        row.append(status);
+        if (push[5u]["targets"].size() > i){row[5u].extend(push[5u]["targets"][(uint32_t)i]);}
+      }
+      output.append(row);
+    }
+  }
+
   /// Gives a list of all currently active pushes
+  /// A fan-out push is listed as one entry per target, see listFanOut.
   void listPush(JSON::Value &output){
     output.null();
     std::set<pid_t> toWipe;
     for (std::map<pid_t, JSON::Value>::iterator it = activePushes.begin(); it != activePushes.end(); ++it){
       if (Util::Procs::isActive(it->first)){
-        output.append(it->second);
+        if (fanOutTargets.count(it->first)){
+          listFanOut(output, it->second, fanOutTargets[it->first], stoppedTargets[it->first]);
+        }else{
+          output.append(it->second);
+        }
       }else{
         toWipe.insert(it->first);
       }
@@ -110,6 +110,9 @@ struct streamTotals{
 
 Comms::Sessions statComm;
 bool statCommActive = false;
+// Host-wide accounting of buffered VoD pages, owned by the stats thread
+static Comms::PageCache pageCache;
+static Comms::ListenerStats listenerStats;
 // Global server wide statistics
 static uint64_t servUpBytes = 0;
 static uint64_t servDownBytes = 0;
@@ -376,6 +379,8 @@ void Controller::SharedMemStats(void *config){
   HIGH_MSG("Starting stats thread");
   statComm.reload(true);
   statCommActive = true;
+  pageCache.reload(true);
+  listenerStats.reload(true);
   std::set<std::string> inactiveStreams;
   Controller::initState();
   bool shiftWrites = true;
@@ -595,6 +600,16 @@ void Controller::SharedMemStats(void *config){
         inactiveStreams.erase(inactiveStreams.begin());
         shiftWrites = true;
       }
+      // Release pages of crashed inputs, then apply the (possibly changed) budget
+      pageCache.removeDead();
+      listenerStats.removeDead();
+      listenerStats.updateRates();
+      uint64_t budgetMiB = 0;
+      if (Storage["config"].isMember("pagecachebudget")){budgetMiB = Storage["config"]["pagecachebudget"].asInt();}
+      pageCache.setBudget(budgetMiB * 1024 * 1024);
+      uint64_t segmentMiB = 0;
+      if (Storage["config"].isMember("segmentcachebudget")){segmentMiB = Storage["config"]["segmentcachebudget"].asInt();}
+      pageCache.setSegmentBudget(segmentMiB * 1024 * 1024);
       /*LTS-START*/
       Controller::checkServerLimits();
       /*LTS-END*/
@@ -605,6 +620,8 @@ void Controller::SharedMemStats(void *config){
   HIGH_MSG("Stopping stats thread");
   if (Util::Config::is_restarting){
     statComm.setMaster(false);
+    pageCache.setMaster(false);
+    listenerStats.setMaster(false);
   }else{/*LTS-START*/
     if (Controller::killOnExit){
       WARN_MSG("Killing all connected clients to force full shutdown");
@@ -1371,6 +1388,53 @@ void Controller::fillHasStats(JSON::Value &req, JSON::Value &rep){
   // all done! return is by reference, so no need to return anything here.
 }
 
+/// This takes a "pagecache" request, and fills in the response data.
+/// The response looks like this:
+/// ~~~~~~~~~~~~~~~{.js}
+///{
+///   "budget": 0, //Configured total budget in bytes, 0 if unlimited
+///   "used": 0, //Bytes of VoD data pages currently in memory
+///   "pages": 0, //Amount of VoD data pages currently in memory
+///   "hits": 0, //Pages viewers moved onto that were already in memory
+///   "misses": 0, //Pages that had to be loaded from the source
+///   "evictions": 0, //Pages removed early to stay within the budget
+///   "streams": {"streamA": {"pages": 0, "bytes": 0, "shared": 0}}, //Per-stream usage; shared pages are also counted by other streams
+///   "segments": {"budget": 0, "used": 0}, //Bytes of cached output segments on this host, and their budget (0 if unlimited)
+///   "hugepages": { //How data pages were backed while MIST_HUGEPAGES was set, live and VoD
+///     "requested": 0, //Data pages created with huge pages enabled
+///     "hugetlbfs": 0, //Data pages backed by hugetlbfs
+///     "thp": 0, //Data pages with transparent huge pages requested
+///     "fallback": 0 //Data pages that fell back to regular pages
+///   }
+///}
+/// ~~~~~~~~~~~~~~~
+void Controller::fillPageCache(JSON::Value &req, JSON::Value &rep){
+  rep.null();
+  rep["budget"] = pageCache.getBudget();
+  rep["used"] = pageCache.getUsed();
+  rep["hits"] = pageCache.getHits();
+  rep["misses"] = pageCache.getMisses();
+  rep["evictions"] = pageCache.getEvictions();
+  uint64_t pages = 0;
+  rep["streams"].null();
+  for (size_t i = 0; i < pageCache.recordCount(); ++i){
+    if (!pageCache.getPid(i)){continue;}
+    JSON::Value &strm = rep["streams"][pageCache.getStream(i)];
+    strm["pages"] = strm["pages"].asInt() + 1;
+    strm["bytes"] = strm["bytes"].asInt() + pageCache.getSize(i);
+    if (pageCache.isShared(i)){strm["shared"] = strm["shared"].asInt() + 1;}
+    ++pages;
+  }
+  rep["pages"] = pages;
+  rep["segments"]["budget"] = pageCache.getSegmentBudget();
+  rep["segments"]["used"] = pageCache.getSegmentBytes();
+  IPC::hugePageCounters huge = pageCache.getHugePages();
+  rep["hugepages"]["requested"] = huge.requested;
+  rep["hugepages"]["hugetlbfs"] = huge.hugetlb;
+  rep["hugepages"]["thp"] = huge.thp;
+  rep["hugepages"]["fallback"] = huge.fallback;
+}
+
 void Controller::fillActive(JSON::Value &req, JSON::Value &rep){
   //check what values we wanted to receive
   JSON::Value fields;
@@ -1810,6 +1874,47 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
     response << "# HELP mist_shm_used Total shared memory in use in KiB.\n";
     response << "# TYPE mist_shm_used gauge\n";
     response << "mist_shm_used " << (shm_total - shm_free) << "\n\n";
+    response << "# HELP mist_pagecache_bytes VoD data page bytes in memory, and the configured budget.\n";
+    response << "# TYPE mist_pagecache_bytes gauge\n";
+    response << "mist_pagecache_bytes{type=\"used\"} " << pageCache.getUsed() << "\n";
+    response << "mist_pagecache_bytes{type=\"budget\"} " << pageCache.getBudget() << "\n\n";
+    response << "# HELP mist_pagecache_total VoD data page cache events since the cache was created.\n";
+    response << "# TYPE mist_pagecache_total counter\n";
+    response << "mist_pagecache_total{event=\"hit\"} " << pageCache.getHits() << "\n";
+    response << "mist_pagecache_total{event=\"miss\"} " << pageCache.getMisses() << "\n";
+    response << "mist_pagecache_total{event=\"eviction\"} " << pageCache.getEvictions() << "\n\n";
+    IPC::hugePageCounters huge = pageCache.getHugePages();
+    response << "# HELP mist_hugepages_total Data pages created while huge pages were enabled, by backing.\n";
+    response << "# TYPE mist_hugepages_total counter\n";
+    response << "mist_hugepages_total{backing=\"requested\"} " << huge.requested << "\n";
+    response << "mist_hugepages_total{backing=\"hugetlbfs\"} " << huge.hugetlb << "\n";
+    response << "mist_hugepages_total{backing=\"thp\"} " << huge.thp << "\n";
+    response << "mist_hugepages_total{backing=\"fallback\"} " << huge.fallback << "\n\n";
+
+    if (listenerStats.recordCount()){
+      response << "# HELP mist_listener_accepts Connections accepted per listener shard since it started.\n";
+      response << "# TYPE mist_listener_accepts counter\n";
+      response << "# HELP mist_listener_accept_rate Connections accepted per second per listener shard.\n";
+      response << "# TYPE mist_listener_accept_rate gauge\n";
+      response << "# HELP mist_listener_forks Processes started per listener shard to handle a connection.\n";
+      response << "# TYPE mist_listener_forks counter\n";
+      response << "# HELP mist_listener_fork_rate Processes started per second per listener shard.\n";
+      response << "# TYPE mist_listener_fork_rate gauge\n";
+      response << "# HELP mist_listener_replies Requests answered by a listener shard without starting a process.\n";
+      response << "# TYPE mist_listener_replies counter\n";
+      for (size_t i = 0; i < listenerStats.recordCount(); ++i){
+        if (!listenerStats.getPid(i)){continue;}
+        std::stringstream labels;
+        labels << "{connector=\"" << listenerStats.getConnector(i) << "\",port=\"" << listenerStats.getPort(i)
+               << "\",shard=\"" << listenerStats.getShard(i) << "\",cpu=\"" << listenerStats.getCpu(i) << "\"}";
+        response << "mist_listener_accepts" << labels.str() << " " << listenerStats.getAccepts(i) << "\n";
+        response << "mist_listener_accept_rate" << labels.str() << " " << listenerStats.getRate(i) << "\n";
+        response << "mist_listener_forks" << labels.str() << " " << listenerStats.getForks(i) << "\n";
+        response << "mist_listener_fork_rate" << labels.str() << " " << listenerStats.getForkRate(i) << "\n";
+        response << "mist_listener_replies" << labels.str() << " " << listenerStats.getReplies(i) << "\n";
+      }
+      response << "\n";
+    }
 
     response << "# HELP mist_viewseconds_total Number of seconds any media was received by a viewer.\n";
     response << "# TYPE mist_viewseconds_total counter\n";
@@ -1868,6 +1973,10 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
       response << "# TYPE mist_bw counter\n";
       response << "# HELP mist_packets Total number of packets sent/received/lost over lossy protocols.\n";
       response << "# TYPE mist_packets counter\n";
+      response << "# HELP mist_segcache_total Shared output segment cache events since stream start.\n";
+      response << "# TYPE mist_segcache_total counter\n";
+      response << "# HELP mist_segcache_bytes Shared memory used by cached output segments.\n";
+      response << "# TYPE mist_segcache_bytes gauge\n";
       for (std::map<std::string, struct streamTotals>::iterator it = streamStats.begin();
             it != streamStats.end(); ++it){
         response << "mist_sessions{stream=\"" << it->first << "\",sessType=\"viewers\"}"
@@ -1885,6 +1994,14 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
         response << "mist_packets{stream=\"" << it->first << "\",pkttype=\"sent\"}" << it->second.packSent << "\n";
         response << "mist_packets{stream=\"" << it->first << "\",pkttype=\"lost\"}" << it->second.packLoss << "\n";
         response << "mist_packets{stream=\"" << it->first << "\",pkttype=\"retrans\"}" << it->second.packRetrans << "\n";
+        Comms::SegmentCache segs;
+        segs.reload(it->first);
+        if (segs){
+          response << "mist_segcache_total{stream=\"" << it->first << "\",event=\"hit\"}" << segs.getHits() << "\n";
+          response << "mist_segcache_total{stream=\"" << it->first << "\",event=\"miss\"}" << segs.getMisses() << "\n";
+          response << "mist_segcache_total{stream=\"" << it->first << "\",event=\"eviction\"}" << segs.getEvictions() << "\n";
+          response << "mist_segcache_bytes{stream=\"" << it->first << "\"}" << segs.getBytes() << "\n";
+        }
       }
 
       if (Controller::triggerStats.size()){
@@ -1909,6 +2026,30 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
     resp["mem_used"] = (mem_total - mem_free - mem_bufcache);
     resp["shm_total"] = shm_total;
     resp["shm_used"] = (shm_total - shm_free);
+    resp["pagecache"].append(pageCache.getUsed());
+    resp["pagecache"].append(pageCache.getBudget());
+    resp["pagecache"].append(pageCache.getHits());
+    resp["pagecache"].append(pageCache.getMisses());
+    resp["pagecache"].append(pageCache.getEvictions());
+    IPC::hugePageCounters huge = pageCache.getHugePages();
+    resp["hugepages"].append(huge.requested);
+    resp["hugepages"].append(huge.hugetlb);
+    resp["hugepages"].append(huge.thp);
+    resp["hugepages"].append(huge.fallback);
+    for (size_t i = 0; i < listenerStats.recordCount(); ++i){
+      if (!listenerStats.getPid(i)){continue;}
+      JSON::Value shard;
+      shard.append(listenerStats.getConnector(i));
+      shard.append(listenerStats.getPort(i));
+      shard.append(listenerStats.getShard(i));
+      shard.append(listenerStats.getCpu(i));
+      shard.append(listenerStats.getAccepts(i));
+      shard.append(listenerStats.getRate(i));
+      shard.append(listenerStats.getForks(i));
+      shard.append(listenerStats.getForkRate(i));
+      shard.append(listenerStats.getReplies(i));
+      resp["listeners"].append(shard);
+    }
     resp["logs"] = Controller::logCounter;
     resp["curr"].append(totViewers);
     resp["curr"].append(totInputs);
@@ -1963,6 +2104,14 @@ void Controller::handlePrometheus(HTTP::Parser &H, Socket::Connection &conn, int
         resp["streams"][it->first]["pkts"].append(it->second.packSent);
         resp["streams"][it->first]["pkts"].append(it->second.packLoss);
         resp["streams"][it->first]["pkts"].append(it->second.packRetrans);
+        Comms::SegmentCache segs;
+        segs.reload(it->first);
+        if (segs){
+          resp["streams"][it->first]["segcache"].append(segs.getHits());
+          resp["streams"][it->first]["segcache"].append(segs.getMisses());
+          resp["streams"][it->first]["segcache"].append(segs.getEvictions());
+          resp["streams"][it->first]["segcache"].append(segs.getBytes());
+        }
       }
       for (std::map<std::string, uint32_t>::iterator it = outputs.begin(); it != outputs.end(); ++it){
         resp["output_counts"][it->first] = it->second;
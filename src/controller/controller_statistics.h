@@ -117,6 +117,7 @@ namespace Controller{
   void fillActive(JSON::Value &req, JSON::Value &rep);
   void fillHasStats(JSON::Value &req, JSON::Value &rep);
   void fillTotals(JSON::Value &req, JSON::Value &rep);
+  void fillPageCache(JSON::Value &req, JSON::Value &rep);
   void SharedMemStats(void *config);
   void sessions_invalidate(const std::string &streamname);
   void sessions_shutdown(JSON::Iter &i);
@@ -397,6 +397,7 @@ namespace Controller{
             Log("STRM", "Deleting source file for stream " + cleaned + ": " + strmSource);
             // Delete dtsh, ignore failures
             if (!unlink((strmSource + ".dtsh").c_str())){++ret;}
+            unlink((strmSource + ".dtsm").c_str());
           }
         }
       }
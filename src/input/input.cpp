@@ -1,5 +1,6 @@
 #include <fcntl.h>
 #include <semaphore.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 
 #include "input.h"
@@ -22,6 +23,8 @@ namespace Mist{
   void Input::userLeadIn(){
     connectedUsers = 0;
     keyLoadPriority.clear();
+    ++readAheadLoop;
+    readAheadHorizon = readAheadMs();
   }
 
   void Input::userOnActive(size_t id){
@@ -33,48 +36,83 @@ namespace Mist{
     }
     //This is a bit tricky:
     //We want to make sure the next page is buffered before we need it, during playback.
-    //To do so, we grab the current key's time and make sure current key and everything 120 seconds after it, is loaded.
+    //To do so, we grab the current key's time and make sure current key and everything within the
+    //read-ahead horizon after it, is loaded. The result is cached until the user moves to another key.
     size_t key = users.getKeyNum(id);
+    readAheadWindow &win = readAhead[id];
+    win.lastSeen = readAheadLoop;
+    if (win.pages.size() && win.track == track && win.key == key && win.horizon == readAheadHorizon){
+      for (std::map<size_t, uint64_t>::iterator it = win.pages.begin(); it != win.pages.end(); ++it){
+        keyLoadPriority[trackKey(track, it->first)] += it->second;
+      }
+      return;
+    }
+    // Pages that were already in this user's window were requested before; they are no new hits
+    std::map<size_t, uint64_t> prevPages;
+    if (win.track == track){prevPages.swap(win.pages);}
+    win.track = track;
+    win.key = key;
+    win.horizon = readAheadHorizon;
+    win.pages.clear();
     uint64_t time = M.getTimeForKeyIndex(track, key);
-    size_t endKey = M.getKeyIndexForTime(track, time + 120000);
+    size_t endKey = M.getKeyIndexForTime(track, time + readAheadHorizon);
     //But! What if our current key is 20+ seconds long? HAVE YOU THOUGHT OF THAT?!
     //Exactly! I thought not! So, if the end key number == the first, we increase by one.
     if (endKey == key){++endKey;}
     if (endKey > key + 1000){endKey = key + 1000;}
     DONTEVEN_MSG("User with ID:%zu is on %zu:%zu -> %zu (timestamp %" PRIu64 ")", id, track, key, endKey, time);
-    for (size_t i = key; i <= endKey; ){
-      const Util::RelAccX &tPages = M.pages(track);
-      Util::RelAccXFieldData firstkeyEntry = tPages.getFieldData("firstkey");
-      Util::RelAccXFieldData keyCountEntry = tPages.getFieldData("keycount");
-      if (!tPages.getEndPos()){return;}
-      DTSC::Keys keys(M.keys(track));
-      if (i > keys.getEndValid()){return;}
-      bool found = false;
-      uint64_t cnt = 1, pageNumber = 0;
-      for (uint64_t j = tPages.getDeleted(); j < tPages.getEndPos(); j++){
-        pageNumber = tPages.getInt(firstkeyEntry, j);
-        cnt = tPages.getInt(keyCountEntry, j);
-        if (pageNumber <= i && pageNumber + cnt > i){
-          found = true;
-          break;
-        }
+    const Util::RelAccX &tPages = M.pages(track);
+    if (!tPages.getEndPos()){return;}
+    DTSC::Keys keys(M.keys(track));
+    if (key > keys.getEndValid()){return;}
+    Util::RelAccXFieldData firstkeyEntry = tPages.getFieldData("firstkey");
+    Util::RelAccXFieldData keyCountEntry = tPages.getFieldData("keycount");
+    Util::RelAccXFieldData availEntry = tPages.getFieldData("avail");
+    // Pages are sorted by first key; find the last one starting at or before our key
+    uint64_t lo = tPages.getDeleted(), hi = tPages.getEndPos();
+    while (hi - lo > 1){
+      uint64_t mid = lo + (hi - lo) / 2;
+      if (tPages.getInt(firstkeyEntry, mid) <= key){
+        lo = mid;
+      }else{
+        hi = mid;
       }
-      // Could not find key? Then we're done here.
-      if (!found){return;}
+    }
+    for (uint64_t j = lo; j < tPages.getEndPos(); ++j){
+      uint64_t pageNumber = tPages.getInt(firstkeyEntry, j);
+      uint64_t cnt = tPages.getInt(keyCountEntry, j);
+      if (pageNumber > endKey || pageNumber > keys.getEndValid()){break;}
+      // Skip pages that end before our key
+      if (pageNumber + cnt <= key && cnt){continue;}
       uint64_t pageTime = M.getTimeForKeyIndex(track, pageNumber);
-      if (pageTime <= time){
-        keyLoadPriority[trackKey(track, pageNumber)] += 10000;
-      }else{
-        keyLoadPriority[trackKey(track, pageNumber)] += 600 - (pageTime - time) / 1000;
+      uint64_t prio = 10000;
+      if (pageTime > time){
+        uint64_t ahead = (pageTime - time) / 1000;
+        prio = (ahead < 600) ? 600 - ahead : 1;
       }
-      // Make sure we always progress, even in edge cases where there is no full key buffered yet
-      if (!cnt){cnt = 1;}
-      i = pageNumber + cnt;
+      win.pages[pageNumber] = prio;
+      keyLoadPriority[trackKey(track, pageNumber)] += prio;
+      // Pages that newly entered this user's window and are already in memory count as page cache hits
+      if (!prevPages.count(pageNumber) && tPages.getInt(availEntry, j)){++cacheHits;}
     }
-    //Now, we can rest assured that the next ~120 seconds or so is pre-buffered in RAM.
+    //Now, we can rest assured that the read-ahead horizon is pre-buffered in RAM.
   }
-  void Input::userOnDisconnect(size_t id){}
+  void Input::userOnDisconnect(size_t id){readAhead.erase(id);}
   void Input::userLeadOut(){
+    if (cacheHits){
+      tthread::lock_guard<tthread::mutex> guard(loadMutex);
+      pageCache.addHits(cacheHits);
+      cacheHits = 0;
+    }
+    // Forget the windows of users that were not seen this loop
+    std::map<size_t, readAheadWindow>::iterator it = readAhead.begin();
+    while (it != readAhead.end()){
+      if (it->second.lastSeen != readAheadLoop){
+        readAhead.erase(it++);
+      }else{
+        ++it;
+      }
+    }
     if (!keyLoadPriority.size()){return;}
     //Make reverse mapping
     std::multimap<uint64_t, trackKey> reverse;
@@ -82,9 +120,173 @@ namespace Mist{
       reverse.insert(std::pair<uint64_t, trackKey>(i->second, i->first));
       VERYHIGH_MSG("Key priority for %zu:%zu = %" PRIu64, i->first.track, i->first.key, i->second);
     }
-    uint64_t timer = Util::bootMS();
-    for (std::multimap<uint64_t, trackKey>::reverse_iterator i = reverse.rbegin(); i != reverse.rend() && Util::bootMS() < timer + INPUT_USER_INTERVAL; ++i){
-      bufferFrame(i->second.track, i->second.key);
+    if (!asyncPageLoads()){
+      uint64_t timer = Util::bootMS();
+      for (std::multimap<uint64_t, trackKey>::reverse_iterator i = reverse.rbegin(); i != reverse.rend() && Util::bootMS() < timer + INPUT_USER_INTERVAL; ++i){
+        bufferFrame(i->second.track, i->second.key);
+      }
+      return;
+    }
+    // Pages that are (being) buffered only need to be marked as still in use; queue the rest for the
+    // loader threads, replacing whatever was queued before so they always pick the most urgent pages.
+    if (!loaderThreads.size()){startPageLoader();}
+    std::deque<trackKey> queue;
+    uint64_t now = Util::bootSecs();
+    tthread::lock_guard<tthread::mutex> guard(loadMutex);
+    for (std::multimap<uint64_t, trackKey>::reverse_iterator i = reverse.rbegin(); i != reverse.rend(); ++i){
+      if (isBuffered(i->second.track, i->second.key, meta)){
+        pageCounter[i->second.track][i->second.key] = now;
+        touchCachedPage(i->second.track, i->second.key);
+      }else{
+        queue.push_back(i->second);
+      }
+    }
+    loadQueue.swap(queue);
+    if (loadQueue.size()){loadCond.notify_all();}
+  }
+
+  /// Returns true if VoD pages should be loaded by a separate loader thread, so that slow reads do not
+  /// hold up the serve loop. Inputs that read from the source on the main thread as well must return false.
+  bool Input::asyncPageLoads(){return M.getVod() && !M.getLive();}
+
+  /// Returns how far ahead of each viewer (in ms) pages should be loaded.
+  /// Starts at INPUT_READAHEAD_DEFAULT, then adapts to the measured read speed: loading one page for
+  /// every viewer should take at most a quarter of the read-ahead. Limited by the pagebudget option.
+  uint64_t Input::readAheadMs(){
+    tthread::lock_guard<tthread::mutex> guard(loadMutex);
+    if (loadSpeed <= 0){return INPUT_READAHEAD_DEFAULT;}
+    uint64_t windows = readAhead.size() ? readAhead.size() : 1;
+    // VoD pages are cut at FLIP_DATA_PAGE_SIZE bytes or FLIP_TARGET_DURATION ms, whichever comes first
+    uint64_t pageMs = FLIP_TARGET_DURATION;
+    if (loadBytesPerMs > 0 && FLIP_DATA_PAGE_SIZE / loadBytesPerMs < pageMs){
+      pageMs = FLIP_DATA_PAGE_SIZE / loadBytesPerMs;
+    }
+    uint64_t horizon = 4 * windows * pageMs / loadSpeed;
+    if (horizon < INPUT_READAHEAD_MIN){horizon = INPUT_READAHEAD_MIN;}
+    if (horizon > INPUT_READAHEAD_MAX){horizon = INPUT_READAHEAD_MAX;}
+    uint64_t budget = config->getInteger("pagebudget") * 1024 * 1024;
+    if (budget && loadBytesPerMs > 0){
+      uint64_t budgetMs = budget / (loadBytesPerMs * windows);
+      if (budgetMs < INPUT_READAHEAD_MIN){budgetMs = INPUT_READAHEAD_MIN;}
+      if (horizon > budgetMs){horizon = budgetMs;}
+    }
+    return horizon;
+  }
+
+  /// Marks a buffered page as recently used in the page cache. Must be called with loadMutex locked.
+  void Input::touchCachedPage(size_t track, uint32_t pageNumber){
+    std::map<size_t, std::map<uint32_t, size_t> >::iterator it = cachedPages.find(track);
+    if (it == cachedPages.end()){return;}
+    std::map<uint32_t, size_t>::iterator jt = it->second.find(pageNumber);
+    if (jt != it->second.end()){pageCache.touchPage(jt->second);}
+  }
+
+  void Input::pageLoaderThread(void *arg){((Input *)arg)->pageLoader();}
+
+  void Input::startPageLoader(){
+    loaderRunning = true;
+    // Local source files are prefetched by the loader threads themselves, so their reads overlap
+    sourceFd = -1;
+    std::string source = config->getString("input");
+    struct stat st;
+    if (source.size() && !stat(source.c_str(), &st) && S_ISREG(st.st_mode)){
+      sourceFd = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    int64_t count = config->hasOption("pageloaders") ? config->getInteger("pageloaders") : INPUT_PAGE_LOADERS;
+    if (count < 1){count = 1;}
+    for (int64_t i = 0; i < count; ++i){loaderThreads.push_back(new tthread::thread(pageLoaderThread, this));}
+    INFO_MSG("Started %zu page loader threads", loaderThreads.size());
+  }
+
+  void Input::stopPageLoader(){
+    if (!loaderThreads.size()){return;}
+    {
+      tthread::lock_guard<tthread::mutex> guard(loadMutex);
+      loaderRunning = false;
+      loadQueue.clear();
+      loadCond.notify_all();
+    }
+    for (size_t i = 0; i < loaderThreads.size(); ++i){
+      loaderThreads[i]->join();
+      delete loaderThreads[i];
+    }
+    loaderThreads.clear();
+    if (sourceFd != -1){
+      close(sourceFd);
+      sourceFd = -1;
+    }
+  }
+
+  /// Returns true if called from one of the page loader threads.
+  bool Input::onPageLoader(){
+    for (size_t i = 0; i < loaderThreads.size(); ++i){
+      if (loaderThreads[i]->get_id() == tthread::this_thread::get_id()){return true;}
+    }
+    return false;
+  }
+
+  /// Reads the byte range of the source file a page will be loaded from, so it is in the OS cache by
+  /// the time bufferFrame parses it. This is the part of a page load that runs in parallel between
+  /// loader threads; seeking and parsing the source share one state and are serialized.
+  void Input::prefetchPage(size_t idx, uint32_t pageNumber, uint64_t pageIdx){
+    if (sourceFd == -1){return;}
+    DTSC::Keys keys(M.keys(idx));
+    Util::RelAccX &tPages = meta.pages(idx);
+    uint32_t nextKey = pageNumber + tPages.getInt("keycount", pageIdx);
+    uint64_t start = keys.getBpos(pageNumber);
+    uint64_t end = (nextKey < keys.getEndValid()) ? keys.getBpos(nextKey) : 0;
+    // Inputs that do not keep byte positions leave them at zero
+    if (!start && !end){return;}
+    // Without a next page, or with interleaving bigger than expected, read about one page worth of data
+    uint64_t limit = tPages.getInt("size", pageIdx) * 2;
+    if (!limit){limit = FLIP_DATA_PAGE_SIZE;}
+    if (end <= start || end - start > limit){end = start + limit;}
+    char buffer[65536];
+    uint64_t pos = start;
+    while (pos < end && loaderRunning){
+      size_t len = (end - pos < sizeof(buffer)) ? end - pos : sizeof(buffer);
+      ssize_t r = pread(sourceFd, buffer, len, pos);
+      if (r <= 0){break;}
+      pos += r;
+    }
+    VERYHIGH_MSG("Prefetched %" PRIu64 " bytes for track %zu, page %" PRIu32, pos - start, idx, pageNumber);
+  }
+
+  /// Loader thread: loads the most urgent queued page that no other loader thread is loading yet,
+  /// until stopPageLoader is called.
+  void Input::pageLoader(){
+    while (true){
+      trackKey next;
+      trackKey loading;
+      uint64_t pageIdx = 0;
+      {
+        tthread::lock_guard<tthread::mutex> guard(loadMutex);
+        while (loaderRunning){
+          if (!loadQueue.size()){
+            loadCond.wait(loadMutex);
+            continue;
+          }
+          next = loadQueue.front();
+          loadQueue.pop_front();
+          // Find the page the key is on; keys on a page that is already being loaded are dropped
+          Util::RelAccX &tPages = meta.pages(next.track);
+          if (!tPages.getEndPos()){continue;}
+          pageIdx = tPages.getDeleted();
+          for (uint64_t i = tPages.getDeleted(); i < tPages.getEndPos(); i++){
+            if (tPages.getInt("firstkey", i) > next.key){break;}
+            pageIdx = i;
+          }
+          loading = trackKey(next.track, tPages.getInt("firstkey", pageIdx));
+          if (loadingPages.count(loading)){continue;}
+          loadingPages.insert(loading);
+          break;
+        }
+        if (!loaderRunning){return;}
+      }
+      if (!isBuffered(loading.track, loading.key, meta)){prefetchPage(loading.track, loading.key, pageIdx);}
+      bufferFrame(next.track, next.key);
+      tthread::lock_guard<tthread::mutex> guard(loadMutex);
+      loadingPages.erase(loading);
     }
   }
 
@@ -101,6 +303,14 @@ namespace Mist{
     standAlone = true;
     Util::Config::binaryType = Util::INPUT;
     inputTimeout = INPUT_TIMEOUT;
+    headerFromImage = false;
+    readAheadLoop = 0;
+    readAheadHorizon = INPUT_READAHEAD_DEFAULT;
+    sourceFd = -1;
+    loaderRunning = false;
+    loadSpeed = 0;
+    loadBytesPerMs = 0;
+    cacheHits = 0;
 
     JSON::Value option;
     option["long"] = "json";
@@ -244,6 +454,30 @@ namespace Mist{
     capa["optional"]["pagetimeout"]["type"] = "uint";
     capa["optional"]["pagetimeout"]["default"] = DEFAULT_PAGE_TIMEOUT;
 
+    option.null();
+    option["long"] = "pagebudget";
+    option["arg"] = "integer";
+    option["value"].append(0);
+    option["help"] = "For VoD inputs, the amount of memory in MiB that read-ahead of pages for viewers may use. The read-ahead adapts to the speed of the source within this budget. Zero means no limit.";
+    config->addOption("pagebudget", option);
+    capa["optional"]["pagebudget"]["name"] = "Read-ahead memory budget";
+    capa["optional"]["pagebudget"]["help"] = "For VoD inputs, the amount of memory in MiB that read-ahead of pages for viewers may use. The read-ahead adapts to the speed of the source within this budget. Zero means no limit.";
+    capa["optional"]["pagebudget"]["option"] = "--pagebudget";
+    capa["optional"]["pagebudget"]["type"] = "uint";
+    capa["optional"]["pagebudget"]["default"] = 0;
+
+    option.null();
+    option["long"] = "pageloaders";
+    option["arg"] = "integer";
+    option["value"].append(INPUT_PAGE_LOADERS);
+    option["help"] = "For VoD inputs, the number of threads that load pages for viewers. Different pages are read from the source in parallel.";
+    config->addOption("pageloaders", option);
+    capa["optional"]["pageloaders"]["name"] = "Page loader threads";
+    capa["optional"]["pageloaders"]["help"] = "For VoD inputs, the number of threads that load pages for viewers. Different pages are read from the source in parallel.";
+    capa["optional"]["pageloaders"]["option"] = "--pageloaders";
+    capa["optional"]["pageloaders"]["type"] = "uint";
+    capa["optional"]["pageloaders"]["default"] = INPUT_PAGE_LOADERS;
+
     /*LTS-END*/
     capa["optional"]["debug"]["name"] = "debug";
     capa["optional"]["debug"]["help"] = "The debug level at which messages need to be printed.";
@@ -281,6 +515,13 @@ namespace Mist{
         INSANE_MSG("Source is not a file - ignoring header check");
         return;
       }
+      std::string imageFile = f + ".dtsm";
+      struct stat bufImage;
+      if (stat(imageFile.c_str(), &bufImage) == 0 && (bufImage.st_mtime < bufStream.st_mtime + 15 ||
+                                                      (hasSrt && bufImage.st_mtime < srtStream.st_mtime + 15))){
+        INFO_MSG("Removing outdated memory image file: %s ", imageFile.c_str());
+        remove(imageFile.c_str());
+      }
       std::string headerFile = f + ".dtsh";
       if (stat(headerFile.c_str(), &bufHeader) != 0){
         INSANE_MSG("No header exists to compare - ignoring header check");
@@ -701,6 +942,11 @@ namespace Mist{
       meta.removeEmptyTracks();
       parseHeader();
       INFO_MSG("Header parsed, %zu tracks", M.getValidTracks().size());
+      // Cache the parsed header (including the page table) as a memory image, for faster startup next time
+      struct stat inStat;
+      if (!headerFromImage && !stat(config->getString("input").c_str(), &inStat) && S_ISREG(inStat.st_mode)){
+        M.toImage(config->getString("input") + ".dtsm");
+      }
     }
 
     if (!streamName.size()){
@@ -790,6 +1036,11 @@ namespace Mist{
   // this was a clean exit or not
   bool Input::exitAndLogReason(){
     int returnCode = 1;
+    if (IPC::hugePageStats.requested){
+      INFO_MSG("Huge pages: %" PRIu64 " of %" PRIu64 " data pages on hugetlbfs, %" PRIu64 " with THP, %" PRIu64 " fell back",
+               IPC::hugePageStats.hugetlb, IPC::hugePageStats.requested, IPC::hugePageStats.thp,
+               IPC::hugePageStats.fallback);
+    }
     // If no reason is set at all, return the default status
     if (!Util::exitReason[0]){
       INFO_MSG("Input closing without a set exit reason");
@@ -840,6 +1091,7 @@ namespace Mist{
   /// ~~~~~~~~~~~~~~~
   void Input::serve(){
     users.reload(streamName, true);
+    segmentCache.reload(streamName, true);
     startTime = Util::bootSecs();
 
     if (!M){
@@ -852,6 +1104,7 @@ namespace Mist{
       //}
     }
     meta.setSource(config->getString("input"));
+    if (M.getVod() && !M.getLive()){meta.setPagePrefix(sharedPagePrefix());}
 
     internalOnly = (config->getString("input").find("INTERNAL_ONLY") != std::string::npos);
     isBuffer = (capa["name"].asStringRef() == "Buffer");
@@ -883,6 +1136,7 @@ namespace Mist{
         Util::logExitReason(ER_SHM_LOST, "Lost connection to metadata");
         break;
       }
+      removeExpiredSegments();
 
       if (M.getLive() && !internalOnly){
         uint64_t currLastUpdate = M.getLastUpdated();
@@ -900,6 +1154,11 @@ namespace Mist{
         Util::wait(waitMs);
       }
     }
+    stopPageLoader();
+    {
+      tthread::lock_guard<tthread::mutex> guard(loadMutex);
+      segmentCache.clear(pageCache);
+    }
     if (!isThread()){
       if (streamStatus){streamStatus.mapped[0] = STRMSTAT_SHUTDOWN;}
       config->is_active = false;
@@ -1258,6 +1517,21 @@ namespace Mist{
     removeUnused();
   }
 
+  /// Drops cached output segments that are no longer in the live buffer window, that were not
+  /// requested for pagetimeout seconds or do not fit the host-wide segment budget, as well as
+  /// segments that were abandoned by their producer.
+  void Input::removeExpiredSegments(){
+    uint64_t firstms = 0;
+    if (M.getLive()){
+      std::set<size_t> validTracks = M.getValidTracks();
+      for (std::set<size_t>::iterator it = validTracks.begin(); it != validTracks.end(); ++it){
+        if (!firstms || M.getFirstms(*it) < firstms){firstms = M.getFirstms(*it);}
+      }
+    }
+    tthread::lock_guard<tthread::mutex> guard(loadMutex);
+    segmentCache.removeExpired(firstms, config->getInteger("pagetimeout") * 1000, pageCache);
+  }
+
   void Input::removeUnused(){
     uint64_t timeout = config->getInteger("pagetimeout");
     uint64_t bufferTime = timeout * 1000;
@@ -1265,24 +1539,115 @@ namespace Mist{
       bufferTime = config->getInteger("bufferTime");
     }
     uint64_t cTime = Util::bootSecs();
+    tthread::lock_guard<tthread::mutex> guard(loadMutex);
     for (std::map<size_t, std::map<uint32_t, uint64_t> >::iterator it = pageCounter.begin();
          it != pageCounter.end(); it++){
       std::set<uint32_t> deletedEntries;
       for (std::map<uint32_t, uint64_t>::iterator it2 = it->second.begin(); it2 != it->second.end(); it2++){
         if (isRecentLivePage(it->first, it2->first, bufferTime)){continue;}
-        if (cTime > it2->second + timeout){
+        // Never remove pages the loader threads are writing to
+        if (loadingPages.count(trackKey(it->first, it2->first))){continue;}
+        size_t cacheIdx = INVALID_RECORD_INDEX;
+        if (cachedPages.count(it->first) && cachedPages[it->first].count(it2->first)){
+          cacheIdx = cachedPages[it->first][it2->first];
+        }
+        // Pages marked by the page cache are removed even if in use, to stay within the global budget
+        bool evicted = pageCache.mustEvict(cacheIdx);
+        if (evicted || cTime > it2->second + timeout){
           deletedEntries.insert(it2->first);
-          bufferRemove(it->first, it2->first);
-          HIGH_MSG("Unloading page %u track %lu", it2->first, it->first);
+          removePage(it->first, it2->first);
+          pageCache.removePage(cacheIdx, evicted);
+          HIGH_MSG("%s page %u track %lu", evicted ? "Evicting" : "Unloading", it2->first, it->first);
         }
       }
       while (deletedEntries.size()){
         it->second.erase(*(deletedEntries.begin()));
+        if (cachedPages.count(it->first)){cachedPages[it->first].erase(*(deletedEntries.begin()));}
         deletedEntries.erase(deletedEntries.begin());
       }
     }
   }
 
+  /// Returns the name to store data pages under, so that other streams backed by the same file can
+  /// attach to them instead of loading them again. The name is a hash of the file identity and the
+  /// track and page layout. Returns an empty string (meaning: use the stream name) if the source is
+  /// not a regular local file, or if the page contents depend on the stream configuration.
+  std::string Input::sharedPagePrefix(){
+    if (hasSrt || (config->hasOption("encryption") && config->getString("encryption").size())){return "";}
+    struct stat inStat;
+    if (stat(config->getString("input").c_str(), &inStat) || !S_ISREG(inStat.st_mode)){return "";}
+    std::stringstream id;
+    id << capa["name"].asStringRef() << " " << inStat.st_dev << " " << inStat.st_ino << " "
+       << inStat.st_mtime << " " << inStat.st_size;
+    std::set<size_t> validTracks = M.getValidTracks();
+    for (std::set<size_t>::iterator it = validTracks.begin(); it != validTracks.end(); ++it){
+      if (M.getEncryption(*it).size()){return "";}
+      id << " " << *it << ":" << M.getType(*it) << ":" << M.getCodec(*it) << ":" << M.getID(*it);
+      const Util::RelAccX &tPages = M.pages(*it);
+      for (uint64_t i = tPages.getDeleted(); i < tPages.getEndPos(); ++i){
+        id << "," << tPages.getInt("firstkey", i) << "/" << tPages.getInt("parts", i);
+      }
+    }
+    return "~" + Secure::md5(id.str()).substr(0, 16);
+  }
+
+  /// Attaches to a data page that the input of another stream already loaded under the same page
+  /// prefix, instead of loading it again. Returns true if the page is now available.
+  bool Input::attachSharedPage(size_t idx, uint32_t pageNumber, uint64_t pageIdx){
+    if (!M.getPagePrefix().size()){return false;}
+    IPC::sharedPage page(M.getDataPageName(idx, pageNumber), 0, false, false);
+    if (!page){return false;}
+    // The loading input holds an exclusive lock until the page is complete
+    if (flock(page.handle, LOCK_SH) || !page.exists()){return false;}
+    Util::RelAccX &tPages = meta.pages(idx);
+    uint64_t parts = tPages.getInt("parts", pageIdx);
+    uint64_t avail = 0;
+    uint64_t count = 0;
+    while (count < parts && avail + 8 <= page.len && !memcmp(page.mapped + avail, "DTP2", 4)){
+      avail += 8 + Bit::btohl(page.mapped + avail + 4);
+      ++count;
+    }
+    if (count < parts){return false;}
+    // Keep a duplicate of the locked descriptor, so the lock outlives the mapping
+    int fd = dup(page.handle);
+    if (fd == -1){return false;}
+    {
+      tthread::lock_guard<tthread::mutex> guard(loadMutex);
+      heldPages[idx][pageNumber] = fd;
+      pageCounter[idx][pageNumber] = Util::bootSecs();
+      if (!pageCache){pageCache.reload();}
+      if (pageCache){
+        cachedPages[idx][pageNumber] = pageCache.addPage(streamName, idx, pageNumber, tPages.getInt("size", pageIdx),
+                                                         M.getDataPageName(idx, pageNumber), true);
+      }
+    }
+    tPages.setInt("avail", avail, pageIdx);
+    meta.signalPageReady();
+    INFO_MSG("Track %zu, page %" PRIu32 " attached from %s", idx, pageNumber, page.name.c_str());
+    return true;
+  }
+
+  /// Removes a data page from memory. Pages shared with other streams are only marked unavailable
+  /// for this stream until the last input using them removes them. Requires loadMutex to be locked.
+  void Input::removePage(size_t idx, uint32_t pageNumber){
+    int fd = -1;
+    std::map<size_t, std::map<uint32_t, int> >::iterator it = heldPages.find(idx);
+    if (it != heldPages.end() && it->second.count(pageNumber)){
+      fd = it->second[pageNumber];
+      it->second.erase(pageNumber);
+    }
+    if (fd == -1 || !flock(fd, LOCK_EX | LOCK_NB)){
+      bufferRemove(idx, pageNumber);
+    }else{
+      Util::RelAccX &tPages = meta.pages(idx);
+      for (uint64_t i = tPages.getDeleted(); i < tPages.getEndPos(); ++i){
+        if (tPages.getInt("firstkey", i) == pageNumber){tPages.setInt("avail", 0, i);}
+      }
+      HIGH_MSG("Page %" PRIu32 " of track %zu is still used by other streams", pageNumber, idx);
+    }
+    if (fd != -1){close(fd);}
+  }
+
   std::string formatGUID(const std::string &val){
     std::stringstream r;
     r << std::hex << std::setw(2) << std::setfill('0');
@@ -1317,10 +1682,10 @@ namespace Mist{
       DTSC::Keys keys(M.keys(*it));
       size_t endKey = keys.getEndValid();
       INFO_MSG("Track %zu has %zu keys", *it, endKey);
-      std::set<uint64_t> &kTimes = keyTimes[*it];
-      for (size_t j = 0; j < endKey; j++){
-        kTimes.insert(keys.getTime(j));
-        if (hasKeySizes && keys.getSize(j) == 0){hasKeySizes = false;}
+      // Memory images are written after this function ran, so their key sizes are always set
+      if (headerFromImage){continue;}
+      for (size_t j = 0; hasKeySizes && j < endKey; j++){
+        if (keys.getSize(j) == 0){hasKeySizes = false;}
       }
     }
 
@@ -1535,7 +1900,11 @@ namespace Mist{
       pageIdx = i;
     }
     uint32_t pageNumber = tPages.getInt("firstkey", pageIdx);
-    pageCounter[idx][pageNumber] = Util::bootSecs();
+    {
+      tthread::lock_guard<tthread::mutex> guard(loadMutex);
+      pageCounter[idx][pageNumber] = Util::bootSecs();
+      touchCachedPage(idx, pageNumber);
+    }
     if (isBuffered(idx, pageNumber, meta)){
       // Mark the page as still actively requested
       DONTEVEN_MSG("Track %zu, key %" PRIu32 " is already buffered in page %" PRIu32
@@ -1543,6 +1912,7 @@ namespace Mist{
                    idx, keyNum, pageNumber);
       return true;
     }
+    if (attachSharedPage(idx, pageNumber, pageIdx)){return true;}
     // Update keynum to point to the corresponding page
     uint64_t bufferTimer = Util::bootMS();
     keyNum = pageNumber;
@@ -1551,10 +1921,21 @@ namespace Mist{
       WARN_MSG("bufferStart failed! Cancelling bufferFrame");
       return false;
     }
+    // bufferStart created shared pages exclusively locked; keep a duplicate of the locked descriptor,
+    // so the lock outlives the mapping and other streams wait for the page to complete
+    int holdFd = -1;
+    if (M.getPagePrefix().size()){holdFd = dup(page.handle);}
 
     uint64_t keyTime = keys.getTime(keyNum);
 
-    inputServeStats();
+    // When loading on a loader thread, the serve loop keeps the stats and activity up to date.
+    // Loader threads share the source's seek/getNext state, so only one of them reads it at a time.
+    bool onLoader = onPageLoader();
+    if (onLoader){
+      sourceMutex.lock();
+    }else{
+      inputServeStats();
+    }
 
     bool isSrt = (hasSrt && idx == srtTrack);
     if (isSrt){
@@ -1601,7 +1982,7 @@ namespace Mist{
       size_t partNo = keys.getFirstPart(keyNum);
       DTSC::Parts parts(M.parts(idx));
       while (thisPacket && thisTime < stopTime){
-        if (connectedUsers || isAlwaysOn()){activityCounter = Util::bootSecs();}
+        if (!onLoader && (connectedUsers || isAlwaysOn())){activityCounter = Util::bootSecs();}
         if (thisTime >= lastBuffered){
           if (sourceIdx != idx){
             if (encryption.find(":") != std::string::npos || M.getEncryption(idx).find(":") != std::string::npos){
@@ -1663,7 +2044,7 @@ namespace Mist{
           byteCounter += thisPacket.getDataLen();
           lastBuffered = thisTime;
         }
-        inputServeStats();
+        if (!onLoader){inputServeStats();}
         getNext(sourceIdx);
       }
       //Sanity check: are we matching the key's data size?
@@ -1683,6 +2064,7 @@ namespace Mist{
         }
       }
     }
+    if (onLoader){sourceMutex.unlock();}
     page.close();
     bufferTimer = Util::bootMS() - bufferTimer;
     if (packCounter < tPages.getInt("parts", pageIdx)){
@@ -1690,23 +2072,56 @@ namespace Mist{
                idx, pageNumber, PRETTY_ARG_MSTIME(tPages.getInt("firsttime", pageIdx)), PRETTY_ARG_MSTIME(thisTime), bufferTimer);
       INFO_MSG("  (%" PRIu32 "/%" PRIu64 " parts, %" PRIu64 " bytes)", packCounter,
                tPages.getInt("parts", pageIdx), byteCounter);
+      tthread::lock_guard<tthread::mutex> guard(loadMutex);
       pageCounter[idx].erase(pageNumber);
       bufferRemove(idx, pageNumber, pageIdx);
+      if (holdFd != -1){close(holdFd);}
       return false;
     }else{
       INFO_MSG("Track %zu, page %" PRIu32 " (" PRETTY_PRINT_MSTIME " - " PRETTY_PRINT_MSTIME ") buffered in %" PRIu64 "ms",
                idx, pageNumber, PRETTY_ARG_MSTIME(tPages.getInt("firsttime", pageIdx)), PRETTY_ARG_MSTIME(thisTime), bufferTimer);
       INFO_MSG("  (%" PRIu32 "/%" PRIu64 " parts, %" PRIu64 " bytes)", packCounter,
                tPages.getInt("parts", pageIdx), byteCounter);
+      tthread::lock_guard<tthread::mutex> guard(loadMutex);
       pageCounter[idx][pageNumber] = Util::bootSecs();
+      if (holdFd != -1){
+        flock(holdFd, LOCK_SH);
+        heldPages[idx][pageNumber] = holdFd;
+      }
+      // Account for the page in the host-wide page cache; it may only appear once the controller runs
+      if (!pageCache){pageCache.reload();}
+      if (pageCache){
+        std::string sharedName = M.getPagePrefix().size() ? M.getDataPageName(idx, pageNumber) : "";
+        cachedPages[idx][pageNumber] =
+            pageCache.addPage(streamName, idx, pageNumber, tPages.getInt("size", pageIdx), sharedName);
+      }
+      // Keep moving averages of the read speed and page sizes, to adapt the read-ahead to
+      uint64_t mediaMs = (stopTime > keyTime) ? stopTime - keyTime : 0;
+      if (mediaMs && byteCounter){
+        double speed = (double)mediaMs / (bufferTimer ? bufferTimer : 1);
+        double bytesPerMs = (double)byteCounter / mediaMs;
+        loadSpeed = (loadSpeed > 0) ? (loadSpeed * 7 + speed) / 8 : speed;
+        loadBytesPerMs = (loadBytesPerMs > 0) ? (loadBytesPerMs * 7 + bytesPerMs) / 8 : bytesPerMs;
+      }
       return true;
     }
   }
 
   bool Input::atKeyFrame(){
     static std::map<size_t, uint64_t> lastSeen;
-    // not in keyTimes? We're not at a keyframe.
-    if (!keyTimes[thisIdx].count(thisTime)){return false;}
+    // Binary search for a key at exactly this time; none? We're not at a keyframe.
+    DTSC::Keys keys(M.keys(thisIdx));
+    size_t lo = keys.getFirstValid();
+    size_t hi = keys.getEndValid();
+    while (lo < hi){
+      size_t mid = lo + (hi - lo) / 2;
+      if (keys.getTime(mid) < thisTime){
+        lo = mid + 1;
+      }else{
+        hi = mid;
+      }
+    }
+    if (lo == keys.getEndValid() || keys.getTime(lo) != thisTime){return false;}
     // skip double times
     if (lastSeen.count(thisIdx) && lastSeen[thisIdx] == thisTime){return false;}
     // set last seen, and return true
@@ -1729,6 +2144,17 @@ namespace Mist{
         }
       }
     }
+    // Try a DTSM memory image next; it loads without parsing anything
+    std::string imageName = config->getString("input") + ".dtsm";
+    struct stat imageStat;
+    if (!stat(imageName.c_str(), &imageStat)){
+      uint64_t timer = Util::getMicros();
+      if (meta.reInitFromImage(config->getBool("realtime") ? "" : streamName, imageName)){
+        headerFromImage = true;
+        INFO_MSG("Read memory image header in %.3f ms", (double)Util::getMicros(timer) / 1000.0);
+        return true;
+      }
+    }
     // Try to read any existing DTSH file
     std::string fileName = config->getString("input") + ".dtsh";
     HIGH_MSG("Loading metadata for stream '%s' from file '%s'", streamName.c_str(), fileName.c_str());
@@ -1,4 +1,5 @@
 #include <cstdlib>
+#include <deque>
 #include <fstream>
 #include <map>
 #include <mist/bitfields.h>
@@ -9,8 +10,10 @@
 #include <mist/json.h>
 #include <mist/shared_memory.h>
 #include <mist/timing.h>
+#include <mist/tinythread.h>
 #include <mist/url.h>
 #include <set>
+#include <vector>
 
 #include "../io.h"
 
@@ -35,6 +38,15 @@ namespace Mist{
     return a.track < b.track || (a.track == b.track && a.key < b.key);
   }
 
+  /// Cached read-ahead window of a single user, only recalculated when the user moves to another key
+  struct readAheadWindow{
+    size_t track;
+    size_t key;
+    uint64_t horizon;
+    uint64_t lastSeen; ///< Number of the serve loop the user was last seen in
+    std::map<size_t, uint64_t> pages; ///< Page record index -> load priority
+  };
+
   class Input : public InOutBase{
   public:
     Input(Util::Config *cfg);
@@ -77,6 +89,7 @@ namespace Mist{
     virtual void parseStreamHeader(){}
     virtual void checkHeaderTimes(const HTTP::URL & streamFile);
     virtual void removeUnused();
+    void removeExpiredSegments();
     virtual void convert();
     virtual void serve();
     virtual void inputServeStats();
@@ -103,11 +116,46 @@ namespace Mist{
 
     JSON::Value capa;
 
-    std::map<size_t, std::set<uint64_t> > keyTimes;
     std::map<trackKey, uint64_t> keyLoadPriority;
 
+    // Asynchronous loading of VoD pages
+    virtual bool asyncPageLoads();
+    uint64_t readAheadMs();
+    void startPageLoader();
+    void stopPageLoader();
+    void pageLoader();
+    static void pageLoaderThread(void *arg);
+    bool onPageLoader();
+    void prefetchPage(size_t idx, uint32_t pageNumber, uint64_t pageIdx);
+    std::map<size_t, readAheadWindow> readAhead; ///< Read-ahead window per user ID
+    uint64_t readAheadLoop;       ///< Serve loop counter, used to expire windows of disconnected users
+    uint64_t readAheadHorizon;    ///< Read-ahead in ms for the current serve loop
+    std::vector<tthread::thread *> loaderThreads;
+    tthread::mutex sourceMutex;   ///< Serializes seek/getNext on the source between loader threads
+    int sourceFd;                 ///< Source file, for prefetching pages in parallel; -1 if not a local file
+    tthread::mutex loadMutex;     ///< Guards pageCounter and all members below
+    tthread::condition_variable loadCond;
+    std::deque<trackKey> loadQueue; ///< Pages to load, most urgent first
+    std::set<trackKey> loadingPages; ///< Track and first key of pages being loaded by loader threads
+    bool loaderRunning;
+    double loadSpeed;             ///< Moving average of media milliseconds loaded per millisecond of reading
+    double loadBytesPerMs;        ///< Moving average of page bytes per media millisecond
+
+    // Host-wide accounting of buffered VoD pages
+    Comms::PageCache pageCache;
+    std::map<size_t, std::map<uint32_t, size_t> > cachedPages; ///< Page cache record per track and page, guarded by loadMutex
+    uint64_t cacheHits; ///< Page cache hits not yet written to the page cache
+    void touchCachedPage(size_t track, uint32_t pageNumber);
+
+    // Data pages shared with other streams backed by the same content
+    std::string sharedPagePrefix();
+    bool attachSharedPage(size_t idx, uint32_t pageNumber, uint64_t pageIdx);
+    void removePage(size_t idx, uint32_t pageNumber);
+    std::map<size_t, std::map<uint32_t, int> > heldPages; ///< Locked descriptor per shared page, guarded by loadMutex
+
     // Create server for user pages
     Comms::Users users;
+    Comms::SegmentCache segmentCache; ///< Muxed output segments of this stream
     size_t connectedUsers;
 
     Encryption::AES aesCipher;
@@ -119,6 +167,7 @@ namespace Mist{
     static Input *singleton;
 
     bool hasSrt;
+    bool headerFromImage; ///< True if the header was loaded from a DTSM memory image
     std::ifstream srtSource;
     unsigned int srtTrack;
 
@@ -13,6 +13,7 @@ namespace Mist{
     capa["priority"] = 0;
     capa["codecs"]["video"].append("H264");
     frameCount = 0;
+    scanPos = 0;
     startTime = Util::bootMS();
     inputProcess = 0;
   }
@@ -48,7 +49,7 @@ namespace Mist{
     }else{
       myConn.open(fileno(stdout), fileno(stdin));
     }
-    myConn.Received().splitter.assign("\000\000\001", 3);
+    scanPos = 0;
     return true;
   }
 
@@ -84,8 +85,18 @@ namespace Mist{
         continue;
       }
       waitsSinceData = 0;
-      uint32_t bytesToRead = myConn.Received().bytesToSplit();
-      if (!bytesToRead){continue;}
+      // Find the next start code, continuing where the previous scan ran out of data
+      Socket::Buffer &buf = myConn.Received();
+      size_t avail = buf.bytes(0xFFFFFFFFul);
+      if (avail < scanPos + 3){continue;}
+      const char *data = buf.peek(avail);
+      const char *code = nalu::scanAnnexB(data + scanPos, avail - scanPos);
+      if (!code){
+        scanPos = avail - 2;
+        continue;
+      }
+      uint32_t bytesToRead = code - data + 3;
+      scanPos = 0;
       std::string NAL = myConn.Received().remove(bytesToRead);
       uint32_t nalSize = NAL.size() - 3;
       while (nalSize && NAL.data()[nalSize - 1] == 0){--nalSize;}
@@ -24,6 +24,7 @@ namespace Mist{
     uint64_t startTime;
     pid_t inputProcess;
     uint32_t waitsSinceData;
+    size_t scanPos; ///< Buffered bytes already searched for a start code
     size_t tNumber;
   };
 }// namespace Mist
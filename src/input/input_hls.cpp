@@ -736,6 +736,7 @@ namespace Mist{
 
     previousSegmentIndex = -1;
     currentIndex = 0;
+    tsStream.setThreaded(false);
 
     capa["name"] = "HLS";
     capa["desc"] = "This input allows you to both play Video on Demand and live HLS streams stored "
@@ -1091,6 +1092,7 @@ namespace Mist{
     // Keep our own variables to make sure buffering live data does not interfere with VoD pages loading
     TS::Packet packet;
     TS::Stream tsStream;
+    tsStream.setThreaded(false);
     char *data;
     size_t dataLen;
     // Get the updated list of entries
@@ -1277,6 +1279,9 @@ namespace Mist{
     }
   }
 
+  /// Live playlists are parsed on the main thread, which must then also do all page loading
+  bool inputHLS::asyncPageLoads(){return !streamIsLive && Input::asyncPageLoads();}
+
   /// \brief Override userLeadOut to buffer new data as live packets
   void inputHLS::userLeadOut(){
     Input::userLeadOut();
@@ -147,6 +147,7 @@ namespace Mist{
 
     // Override userLeadOut to buffer new data as live packets
     void userLeadOut();
+    bool asyncPageLoads();
     // Removes any metadata which is no longer and the playlist or buffered in memory
     void updateMeta();
     /// Tries to add as much live packets from a TS file at the given location
@@ -28,48 +28,146 @@ Util::Config *cfgPointer = NULL;
 #define THREAD_TIMEOUT 15
 std::map<size_t, uint64_t> threadTimer;
 
-std::set<size_t> claimableThreads;
+/// Tracks waiting for a parse thread, with the ring that thread should read from
+std::map<size_t, TS::PacketRing *> claimableThreads;
 
 /// Global, so that all tracks stay in sync
 int64_t timeStampOffset = 0;
 
+/// Hands TS packets from the receiving thread to the parse threads of the data tracks.
+/// Data packets go straight into the ring of their track; the PAT and PMTs are parsed into
+/// liveStream to discover tracks and are copied into every ring, so each parse thread can demux
+/// its own track with a private TS::Stream.
+/// Only ever used from the receiving thread.
+class PacketRouter : public Util::DataCallback{
+public:
+  PacketRouter(){memset(rings, 0, sizeof(rings));}
+
+  virtual void dataCallback(const char *ptr, size_t size){
+    size_t pid = ((ptr[1] & 0x1F) << 8) | (unsigned char)ptr[2];
+    if (rings[pid]){
+      rings[pid]->write(ptr);
+      return;
+    }
+    // Data tracks without a parse thread (yet) are ignored
+    if (liveStream.isDataTrack(pid)){return;}
+    tsBuf.FromPointer(ptr);
+    liveStream.add(tsBuf);
+    liveStream.parse(pid);
+    if (!liveStream.isPSITrack(pid)){return;}
+    tables[pid].assign(ptr, 188);
+    for (std::map<size_t, TS::PacketRing *>::iterator it = active.begin(); it != active.end(); ++it){
+      it->second->write(ptr);
+    }
+  }
+
+  /// Makes all packets routed so far visible to the parse threads.
+  void publish(){
+    for (std::map<size_t, TS::PacketRing *>::iterator it = active.begin(); it != active.end(); ++it){
+      it->second->publish();
+    }
+  }
+
+  /// Starts routing the given track into a new ring, primed with the last known tables.
+  /// A ring still in use by a previous thread for the same track is cut off and deleted once
+  /// that thread lets go of it.
+  TS::PacketRing *attach(size_t pid){
+    if (rings[pid]){retired.insert(rings[pid]);}
+    TS::PacketRing *ring = new TS::PacketRing();
+    for (std::map<size_t, std::string>::iterator it = tables.begin(); it != tables.end(); ++it){
+      ring->write(it->second.data());
+    }
+    ring->publish();
+    rings[pid] = ring;
+    active[pid] = ring;
+    return ring;
+  }
+
+  /// Deletes the rings whose parse threads have shut down.
+  void reap(){
+    std::map<size_t, TS::PacketRing *>::iterator it = active.begin();
+    while (it != active.end()){
+      if (it->second->isClosed()){
+        rings[it->first] = 0;
+        delete it->second;
+        active.erase(it++);
+      }else{
+        ++it;
+      }
+    }
+    std::set<TS::PacketRing *>::iterator rIt = retired.begin();
+    while (rIt != retired.end()){
+      if ((*rIt)->isClosed()){
+        delete *rIt;
+        retired.erase(rIt++);
+      }else{
+        ++rIt;
+      }
+    }
+  }
+
+private:
+  TS::PacketRing *rings[8192];                  ///< Ring of the parse thread for each PID, if any
+  std::map<size_t, TS::PacketRing *> active;    ///< Same rings, by PID
+  std::set<TS::PacketRing *> retired;           ///< Rings cut off from a thread that is still running
+  std::map<size_t, std::string> tables;         ///< Last packet of the PAT and each PMT
+  TS::Packet tsBuf;
+};
+
+PacketRouter router;
+
 void parseThread(void *mistIn){
   uint64_t lastTimeStamp = 0;
   Mist::inputTS *input = reinterpret_cast<Mist::inputTS *>(mistIn);
 
   size_t tid = 0;
+  TS::PacketRing *ring = 0;
   {
     tthread::lock_guard<tthread::mutex> guard(threadClaimMutex);
     if (claimableThreads.size()){
-      tid = *claimableThreads.begin();
+      tid = claimableThreads.begin()->first;
+      ring = claimableThreads.begin()->second;
       claimableThreads.erase(claimableThreads.begin());
     }
   }
   if (tid == 0){return;}
 
+  // This thread is the only one reading this track, so it demuxes without any locking
+  TS::Stream trackStream(liveStream);
+  trackStream.setThreaded(false);
   Comms::Users userConn;
   DTSC::Meta meta;
   DTSC::Packet pack;
-  bool dataTrack = liveStream.isDataTrack(tid);
   size_t idx = INVALID_TRACK_ID;
+  size_t lastDropped = 0;
+  uint64_t lastDropWarn = 0;
   {
     tthread::lock_guard<tthread::mutex> guard(threadClaimMutex);
     threadTimer[tid] = Util::bootSecs();
   }
   while (Util::bootSecs() - threadTimer[tid] < THREAD_TIMEOUT && cfgPointer->is_active &&
-         (!dataTrack || (userConn ? userConn : true))){
-    liveStream.parse(tid);
-    if (!liveStream.hasPacket(tid)){
-      Util::sleep(100);
-      continue;
+         (userConn ? userConn : true)){
+    const char *packets;
+    size_t count = ring->peek(packets);
+    for (size_t i = 0; i < count; ++i){
+      size_t pid = ((packets[1] & 0x1F) << 8) | (unsigned char)packets[2];
+      trackStream.add((char *)packets);
+      if (pid != tid){trackStream.parse(pid);}
+      packets += 188;
     }
-    threadTimer[tid] = Util::bootSecs();
-    //Non-stream tracks simply flush all packets and continue
-    if (!dataTrack){
-      while (liveStream.hasPacket(tid)){liveStream.getPacket(tid, pack);}
+    if (count){ring->consume(count);}
+    if (ring->getDropped() != lastDropped && Util::bootSecs() - lastDropWarn >= 5){
+      WARN_MSG("Track %zu is falling behind: dropped %zu packets, up to %zu/%zu packets waiting", tid,
+               ring->getDropped() - lastDropped, ring->getPeak(), ring->capacity());
+      lastDropped = ring->getDropped();
+      lastDropWarn = Util::bootSecs();
+    }
+    trackStream.parse(tid);
+    if (!trackStream.hasPacket(tid)){
+      if (!count){Util::sleep(10);}
       continue;
     }
-    //If we arrive here, we want the stream data
+    threadTimer[tid] = Util::bootSecs();
     //Make sure the track is valid, loaded, etc
     if (!meta || idx == INVALID_TRACK_ID || !meta.trackValid(idx)){
       {//Only lock the mutex for as long as strictly necessary
@@ -78,6 +176,7 @@ void parseThread(void *mistIn){
         overrides["singular"] = "";
         if (!Util::streamAlive(globalStreamName) && !Util::startInput(globalStreamName, "push://INTERNAL_ONLY:" + cfgPointer->getString("input"), true, true, overrides)){
           FAIL_MSG("Could not start buffer for %s", globalStreamName.c_str());
+          ring->close();
           return;
         }
         if (!input->hasMeta()){input->reloadClientMeta();}
@@ -89,7 +188,7 @@ void parseThread(void *mistIn){
         Util::sleep(100);
         continue;
       }
-      liveStream.initializeMetadata(meta, tid);
+      trackStream.initializeMetadata(meta, tid);
       idx = meta.trackIDToIndex(tid, getpid());
       if (idx != INVALID_TRACK_ID){
         //Successfully assigned a track index! Inform the buffer we're pushing
@@ -101,8 +200,8 @@ void parseThread(void *mistIn){
         continue;
       }
     }
-    while (liveStream.hasPacket(tid)){
-      liveStream.getPacket(tid, pack);
+    while (trackStream.hasPacket(tid)){
+      trackStream.getPacket(tid, pack);
       if (pack){
         char *data;
         size_t dataLen;
@@ -143,17 +242,18 @@ void parseThread(void *mistIn){
   std::string reason = "unknown reason";
   if (!(Util::bootSecs() - threadTimer[tid] < THREAD_TIMEOUT)){reason = "thread timeout";}
   if (!cfgPointer->is_active){reason = "input shutting down";}
-  if (!(!liveStream.isDataTrack(tid) || userConn)){
+  if (!userConn){
     reason = "buffer disconnect";
     cfgPointer->is_active = false;
   }
-  INFO_MSG("Shutting down thread for %zu because %s", tid, reason.c_str());
+  INFO_MSG("Shutting down thread for %zu because %s; %zu packets received, %zu dropped", tid,
+           reason.c_str(), ring->getWritten(), ring->getDropped());
   {
     tthread::lock_guard<tthread::mutex> guard(threadClaimMutex);
     threadTimer.erase(tid);
   }
-  liveStream.eraseTrack(tid);
-  if (dataTrack && userConn){userConn.setStatus(COMM_STATUS_DISCONNECT | userConn.getStatus());}
+  if (userConn){userConn.setStatus(COMM_STATUS_DISCONNECT | userConn.getStatus());}
+  ring->close();
 }
 
 namespace Mist{
@@ -207,6 +307,9 @@ namespace Mist{
     capa["codecs"]["passthrough"].append("rawts");
     inputProcess = 0;
     isFinished = false;
+    // Neither stream is shared between threads: the per-track threads each demux their own copy
+    tsStream.setThreaded(false);
+    liveStream.setThreaded(false);
 
 #ifndef WITH_SRT
     {
@@ -559,6 +662,8 @@ namespace Mist{
     HTTP::URL input_url(config->getString("input"));
     udpCon.setBlocking(false);
     udpCon.bind(input_url.getPort(), input_url.host, input_url.path);
+    // TS packets don't care about datagram boundaries, so let the kernel coalesce them
+    udpCon.enableGRO();
     // This line assures memory for destination address is allocated, so we can fill it during receive later
     udpCon.allocateDestination();
     return (udpCon.getSock() != -1);
@@ -605,11 +710,10 @@ namespace Mist{
               }else {
                 size_t shiftAmount = 0;
                 for (size_t offset = 0; liveReadBuffer.size() >= offset + 188; offset += 188){
-                  tsBuf.FromPointer(liveReadBuffer + offset);
-                  liveStream.add(tsBuf);
-                  if (!liveStream.isDataTrack(tsBuf.getPID())){liveStream.parse(tsBuf.getPID());}
+                  router.dataCallback(liveReadBuffer + offset, 188);
                   shiftAmount += 188;
                 }
+                router.publish();
                 liveReadBuffer.shift(shiftAmount);
               }
             }
@@ -648,7 +752,8 @@ namespace Mist{
               liveReadBuffer.truncate(0);
             }
           }else{
-            assembler.assemble(liveStream, udpCon.data, udpCon.data.size());
+            assembler.assemble(router, udpCon.data, udpCon.data.size());
+            router.publish();
           }
         }
         if (!received){
@@ -683,6 +788,7 @@ namespace Mist{
           statComm.setLastSecond(0);
         }
 
+        router.reap();
         std::set<size_t> activeTracks = liveStream.getActiveTracks();
         if (!rawMode){
           tthread::lock_guard<tthread::mutex> guard(threadClaimMutex);
@@ -705,10 +811,11 @@ namespace Mist{
               threadTimer.erase(*it);
             }
             if (!hasStarted){hasStarted = true;}
-            if (!threadTimer.count(*it)){
+            // Wait for a thread spawned earlier to claim its track before spawning another
+            if (!threadTimer.count(*it) && !claimableThreads.count(*it)){
 
-              // Add to list of unclaimed threads
-              claimableThreads.insert(*it);
+              // Add to list of unclaimed threads, and start routing its packets
+              claimableThreads[*it] = router.attach(*it);
 
               // Spawn thread here.
               tthread::thread thisThread(parseThread, this);
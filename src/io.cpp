@@ -9,10 +9,30 @@
 #include <mist/stream.h>
 #include <mist/h264.h>
 #include <mist/config.h>
+#include <mist/tinythread.h>
 
 namespace Mist{
   InOutBase::InOutBase() : M(meta){}
 
+  /// Adds the huge page counters of the data pages created since the previous call to the
+  /// host-wide totals, so they show up in the controller's page cache statistics.
+  static void publishHugePageStats(){
+    static tthread::mutex publishMutex;
+    static IPC::hugePageCounters published = {0, 0, 0, 0};
+    static Comms::PageCache hostTotals;
+    tthread::lock_guard<tthread::mutex> guard(publishMutex);
+    if (IPC::hugePageStats.requested == published.requested){return;}
+    if (!hostTotals){hostTotals.reload();}
+    if (!hostTotals){return;}
+    IPC::hugePageCounters delta;
+    delta.requested = IPC::hugePageStats.requested - published.requested;
+    delta.hugetlb = IPC::hugePageStats.hugetlb - published.hugetlb;
+    delta.thp = IPC::hugePageStats.thp - published.thp;
+    delta.fallback = IPC::hugePageStats.fallback - published.fallback;
+    hostTotals.addHugePages(delta);
+    published = IPC::hugePageStats;
+  }
+
   /// Returns the ID of the main selected track, or 0 if no tracks are selected.
   /// The main track is the first video track, if any, and otherwise the first other track.
   /// Returns INVALID_TRACK_ID if there are no valid selected tracks.
@@ -86,16 +106,25 @@ namespace Mist{
     }
 
     // Open the correct page for the data
-    char pageId[NAME_BUFFER_SIZE];
-    snprintf(pageId, NAME_BUFFER_SIZE, SHM_TRACK_DATA, streamName.c_str(), idx, pageNumber);
+    std::string pageName = aMeta.getDataPageName(idx, pageNumber);
     uint64_t pageSize = tPages.getInt("size", pageIdx);
-    std::string pageName(pageId);
-    page.init(pageName, pageSize, true);
+    if (aMeta.getPagePrefix().size()){
+      // Pages shared between streams are created exclusively locked, so other streams wait for them
+      // to complete. The lock stays on page.handle; one held elsewhere means someone else loads it.
+      if (!page.initLocked(pageName, pageSize)){
+        publishHugePageStats();
+        INFO_MSG("Page %s is being loaded for another stream", pageName.c_str());
+        return false;
+      }
+    }else{
+      page.init(pageName, pageSize, true);
+    }
 
     if (!page){
-      ERROR_MSG("Could not open page %s", pageId);
+      ERROR_MSG("Could not open page %s", pageName.c_str());
       return false;
     }
+    publishHugePageStats();
 
     // Make sure the data page is not destroyed when we are done buffering it later on.
     page.master = false;
@@ -157,9 +186,7 @@ namespace Mist{
     tPages.setInt("avail", 0, pageIdx);
 
     // Open the correct page
-    char pageId[NAME_BUFFER_SIZE];
-    snprintf(pageId, NAME_BUFFER_SIZE, SHM_TRACK_DATA, streamName.c_str(), idx, pageNumber);
-    std::string pageName(pageId);
+    std::string pageName = meta.getDataPageName(idx, pageNumber);
     IPC::sharedPage toErase;
 #ifdef __CYGWIN__
     toErase.init(pageName, 26 * 1024 * 1024, false, false);
@@ -321,6 +348,8 @@ namespace Mist{
 
     DONTEVEN_MSG("Setting page %" PRIu32 " available to %" PRIu64, pageIdx, pageOffset + packDataLen);
     tPages.setInt("avail", pageOffset + packDataLen, pageIdx);
+    // Wake up outputs waiting for this page to become available, or for a new key to appear
+    if (!pageOffset || isKeyframe){aMeta.signalPageReady();}
   }
 
   /// Wraps up the buffering of a shared memory data page
@@ -328,6 +357,7 @@ namespace Mist{
   void InOutBase::liveFinalize(size_t idx){
     if (!livePage.count(idx)){return;}
     livePage[idx].close();
+    meta.signalPageReady();
   }
 
   /// Buffers a live packet to a page.
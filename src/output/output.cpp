@@ -31,6 +31,13 @@
 /*LTS-END*/
 
 namespace Mist{
+  /// Target parameters that apply to the whole output rather than one target's connection
+  static const char *fanOutParams[] ={"audio", "video", "subtitle", "meta", "tracks", "rate", "realtime",
+                                      "start", "stop", "startunix", "stopunix", "unixstart", "unixstop",
+                                      "duration", "recstart", "recstop", "recstartunix", "recstopunix",
+                                      "split", "pushdelay", "unmask", "passthrough", "waittrackcount",
+                                      "maxwaittrackms", 0};
+
   JSON::Value Output::capa = JSON::Value();
   Util::Config *Output::config = NULL;
 
@@ -38,6 +45,24 @@ namespace Mist{
 
   uint64_t getDTSCTime(char *mapped, uint64_t offset){return Bit::btohll(mapped + offset + 12);}
 
+  PushTargetStats::PushTargetStats(const std::string &tgt){
+    target = tgt.substr(0, tgt.rfind('?'));
+    bytes = 0;
+    dropped = 0;
+    reconnects = 0;
+    active = false;
+    stopped = false;
+  }
+
+  void PushTargetStats::fillStatus(JSON::Value &status) const{
+    status["target"] = target;
+    status["bytes"] = bytes;
+    status["dropped"] = dropped;
+    status["reconnects"] = reconnects;
+    status["active"] = active;
+    status["stopped"] = stopped;
+  }
+
   void Output::init(Util::Config *cfg){
     capa["optional"]["debug"]["name"] = "debug";
     capa["optional"]["debug"]["help"] = "The debug level at which messages need to be printed.";
@@ -137,7 +162,42 @@ namespace Mist{
 
     /*LTS-START*/
     // If we have a target, scan for trailing ?, remove it, parse into targetParams
-    if (config->hasOption("target")){
+    // Fan-out targets keep their own parameters; those that apply to the whole output (track
+    // selection, timing) go in targetParams, and must be the same for every target.
+    if (config->hasOption("target") && capa["push_fanout"].asBool()){
+      std::deque<std::string> tgts = Util::getPushTargets(config->getString("target"));
+      if (tgts.size() > 1){
+        pushTargets = tgts;
+        std::string conflict;
+        for (std::deque<std::string>::iterator it = pushTargets.begin(); it != pushTargets.end(); ++it){
+          std::map<std::string, std::string> params;
+          if (it->rfind('?') != std::string::npos){HTTP::parseVars(it->substr(it->rfind('?') + 1), params);}
+          for (size_t i = 0; fanOutParams[i]; ++i){
+            std::string val = params.count(fanOutParams[i]) ? params[fanOutParams[i]] : "";
+            if (it == pushTargets.begin()){
+              if (val.size()){targetParams[fanOutParams[i]] = val;}
+            }else if ((targetParams.count(fanOutParams[i]) ? targetParams[fanOutParams[i]] : "") != val){
+              conflict = fanOutParams[i];
+            }
+          }
+        }
+        if (conflict.size()){
+          FAIL_MSG("Fan-out targets have different values for the '%s' parameter; it must be the same for all targets", conflict.c_str());
+          onFail("Fan-out targets have conflicting parameters", true);
+          config->is_active = false;
+          pushTargets.clear();
+          targetParams.clear();
+          return;
+        }
+        INFO_MSG("Fanning out to %zu targets", pushTargets.size());
+        // The controller stops single targets by setting their byte in this page
+        char pageName[NAME_BUFFER_SIZE];
+        snprintf(pageName, NAME_BUFFER_SIZE, SHM_PUSH_TARGETS, (uint32_t)getpid());
+        pushCtl.init(pageName, SHM_PUSH_TARGETS_LEN, true);
+        if (pushCtl){memset(pushCtl.mapped, 0, SHM_PUSH_TARGETS_LEN);}
+      }
+    }
+    if (config->hasOption("target") && !pushTargets.size()){
       std::string tgt = config->getString("target");
       if (tgt.rfind('?') != std::string::npos){
         INFO_MSG("Stripping target options: %s", tgt.substr(tgt.rfind('?') + 1).c_str());
@@ -360,12 +420,14 @@ namespace Mist{
     //live streams that are no push outputs (recordings), wait for stream to be ready
     if (!isRecording() && M.getLive() && !isReadyForPlay()){
       uint64_t waitUntil = Util::bootSecs() + 45;
+      uint32_t pageSignal = M.getPageSignal();
       while (M.getLive() && !isReadyForPlay()){
         if (Util::bootSecs() > waitUntil || (!userSelect.size() && Util::bootSecs() > waitUntil)){
           INFO_MSG("Giving up waiting for playable tracks. IP: %s", getConnectedHost().c_str());
           break;
         }
-        Util::wait(500);
+        M.waitPageSignal(pageSignal, 500);
+        pageSignal = M.getPageSignal();
         meta.reloadReplacedPagesIfNeeded();
         stats();
       }
@@ -658,13 +720,16 @@ namespace Mist{
     }
     uint64_t micros = Util::getMicros();
     VERYHIGH_MSG("Loading track %zu, containing key %zu", trackId, keyNum);
-    uint32_t timeout = 0;
+    uint64_t timeout = 0;
+    uint32_t pageSignal = M.getPageSignal();
     uint32_t pageNum = pageNumForKey(trackId, keyNum);
     while (keepGoing() && pageNum == INVALID_KEY_NUM){
-      if (!timeout){HIGH_MSG("Requesting page with key %zu:%zu", trackId, keyNum);}
-      ++timeout;
+      if (!timeout){
+        HIGH_MSG("Requesting page with key %zu:%zu", trackId, keyNum);
+        timeout = Util::bootMS() + 15000;
+      }
       //Time out after 15 seconds
-      if (timeout > 300){
+      if (Util::bootMS() > timeout){
         FAIL_MSG("Timeout while waiting for requested key %zu for track %zu. Aborting.", keyNum, trackId);
         curPage.erase(trackId);
         currentPage.erase(trackId);
@@ -677,7 +742,8 @@ namespace Mist{
       }
 
       stats(true);
-      playbackSleep(50);
+      pageSignalSleep(pageSignal, 50);
+      pageSignal = M.getPageSignal();
       meta.reloadReplacedPagesIfNeeded();
       pageNum = pageNumForKey(trackId, keyNum);
     }
@@ -698,8 +764,7 @@ namespace Mist{
     if (currentPage.count(trackId) && currentPage[trackId] == pageNum){return;}
     // If we're loading the track thisPacket is on, null it to prevent accesses.
     if (thisPacket && thisIdx == trackId){thisPacket.null();}
-    char id[NAME_BUFFER_SIZE];
-    snprintf(id, NAME_BUFFER_SIZE, SHM_TRACK_DATA, streamName.c_str(), trackId, pageNum);
+    std::string id = M.getDataPageName(trackId, pageNum);
     curPage[trackId].init(id, DEFAULT_DATA_PAGE_SIZE);
     if (!(curPage[trackId].mapped)){
       FAIL_MSG("Initializing page %s failed", curPage[trackId].name.c_str());
@@ -709,9 +774,9 @@ namespace Mist{
     currentPage[trackId] = pageNum;
     micros = Util::getMicros(micros);
     if (micros > 2000000){
-      INFO_MSG("Page %s loaded for %s in %.2fms", id, streamName.c_str(), micros/1000.0);
+      INFO_MSG("Page %s loaded for %s in %.2fms", id.c_str(), streamName.c_str(), micros/1000.0);
     }else{
-      VERYHIGH_MSG("Page %s loaded for %s in %.2fms", id, streamName.c_str(), micros/1000.0);
+      VERYHIGH_MSG("Page %s loaded for %s in %.2fms", id.c_str(), streamName.c_str(), micros/1000.0);
     }
   }
 
@@ -1380,6 +1445,16 @@ namespace Mist{
     Util::wait(millis);
   }
 
+  /// Like playbackSleep, but returns early as soon as the input signals a new data page or key
+  /// (see DTSC::Meta::signalPageReady) after getPageSignal returned lastSignal.
+  void Output::pageSignalSleep(uint32_t lastSignal, uint64_t millis){
+    uint64_t start = Util::bootMS();
+    M.waitPageSignal(lastSignal, millis);
+    if (realTime && M.getLive() && buffer.getSyncMode()){
+      firstTime += Util::bootMS() - start;
+    }
+  }
+
   /// Called right before sendNext(). Should return true if this is a stopping point.
   bool Output::reachedPlannedStop(){
     // If we're recording to file and reached the target position, stop
@@ -2272,6 +2347,15 @@ namespace Mist{
     if (now <= lastStats && !force){return;}
 
     if (isRecording()){
+      // Fan-out targets stopped through the API
+      if (pushCtl){
+        for (size_t i = 0; i < pushTargets.size() && i < SHM_PUSH_TARGETS_LEN; ++i){
+          if (pushCtl.mapped[i] != 1){continue;}
+          pushCtl.mapped[i] = 2;
+          INFO_MSG("Stopping push to %s", pushTargets[i].c_str());
+          stopTarget(i);
+        }
+      }
       if(lastPushUpdate == 0){
         lastPushUpdate = now;
       }
@@ -2285,6 +2369,11 @@ namespace Mist{
           pData["tracks"].append((uint64_t)it->first);
         }
         pData["bytes"] = statComm.getUp();
+        if (pushTargets.size()){
+          JSON::Value tgts;
+          fanOutStatus(tgts);
+          if (tgts.size()){pData["targets"] = tgts;}
+        }
         uint64_t pktCntNow = statComm.getPacketCount();
         if (pktCntNow){
           uint64_t pktLosNow = statComm.getPacketLostCount();
@@ -1,6 +1,7 @@
 #pragma once
 #include "../io.h"
 #include <cstdlib>
+#include <deque>
 #include <map>
 #include <mist/comms.h>
 #include <mist/config.h>
@@ -16,6 +17,18 @@
 
 namespace Mist{
 
+  /// Delivery statistics for a single target of a fan-out push, as reported to the controller.
+  struct PushTargetStats{
+    PushTargetStats(const std::string &tgt = "");
+    void fillStatus(JSON::Value &status) const;
+    std::string target;  ///< Target URL, without parameters.
+    uint64_t bytes;      ///< Bytes sent to this target.
+    uint64_t dropped;    ///< Packets that could not be delivered to this target.
+    uint64_t reconnects; ///< Times the connection to this target was re-established.
+    bool active;         ///< True while this target accepts data.
+    bool stopped;        ///< True once this target was stopped through the API.
+  };
+
   /// The output class is intended to be inherited by MistOut process classes.
   /// It contains all generic code and logic, while the child classes implement
   /// anything specific to particular protocols or containers.
@@ -72,6 +85,7 @@ namespace Mist{
     virtual void requestHandler();
     static Util::Config *config;
     void playbackSleep(uint64_t millis);
+    void pageSignalSleep(uint32_t lastSignal, uint64_t millis);
 
     void selectAllTracks();
 
@@ -114,6 +128,7 @@ namespace Mist{
     }///< True if the output is capable of restarting mid-stream. This is used for swapping recording files
     bool pushing;
     std::map<std::string, std::string> targetParams; /*LTS*/
+    std::deque<std::string> pushTargets; ///< Targets of a fan-out push, each with its own parameters. Empty otherwise.
     std::string UA;                                  ///< User Agent string, if known.
     uint64_t uaDelay;                                ///< Seconds to wait before setting the UA.
     uint64_t lastRecv;
@@ -124,6 +139,11 @@ namespace Mist{
     virtual std::string getStatsName();
 
     virtual void connStats(uint64_t now, Comms::Connections &statComm);
+    /// Called for fan-out pushes; should append a status object per target to the given array.
+    virtual void fanOutStatus(JSON::Value &targets){}
+    /// Called for fan-out pushes when the target with the given index must no longer be sent to.
+    virtual void stopTarget(size_t idx){}
+    IPC::sharedPage pushCtl; ///< Per-target stop flags of a fan-out push, set by the controller
 
     std::set<size_t> getSupportedTracks(const std::string &type = "") const;
 
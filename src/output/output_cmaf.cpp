@@ -449,8 +449,14 @@ namespace Mist{
     Bit::htobl(mdatHeader, mdatSize);
 
     H.StartResponse(H, myConn, config->getBool("nonchunked"));
-    H.Chunkify(headerData.c_str(), headerData.size(), myConn);
-    H.Chunkify(mdatHeader, 8, myConn);
+    // Fully buffered segments are muxed once and shared with all viewers requesting the same one
+    if (!M.getLive() || M.getLastms(idx) >= targetTime){
+      std::stringstream segId;
+      segId << "cmaf_" << idx << "_" << mTrack << "/" << fragmentIndex << "_" << startTime << "_" << targetTime;
+      if (serveCachedSegment(segId.str(), startTime, targetTime, headerData.size() + mdatSize)){return;}
+    }
+    sendSegmentData(headerData.data(), headerData.size());
+    sendSegmentData(mdatHeader, 8);
 
     seek(startTime);
 
@@ -467,13 +473,14 @@ namespace Mist{
       HIGH_MSG("Finished playback to %" PRIu64, targetTime);
       wantRequest = true;
       parseData = false;
+      finishCachedSegment(true);
       H.Chunkify("", 0, myConn);
       return;
     }
     char *data;
     size_t dataLen;
     thisPacket.getString("data", data, dataLen);
-    H.Chunkify(data, dataLen, myConn);
+    sendSegmentData(data, dataLen);
   }
 
   /***************************************************************************************************/
@@ -159,8 +159,9 @@ namespace Mist{
   }
 
   void OutDTSC::onRequest(){
-    while (myConn.Received().available(8)){
-      if (myConn.Received().copy(4) == "DTCM"){
+    Socket::Buffer &buf = myConn.Received();
+    while (buf.available(8)){
+      if (!memcmp(buf.peek(8), "DTCM", 4)){
         // Command message
         std::string toRec = myConn.Received().copy(8);
         unsigned long rSize = Bit::btohl(toRec.c_str() + 4);
@@ -226,7 +227,7 @@ namespace Mist{
           continue;
         }
         WARN_MSG("Unhandled DTCM command: '%s'", dScan.getMember("cmd").asString().c_str());
-      }else if (myConn.Received().copy(4) == "DTSC"){
+      }else if (!memcmp(buf.peek(8), "DTSC", 4)){
         // Header packet
         if (!isPushing()){
           onFail("DTSC_HEAD ignored: you are not cleared for pushing data!", true);
@@ -270,20 +271,19 @@ namespace Mist{
         std::stringstream rep;
         rep << "DTSC_HEAD parsed, we went from " << prevTracks << " to " << meta.getValidTracks().size() << " tracks. Bring on those data packets!";
         sendOk(rep.str());
-      }else if (myConn.Received().copy(4) == "DTP2"){
+      }else if (!memcmp(buf.peek(8), "DTP2", 4)){
         if (!isPushing()){
           onFail("DTSC_V2 ignored: you are not cleared for pushing data!", true);
           return;
         }
-        // Data packet
-        std::string toRec = myConn.Received().copy(8);
-        unsigned long rSize = Bit::btohl(toRec.c_str() + 4);
-        if (!myConn.Received().available(8 + rSize)){return;}// abort - not enough data yet
-        std::string dataPacket = myConn.Received().remove(8 + rSize);
-        DTSC::Packet inPack(dataPacket.data(), dataPacket.size(), true);
+        // Data packet, parsed in place in the socket buffer
+        unsigned long rSize = Bit::btohl(buf.peek(8) + 4);
+        if (!buf.available(8 + rSize)){return;}// abort - not enough data yet
+        DTSC::Packet inPack(buf.peek(8 + rSize), 8 + rSize, true);
         size_t tid = M.trackIDToIndex(inPack.getTrackId(), getpid());
         if (tid == INVALID_TRACK_ID){
           //WARN_MSG("Received data for unknown track: %zu", inPack.getTrackId());
+          buf.consume(8 + rSize);
           onFail("DTSC_V2 received for a track that was not announced in a header!", true);
           return;
         }
@@ -294,6 +294,7 @@ namespace Mist{
         size_t dataLen;
         inPack.getString("data", data, dataLen);
         bufferLivePacket(inPack.getTime(), inPack.getInt("offset"), tid, data, dataLen, inPack.getInt("bpos"), inPack.getFlag("keyframe"));
+        buf.consume(8 + rSize);
       }else{
         // Invalid
         onFail("Invalid packet header received. Aborting.", true);
@@ -176,8 +176,7 @@ namespace Mist{
       EBML::sendElemUInt(myConn, EBML::EID_TIMECODE, currentClusterTime);
     }
 
-    DTSC::Packet p(thisPacket, thisIdx + 1);
-    EBML::sendSimpleBlock(myConn, p, currentClusterTime, M.getType(thisIdx) != "video");
+    EBML::sendSimpleBlock(myConn, thisPacket, currentClusterTime, M.getType(thisIdx) != "video", thisIdx + 1);
   }
 
   std::string OutEBML::trackCodecID(size_t idx){
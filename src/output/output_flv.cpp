@@ -77,8 +77,8 @@ namespace Mist{
         }
       }
     }
-    tag.DTSCLoader(thisPacket, M, thisIdx);
     if (M.getCodec(thisIdx) == "PCM" && M.getSize(thisIdx) == 16){
+      tag.DTSCLoader(thisPacket, M, thisIdx);
       char *ptr = tag.getData();
       uint32_t ptrSize = tag.getDataLen();
       for (uint32_t i = 0; i < ptrSize; i += 2){
@@ -86,8 +86,21 @@ namespace Mist{
         ptr[i] = ptr[i + 1];
         ptr[i + 1] = tmpchar;
       }
+      myConn.SendNow(tag.data, tag.len);
+    }else if (tag.DTSCLoader(thisPacket, M, thisIdx, true)){
+      // Send the tag header and trailer around the packet data, straight from the data page
+      char *dataPointer = 0;
+      size_t dataLen = 0;
+      thisPacket.getString("data", dataPointer, dataLen);
+      struct iovec vec[3];
+      vec[0].iov_base = tag.data;
+      vec[0].iov_len = tag.len - 4 - dataLen;
+      vec[1].iov_base = dataPointer;
+      vec[1].iov_len = dataLen;
+      vec[2].iov_base = tag.data + tag.len - 4;
+      vec[2].iov_len = 4;
+      myConn.SendNow(vec, 3);
     }
-    myConn.SendNow(tag.data, tag.len);
     if (config->getBool("keyframeonly")){config->is_active = false;}
   }
 
@@ -142,8 +155,13 @@ namespace Mist{
   void OutFLV::onHTTP(){
     std::string method = H.method;
 
+    const HTTP::Parser req = H;
     H.Clean();
     H.setCORSHeaders();
+    H.SetHeader("Content-Type", "video/x-flv");
+    if (!config->getBool("keyframeonly") && passthroughFile(req, method == "OPTIONS" || method == "HEAD", ".flv")){
+      return;
+    }
     if (method == "OPTIONS" || method == "HEAD"){
       H.SetHeader("Content-Type", "video/x-flv");
       H.protocol = "HTTP/1.0";
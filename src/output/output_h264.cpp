@@ -312,7 +312,7 @@ namespace Mist{
 
   bool OutH264::onFinish() {
     if (!webSock){
-      H.Chunkify(0, 0, myConn);
+      H.Chunkify("", 0, myConn);
       wantRequest = true;
       return true;
     }
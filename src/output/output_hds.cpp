@@ -188,8 +188,8 @@ namespace Mist{
       H.Chunkify("", 0, myConn);
       return;
     }
-    tag.DTSCLoader(thisPacket, M, thisIdx);
     if (M.getCodec(thisIdx) == "PCM" && M.getSize(thisIdx) == 16){
+      tag.DTSCLoader(thisPacket, M, thisIdx);
       char *ptr = tag.getData();
       uint32_t ptrSize = tag.getDataLen();
       for (uint32_t i = 0; i < ptrSize; i += 2){
@@ -197,8 +197,20 @@ namespace Mist{
         ptr[i] = ptr[i + 1];
         ptr[i + 1] = tmpchar;
       }
+      if (tag.len){H.Chunkify(tag.data, tag.len, myConn);}
+    }else if (tag.DTSCLoader(thisPacket, M, thisIdx, true)){
+      char *dataPointer = 0;
+      size_t dataLen = 0;
+      thisPacket.getString("data", dataPointer, dataLen);
+      struct iovec vec[3];
+      vec[0].iov_base = tag.data;
+      vec[0].iov_len = tag.len - 4 - dataLen;
+      vec[1].iov_base = dataPointer;
+      vec[1].iov_len = dataLen;
+      vec[2].iov_base = tag.data + tag.len - 4;
+      vec[2].iov_len = 4;
+      H.Chunkify(vec, 3, myConn);
     }
-    if (tag.len){H.Chunkify(tag.data, tag.len, myConn);}
   }
 
   void OutHDS::onHTTP(){
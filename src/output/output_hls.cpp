@@ -167,6 +167,8 @@ namespace Mist{
 
   OutHLS::OutHLS(Socket::Connection &conn) : TSOutput(conn){
     uaDelay = 0;
+    tsFlushSize = TS_FLUSH_SIZE;
+    tsBatchLive = true; // Segments are only listed once complete, so batching adds no latency
     realTime = 0;
     until = 0xFFFFFFFFFFFFFFFFull;
     // If this connection is a socket and not already connected to stdio, connect it to stdio.
@@ -372,12 +374,27 @@ namespace Mist{
 
       H.StartResponse(H, myConn, VLCworkaround || config->getBool("nonchunked"));
       responded = true;
+      // Fully buffered segments are muxed once and shared with all viewers of this selection
+      uint64_t segmentBound = segmentSizeBound(from, until);
+      if (segmentBound){
+        std::stringstream segId;
+        segId << "hls";
+        for (std::map<size_t, Comms::Users>::iterator it = userSelect.begin(); it != userSelect.end(); ++it){
+          segId << "_" << it->first;
+        }
+        segId << "/" << from << "_" << until;
+        if (serveCachedSegment(segId.str(), from, until, segmentBound)){
+          H.Clean();
+          return;
+        }
+      }
       // we assume whole fragments - but timestamps may be altered at will
       uint32_t fragIndice = M.getFragmentIndexForTime(vidTrack, from);
       contPAT = fragIndice; // PAT continuity counter
       contPMT = fragIndice; // PMT continuity counter
       contSDT = fragIndice; // SDT continuity counter
       packCounter = 0;
+      tsBuffer.truncate(0);
       parseData = true;
       wantRequest = false;
       seek(from);
@@ -433,11 +450,13 @@ namespace Mist{
           packData.addStuffing();
           while (it->second % 16 != 0){
             packData.setContinuityCounter(++it->second);
-            sendTS(packData.checkAndGetBuffer());
+            bufferTS(packData.checkAndGetBuffer());
           }
           packData.clear();
         }
       }
+      flushTS();
+      finishCachedSegment(true);
 
       // Signal end of data
       H.Chunkify("", 0, myConn);
@@ -448,7 +467,27 @@ namespace Mist{
     TSOutput::sendNext();
   }
 
-  void OutHLS::sendTS(const char *tsData, size_t len){H.Chunkify(tsData, len, myConn);}
+  void OutHLS::sendTS(const char *tsData, size_t len){
+    sendSegmentData(tsData, len);
+  }
+
+  /// Returns the largest size the TS segment for the selected tracks from `from` to `until` can
+  /// have, or zero if the segment is not fully buffered yet.
+  uint64_t OutHLS::segmentSizeBound(uint64_t from, uint64_t until){
+    uint64_t res = 64 * 1024; // PAT/PMT/SDT and continuity counter alignment
+    for (std::map<size_t, Comms::Users>::iterator it = userSelect.begin(); it != userSelect.end(); ++it){
+      size_t idx = it->first;
+      if (M.getLive() && M.getLastms(idx) < until){return 0;}
+      DTSC::Parts parts(M.parts(idx));
+      size_t firstPart = M.getPartIndex(from, idx);
+      size_t endPart = M.getPartIndex(until, idx);
+      uint64_t payload = 0;
+      for (size_t i = firstPart; i < endPart; ++i){payload += parts.getSize(i);}
+      // Every frame may add PES headers, init data and a stuffed packet to the 188/184 packetization
+      res += payload * 188 / 184 + (endPart - firstPart + 1) * (188 + 256 + M.getInit(idx).size());
+    }
+    return res;
+  }
 
   void OutHLS::onFail(const std::string &msg, bool critical){
     if (HTTP::URL(H.url).getExt().substr(0, 3) != "m3u"){
@@ -19,6 +19,7 @@ namespace Mist{
     std::string h265init(const std::string &initData);
     std::string liveIndex();
     std::string liveIndex(size_t tid, const std::string &sessId, const std::string &urlPrefix = "");
+    uint64_t segmentSizeBound(uint64_t from, uint64_t until);
 
     size_t vidTrack;
     size_t audTrack;
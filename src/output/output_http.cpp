@@ -1,10 +1,15 @@
 #include "output_http.h"
+#include <mist/auth.h>
 #include <mist/checksum.h>
 #include <mist/encode.h>
+#include <mist/flv_tag.h>
 #include <mist/langcodes.h>
+#include <mist/mp4.h>
 #include <mist/stream.h>
+#include <mist/ts_packet.h>
 #include <mist/util.h>
 #include <mist/url.h>
+#include <fcntl.h>
 #include <set>
 #include <sys/stat.h>
 
@@ -17,6 +22,8 @@ namespace Mist{
     target_rate = 0.0;
     forwardTo = 0;
     prevVidTrack = INVALID_TRACK_ID;
+    segmentSlot = INVALID_RECORD_INDEX;
+    segmentSkip = 0;
 
     //General
     idleInterval = 0;
@@ -29,6 +36,7 @@ namespace Mist{
   }
 
   HTTPOutput::~HTTPOutput(){
+    finishCachedSegment(false);
     if (webSock){
       delete webSock;
       webSock = 0;
@@ -187,10 +195,98 @@ namespace Mist{
     return "";
   }
 
+  /// Serves a segment from the shared segment cache, if possible. Must be called after the
+  /// response headers are sent. The id must uniquely describe the segment contents (format,
+  /// tracks and time range); capacity is the largest size the muxed segment can have.
+  /// Returns true if the response body was sent from the cache. Returns false if the caller must
+  /// mux the segment itself and send it through sendSegmentData; if this output is the first to
+  /// request it, that data is then shared until finishCachedSegment is called.
+  /// If the producer of a segment that is partially sent already abandons it, another producer is
+  /// looked for (or this output becomes the producer), and sending resumes where it left off.
+  bool HTTPOutput::serveCachedSegment(const std::string &id, uint64_t from, uint64_t until, uint64_t capacity){
+    finishCachedSegment(false);
+    segmentSkip = 0;
+    if (!segmentCache){segmentCache.reload(streamName);}
+    std::string key = Secure::md5(streamName + "/" + id).substr(0, 16);
+    uint64_t sent = 0;
+    while (keepGoing()){
+      IPC::sharedPage page;
+      int res = segmentCache.open(key, from, until, capacity, page, segmentSlot);
+      if (res == SEGMENT_MISS){
+        segmentPage = page;
+        // Segments any cache may store are also served by URL from the MistOutHTTP event loop,
+        // which accounts those viewers to this connector
+        const std::string &cacheCtl = H.GetHeader("Cache-Control");
+        if (cacheCtl.substr(0, 6) == "public"){
+          segmentCache.setPublic(segmentSlot, reqPath, H.GetHeader("Content-Type"), cacheCtl, getStatsName());
+        }
+      }
+      if (res != SEGMENT_HIT){
+        // Muxing always produces the same bytes for the same segment, so skip what was already sent
+        segmentSkip = sent;
+        return false;
+      }
+      HIGH_MSG("Serving segment %s from cache, from byte %" PRIu64, id.c_str(), sent);
+      while (keepGoing()){
+        uint32_t signal = Comms::SegmentCache::getSignal(page);
+        uint64_t avail = Comms::SegmentCache::available(page);
+        if (avail > sent){
+          H.Chunkify(page.mapped + SEGMENT_HEADER_SIZE + sent, avail - sent, myConn);
+          sent = avail;
+          continue;
+        }
+        uint8_t state = Comms::SegmentCache::state(page);
+        if (state == SEGMENT_COMPLETE){
+          if (Comms::SegmentCache::available(page) > sent){continue;}
+          H.Chunkify("", 0, myConn);
+          return true;
+        }
+        if (state == SEGMENT_ABORTED){
+          if (sent){INFO_MSG("Cached segment %s was abandoned by its producer after %" PRIu64 " bytes", id.c_str(), sent);}
+          break;
+        }
+        // Sleep until the producer appends data or finishes; the timeout notices producers that died
+        Comms::SegmentCache::waitSignal(page, signal, 500);
+        stats();
+      }
+    }
+    return true;
+  }
+
+  /// Sends segment data muxed by this output and adds it to the segment cache, if this output is
+  /// producing it. Bytes that were already sent from an abandoned cached copy are not sent again.
+  void HTTPOutput::sendSegmentData(const char *data, size_t len){
+    if (segmentSkip < len){
+      H.Chunkify(data + segmentSkip, len - segmentSkip, myConn);
+      segmentSkip = 0;
+    }else{
+      segmentSkip -= len;
+    }
+    cacheSegmentData(data, len);
+  }
+
+  /// Adds data to the segment this output is producing for the shared segment cache, if any.
+  void HTTPOutput::cacheSegmentData(const char *data, size_t len){
+    if (!segmentPage.mapped){return;}
+    if (!Comms::SegmentCache::append(segmentPage, data, len)){
+      WARN_MSG("Segment does not fit in its cache page; no longer caching it");
+      finishCachedSegment(false);
+    }
+  }
+
+  /// Ends production of the segment this output is producing for the shared segment cache, if
+  /// any. Incomplete segments are removed from the cache.
+  void HTTPOutput::finishCachedSegment(bool complete){
+    if (!segmentPage.mapped){return;}
+    segmentCache.finish(segmentPage, segmentSlot, complete);
+  }
+
   bool HTTPOutput::onFinish(){
+    // A segment is complete if we ran out of data while still connected
+    finishCachedSegment(keepGoing());
     //If we're in the middle of sending a chunked reply, finish it cleanly and get read for the next request
     if (!webSock && H.sendingChunks){
-      H.Chunkify(0, 0, myConn);
+      H.Chunkify("", 0, myConn);
       wantRequest = true;
       return true;
     }
@@ -342,6 +438,7 @@ namespace Mist{
         reqUrl = qUrl.getUrl();
       }
       /*LTS-END*/
+      reqPath = H.url;
       if (H.hasHeader("User-Agent")){UA = H.GetHeader("User-Agent");}
 
       if (H.GetVar("audio") != ""){targetParams["audio"] = H.GetVar("audio");}
@@ -1001,72 +1098,91 @@ namespace Mist{
   }
   /*LTS-END*/
 
-  /// Parses a "Range: " header, setting byteStart and byteEnd.
-  /// Assumes byteStart and byteEnd are initialized to their minimum respectively maximum values
-  /// when the function is called. On error, byteEnd is set to zero and the function return false.
+  /// Parses a "Range: " header, setting byteStart and byteEnd. See HTTP::parseRange.
   bool HTTPOutput::parseRange(std::string header, uint64_t &byteStart, uint64_t &byteEnd){
-    if (header.size() < 6 || header.substr(0, 6) != "bytes="){
-      byteEnd = 0;
-      WARN_MSG("Invalid range header: %s", header.c_str());
+    return HTTP::parseRange(header, byteStart, byteEnd);
+  }
+
+  /// Sends the source file of a VoD stream as-is, if it already is in the container this output
+  /// produces and the request wants all of it: every track, no start or stop times.
+  /// The file itself must match the output's layout: progressive MP4 with moov before mdat and no
+  /// fragments, single-program TS, and no tracks in the file that the stream does not have.
+  /// Range requests are handled through parseRange, and the data goes straight from the file to
+  /// the socket, so no data pages are ever loaded for this request.
+  /// \param ext Lowercase extension, including the dot, of source files in this container.
+  /// \returns False, without sending anything, if the request cannot be served this way.
+  bool HTTPOutput::passthroughFile(const HTTP::Parser &req, bool headersOnly, const std::string &ext){
+    if (M.getLive() || !M.getVod() || webSock || isRecording()){return false;}
+    if (targetParams.count("start") || targetParams.count("stop") || targetParams.count("startunix") ||
+        targetParams.count("stopunix") || targetParams.count("duration")){
       return false;
     }
-    header.erase(0, 6);
-    // Do parsing of the rest of the header...
-    if (header.size() && header[0] == '-'){
-      // negative range = count from end
-      byteStart = 0;
-      for (unsigned int i = 1; i < header.size(); ++i){
-        if (header[i] >= '0' && header[i] <= '9'){
-          byteStart *= 10;
-          byteStart += header[i] - '0';
-          continue;
-        }
-        break;
-      }
-      if (byteStart > byteEnd){
-        // entire file if starting before byte zero
-        byteStart = 0;
-      }else{
-        // start byteStart bytes before byteEnd
-        byteStart = byteEnd - byteStart;
-      }
-      MEDIUM_MSG("Range request: %" PRIu64 "-%" PRIu64 " (%s)", byteStart, byteEnd, header.c_str());
-      return true;
+    std::set<size_t> validTracks = M.getValidTracks();
+    if (!validTracks.size() || validTracks.size() != userSelect.size()){return false;}
+    for (std::set<size_t>::iterator it = validTracks.begin(); it != validTracks.end(); ++it){
+      if (!userSelect.count(*it)){return false;}
     }
+    std::string source = M.getSource();
+    if (source.find("://") != std::string::npos || source.size() <= ext.size()){return false;}
+    std::string srcExt = source.substr(source.size() - ext.size());
+    for (size_t i = 0; i < srcExt.size(); ++i){srcExt[i] = tolower(srcExt[i]);}
+    if (srcExt != ext){return false;}
+    const std::string &range = req.GetHeader("Range");
+    if (range.size() && range.substr(0, 6) != "bytes="){return false;}
 
-    // Positive range
-    long long size = byteEnd;
-    byteEnd = 0;
-    byteStart = 0;
-    unsigned int i = 0;
-    for (; i < header.size(); ++i){
-      if (header[i] >= '0' && header[i] <= '9'){
-        byteStart *= 10;
-        byteStart += header[i] - '0';
-        continue;
-      }
-      break;
+    int fd = open(source.c_str(), O_RDONLY);
+    if (fd < 0){return false;}
+    struct stat st;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) || !st.st_size){
+      close(fd);
+      return false;
     }
-    if (header[i] != '-'){
-      WARN_MSG("Invalid range header: %s", header.c_str());
-      byteEnd = 0;
+    uint64_t fileSize = st.st_size;
+    // The file must be laid out like the output would be, with exactly the tracks Mist knows about
+    size_t fileTracks = 0;
+    if (ext == ".mp4"){fileTracks = MP4::progressiveTracks(fd, fileSize);}
+    if (ext == ".flv"){fileTracks = FLV::fileTracks(fd, fileSize);}
+    if (ext == ".ts"){fileTracks = TS::fileTracks(fd, fileSize);}
+    if (fileTracks != validTracks.size()){
+      MEDIUM_MSG("Not passing through %s: %zu tracks in a usable layout, %zu tracks in stream", source.c_str(), fileTracks, validTracks.size());
+      close(fd);
       return false;
     }
-    ++i;
-    if (i < header.size()){
-      for (; i < header.size(); ++i){
-        if (header[i] >= '0' && header[i] <= '9'){
-          byteEnd *= 10;
-          byteEnd += header[i] - '0';
-          continue;
-        }
-        break;
+    uint64_t byteStart = 0;
+    uint64_t byteEnd = fileSize - 1;
+    H.protocol = req.protocol;
+    H.SetHeader("Accept-Ranges", "bytes");
+    if (range.size()){
+      if (!parseRange(range, byteStart, byteEnd) || byteStart > byteEnd){
+        close(fd);
+        if (!headersOnly){H.SetBody("Requested Range Not Satisfiable");}
+        H.SendResponse("416", "Requested Range Not Satisfiable", myConn);
+        H.Clean();
+        parseData = false;
+        wantRequest = true;
+        return true;
       }
-      if (byteEnd > size){byteEnd = size;}
+      std::stringstream rangeReply;
+      rangeReply << "bytes " << byteStart << "-" << byteEnd << "/" << fileSize;
+      H.SetHeader("Content-Length", byteEnd - byteStart + 1);
+      H.SetHeader("Content-Range", rangeReply.str());
+      H.SendResponse("206", "Partial content", myConn);
     }else{
-      byteEnd = size;
+      H.SetHeader("Content-Length", fileSize);
+      H.SendResponse("200", "OK", myConn);
+    }
+    H.Clean();
+    INFO_MSG("Passing through %s bytes %" PRIu64 "-%" PRIu64, source.c_str(), byteStart, byteEnd);
+    uint64_t pos = byteStart;
+    while (!headersOnly && pos <= byteEnd && myConn && keepGoing()){
+      size_t sent = myConn.sendFile(fd, pos, std::min(byteEnd - pos + 1, (uint64_t)PASSTHROUGH_CHUNK_SIZE));
+      if (!sent){break;}
+      pos += sent;
+      stats();
     }
-    MEDIUM_MSG("Range request: %" PRIu64 "-%" PRIu64 " (%s)", byteStart, byteEnd, header.c_str());
+    close(fd);
+    parseData = false;
+    wantRequest = true;
     return true;
   }
 
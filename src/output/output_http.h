@@ -4,6 +4,9 @@
 #include <mist/http_parser.h>
 #include <mist/websocket.h>
 
+/// Amount of bytes passthroughFile sends between statistics updates
+#define PASSTHROUGH_CHUNK_SIZE (4 * 1024 * 1024)
+
 namespace Mist{
 
   class HTTPOutput : public Output{
@@ -23,6 +26,7 @@ namespace Mist{
     void reConnector(std::string &connector);
     std::string getHandler();
     bool parseRange(std::string header, uint64_t &byteStart, uint64_t &byteEnd);
+    bool passthroughFile(const HTTP::Parser &req, bool headersOnly, const std::string &ext);
 
     //WebSocket related
     virtual bool doesWebsockets(){return false;}
@@ -49,5 +53,16 @@ namespace Mist{
     std::string getConnectedHost();             // LTS
     std::string getConnectedBinHost();          // LTS
     bool isTrustedProxy(const std::string &ip); // LTS
+
+    // Segments shared with other outputs of the same stream
+    bool serveCachedSegment(const std::string &id, uint64_t from, uint64_t until, uint64_t capacity);
+    void sendSegmentData(const char *data, size_t len);
+    void cacheSegmentData(const char *data, size_t len);
+    void finishCachedSegment(bool complete);
+    Comms::SegmentCache segmentCache;
+    IPC::sharedPage segmentPage; ///< Page of the segment currently being produced, if any
+    size_t segmentSlot;
+    uint64_t segmentSkip; ///< Bytes of the segment being muxed that were already sent from the cache
+    std::string reqPath;  ///< URL path of the current request; H.url is reset once a response starts
   };
 }// namespace Mist
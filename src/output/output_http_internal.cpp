@@ -65,6 +65,140 @@ namespace Mist{
 
   bool OutHTTP::listenMode(){return !(config->getString("ip").size());}
 
+  /// Serves connections through the event loop if so configured, one process per connection otherwise.
+  void OutHTTP::listener(Util::Config &conf, int (*callback)(Socket::Connection &S)){
+    if (conf.getString("serving") == "event"){
+      conf.serveEventSocket(callback, dispatchRequest);
+      return;
+    }
+    Output::listener(conf, callback);
+  }
+
+  /// Event loop reply body that is sent straight from the shared page of a cached segment
+  class SegmentBody : public Util::EventBody{
+  public:
+    IPC::sharedPage page;
+  };
+
+  /// Looks up a complete, publicly cacheable segment (as produced by e.g. HLS or CMAF) requested
+  /// by exactly this URL in the segment cache of the stream named by the second path component.
+  /// If found, body refers to the segment data in the mapped page, which it keeps open, and viewer
+  /// holds a connection on the viewer's session to account the request to.
+  /// Only viewers whose session is already running are served this way, which needs a session
+  /// token; the first request of a session (normally for a playlist) starts it in a process of its
+  /// own. Streams with triggers that must see every viewer, requests with parameters other than
+  /// the session token and requests passed on by a proxy are never served this way.
+  bool OutHTTP::cachedSegment(const HTTP::Parser &req, Socket::Connection &conn, std::string &type,
+                              std::string &cache, Util::EventBody *&body, Comms::Connections &viewer){
+    const std::string &url = req.url;
+    if (url.size() < 2 || url[0] != '/'){return false;}
+    size_t start = url.find('/', 1);
+    if (start == std::string::npos){return false;}
+    size_t end = url.find_first_of("/?", start + 1);
+    if (end == std::string::npos || url[end] != '/'){return false;}
+    std::string streamName = url.substr(start + 1, end - start - 1);
+    Util::sanitizeName(streamName);
+    if (!streamName.size()){return false;}
+    if (req.hasHeader("X-Real-IP")){return false;}
+    std::string allVars = req.allVars();
+    if (allVars.size()){
+      std::map<std::string, std::string> vars;
+      HTTP::parseVars(allVars.substr(1), vars);
+      for (std::map<std::string, std::string>::iterator it = vars.begin(); it != vars.end(); ++it){
+        if (it->first != "tkn" && it->first != "sid" && it->first != "sessId"){return false;}
+      }
+    }
+    if (Triggers::shouldTrigger("USER_NEW", streamName) || Triggers::shouldTrigger("CONN_OPEN", streamName) ||
+        Triggers::shouldTrigger("CONN_PLAY", streamName)){
+      return false;
+    }
+    // Read the session token the same way HTTPOutput::requestHandler does
+    Comms::sessionConfigCache();
+    std::string tkn;
+    if (Comms::tknMode & 0x01){
+      if (req.GetVar("tkn") != ""){
+        tkn = req.GetVar("tkn");
+      }else if (req.GetVar("sid") != ""){
+        tkn = req.GetVar("sid");
+      }else if (req.GetVar("sessId") != ""){
+        tkn = req.GetVar("sessId");
+      }
+    }
+    if ((Comms::tknMode & 0x02) && !tkn.size()){
+      std::map<std::string, std::string> storage;
+      HTTP::parseVars(req.GetHeader("Cookie"), storage, "; ");
+      if (storage.count("tkn")){tkn = storage.at("tkn");}
+    }
+    if (!tkn.size()){return false;}
+    Comms::SegmentCache segments;
+    segments.reload(streamName);
+    SegmentBody *seg = new SegmentBody();
+    std::string connector;
+    if (!segments.findPublic(url, seg->page, type, cache, connector) ||
+        !viewer.attach(streamName, conn.getBinHost(), tkn, connector)){
+      delete seg;
+      return false;
+    }
+    seg->data = seg->page.mapped + SEGMENT_HEADER_SIZE;
+    seg->len = Comms::SegmentCache::available(seg->page);
+    body = seg;
+    HIGH_MSG("Serving cached segment %s from the event loop to session %s", url.c_str(), viewer.sessionId.c_str());
+    return true;
+  }
+
+  /// Request dispatcher for the event loop serving mode.
+  /// Answers requests for built-in files and publicly cacheable segments that are completely in
+  /// the segment cache directly; everything else (manifests, segments still to be muxed, stream
+  /// data) gets its own process, which keeps the connection from then on. Outputs themselves do
+  /// not run inside the event loop: they rely on blocking I/O and per-process state.
+  /// Cached segments are sent from their shared page without copying, and the bytes of each reply
+  /// are added to the session of the viewer that requested it.
+  int OutHTTP::dispatchRequest(Socket::Connection &conn, std::string &reply, Util::EventBody *&body){
+    Socket::Buffer &buf = conn.Received();
+    std::string data = buf.copy(buf.bytes(EVENT_MAX_REQUEST));
+    size_t hdrEnd = data.find("\r\n\r\n");
+    if (hdrEnd == std::string::npos){return EVENT_NEED_DATA;}
+    data.erase(hdrEnd + 4);
+    HTTP::Parser req;
+    if (!req.Read(data)){return EVENT_FORK;}
+    if ((req.method != "GET" && req.method != "HEAD") || req.hasHeader("Content-Length") ||
+        req.hasHeader("Transfer-Encoding") || req.hasHeader("Upgrade")){
+      return EVENT_FORK;
+    }
+    std::string type, cache, asset;
+    Comms::Connections viewer;
+    if (!staticAsset(req.url, type, asset) && !cachedSegment(req, conn, type, cache, body, viewer)){
+      return EVENT_FORK;
+    }
+    buf.remove(hdrEnd + 4);
+    HTTP::Parser H;
+    H.protocol = req.protocol;
+    H.SetHeader("Content-Type", type);
+    H.SetHeader("Server", APPIDENT);
+    if (cache.size()){H.SetHeader("Cache-Control", cache);}
+    H.setCORSHeaders();
+    if (body){
+      H.SetHeader("Content-Length", body->len);
+      reply = H.BuildResponse("200", "OK");
+      if (req.method == "HEAD"){
+        delete body;
+        body = 0;
+      }
+      // A single request on a connection of its own, as far as the session is concerned
+      viewer.setNow(Util::bootSecs());
+      viewer.setDown(hdrEnd + 4);
+      viewer.setUp(reply.size() + (body ? body->len : 0));
+      viewer.setPid(getpid());
+      viewer.unload();
+    }else{
+      H.SetBody(asset);
+      reply = H.BuildResponse("200", "OK");
+      if (req.method == "HEAD"){reply.erase(reply.size() - asset.size());}
+    }
+    if (req.protocol != "HTTP/1.1" || req.GetHeader("Connection") == "close"){return EVENT_REPLY_CLOSE;}
+    return EVENT_REPLY;
+  }
+
   void OutHTTP::onFail(const std::string &msg, bool critical){
     // If we are connected through WS, the websockethandler should return the error message
     if (stayConnected){
@@ -168,6 +302,27 @@ namespace Mist{
     capa["optional"]["certbot"]["type"] = "str";
     capa["optional"]["certbot"]["option"] = "--certbot";
     capa["optional"]["certbot"]["short"] = "C";
+    capa["optional"]["serving"]["name"] = "Connection handling";
+    capa["optional"]["serving"]["help"] =
+        "How incoming connections are handled. The event loop answers requests for built-in "
+        "files and for segments already muxed for other viewers from a single process. It starts "
+        "a new process, which then keeps the connection, for the first request that needs one, "
+        "such as a playlist or stream data. The mist_listener_forks and mist_listener_replies "
+        "metrics show how requests were handled. The event loop is only available on Linux.";
+    capa["optional"]["serving"]["default"] = "fork";
+    capa["optional"]["serving"]["type"] = "select";
+    capa["optional"]["serving"]["option"] = "--serving";
+    capa["optional"]["serving"]["short"] = "E";
+    {
+      JSON::Value option;
+      option.append("fork");
+      option.append("One process per connection");
+      capa["optional"]["serving"]["select"].append(option);
+      option.null();
+      option.append("event");
+      option.append("Event loop");
+      capa["optional"]["serving"]["select"].append(option);
+    }
     cfg->addConnectorOptions(8080, capa);
     /*LTS-START*/
     cfg->addOption("nostreamtext",
@@ -694,47 +849,7 @@ namespace Mist{
       return;
     }
 
-    if (req.url == "/crossdomain.xml"){
-      H.SetHeader("Content-Type", "text/xml");
-      H.SetHeader("Server", APPIDENT);
-      H.setCORSHeaders();
-      if (headersOnly){
-        H.SendResponse("200", "OK", myConn);
-        responded = true;
-        H.Clean();
-        return;
-      }
-      H.SetBody("<?xml version=\"1.0\"?><!DOCTYPE cross-domain-policy SYSTEM "
-                "\"http://www.adobe.com/xml/dtds/"
-                "cross-domain-policy.dtd\"><cross-domain-policy><allow-access-from domain=\"*\" "
-                "/><site-control permitted-cross-domain-policies=\"all\"/></cross-domain-policy>");
-      H.SendResponse("200", "OK", myConn);
-      responded = true;
-      H.Clean();
-      return;
-    }// crossdomain.xml
-
-    if (req.url == "/clientaccesspolicy.xml"){
-      H.SetHeader("Content-Type", "text/xml");
-      H.SetHeader("Server", APPIDENT);
-      H.setCORSHeaders();
-      if (headersOnly){
-        H.SendResponse("200", "OK", myConn);
-        responded = true;
-        H.Clean();
-        return;
-      }
-      H.SetBody(
-          "<?xml version=\"1.0\" "
-          "encoding=\"utf-8\"?><access-policy><cross-domain-access><policy><allow-from "
-          "http-methods=\"*\" http-request-headers=\"*\"><domain "
-          "uri=\"*\"/></allow-from><grant-to><resource path=\"/\" "
-          "include-subpaths=\"true\"/></grant-to></policy></cross-domain-access></access-policy>");
-      H.SendResponse("200", "OK", myConn);
-      responded = true;
-      H.Clean();
-      return;
-    }// clientaccesspolicy.xml
+    if (sendStaticAsset(req.url, headersOnly)){return;}
 
     if (req.url == "/flashplayer.swf"){
       H.SetHeader("Content-Type", "application/x-shockwave-flash");
@@ -752,11 +867,6 @@ namespace Mist{
       responded = true;
       return;
     }
-    // send logo icon
-    if (req.url.length() > 4 && req.url.substr(req.url.length() - 4, 4) == ".ico"){
-      sendIcon(headersOnly);
-      return;
-    }
 
     // send generic HTML page
     if (req.url.length() > 6 && req.url.substr(req.url.length() - 5, 5) == ".html"){
@@ -953,184 +1063,122 @@ namespace Mist{
     }
 
     if (req.url.substr(0, 7) == "/skins/"){
-      std::string response;
-      std::string url = req.url;
       H.SetHeader("Server", APPIDENT);
       H.setCORSHeaders();
       H.SetHeader("Content-Type", "text/css");
-      if (headersOnly){
-        H.SendResponse("200", "OK", myConn);
-        responded = true;
-        H.Clean();
-        return;
-      }
-
-      if (url == "/skins/default.css"){
-#include "skin_default.css.h"
-        response.append((char *)skin_default_css, (size_t)skin_default_css_len);
-      }else if (url == "/skins/dev.css"){
-#include "skin_dev.css.h"
-        response.append((char *)skin_dev_css, (size_t)skin_dev_css_len);
-      }else if (url == "/skins/videojs.css"){
-#include "skin_videojs.css.h"
-        response.append((char *)skin_videojs_css, (size_t)skin_videojs_css_len);
-      }else{
-        H.SetBody("Unknown stylesheet: " + url);
-        H.SendResponse("404", "Unknown stylesheet", myConn);
-        responded = true;
-        H.Clean();
-        return;
-      }
-
-      H.SetBody(response);
-      H.SendResponse("200", "OK", myConn);
+      H.SetBody("Unknown stylesheet: " + req.url);
+      H.SendResponse("404", "Unknown stylesheet", myConn);
       responded = true;
       H.Clean();
       return;
     }
-    if (req.url == "/videojs.js"){
-      std::string response;
-      H.SetHeader("Server", APPIDENT);
-      H.setCORSHeaders();
-      H.SetHeader("Content-Type", "application/javascript");
-      if (headersOnly){
-        H.SendResponse("200", "OK", myConn);
-        responded = true;
-        H.Clean();
-        return;
-      }
+  }
 
+  /// Returns the content type and contents of the built-in file at url, if there is one.
+  /// Static, so the event loop can answer these requests without starting a new process.
+  bool OutHTTP::staticAsset(const std::string &url, std::string &type, std::string &body){
+    if (url == "/crossdomain.xml"){
+      type = "text/xml";
+      body = "<?xml version=\"1.0\"?><!DOCTYPE cross-domain-policy SYSTEM "
+             "\"http://www.adobe.com/xml/dtds/"
+             "cross-domain-policy.dtd\"><cross-domain-policy><allow-access-from domain=\"*\" "
+             "/><site-control permitted-cross-domain-policies=\"all\"/></cross-domain-policy>";
+      return true;
+    }
+    if (url == "/clientaccesspolicy.xml"){
+      type = "text/xml";
+      body = "<?xml version=\"1.0\" "
+             "encoding=\"utf-8\"?><access-policy><cross-domain-access><policy><allow-from "
+             "http-methods=\"*\" http-request-headers=\"*\"><domain "
+             "uri=\"*\"/></allow-from><grant-to><resource path=\"/\" "
+             "include-subpaths=\"true\"/></grant-to></policy></cross-domain-access></access-policy>";
+      return true;
+    }
+    if (url.length() > 4 && url.substr(url.length() - 4, 4) == ".ico"){
+#include "../icon.h"
+      type = "image/x-icon";
+      body.assign((const char *)icon_data, icon_len);
+      return true;
+    }
+    if (url == "/skins/default.css"){
+#include "skin_default.css.h"
+      type = "text/css";
+      body.assign((char *)skin_default_css, (size_t)skin_default_css_len);
+      return true;
+    }
+    if (url == "/skins/dev.css"){
+#include "skin_dev.css.h"
+      type = "text/css";
+      body.assign((char *)skin_dev_css, (size_t)skin_dev_css_len);
+      return true;
+    }
+    if (url == "/skins/videojs.css"){
+#include "skin_videojs.css.h"
+      type = "text/css";
+      body.assign((char *)skin_videojs_css, (size_t)skin_videojs_css_len);
+      return true;
+    }
+    if (url == "/videojs.js"){
 #include "player_video.js.h"
-      response.append((char *)player_video_js, (size_t)player_video_js_len);
-
-      H.SetBody(response);
-      H.SendResponse("200", "OK", myConn);
-      responded = true;
-      H.Clean();
-      return;
+      type = "application/javascript";
+      body.assign((char *)player_video_js, (size_t)player_video_js_len);
+      return true;
     }
-    if (req.url == "/dashjs.js"){
-      std::string response;
-      H.SetHeader("Server", APPIDENT);
-      H.setCORSHeaders();
-      H.SetHeader("Content-Type", "application/javascript");
-      if (headersOnly){
-        H.SendResponse("200", "OK", myConn);
-        responded = true;
-        H.Clean();
-        return;
-      }
-
+    if (url == "/dashjs.js"){
 #include "player_dash_lic.js.h"
-      response.append((char *)player_dash_lic_js, (size_t)player_dash_lic_js_len);
 #include "player_dash.js.h"
-      response.append((char *)player_dash_js, (size_t)player_dash_js_len);
-
-      H.SetBody(response);
-      H.SendResponse("200", "OK", myConn);
-      responded = true;
-      H.Clean();
-      return;
+      type = "application/javascript";
+      body.assign((char *)player_dash_lic_js, (size_t)player_dash_lic_js_len);
+      body.append((char *)player_dash_js, (size_t)player_dash_js_len);
+      return true;
     }
-    if (req.url == "/webrtc.js"){
-      std::string response;
-      H.SetHeader("Server", APPIDENT);
-      H.setCORSHeaders();
-      H.SetHeader("Content-Type", "application/javascript");
-      if (headersOnly){
-        H.SendResponse("200", "OK", myConn);
-        responded = true;
-        H.Clean();
-        return;
-      }
-
+    if (url == "/webrtc.js"){
 #include "player_webrtc.js.h"
-      response.append((char *)player_webrtc_js, (size_t)player_webrtc_js_len);
-
-      H.SetBody(response);
-      H.SendResponse("200", "OK", myConn);
-      responded = true;
-      H.Clean();
-      return;
+      type = "application/javascript";
+      body.assign((char *)player_webrtc_js, (size_t)player_webrtc_js_len);
+      return true;
     }
-    if (req.url == "/flv.js"){
-      std::string response;
-      H.SetHeader("Server", "MistServer/" PACKAGE_VERSION);
-      H.setCORSHeaders();
-      H.SetHeader("Content-Type", "application/javascript");
-      if (headersOnly){
-        H.SendResponse("200", "OK", myConn);
-        H.Clean();
-        return;
-      }
-
+    if (url == "/flv.js"){
 #include "player_flv.js.h"
-      response.append((char *)player_flv_js, (size_t)player_flv_js_len);
-
-      H.SetBody(response);
-      H.SendResponse("200", "OK", myConn);
-      H.Clean();
-      return;
+      type = "application/javascript";
+      body.assign((char *)player_flv_js, (size_t)player_flv_js_len);
+      return true;
     }
-    if (req.url == "/hlsjs.js"){
-      std::string response;
-      H.SetHeader("Server", "MistServer/" PACKAGE_VERSION);
-      H.setCORSHeaders();
-      H.SetHeader("Content-Type", "application/javascript");
-      if (headersOnly){
-        H.SendResponse("200", "OK", myConn);
-        H.Clean();
-        return;
-      }
-      
-      #include "player_hlsjs.js.h"
-      response.append((char*)player_hlsjs_js, (size_t)player_hlsjs_js_len);
-      
-      H.SetBody(response);
-      H.SendResponse("200", "OK", myConn);
-      H.Clean();
-      return;
+    if (url == "/hlsjs.js"){
+#include "player_hlsjs.js.h"
+      type = "application/javascript";
+      body.assign((char *)player_hlsjs_js, (size_t)player_hlsjs_js_len);
+      return true;
     }
-    if (req.url == "/libde265.js"){
-      std::string response;
-      H.Clean();
-      H.SetHeader("Server", "MistServer/" PACKAGE_VERSION);
-      H.setCORSHeaders();
-      H.SetHeader("Content-Type", "application/javascript");
-      if (headersOnly){
-        H.SendResponse("200", "OK", myConn);
-        H.Clean();
-        return;
-      }
-
-      #include "player_libde265.js.h"
-      response.append((char*)player_libde265_js, (size_t)player_libde265_js_len);
-
-      H.SetBody(response);
-      H.SendResponse("200", "OK", myConn);
-      H.Clean();
-      return;
-    } 
+    if (url == "/libde265.js"){
+#include "player_libde265.js.h"
+      type = "application/javascript";
+      body.assign((char *)player_libde265_js, (size_t)player_libde265_js_len);
+      return true;
+    }
+    return false;
   }
 
-  void OutHTTP::sendIcon(bool headersOnly){
-#include "../icon.h"
-    H.SetHeader("Content-Type", "image/x-icon");
+  /// Sends the built-in file at url, if there is one. Returns false if there is not.
+  bool OutHTTP::sendStaticAsset(const std::string &url, bool headersOnly){
+    std::string type, body;
+    if (!staticAsset(url, type, body)){return false;}
+    H.SetHeader("Content-Type", type);
     H.SetHeader("Server", APPIDENT);
-    H.SetHeader("Content-Length", icon_len);
     H.setCORSHeaders();
     if (headersOnly){
-      H.SendResponse("200", "OK", myConn);
-      responded = true;
-      H.Clean();
-      return;
+      H.SetHeader("Content-Length", body.size());
+    }else{
+      H.SetBody(body);
     }
     H.SendResponse("200", "OK", myConn);
     responded = true;
-    myConn.SendNow((const char *)icon_data, icon_len);
     H.Clean();
+    return true;
   }
 
+  void OutHTTP::sendIcon(bool headersOnly){sendStaticAsset("/favicon.ico", headersOnly);}
+
   bool OutHTTP::websocketHandler(const HTTP::Parser & req, bool headersOnly){
     stayConnected = true;
     std::string reqHost = HTTP::URL(req.GetHeader("Host")).host;
@@ -7,12 +7,18 @@ namespace Mist{
     ~OutHTTP();
     static void init(Util::Config *cfg);
     static bool listenMode();
+    static void listener(Util::Config &conf, int (*callback)(Socket::Connection &S));
+    static int dispatchRequest(Socket::Connection &conn, std::string &reply, Util::EventBody *&body);
+    static bool staticAsset(const std::string &url, std::string &type, std::string &body);
+    static bool cachedSegment(const HTTP::Parser &req, Socket::Connection &conn, std::string &type,
+                              std::string &cache, Util::EventBody *&body, Comms::Connections &viewer);
     virtual void onFail(const std::string &msg, bool critical = false);
     /// preHTTP is disabled in the internal HTTP output, since most don't need the stream alive to work
     virtual void preHTTP(){};
     void HTMLResponse(const HTTP::Parser & req, bool headersOnly);
     void respondHTTP(const HTTP::Parser & req, bool headersOnly);
     void sendIcon(bool headersOnly);
+    bool sendStaticAsset(const std::string &url, bool headersOnly);
     bool websocketHandler(const HTTP::Parser & req, bool headersOnly);
     JSON::Value getStatusJSON(std::string &reqHost, const std::string &useragent = "", bool metaEverywhere = false);
     bool stayConnected;
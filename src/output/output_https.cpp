@@ -1,5 +1,6 @@
 #include "output_https.h"
 #include <mist/procs.h>
+#include <vector>
 
 namespace Mist{
   mbedtls_entropy_context OutHTTPS::entropy;
@@ -7,6 +8,7 @@ namespace Mist{
   mbedtls_ssl_config OutHTTPS::sslConf;
   mbedtls_x509_crt OutHTTPS::srvcert;
   mbedtls_pk_context OutHTTPS::pkey;
+  Socket::TLSKeys OutHTTPS::tlsKeys;
 
   void OutHTTPS::init(Util::Config *cfg){
     Output::init(cfg);
@@ -40,6 +42,13 @@ namespace Mist{
     capa["optional"]["wrappers"]["allowed"].append("img");
     capa["optional"]["wrappers"]["option"] = "--wrappers";
     capa["optional"]["wrappers"]["short"] = "w";
+    capa["optional"]["ktls"]["name"] = "Kernel TLS";
+    capa["optional"]["ktls"]["help"] =
+        "If enabled, hands encryption to the kernel after the handshake where the kernel and "
+        "negotiated cipher allow it, and lets the HTTP handler use the connection directly.";
+    capa["optional"]["ktls"]["option"] = "--ktls";
+    capa["optional"]["ktls"]["short"] = "k";
+    capa["optional"]["ktls"]["default"] = 0;
     cfg->addConnectorOptions(4433, capa);
     cfg->addOption("nostreamtext",
                    JSON::fromString("{\"arg\":\"string\", \"default\":\"\", "
@@ -66,6 +75,7 @@ namespace Mist{
 
   OutHTTPS::OutHTTPS(Socket::Connection &C) : Output(C){
     int ret;
+    kernelTLS = false;
     mbedtls_net_init(&client_fd);
     client_fd.fd = C.getSocket();
     mbedtls_ssl_init(&ssl);
@@ -99,21 +109,23 @@ namespace Mist{
         Util::sleep(20);
       }
     }
-    HIGH_MSG("Started SSL connection handler");
+    if (config->hasOption("ktls") && config->getBool("ktls")){
+      int kTLS = Socket::enableKTLS(client_fd.fd, &ssl, tlsKeys, true);
+      if (kTLS == KTLS_BROKEN){
+        Util::logExitReason(ER_READ_START_FAILURE, "Could not enable kernel TLS");
+        kernelTLS = true; // mbedtls may no longer send anything on this socket
+        C.close();
+        return;
+      }
+      kernelTLS = (kTLS == KTLS_ON);
+    }
+    HIGH_MSG("Started SSL connection handler%s", kernelTLS ? " using kernel TLS" : "");
   }
 
   int OutHTTPS::run(){
     unsigned char buf[1024 * 4]; // 4k internal buffer
     int ret;
 
-    // Start a MistOutHTTP process, connected to this SSL connection
-    int fderr = 2;
-    int fd[2];
-    if (socketpair(PF_LOCAL, SOCK_STREAM, 0, fd) != 0){
-      FAIL_MSG("Could not open anonymous socket for SSL<->HTTP connection!");
-      Util::logExitReason(ER_READ_START_FAILURE, "Could not open anonymous socket for SSL<->HTTP connection!");
-      return 1;
-    }
     std::deque<std::string> args;
     args.push_back(Util::getMyPath() + "MistOutHTTP");
     args.push_back("--ip");
@@ -129,6 +141,36 @@ namespace Mist{
         args.push_back(jIt->asStringRef());
       }
     }
+
+    if (kernelTLS){
+      // The kernel encrypts and decrypts from here on, so MistOutHTTP can take over the
+      // connection itself: this process is replaced by it, and no data is copied in between.
+      if (!myConn){return 1;}
+      mbedtls_net_set_block(&client_fd);
+      if (dup2(client_fd.fd, 0) < 0 || dup2(client_fd.fd, 1) < 0){
+        FAIL_MSG("Could not hand kernel TLS connection to MistOutHTTP: %s", strerror(errno));
+        Util::logExitReason(ER_EXEC_FAILURE, "Could not hand kernel TLS connection to MistOutHTTP");
+        return 1;
+      }
+      setenv("MIST_BOUND_ADDR", myConn.getBoundAddress().c_str(), 1);
+      if (client_fd.fd > 1){close(client_fd.fd);}
+      std::vector<char *> argv;
+      for (size_t i = 0; i < args.size(); ++i){argv.push_back((char *)args[i].c_str());}
+      argv.push_back(0);
+      execvp(argv[0], &argv[0]);
+      FAIL_MSG("Could not start MistOutHTTP for kernel TLS connection: %s", strerror(errno));
+      Util::logExitReason(ER_EXEC_FAILURE, "Could not start MistOutHTTP for kernel TLS connection");
+      return 1;
+    }
+
+    // Start a MistOutHTTP process, connected to this SSL connection
+    int fderr = 2;
+    int fd[2];
+    if (socketpair(PF_LOCAL, SOCK_STREAM, 0, fd) != 0){
+      FAIL_MSG("Could not open anonymous socket for SSL<->HTTP connection!");
+      Util::logExitReason(ER_READ_START_FAILURE, "Could not open anonymous socket for SSL<->HTTP connection!");
+      return 1;
+    }
     args.push_back("");
     Util::Procs::socketList.insert(fd[0]);
     setenv("MIST_BOUND_ADDR", myConn.getBoundAddress().c_str(), 1);
@@ -199,8 +241,8 @@ namespace Mist{
 
   OutHTTPS::~OutHTTPS(){
     HIGH_MSG("Ending SSL connection handler");
-    // close when we're done
-    mbedtls_ssl_close_notify(&ssl);
+    // close when we're done; with kernel TLS, mbedtls no longer knows the connection state
+    if (!kernelTLS){mbedtls_ssl_close_notify(&ssl);}
     mbedtls_ssl_free(&ssl);
     mbedtls_net_free(&client_fd);
     myConn.close();
@@ -251,6 +293,7 @@ namespace Mist{
       return;
     }
     mbedtls_ssl_conf_rng(&sslConf, mbedtls_ctr_drbg_random, &ctr_drbg);
+    if (config->getBool("ktls")){Socket::exportTLSKeys(&sslConf, &tlsKeys);}
     mbedtls_ssl_conf_ca_chain(&sslConf, srvcert.next, NULL);
     if ((ret = mbedtls_ssl_conf_own_cert(&sslConf, &srvcert, &pkey)) != 0){
       FAIL_MSG("SSL config own certificate failed");
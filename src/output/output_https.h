@@ -24,6 +24,8 @@ namespace Mist{
   private:
     mbedtls_net_context client_fd;
     mbedtls_ssl_context ssl;
+    bool kernelTLS; ///< True if the kernel took over encryption after the handshake
+    static Socket::TLSKeys tlsKeys;
     static mbedtls_entropy_context entropy;
     static mbedtls_ctr_drbg_context ctr_drbg;
     static mbedtls_ssl_config sslConf;
@@ -13,6 +13,7 @@
 namespace Mist{
   OutHTTPTS::OutHTTPTS(Socket::Connection &conn) : TSOutput(conn){
     sendRepeatingHeaders = 500; // PAT/PMT every 500ms (DVB spec)
+    tsFlushSize = TS_FLUSH_SIZE;
     HTTP::URL target(config->getString("target"));
     if (target.protocol == "srt"){
       std::string newTarget = "ts-exec:srt-live-transmit file://con " + target.getUrl();
@@ -55,7 +56,7 @@ namespace Mist{
   void OutHTTPTS::initialSeek(bool dryRun){
     // Adds passthrough support to the regular initialSeek function
     if (targetParams.count("passthrough")){selectAllTracks();}
-    Output::initialSeek(dryRun);
+    TSOutput::initialSeek(dryRun);
   }
 
   void OutHTTPTS::init(Util::Config *cfg){
@@ -113,6 +114,7 @@ namespace Mist{
 
   void OutHTTPTS::respondHTTP(const HTTP::Parser & req, bool headersOnly){
     HTTPOutput::respondHTTP(req, headersOnly);
+    if (passthroughFile(req, headersOnly, ".ts")){return;}
     H.protocol = "HTTP/1.0";
     H.SendResponse("200", "OK", myConn);
     if (!headersOnly){
@@ -1087,17 +1087,20 @@ namespace Mist{
 
     realBaseOffset += (moofBox.boxedSize() + mdatSize);
 
-    H.Chunkify(moofBox.asBox(), moofBox.boxedSize(), myConn);
-
     char mdatHeader[8] ={0x00, 0x00, 0x00, 0x00, 'm', 'd', 'a', 't'};
     Bit::htobl(mdatHeader, mdatSize);
-    H.Chunkify(mdatHeader, 8, myConn);
+    // moof and mdat header go out in a single write (and a single HTTP chunk)
+    struct iovec vec[2];
+    vec[0].iov_base = moofBox.asBox();
+    vec[0].iov_len = moofBox.boxedSize();
+    vec[1].iov_base = mdatHeader;
+    vec[1].iov_len = 8;
+    H.Chunkify(vec, 2, myConn);
   }
 
   void OutMP4::respondHTTP(const HTTP::Parser & req, bool headersOnly){
     //Set global defaults, first
     HTTPOutput::respondHTTP(req, headersOnly);
-    initialSeek();
 
     H.SetHeader("Content-Type", "video/MP4");
     if (!M.getLive()){H.SetHeader("Accept-Ranges", "bytes, parsec");}
@@ -1114,7 +1117,9 @@ namespace Mist{
 
     // Check if the url contains .3gp --> if yes, we will send a 3gp header
     sending3GP = (req.url.find(".3gp") != std::string::npos);
+    if (!sending3GP && passthroughFile(req, headersOnly, ".mp4")){return;}
 
+    initialSeek();
     fileSize = 0;
     headerSize = mp4HeaderSize(fileSize, M.getLive());
 
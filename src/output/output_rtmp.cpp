@@ -10,6 +10,7 @@
 #include <mist/triggers.h>
 #include <mist/util.h>
 #include <sys/stat.h>
+#include <vector>
 
 const char * trackType(char ID){
   if (ID == 8){return "audio";}
@@ -20,7 +21,34 @@ const char * trackType(char ID){
 
 
 namespace Mist{
+  RTMPTarget::RTMPTarget(const std::string &tgt) : url(tgt.substr(0, tgt.rfind('?'))), stats(tgt){
+    authAttempts = 0;
+    lastAck = Util::bootSecs();
+    nextConnect = 0;
+    backoff = 1000;
+    handshakeStart = 0;
+    opened = false;
+    publishing = false;
+    sentHeader = false;
+    wasPublishing = false;
+  }
+
+  /// Drops the connection to this target and schedules the next attempt, backing off
+  /// exponentially.
+  void RTMPTarget::retryLater(){
+    conn.close();
+    opened = false;
+    handshakeStart = 0;
+    publishing = false;
+    sentHeader = false;
+    stats.active = false;
+    nextConnect = Util::bootMS() + backoff;
+    WARN_MSG("Could not push to %s, retrying in %" PRIu64 "ms", stats.target.c_str(), backoff);
+    backoff = std::min(backoff * 2, (uint64_t)30000);
+  }
+
   OutRTMP::OutRTMP(Socket::Connection &conn) : Output(conn){
+    curTarget = 0;
     lastSilence = 0;
     hasSilence = false;
     lastAudioInserted = 0;
@@ -36,6 +64,35 @@ namespace Mist{
     maxbps = config->getInteger("maxkbps") * 128;
     //Switch realtime tracking system to mode where it never skips ahead, but only changes playback speed
     maxSkipAhead = 0;
+    // Output::Output refused the fan-out push already
+    if (!config->is_active){return;}
+    if (pushTargets.size()){
+      // A fan-out push publishes to each of its targets over a connection of its own
+      streamName = config->getString("streamname");
+      for (std::deque<std::string>::iterator it = pushTargets.begin(); it != pushTargets.end(); ++it){
+        targets.push_back(new RTMPTarget(*it));
+        RTMPTarget &tgt = *targets.back();
+#ifdef SSL
+        if (tgt.url.protocol != "rtmp" && tgt.url.protocol != "rtmps"){
+#else
+        if (tgt.url.protocol != "rtmp"){
+#endif
+          FAIL_MSG("Protocol not supported: %s", tgt.url.protocol.c_str());
+          onFail("Invalid RTMP target: protocol " + tgt.url.protocol + " not supported", true);
+          return;
+        }
+        std::string app = Encodings::URL::encode(tgt.url.path, "/:=@[]");
+        size_t slash = app.find('/');
+        if (slash != std::string::npos){tgt.streamOut = app.substr(slash + 1);}
+        if (!tgt.streamOut.size()){tgt.streamOut = streamName;}
+        INFO_MSG("About to push stream %s out to %s as %s", streamName.c_str(), tgt.stats.target.c_str(),
+                 tgt.streamOut.c_str());
+      }
+      myConn.setHost(targets.front()->url.host);
+      initialize();
+      initialSeek();
+      return;
+    }
     if (config->getString("target").size() && config->getString("target") != "-"){
       streamName = config->getString("streamname");
       pushUrl = HTTP::URL(config->getString("target"));
@@ -90,10 +147,22 @@ namespace Mist{
     }
   }
 
-  void OutRTMP::startPushOut(const char *args){
+  OutRTMP::~OutRTMP(){
+    while (targets.size()){
+      targets.front()->conn.close();
+      delete targets.front();
+      targets.pop_front();
+    }
+  }
 
-    myConn.close();
-    myConn.Received().clear();
+  /// Connects to the push target in use and starts the handshake.
+  /// Fan-out targets finish the handshake in serviceTargets, so the others are not held up;
+  /// a single push waits for it and sends the connect request right away.
+  void OutRTMP::startPushOut(const char *args){
+    const HTTP::URL &url = curTarget ? curTarget->url : pushUrl;
+    Socket::Connection &conn = peer();
+    conn.close();
+    conn.Received().clear();
 
     RTMPStream::chunk_rec_max = 128;
     RTMPStream::chunk_snd_max = 128;
@@ -107,23 +176,20 @@ namespace Mist{
     RTMPStream::lastsend.clear();
     RTMPStream::lastrecv.clear();
 
-    std::string app = Encodings::URL::encode(pushUrl.path, "/:=@[]");
-    size_t slash = app.find('/');
-    if (slash != std::string::npos){app = app.substr(0, slash);}
-
-    if (pushUrl.protocol == "rtmp"){myConn.open(pushUrl.host, pushUrl.getPort(), false);}
+    if (url.protocol == "rtmp"){conn.open(url.host, url.getPort(), false);}
 #ifdef SSL
-    if (pushUrl.protocol == "rtmps"){myConn.open(pushUrl.host, pushUrl.getPort(), false, true);}
+    if (url.protocol == "rtmps"){conn.open(url.host, url.getPort(), false, true);}
 #endif
-    if (!myConn){
-      FAIL_MSG("Could not connect to %s:%d!", pushUrl.host.c_str(), pushUrl.getPort());
+    if (!conn){
+      FAIL_MSG("Could not connect to %s:%d!", url.host.c_str(), url.getPort());
+      if (curTarget){curTarget->retryLater();}
       return;
     }
     // do handshake
-    myConn.SendNow("\003", 1); // protocol version. Always 3
+    conn.SendNow("\003", 1); // protocol version. Always 3
     char *temp = (char *)malloc(3072);
     if (!temp){
-      myConn.close();
+      conn.close();
       return;
     }
     *((uint32_t *)temp) = 0;                         // time zero
@@ -131,21 +197,36 @@ namespace Mist{
     for (int i = 8; i < 3072; ++i){
       temp[i] = FILLER_DATA[i % sizeof(FILLER_DATA)];
     }//"random" data
-    myConn.SendNow(temp, 3072);
+    conn.SendNow(temp, 3072);
     free(temp);
+    if (curTarget){
+      curTarget->opened = true;
+      curTarget->authArgs = args;
+      curTarget->handshakeStart = Util::bootMS();
+      return;
+    }
     setBlocking(true);
-    while (!myConn.Received().available(3073) && myConn.connected() && config->is_active){
-      myConn.spool();
+    while (!conn.Received().available(3073) && conn.connected() && config->is_active){
+      conn.spool();
     }
-    if (!myConn || !config->is_active){return;}
-    myConn.Received().remove(3073);
+    if (!conn || !config->is_active){return;}
+    conn.Received().remove(3073);
     RTMPStream::rec_cnt += 3073;
     RTMPStream::snd_cnt += 3073;
     setBlocking(false);
+    sendConnect(args);
+  }
+
+  /// Sends the connect request to the push target in use, once its handshake completed.
+  void OutRTMP::sendConnect(const std::string &args){
+    const HTTP::URL &url = curTarget ? curTarget->url : pushUrl;
     VERYHIGH_MSG("Push out handshake completed");
-    std::string pushHost = "rtmp://" + pushUrl.host + "/";
-    if (pushUrl.getPort() != 1935){
-      pushHost = "rtmp://" + pushUrl.host + ":" + JSON::Value(pushUrl.getPort()).asString() + "/";
+    std::string app = Encodings::URL::encode(url.path, "/:=@[]");
+    size_t slash = app.find('/');
+    if (slash != std::string::npos){app = app.substr(0, slash);}
+    std::string pushHost = "rtmp://" + url.host + "/";
+    if (url.getPort() != 1935){
+      pushHost = "rtmp://" + url.host + ":" + JSON::Value(url.getPort()).asString() + "/";
     }
 
     AMF::Object amfReply("container", AMF::AMF0_DDV_CONTAINER);
@@ -160,22 +241,94 @@ namespace Mist{
     sendCommand(amfReply, 20, 0);
 
     RTMPStream::chunk_snd_max = 65536;                                 // 64KiB
-    myConn.SendNow(RTMPStream::SendCTL(1, RTMPStream::chunk_snd_max)); // send chunk size max (msg 1)
+    peer().SendNow(RTMPStream::SendCTL(1, RTMPStream::chunk_snd_max)); // send chunk size max (msg 1)
     HIGH_MSG("Waiting for server to acknowledge connect request...");
   }
 
+  /// Makes the given target the one the RTMP code works on, storing the connection state of the
+  /// previous one. Passing 0 returns to the state of the client connection.
+  void OutRTMP::selectTarget(RTMPTarget *tgt){
+    if (tgt == curTarget){return;}
+    if (curTarget){swapTarget(curTarget);}
+    if (tgt){swapTarget(tgt);}
+    curTarget = tgt;
+  }
+
+  /// Exchanges the connection state in use with the state stored in the given target.
+  /// Everything swapped is cheap to exchange; the target URL is read from curTarget instead.
+  void OutRTMP::swapTarget(RTMPTarget *tgt){
+    tgt->session.swap();
+    streamOut.swap(tgt->streamOut);
+    std::swap(authAttempts, tgt->authAttempts);
+    std::swap(lastAck, tgt->lastAck);
+  }
+
+  /// Connects, handshakes with and reads from each target of a fan-out push, dropping and later
+  /// retrying targets whose connection broke or that did not complete the handshake in time.
+  void OutRTMP::serviceTargets(){
+    bool gotData = false;
+    uint64_t now = Util::bootMS();
+    for (std::deque<RTMPTarget *>::iterator it = targets.begin(); it != targets.end(); ++it){
+      RTMPTarget *tgt = *it;
+      if (tgt->stats.stopped){continue;}
+      if (!tgt->conn){
+        if (tgt->opened){
+          WARN_MSG("Lost connection to %s", tgt->stats.target.c_str());
+          tgt->retryLater();
+        }
+        if (now < tgt->nextConnect){continue;}
+        selectTarget(tgt);
+        startPushOut("");
+        continue;
+      }
+      if (tgt->handshakeStart && now - tgt->handshakeStart > 10000){
+        WARN_MSG("Handshake with %s timed out", tgt->stats.target.c_str());
+        tgt->retryLater();
+        continue;
+      }
+      if (!tgt->conn.spool()){continue;}
+      gotData = true;
+      selectTarget(tgt);
+      if (tgt->handshakeStart){
+        if (!tgt->conn.Received().available(3073)){continue;}
+        tgt->conn.Received().remove(3073);
+        RTMPStream::rec_cnt += 3073;
+        RTMPStream::snd_cnt += 3073;
+        tgt->handshakeStart = 0;
+        sendConnect(tgt->authArgs);
+      }
+      parseChunk(tgt->conn.Received());
+    }
+    if (!gotData && !parseData){Util::sleep(20);}
+  }
+
   bool OutRTMP::listenMode(){return !(config->getString("target").size());}
 
+  /// Tells the push target in use that we stop publishing.
+  void OutRTMP::sendDeleteStream(){
+    AMF::Object amfreply("container", AMF::AMF0_DDV_CONTAINER);
+    amfreply.addContent(AMF::Object("", "deleteStream"));            // status reply
+    amfreply.addContent(AMF::Object("", (double)6));                 // transaction ID
+    amfreply.addContent(AMF::Object("", (double)0, AMF::AMF0_NULL)); // null - command info
+    amfreply.addContent(AMF::Object("", (double)1)); // No clue. But OBS sends this, too.
+    sendCommand(amfreply, 20, 1);
+  }
+
   bool OutRTMP::onFinish(){
+    if (targets.size()){
+      MEDIUM_MSG("Finishing stream %s to %zu targets", streamName.c_str(), targets.size());
+      for (std::deque<RTMPTarget *>::iterator it = targets.begin(); it != targets.end(); ++it){
+        if (!(*it)->conn){continue;}
+        selectTarget(*it);
+        if ((*it)->publishing){sendDeleteStream();}
+        (*it)->conn.close();
+      }
+      return false;
+    }
     MEDIUM_MSG("Finishing stream %s, %s", streamName.c_str(), myConn ? "while connected" : "already disconnected");
     if (myConn){
       if (isRecording()){
-        AMF::Object amfreply("container", AMF::AMF0_DDV_CONTAINER);
-        amfreply.addContent(AMF::Object("", "deleteStream"));            // status reply
-        amfreply.addContent(AMF::Object("", (double)6));                 // transaction ID
-        amfreply.addContent(AMF::Object("", (double)0, AMF::AMF0_NULL)); // null - command info
-        amfreply.addContent(AMF::Object("", (double)1)); // No clue. But OBS sends this, too.
-        sendCommand(amfreply, 20, 1);
+        sendDeleteStream();
         myConn.close();
         return false;
       }
@@ -262,6 +415,7 @@ namespace Mist{
     config->addStandardPushCapabilities(capa);
     capa["push_urls"].append("rtmp://*");
     capa["push_urls"].append("rtmps://*");
+    capa["push_fanout"] = true;
 
     JSON::Value opt;
     opt["arg"] = "string";
@@ -290,86 +444,8 @@ namespace Mist{
         
     tmpData: 10101111 00000001 = af 01 = \257 \001 + raw AAC silence
     */
-    const char * tmpData = "\257\001!\020\004`\214\034";
-    
-    size_t data_len = 8;
-
-    char rtmpheader[] ={0,                // byte 0 = cs_id | ch_type
-                         0,    0, 0,      // bytes 1-3 = timestamp
-                         0,    0, 0,      // bytes 4-6 = length
-                         0x08,            // byte 7 = msg_type_id
-                         1,    0, 0, 0,   // bytes 8-11 = msg_stream_id = 1
-                         0,    0, 0, 0};  // bytes 12-15 = extended timestamp
-                         
-    bool allow_short = RTMPStream::lastsend.count(4);
-    RTMPStream::Chunk &prev = RTMPStream::lastsend[4];
-    uint8_t chtype = 0x00;
-    size_t header_len = 12;
-    bool time_is_diff = false;
-    if (allow_short && (prev.cs_id == 4)){
-      if (prev.msg_stream_id == 1){
-        chtype = 0x40;
-        header_len = 8; // do not send msg_stream_id
-        if (data_len == prev.len && rtmpheader[7] == prev.msg_type_id){
-          chtype = 0x80;
-          header_len = 4; // do not send len and msg_type_id
-          if (timestamp == prev.timestamp){
-            chtype = 0xC0;
-            header_len = 1; // do not send timestamp
-          }
-        }
-        // override - we always sent type 0x00 if the timestamp has decreased since last chunk in this channel
-        if (timestamp < prev.timestamp){
-          chtype = 0x00;
-          header_len = 12;
-        }else{
-          // store the timestamp diff instead of the whole timestamp
-          timestamp -= prev.timestamp;
-          time_is_diff = true;
-        }
-      }
-    }
-
-    // update previous chunk variables
-    prev.cs_id = 4;
-    prev.msg_stream_id = 1;
-    prev.len = data_len;
-    prev.msg_type_id = 0x08;
-    if (time_is_diff){
-      prev.timestamp += timestamp;
-    }else{
-      prev.timestamp = timestamp;
-    }
-
-    // cs_id and ch_type
-    rtmpheader[0] = chtype | 4;
-    // data length, 3 bytes
-    rtmpheader[4] = (data_len >> 16) & 0xff;
-    rtmpheader[5] = (data_len >> 8) & 0xff;
-    rtmpheader[6] = data_len & 0xff;
-    // timestamp, 3 bytes
-    if (timestamp >= 0x00ffffff){
-      // send extended timestamp
-      rtmpheader[1] = 0xff;
-      rtmpheader[2] = 0xff;
-      rtmpheader[3] = 0xff;
-      rtmpheader[header_len++] = (timestamp >> 24) & 0xff;
-      rtmpheader[header_len++] = (timestamp >> 16) & 0xff;
-      rtmpheader[header_len++] = (timestamp >> 8) & 0xff;
-      rtmpheader[header_len++] = timestamp & 0xff;
-    }else{
-      // regular timestamp
-      rtmpheader[1] = (timestamp >> 16) & 0xff;
-      rtmpheader[2] = (timestamp >> 8) & 0xff;
-      rtmpheader[3] = timestamp & 0xff;
-    }
-
-    // send the packet
-    myConn.setBlocking(true);
-    myConn.SendNow(rtmpheader, header_len);
-    myConn.SendNow(tmpData, data_len);
-    RTMPStream::snd_cnt += header_len+data_len; // update the sent data counter
-    myConn.setBlocking(false);
+    // The first two bytes are the FLV audio tag header, the rest is a silent AAC frame
+    sendMedia(0x08, timestamp, "\257\001", 2, "!\020\004`\214\034", 6);
   }
   
   // Gets next ADTS frame and loops back to 0 is EOF is reached
@@ -428,101 +504,9 @@ namespace Mist{
     
     // Keep parsing ADTS frames until we reach a frame which starts in the future
     while (currentFrameTimestamp < untilTimestamp){  
-      // Init RTMP header info
-      char rtmpheader[] ={0,              // byte 0 = cs_id | ch_type
-                          0,    0, 0,     // bytes 1-3 = timestamp
-                          0,    0, 0,     // bytes 4-6 = length
-                          0x08,           // byte 7 = msg_type_id
-                          1,    0, 0, 0,  // bytes 8-11 = msg_stream_id = 1
-                          0,    0, 0, 0}; // bytes 12-15 = extended timestamp
-                          
-      // Separate timestamp since we store Δtimestamps
-      uint64_t rtmpTimestamp = currentFrameTimestamp;
-      // Since we have to prepend an FLV audio tag, increase size by 2 bytes
-      uint64_t aacPacketSize = currentFrameInfo.getPayloadSize() + 2;
-      // If there is a previous sent package, we do not need to send all data
-      bool allow_short = RTMPStream::lastsend.count(4);
-      RTMPStream::Chunk &prev = RTMPStream::lastsend[4];
-      // Defines the type of header. Only the 2 most significant bits are counted:
-      //  0x00 = 000.. = 12 byte header
-      //  0x40 = 010.. = 8 byte header, leave out message ID if it's the same as prev
-      //  0x80 = 100.. = 4 byte header, above + leave out msg type and size if the packets are all the same size and type
-      //  0xC0 = 110.. = 1 byte header, above + leave out timestamp as well
-      uint8_t chtype = 0x00;
-      size_t header_len = 12;
-      bool time_is_diff = false;
-      if (allow_short && (prev.cs_id == 4)){
-        if (prev.msg_stream_id == 1){
-          chtype = 0x40;
-          header_len = 8;
-          if (aacPacketSize == prev.len && rtmpheader[7] == prev.msg_type_id){
-            chtype = 0x80;
-            header_len = 4;
-            if (rtmpTimestamp == prev.timestamp){
-              chtype = 0xC0;
-              header_len = 1;
-            }
-          }
-          // override - we always sent type 0x00 if the timestamp has decreased since last chunk in this channel
-          if (rtmpTimestamp < prev.timestamp){
-            chtype = 0x00;
-            header_len = 12;
-          }else{
-            // store the timestamp diff instead of the whole timestamp
-            rtmpTimestamp -= prev.timestamp;
-            time_is_diff = true;
-          }
-        }
-      }
-
-      // Update previous chunk variables
-      prev.cs_id = 4;
-      prev.msg_stream_id = 1;
-      prev.len = aacPacketSize;
-      prev.msg_type_id = 0x08;
-      if (time_is_diff){
-        prev.timestamp += rtmpTimestamp;
-      }else{
-        prev.timestamp = rtmpTimestamp;
-      }
-
-      // Now fill in type...
-      rtmpheader[0] = chtype | 4;
-      // data length...
-      rtmpheader[4] = (aacPacketSize >> 16) & 0xff;
-      rtmpheader[5] = (aacPacketSize >> 8) & 0xff;
-      rtmpheader[6] = aacPacketSize & 0xff;
-      // and timestamp (3 bytes unless extended)
-      if (rtmpTimestamp >= 0x00ffffff){
-        rtmpheader[1] = 0xff;
-        rtmpheader[2] = 0xff;
-        rtmpheader[3] = 0xff;
-        rtmpheader[header_len++] = (rtmpTimestamp >> 24) & 0xff;
-        rtmpheader[header_len++] = (rtmpTimestamp >> 16) & 0xff;
-        rtmpheader[header_len++] = (rtmpTimestamp >> 8) & 0xff;
-        rtmpheader[header_len++] = rtmpTimestamp & 0xff;
-      }else{
-        rtmpheader[1] = (rtmpTimestamp >> 16) & 0xff;
-        rtmpheader[2] = (rtmpTimestamp >> 8) & 0xff;
-        rtmpheader[3] = rtmpTimestamp & 0xff;
-      }
-
-      // Send RTMP packet containing header only
-      myConn.setBlocking(true);
-      myConn.SendNow(rtmpheader, header_len);
-      // Prepend FLV AAC audio tag
-      char *tmpData = (char*)malloc(aacPacketSize);
-      const char *tmpBuf = currentFrameInfo.getPayload();
       // Prepend FLV Audio tag: always 10101111 00000001 + raw AAC
-      tmpData[0] = '\257';
-      tmpData[1] = '\001';
-      for (int i = 2; i < aacPacketSize; i++)
-        tmpData[i] = tmpBuf[i-2];
-
-      myConn.SendNow(tmpData, aacPacketSize);
-      // Update internal variables
-      RTMPStream::snd_cnt += header_len+aacPacketSize;
-      myConn.setBlocking(false);
+      sendMedia(0x08, currentFrameTimestamp, "\257\001", 2, currentFrameInfo.getPayload(),
+                currentFrameInfo.getPayloadSize());
       
       // get next ADTS frame for new raw AAC data
       calcNextFrameInfo();
@@ -545,7 +529,7 @@ namespace Mist{
       if (liveSeek()){return;}
     }
 
-    if (streamOut.size()){
+    if (streamOut.size() || targets.size()){
       if (thisPacket.getTime() - rtmpOffset < lastOutTime){
         int64_t OLD = rtmpOffset;
         rtmpOffset -= (1 + lastOutTime - (thisPacket.getTime() - rtmpOffset));
@@ -561,6 +545,15 @@ namespace Mist{
       rtmpOffset = (int64_t)thisPacket.getTime();
     }
 
+    // Targets of a fan-out push that started publishing get the init data first
+    for (std::deque<RTMPTarget *>::iterator it = targets.begin(); it != targets.end(); ++it){
+      RTMPTarget *tgt = *it;
+      if (!tgt->publishing || tgt->sentHeader || !tgt->conn || !atJoinPoint()){continue;}
+      selectTarget(tgt);
+      sendInitData();
+      tgt->sentHeader = true;
+    }
+
     // Send silence packets if needed
     if (hasSilence){
       // If there's more than 15s of skip, skip audio as well
@@ -591,12 +584,7 @@ namespace Mist{
       lastAudioInserted = timestamp;
     }
 
-    char rtmpheader[] ={ 0,              // byte 0 = cs_id | ch_type
-                         0,    0, 0,     // bytes 1-3 = timestamp
-                         0,    0, 0,     // bytes 4-6 = length
-                         0x12,           // byte 7 = msg_type_id
-                         1,    0, 0, 0,  // bytes 8-11 = msg_stream_id = 1
-                         0,    0, 0, 0}; // bytes 12-15 = extended timestamp
+    char msgType = 0x12;
     char dataheader[] ={0, 0, 0, 0, 0};
     unsigned int dheader_len = 1;
     static Util::ResizeablePointer swappy;
@@ -609,7 +597,7 @@ namespace Mist{
 
     // set msg_type_id
     if (type == "video"){
-      rtmpheader[7] = 0x09;
+      msgType = 0x09;
       if (codec == "H264"){
         dheader_len += 4;
         dataheader[0] = 7;
@@ -628,7 +616,7 @@ namespace Mist{
 
     if (type == "audio"){
       uint32_t rate = M.getRate(thisIdx);
-      rtmpheader[7] = 0x08;
+      msgType = 0x08;
       if (codec == "AAC"){
         dataheader[0] += 0xA0;
         dheader_len += 1;
@@ -666,7 +654,51 @@ namespace Mist{
       if (M.getSize(thisIdx) != 8){dataheader[0] |= 0x02;}
       if (M.getChannels(thisIdx) > 1){dataheader[0] |= 0x01;}
     }
-    data_len += dheader_len;
+    sendMedia(msgType, timestamp, dataheader, dheader_len, tmpData, data_len);
+  }
+
+  /// Returns true if a fan-out target can start receiving the stream at the current packet: at a
+  /// video keyframe, or anywhere if no video is sent.
+  bool OutRTMP::atJoinPoint(){
+    if (M.getType(thisIdx) == "video"){return thisPacket.getFlag("keyframe");}
+    for (std::map<size_t, Comms::Users>::iterator it = userSelect.begin(); it != userSelect.end(); ++it){
+      if (M.getType(it->first) == "video"){return false;}
+    }
+    return true;
+  }
+
+  /// Sends a media message to the client, or to each target of a fan-out push that is ready for it.
+  void OutRTMP::sendMedia(char msgType, uint64_t timestamp, const char *dataheader, size_t dheader_len,
+                          const char *data, size_t len){
+    if (!targets.size()){
+      sendChunks(msgType, timestamp, dataheader, dheader_len, data, len);
+      return;
+    }
+    for (std::deque<RTMPTarget *>::iterator it = targets.begin(); it != targets.end(); ++it){
+      RTMPTarget *tgt = *it;
+      if (tgt->stats.stopped){continue;}
+      if (!tgt->sentHeader || !tgt->conn){
+        ++tgt->stats.dropped;
+        continue;
+      }
+      selectTarget(tgt);
+      size_t prevCnt = RTMPStream::snd_cnt;
+      sendChunks(msgType, timestamp, dataheader, dheader_len, data, len);
+      tgt->stats.bytes += RTMPStream::snd_cnt - prevCnt;
+    }
+  }
+
+  /// Sends a media message over the connection in use, as chunks of at most chunk_snd_max bytes.
+  /// The data header goes in front of the data, in the same message.
+  void OutRTMP::sendChunks(char msgType, uint64_t timestamp, const char *dataheader, size_t dheader_len,
+                           const char *data, size_t len){
+    char rtmpheader[] ={ 0,              // byte 0 = cs_id | ch_type
+                         0,    0, 0,     // bytes 1-3 = timestamp
+                         0,    0, 0,     // bytes 4-6 = length
+                         msgType,        // byte 7 = msg_type_id
+                         1,    0, 0, 0,  // bytes 8-11 = msg_stream_id = 1
+                         0,    0, 0, 0}; // bytes 12-15 = extended timestamp
+    size_t data_len = len + dheader_len;
 
     bool allow_short = RTMPStream::lastsend.count(4);
     RTMPStream::Chunk &prev = RTMPStream::lastsend[4];
@@ -731,17 +763,23 @@ namespace Mist{
       rtmpheader[3] = timestamp & 0xff;
     }
 
-    // send the header
-    myConn.setBlocking(true);
-    myConn.SendNow(rtmpheader, header_len);
+    // Gather the header, data and continuation headers, then send them in one go
+    static std::vector<struct iovec> vecs;
+    vecs.clear();
+    struct iovec v;
+    v.iov_base = rtmpheader;
+    v.iov_len = header_len;
+    vecs.push_back(v);
     RTMPStream::snd_cnt += header_len; // update the sent data counter
-    // set the header's first byte to the "continue" type chunk, for later use
-    rtmpheader[0] = 0xC4;
+    // use a separate header, set to the "continue" type chunk, between blocks
+    char contheader[5] ={(char)0xC4, 0, 0, 0, 0};
+    size_t contheader_len = 1;
     if (timestamp >= 0x00ffffff){
-      rtmpheader[1] = (timestamp >> 24) & 0xff;
-      rtmpheader[2] = (timestamp >> 16) & 0xff;
-      rtmpheader[3] = (timestamp >> 8) & 0xff;
-      rtmpheader[4] = timestamp & 0xff;
+      contheader[1] = (timestamp >> 24) & 0xff;
+      contheader[2] = (timestamp >> 16) & 0xff;
+      contheader[3] = (timestamp >> 8) & 0xff;
+      contheader[4] = timestamp & 0xff;
+      contheader_len = 5;
     }
 
     // sent actual data - never send more than chunk_snd_max at a time
@@ -750,27 +788,49 @@ namespace Mist{
     while (len_sent < data_len){
       size_t to_send = std::min(data_len - len_sent, RTMPStream::chunk_snd_max);
       if (!len_sent){
-        myConn.SendNow(dataheader, dheader_len);
+        v.iov_base = (void *)dataheader;
+        v.iov_len = dheader_len;
+        vecs.push_back(v);
         RTMPStream::snd_cnt += dheader_len; // update the sent data counter
         to_send -= dheader_len;
         len_sent += dheader_len;
       }
-      myConn.SendNow(tmpData + len_sent - dheader_len, to_send);
+      v.iov_base = (void *)(data + len_sent - dheader_len);
+      v.iov_len = to_send;
+      vecs.push_back(v);
+      RTMPStream::snd_cnt += to_send; // update the sent data counter
       len_sent += to_send;
       if (len_sent < data_len){
-        if (timestamp >= 0x00ffffff){
-          myConn.SendNow(rtmpheader, 5);
-          RTMPStream::snd_cnt += 5; // update the sent data counter
-        }else{
-          myConn.SendNow(rtmpheader, 1);
-          RTMPStream::snd_cnt += 1; // update the sent data counter
-        }
+        v.iov_base = contheader;
+        v.iov_len = contheader_len;
+        vecs.push_back(v);
+        RTMPStream::snd_cnt += contheader_len; // update the sent data counter
       }
     }
-    myConn.setBlocking(false);
+    peer().setBlocking(true);
+    peer().SendNow(&vecs[0], vecs.size());
+    peer().setBlocking(false);
   }
 
   void OutRTMP::sendHeader(){
+    if (!targets.size()){
+      sendInitData();
+      return;
+    }
+    // Targets that start publishing later get their init data in sendNext
+    for (std::deque<RTMPTarget *>::iterator it = targets.begin(); it != targets.end(); ++it){
+      RTMPTarget *tgt = *it;
+      tgt->sentHeader = false;
+      if (!tgt->publishing || !tgt->conn){continue;}
+      selectTarget(tgt);
+      sendInitData();
+      tgt->sentHeader = true;
+    }
+    sentHeader = true;
+  }
+
+  /// Sends the metadata and the init data of the selected tracks over the connection in use.
+  void OutRTMP::sendInitData(){
     FLV::Tag tag;
     std::set<size_t> selectedTracks;
     // Will contain the full audio=<> parameter in it, which should be CSV's of
@@ -791,7 +851,7 @@ namespace Mist{
     tag.DTSCMetaInit(meta, selectedTracks);
     if (tag.len){
       tag.tagTime(currentTime() - rtmpOffset);
-      myConn.SendNow(RTMPStream::SendMedia(tag));
+      peer().SendNow(RTMPStream::SendMedia(tag));
     }
 
     for (std::set<size_t>::iterator it = selectedTracks.begin(); it != selectedTracks.end(); it++){
@@ -799,18 +859,19 @@ namespace Mist{
       if (type == "video"){
         if (tag.DTSCVideoInit(meta, *it)){
           tag.tagTime(currentTime() - rtmpOffset);
-          myConn.SendNow(RTMPStream::SendMedia(tag));
+          peer().SendNow(RTMPStream::SendMedia(tag));
         }
       }
       if (type == "audio"){
         if (tag.DTSCAudioInit(meta.getCodec(*it), meta.getRate(*it), meta.getSize(*it), meta.getChannels(*it), meta.getInit(*it))){
           tag.tagTime(currentTime() - rtmpOffset);
-          myConn.SendNow(RTMPStream::SendMedia(tag));
+          peer().SendNow(RTMPStream::SendMedia(tag));
         }
       }
     }
     // Insert silent init data if audio set to silent or loop a custom AAC file
-    audioParameterBuffer = targetParams["audio"];
+    // Every connection of a fan-out push gets this init data, but the file is only loaded once
+    if (!hasSilence && !hasCustomAudio){audioParameterBuffer = targetParams["audio"];}
     HIGH_MSG("audioParameterBuffer: %s", audioParameterBuffer.c_str());
     // Read until we find a , or end of audioParameterBuffer
     for (std::string::size_type i = 0; i < audioParameterBuffer.size(); i++){
@@ -856,7 +917,7 @@ namespace Mist{
       //                   AACLC-44100 -2   -000
       INFO_MSG("Inserting silence track init data");
       tag.tagTime(currentTime() - rtmpOffset);
-      myConn.SendNow(RTMPStream::SendMedia(tag));
+      peer().SendNow(RTMPStream::SendMedia(tag));
     }
     if (hasCustomAudio){
       // Get first frame in order to init the audio track correctly
@@ -891,7 +952,7 @@ namespace Mist{
       
       if (tag.DTSCAudioInit("AAC", currentFrameInfo.getFrequency(), currentFrameInfo.getSampleCount(), currentFrameInfo.getChannelCount(), initData)){
         INFO_MSG("Loaded a %" PRIu64 " byte custom audio file as audio loop", customAudioSize);
-        myConn.SendNow(RTMPStream::SendMedia(tag));
+        peer().SendNow(RTMPStream::SendMedia(tag));
       }
     }
 
@@ -899,6 +960,10 @@ namespace Mist{
   }
 
   void OutRTMP::requestHandler(){
+    if (targets.size()){
+      serviceTargets();
+      return;
+    }
     // If needed, slow down the reading to a rate of maxbps on average
     static bool slowWarned = false;
     if (maxbps && (Util::bootSecs() - myConn.connTime()) &&
@@ -924,9 +989,9 @@ namespace Mist{
   void OutRTMP::sendCommand(AMF::Object &amfReply, int messageType, int streamId){
     HIGH_MSG("Sending: %s", amfReply.Print().c_str());
     if (messageType == 17){
-      myConn.SendNow(RTMPStream::SendChunk(3, messageType, streamId, (char)0 + amfReply.Pack()));
+      peer().SendNow(RTMPStream::SendChunk(3, messageType, streamId, (char)0 + amfReply.Pack()));
     }else{
-      myConn.SendNow(RTMPStream::SendChunk(3, messageType, streamId, amfReply.Pack()));
+      peer().SendNow(RTMPStream::SendChunk(3, messageType, streamId, amfReply.Pack()));
     }
   }// sendCommand
 
@@ -982,7 +1047,7 @@ namespace Mist{
       if (UA == "FMLE/3.0 (compatible; FMSc/1.0)"){
         // set max chunk size early, to work around OBS v25 bug
         RTMPStream::chunk_snd_max = 65536;                                 // 64KiB
-        myConn.SendNow(RTMPStream::SendCTL(1, RTMPStream::chunk_snd_max)); // send chunk size max (msg 1)
+        peer().SendNow(RTMPStream::SendCTL(1, RTMPStream::chunk_snd_max)); // send chunk size max (msg 1)
       }
       // send a _result reply
       AMF::Object amfReply("container", AMF::AMF0_DDV_CONTAINER);
@@ -1003,9 +1068,9 @@ namespace Mist{
       sendCommand(amfReply, messageType, streamId);
       // Send other stream-related packets
       RTMPStream::chunk_snd_max = 65536;                                 // 64KiB
-      myConn.SendNow(RTMPStream::SendCTL(1, RTMPStream::chunk_snd_max)); // send chunk size max (msg 1)
-      myConn.SendNow(RTMPStream::SendCTL(5, RTMPStream::snd_window_size)); // send window acknowledgement size (msg 5)
-      myConn.SendNow(RTMPStream::SendCTL(6, RTMPStream::rec_window_size)); // send rec window acknowledgement size (msg 6)
+      peer().SendNow(RTMPStream::SendCTL(1, RTMPStream::chunk_snd_max)); // send chunk size max (msg 1)
+      peer().SendNow(RTMPStream::SendCTL(5, RTMPStream::snd_window_size)); // send window acknowledgement size (msg 5)
+      peer().SendNow(RTMPStream::SendCTL(6, RTMPStream::rec_window_size)); // send rec window acknowledgement size (msg 6)
       // myConn.SendNow(RTMPStream::SendUSR(0, 1)); //send UCM StreamBegin (0), stream 1
       // send onBWDone packet - no clue what it is, but real server sends it...
       // amfReply = AMF::Object("container", AMF::AMF0_DDV_CONTAINER);
@@ -1037,7 +1102,7 @@ namespace Mist{
       return;
     }// createStream
     if (amfData.getContentP(0)->StrValue() == "closeStream"){
-      myConn.SendNow(RTMPStream::SendUSR(1, 1)); // send UCM StreamEOF (1), stream 1
+      peer().SendNow(RTMPStream::SendUSR(1, 1)); // send UCM StreamEOF (1), stream 1
       AMF::Object amfreply("container", AMF::AMF0_DDV_CONTAINER);
       amfreply.addContent(AMF::Object("", "onStatus"));          // status reply
       amfreply.addContent(AMF::Object("", 0.0));                 // transaction ID
@@ -1233,7 +1298,7 @@ namespace Mist{
       amfReply.addContent(AMF::Object("", 1, AMF::AMF0_BOOL)); //publish success?
       sendCommand(amfReply, messageType, streamId);
       */
-      myConn.SendNow(RTMPStream::SendUSR(0, 1)); // send UCM StreamBegin (0), stream 1
+      peer().SendNow(RTMPStream::SendUSR(0, 1)); // send UCM StreamBegin (0), stream 1
       return;
     }// getStreamLength
     if (amfData.getContentP(0)->StrValue() == "checkBandwidth"){
@@ -1323,10 +1388,10 @@ namespace Mist{
       sendCommand(amfreply, playMessageType, playStreamId);
       // send streamisrecorded if stream, well, is recorded.
       if (M.getVod()){// isMember("length") && Strm.metadata["length"].asInt() > 0){
-        myConn.SendNow(RTMPStream::SendUSR(4, 1)); // send UCM StreamIsRecorded (4), stream 1
+        peer().SendNow(RTMPStream::SendUSR(4, 1)); // send UCM StreamIsRecorded (4), stream 1
       }
       // send streambegin
-      myConn.SendNow(RTMPStream::SendUSR(0, 1)); // send UCM StreamBegin (0), stream 1
+      peer().SendNow(RTMPStream::SendUSR(0, 1)); // send UCM StreamBegin (0), stream 1
       // and more reply
       amfreply = AMF::Object("container", AMF::AMF0_DDV_CONTAINER);
       amfreply.addContent(AMF::Object("", "onStatus"));          // status reply
@@ -1343,9 +1408,9 @@ namespace Mist{
       amfreply.getContentP(3)->addContent(AMF::Object("timecodeOffset", (double)rtmpOffset));
       sendCommand(amfreply, playMessageType, playStreamId);
       RTMPStream::chunk_snd_max = 65536;                                 // 64KiB
-      myConn.SendNow(RTMPStream::SendCTL(1, RTMPStream::chunk_snd_max)); // send chunk size max (msg 1)
+      peer().SendNow(RTMPStream::SendCTL(1, RTMPStream::chunk_snd_max)); // send chunk size max (msg 1)
       // send dunno?
-      myConn.SendNow(RTMPStream::SendUSR(32, 1)); // send UCM no clue?, stream 1
+      peer().SendNow(RTMPStream::SendUSR(32, 1)); // send UCM no clue?, stream 1
 
       parseData = true;
       return;
@@ -1384,10 +1449,10 @@ namespace Mist{
       sendCommand(amfreply, playMessageType, playStreamId);
       // send streamisrecorded if stream, well, is recorded.
       if (M.getVod()){// isMember("length") && Strm.metadata["length"].asInt() > 0){
-        myConn.SendNow(RTMPStream::SendUSR(4, 1)); // send UCM StreamIsRecorded (4), stream 1
+        peer().SendNow(RTMPStream::SendUSR(4, 1)); // send UCM StreamIsRecorded (4), stream 1
       }
       // send streambegin
-      myConn.SendNow(RTMPStream::SendUSR(0, 1)); // send UCM StreamBegin (0), stream 1
+      peer().SendNow(RTMPStream::SendUSR(0, 1)); // send UCM StreamBegin (0), stream 1
       // and more reply
       amfreply = AMF::Object("container", AMF::AMF0_DDV_CONTAINER);
       amfreply.addContent(AMF::Object("", "onStatus"));          // status reply
@@ -1405,9 +1470,9 @@ namespace Mist{
       }
       sendCommand(amfreply, playMessageType, playStreamId);
       RTMPStream::chunk_snd_max = 65536;                                 // 64KiB
-      myConn.SendNow(RTMPStream::SendCTL(1, RTMPStream::chunk_snd_max)); // send chunk size max (msg 1)
+      peer().SendNow(RTMPStream::SendCTL(1, RTMPStream::chunk_snd_max)); // send chunk size max (msg 1)
       // send dunno?
-      myConn.SendNow(RTMPStream::SendUSR(32, 1)); // send UCM no clue?, stream 1
+      peer().SendNow(RTMPStream::SendUSR(32, 1)); // send UCM no clue?, stream 1
 
       return;
     }// seek
@@ -1470,14 +1535,15 @@ namespace Mist{
         }
         if (code.size() || description.size()){
           if (description.find("authmod=adobe") != std::string::npos){
-            if (!pushUrl.user.size() && !pushUrl.pass.size()){
+            const HTTP::URL &url = curTarget ? curTarget->url : pushUrl;
+            if (!url.user.size() && !url.pass.size()){
               FAIL_MSG("Receiving side wants credentials, but none were provided in the target");
               return;
             }
             if (description.find("?reason=authfailed") != std::string::npos || authAttempts > 1){
               FAIL_MSG(
                   "Credentials provided in the target were not accepted by the receiving side");
-              myConn.close();
+              peer().close();
               return;
             }
             if (description.find("?reason=needauth") != std::string::npos){
@@ -1493,7 +1559,7 @@ namespace Mist{
               authAttempts++;
 
               char md5buffer[16];
-              std::string to_hash = pushUrl.user + authSalt + pushUrl.pass;
+              std::string to_hash = url.user + authSalt + url.pass;
               Secure::md5bin(to_hash.data(), to_hash.size(), md5buffer);
               std::string hash_one = Encodings::Base64::encode(std::string(md5buffer, 16));
               if (authOpaque.size()){
@@ -1503,7 +1569,7 @@ namespace Mist{
               }
               Secure::md5bin(to_hash.data(), to_hash.size(), md5buffer);
               std::string hash_two = Encodings::Base64::encode(std::string(md5buffer, 16));
-              std::string authStr = "?authmod=adobe&user=" + Encodings::URL::encode(pushUrl.user, "/:=@[]") +
+              std::string authStr = "?authmod=adobe&user=" + Encodings::URL::encode(url.user, "/:=@[]") +
                                     "&challenge=00000000&response=" + hash_two;
               if (authOpaque.size()){authStr += "&opaque=" + Encodings::URL::encode(authOpaque, "/:=@[]");}
               startPushOut(authStr.c_str());
@@ -1511,7 +1577,7 @@ namespace Mist{
             }
             INFO_MSG("Adobe auth: sending credentials phase 1");
             authAttempts++;
-            std::string authStr = "?authmod=adobe&user=" + Encodings::URL::encode(pushUrl.user, "/:=@[]");
+            std::string authStr = "?authmod=adobe&user=" + Encodings::URL::encode(url.user, "/:=@[]");
             startPushOut(authStr.c_str());
             return;
           }
@@ -1567,6 +1633,13 @@ namespace Mist{
           sendCommand(amfReply, 20, 1);
         }
         HIGH_MSG("Publish starting");
+        if (curTarget){
+          if (curTarget->wasPublishing){++curTarget->stats.reconnects;}
+          curTarget->wasPublishing = true;
+          curTarget->publishing = true;
+          curTarget->stats.active = true;
+          curTarget->backoff = 1000;
+        }
         if (!targetParams.count("realtime")){realTime = 0;}
         parseData = true;
         return;
@@ -1612,13 +1685,18 @@ namespace Mist{
       if ((RTMPStream::rec_cnt - RTMPStream::rec_window_at > RTMPStream::rec_window_size / 4) || Util::bootSecs() > lastAck+15){
         lastAck = Util::bootSecs();
         RTMPStream::rec_window_at = RTMPStream::rec_cnt;
-        myConn.SendNow(RTMPStream::SendCTL(3, RTMPStream::rec_cnt)); // send ack (msg 3)
+        peer().SendNow(RTMPStream::SendCTL(3, RTMPStream::rec_cnt)); // send ack (msg 3)
       }
 
       switch (next.msg_type_id){
       case 0: // does not exist
         WARN_MSG("UNKN: Received a zero-type message. Possible data corruption? Aborting!");
         while (inputBuffer.size()){inputBuffer.get().clear();}
+        // Only drop this target of a fan-out push; serviceTargets reconnects it
+        if (curTarget){
+          peer().close();
+          break;
+        }
         stop();
         onFinish();
         break; // happens when connection breaks unexpectedly
@@ -1662,7 +1740,7 @@ namespace Mist{
           break;
         case 6:
           MEDIUM_MSG("CTRL: UCM PingRequest %" PRIu32, Bit::btohl(next.data.data() + 2));
-          myConn.SendNow(RTMPStream::SendUSR(7, Bit::btohl(next.data.data() + 2))); // send UCM PingResponse (7)
+          peer().SendNow(RTMPStream::SendUSR(7, Bit::btohl(next.data.data() + 2))); // send UCM PingResponse (7)
           break;
         case 7:
           MEDIUM_MSG("CTRL: UCM PingResponse %" PRIu32, Bit::btohl(next.data.data() + 2));
@@ -1674,14 +1752,14 @@ namespace Mist{
         MEDIUM_MSG("CTRL: Window size");
         RTMPStream::rec_window_size = Bit::btohl(next.data.data());
         RTMPStream::rec_window_at = RTMPStream::rec_cnt;
-        myConn.SendNow(RTMPStream::SendCTL(3, RTMPStream::rec_cnt)); // send ack (msg 3)
+        peer().SendNow(RTMPStream::SendCTL(3, RTMPStream::rec_cnt)); // send ack (msg 3)
         lastAck = Util::bootSecs();
         break;
       case 6:
         MEDIUM_MSG("CTRL: Set peer bandwidth");
         // 4 bytes window size, 1 byte limit type (ignored)
         RTMPStream::snd_window_size = Bit::btohl(next.data.data());
-        myConn.SendNow(RTMPStream::SendCTL(5, RTMPStream::snd_window_size)); // send window acknowledgement size (msg 5)
+        peer().SendNow(RTMPStream::SendCTL(5, RTMPStream::snd_window_size)); // send window acknowledgement size (msg 5)
         break;
       case 8:    // audio data
       case 9:    // video data
@@ -1826,4 +1904,36 @@ namespace Mist{
       }
     }
   }
+
+  void OutRTMP::connStats(uint64_t now, Comms::Connections &statComm){
+    if (!targets.size()){
+      Output::connStats(now, statComm);
+      return;
+    }
+    uint64_t up = 0;
+    for (std::deque<RTMPTarget *>::iterator it = targets.begin(); it != targets.end(); ++it){
+      up += (*it)->stats.bytes;
+    }
+    statComm.setUp(up);
+    statComm.setTime(now - myConn.connTime());
+  }
+
+  void OutRTMP::stopTarget(size_t idx){
+    if (idx >= targets.size()){return;}
+    RTMPTarget *tgt = targets[idx];
+    if (tgt->conn && tgt->publishing){
+      selectTarget(tgt);
+      sendDeleteStream();
+    }
+    tgt->conn.close();
+    tgt->publishing = false;
+    tgt->stats.stopped = true;
+    tgt->stats.active = false;
+  }
+
+  void OutRTMP::fanOutStatus(JSON::Value &status){
+    for (std::deque<RTMPTarget *>::iterator it = targets.begin(); it != targets.end(); ++it){
+      (*it)->stats.fillStatus(status.append());
+    }
+  }
 }// namespace Mist
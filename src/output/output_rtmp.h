@@ -8,10 +8,38 @@
 #include <mist/adts.h>
 
 namespace Mist{
+  /// A single destination of a fan-out RTMP push.
+  /// Each target has its own connection, chunk state and connect/publish exchange, and is
+  /// reconnected on its own, backing off exponentially while it stays unreachable.
+  class RTMPTarget{
+  public:
+    RTMPTarget(const std::string &tgt);
+    void retryLater();
+    HTTP::URL url;
+    std::string streamOut; ///< Stream name to publish as.
+    std::string authArgs;  ///< Authentication arguments for the next connect request.
+    Socket::Connection conn;
+    RTMPStream::Session session; ///< Chunk and window state, while another target is handled.
+    PushTargetStats stats;
+    uint8_t authAttempts;
+    uint64_t lastAck;
+    uint64_t nextConnect;    ///< Util::bootMS() time of the next connection attempt.
+    uint64_t backoff;        ///< Milliseconds to wait after the next failed connection attempt.
+    uint64_t handshakeStart; ///< Util::bootMS() time the handshake was started, 0 once it completed.
+    bool opened;             ///< True from opening the connection until it is dropped.
+    bool publishing;         ///< True once the publish request was sent.
+    bool sentHeader;         ///< True once the init data was sent to this target.
+    bool wasPublishing;
+
+  private:
+    RTMPTarget(const RTMPTarget &);
+    RTMPTarget &operator=(const RTMPTarget &);
+  };
 
   class OutRTMP : public Output{
   public:
     OutRTMP(Socket::Connection &conn);
+    ~OutRTMP();
     static void init(Util::Config *cfg);
     void onRequest();
     void sendNext();
@@ -21,6 +49,10 @@ namespace Mist{
     bool onFinish();
 
   protected:
+    virtual void connStats(uint64_t now, Comms::Connections &statComm);
+    virtual void fanOutStatus(JSON::Value &status);
+    virtual void stopTarget(size_t idx);
+    inline virtual bool keepGoing(){return config->is_active && (targets.size() || myConn);}
     std::string streamOut; ///< When pushing out, the output stream name
     bool setRtmpOffset;
     int64_t rtmpOffset;
@@ -31,6 +63,20 @@ namespace Mist{
     void parseAMFCommand(AMF::Object &amfData, int messageType, int streamId);
     void sendCommand(AMF::Object &amfReply, int messageType, int streamId);
     void startPushOut(const char *args);
+    void sendConnect(const std::string &args);
+    void sendDeleteStream();
+    void sendInitData();
+    bool atJoinPoint();
+    void sendMedia(char msgType, uint64_t timestamp, const char *dataheader, size_t dheader_len,
+                   const char *data, size_t len);
+    void sendChunks(char msgType, uint64_t timestamp, const char *dataheader, size_t dheader_len,
+                    const char *data, size_t len);
+    Socket::Connection &peer(){return curTarget ? curTarget->conn : myConn;}
+    void selectTarget(RTMPTarget *tgt);
+    void swapTarget(RTMPTarget *tgt);
+    void serviceTargets();
+    std::deque<RTMPTarget *> targets; ///< Targets of a fan-out push; myConn is unused if there are any.
+    RTMPTarget *curTarget; ///< Target whose connection state is currently in use, if any.
     uint64_t lastAck;
     HTTP::URL pushApp, pushUrl;
     uint8_t authAttempts;
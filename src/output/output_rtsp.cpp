@@ -66,6 +66,14 @@ namespace Mist{
     if (mainConn){mainConn->addUp(len);}
   }
 
+  /// Function used to queue RTP packets for sending over UDP, in batches
+  /// The socket must be flushed once all packets for the current frame are queued.
+  ///\param socket A UDP Connection pointer, sent as a void*, to keep portability.
+  void sendUDPBatched(void *socket, const char *data, size_t len, uint8_t){
+    ((Socket::UDPConnection *)socket)->sendBatched(data, len);
+    if (mainConn){mainConn->addUp(len);}
+  }
+
   /// Function used to send RTP packets over TCP
   ///\param socket A TCP Connection pointer, sent as a void*, to keep portability.
   ///\param data The RTP Packet that needs to be sent
@@ -147,7 +155,7 @@ namespace Mist{
 
     if (sdpState.tracks[thisIdx].channel == -1){// UDP connection
       socket = &sdpState.tracks[thisIdx].data;
-      callBack = sendUDP;
+      callBack = sendUDPBatched;
     }else{
       socket = &myConn;
       callBack = sendTCP;
@@ -157,11 +165,12 @@ namespace Mist{
     sdpState.tracks[thisIdx].pack.setTimestamp((timestamp + offset) * SDP::getMultiplier(&M, thisIdx));
     sdpState.tracks[thisIdx].pack.sendData(socket, callBack, dataPointer, dataLen,
                                            sdpState.tracks[thisIdx].channel, meta.getCodec(thisIdx));
+    if (sdpState.tracks[thisIdx].channel == -1){sdpState.tracks[thisIdx].data.flush();}
 
 
     if (Util::bootSecs() != sdpState.tracks[thisIdx].rtcpSent){
       if (sdpState.tracks[thisIdx].channel == -1){// UDP connection
-        sdpState.tracks[thisIdx].pack.sendRTCP_SR(&sdpState.tracks[thisIdx].rtcp, 0, callBack);
+        sdpState.tracks[thisIdx].pack.sendRTCP_SR(&sdpState.tracks[thisIdx].rtcp, 0, sendUDP);
       }else{
         sdpState.tracks[thisIdx].pack.sendRTCP_SR(socket, sdpState.tracks[thisIdx].channel, callBack);
       }
@@ -23,6 +23,14 @@ namespace Mist{
     if (mainConn){mainConn->addUp(len);}
   }
 
+  /// Function used to queue RTP packets for sending over UDP, in batches
+  /// The socket must be flushed once all packets for the current frame are queued.
+  ///\param socket A UDP Connection pointer, sent as a void*, to keep portability.
+  void sendUDPBatched(void *socket, const char *data, size_t len, uint8_t){
+    ((Socket::UDPConnection *)socket)->sendBatched(data, len);
+    if (mainConn){mainConn->addUp(len);}
+  }
+
   /// \brief Initializes the SDP state
   /// \param  port: Each track will have a data and RTCP port.
   ///                    These are consecutive and start at startPort
@@ -166,7 +174,7 @@ namespace Mist{
     // Get data socket and send RTCP
     if (sdpState.tracks[thisIdx].channel == -1){
       socket = &sdpState.tracks[thisIdx].data;
-      callBack = sendUDP;
+      callBack = sendUDPBatched;
       if (Util::bootSecs() != sdpState.tracks[thisIdx].rtcpSent){
         sdpState.tracks[thisIdx].pack.setTimestamp(timestamp * SDP::getMultiplier(&M, thisIdx));
         sdpState.tracks[thisIdx].rtcpSent = Util::bootSecs();
@@ -180,6 +188,7 @@ namespace Mist{
     sdpState.tracks[thisIdx].pack.setTimestamp((timestamp + offset) * SDP::getMultiplier(&M, thisIdx));
     sdpState.tracks[thisIdx].pack.sendData(socket, callBack, dataPointer, dataLen,
                                            sdpState.tracks[thisIdx].channel, meta.getCodec(thisIdx));
+    sdpState.tracks[thisIdx].data.flush();
     
     // Update last RTCP received variable
     if (exitOnNoRTCP){
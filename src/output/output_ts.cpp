@@ -6,86 +6,168 @@
 #include <mist/stream.h>
 
 namespace Mist{
+  TSTarget::TSTarget(const std::string &tgt) : stats(tgt){
+    udpSize = 7;
+    curFilled = 0;
+    wrapRTP = false;
+    sendFEC = false;
+    dropPercentage = 0;
+  }
+
+  /// Sets up the sockets for this target, configured by the given target parameters.
+  /// Returns false if the requested local interface could not be bound.
+  bool TSTarget::open(const HTTP::URL &target, const std::map<std::string, std::string> &params){
+    // Wrap TS packets inside an RTP packet
+    if (target.protocol == "tsrtp"){
+      // MP2T payload, no CSRC list and init to sequence number 1, random SSRC and random timestamp
+      tsOut = RTP::Packet(33, 1, rand(), rand());
+      wrapRTP = true;
+    }
+    if (wrapRTP && params.count("fec")){
+      if (params.at("fec") == "prompeg"){
+        uint8_t rows = 8;
+        uint8_t columns = 4;
+        if (params.count("rows")){
+          rows = atoi(params.at("rows").c_str());
+        }
+        if (params.count("columns")){
+          columns = atoi(params.at("columns").c_str());
+        }
+        if (tsOut.configureFEC(rows, columns)){
+          // Send Pro-MPEG FEC columns over port number + 2
+          fecColumnSock.SetDestination(target.host, target.getPort() + 2);
+          // Send Pro-MPEG FEC rows over port number + 4
+          fecRowSock.SetDestination(target.host, target.getPort() + 4);
+          sendFEC = true;
+        } else {
+          WARN_MSG("Failed to configure FEC. Running without forward error correction");
+        }
+      }else{
+        WARN_MSG("Unsupported FEC of name '%s'. Running without forward error correction", params.at("fec").c_str());
+      }
+    }
+    if (params.count("drop")){
+      dropPercentage = atoi(params.at("drop").c_str());
+    }
+    if (params.count("pkts")){udpSize = atoi(params.at("pkts").c_str());}
+    packetBuffer.reserve(188 * udpSize);
+    if (target.path.size()){
+      if (!pushSock.bind(0, target.path)){return false;}
+    }
+    pushSock.SetDestination(target.host, target.getPort());
+    stats.active = true;
+    return true;
+  }
+
+  /// Sends TS data to this target in datagrams of udpSize packets, returning the bytes sent.
+  size_t TSTarget::send(const char *tsData, size_t len){
+    size_t sent = 0;
+    if (!wrapRTP){
+      // Send all complete datagrams of udpSize packets at once, letting the kernel split them
+      packetBuffer.append(tsData, len - len % 188);
+      size_t full = packetBuffer.size() - packetBuffer.size() % (udpSize * 188);
+      if (full){
+        pushSock.SendNow(packetBuffer.data(), full, udpSize * 188);
+        sent = full;
+        packetBuffer.erase(0, full);
+      }
+      stats.bytes += sent;
+      return sent;
+    }
+    // Aggregated data may hold many TS packets; split them into datagrams of udpSize packets
+    for (size_t i = 0; i + 188 <= len; i += 188){
+      if (curFilled == udpSize){
+        // in MPEG-TS over RTP mode, wrap TS packets in a RTP header
+        // Send RTP packet itself
+        if (rand() % 100 >= dropPercentage){
+          tsOut.sendTS(&pushSock, packetBuffer.c_str(), packetBuffer.size());
+          sent += tsOut.getHsize() + tsOut.getPayloadSize();
+        } else {
+          INFO_MSG("Dropping RTP packet in order to simulate packet loss");
+          tsOut.sendNoPacket(packetBuffer.size());
+          ++stats.dropped;
+        }
+        if (sendFEC){
+          // Send FEC packet if available
+          uint64_t bytesSent = 0;
+          tsOut.parseFEC(&fecColumnSock, &fecRowSock, bytesSent, packetBuffer.c_str(), packetBuffer.size());
+          sent += bytesSent;
+        }
+        packetBuffer.clear();
+        packetBuffer.reserve(udpSize * 188);
+        curFilled = 0;
+      }
+      packetBuffer.append(tsData + i, 188);
+      curFilled++;
+    }
+    // RTP packets are queued on the socket; send those built from this data together
+    pushSock.flush();
+    stats.bytes += sent;
+    return sent;
+  }
+
   OutTS::OutTS(Socket::Connection &conn) : TSOutput(conn){
     sendRepeatingHeaders = 500; // PAT/PMT every 500ms (DVB spec)
+    tsFlushSize = TS_FLUSH_SIZE;
     streamName = config->getString("streamname");
     pushOut = false;
-    sendFEC = false;
-    wrapRTP = false;
-    dropPercentage = 0;
     std::string tracks = config->getString("tracks");
+    // Output::Output refused the fan-out push already
+    if (!config->is_active){return;}
     if (config->getString("target").size()){
-      HTTP::URL target(config->getString("target"));
-      if (target.protocol != "tsudp" && target.protocol != "tsrtp" && target.protocol != "tstcp"){
-        FAIL_MSG("Target %s must begin with tsudp:// or tsrtp:// or tstcp://, aborting", target.getUrl().c_str());
-        onFail("Invalid TS target: doesn't start with tsudp:// or tsrtp:// or tstcp://", true);
-        return;
-      }
-      if (!target.getPort()){
-        FAIL_MSG("Target %s must contain a port, aborting", target.getUrl().c_str());
-        onFail("Invalid TS target: missing port", true);
-        return;
-      }
-      // Wrap TS packets inside an RTP packet
-      wrapRTP = false;
-      if (target.protocol == "tsrtp"){
-        // MP2T payload, no CSRC list and init to sequence number 1, random SSRC and random timestamp
-        tsOut = RTP::Packet(33, 1, rand(), rand());
-        wrapRTP = true;
-      }
-      if (wrapRTP && targetParams.count("fec")){
-        if (targetParams.at("fec") == "prompeg"){
-          uint8_t rows = 8;
-          uint8_t columns = 4;
-          if (targetParams.count("rows")){
-            rows = atoi(targetParams.at("rows").c_str());
+      // A fan-out push sends the same TS data to each of its targets
+      std::deque<std::string> tgts = pushTargets;
+      if (!tgts.size()){tgts.push_back(config->getString("target"));}
+      for (std::deque<std::string>::iterator it = tgts.begin(); it != tgts.end(); ++it){
+        std::string tgtUrl = *it;
+        std::map<std::string, std::string> params = targetParams;
+        if (pushTargets.size()){
+          // Targets of a fan-out push only use their own parameters
+          params.clear();
+          if (tgtUrl.rfind('?') != std::string::npos){
+            HTTP::parseVars(tgtUrl.substr(tgtUrl.rfind('?') + 1), params);
+            tgtUrl.erase(tgtUrl.rfind('?'));
           }
-          if (targetParams.count("columns")){
-            columns = atoi(targetParams.at("columns").c_str());
+        }
+        HTTP::URL target(tgtUrl);
+        if (target.protocol != "tsudp" && target.protocol != "tsrtp" && target.protocol != "tstcp"){
+          FAIL_MSG("Target %s must begin with tsudp:// or tsrtp:// or tstcp://, aborting", target.getUrl().c_str());
+          onFail("Invalid TS target: doesn't start with tsudp:// or tsrtp:// or tstcp://", true);
+          return;
+        }
+        if (!target.getPort()){
+          FAIL_MSG("Target %s must contain a port, aborting", target.getUrl().c_str());
+          onFail("Invalid TS target: missing port", true);
+          return;
+        }
+        if (it == tgts.begin()){myConn.setHost(target.host);}
+        if (target.protocol == "tstcp"){
+          if (pushTargets.size()){
+            FAIL_MSG("Target %s cannot be combined with other targets, aborting", target.getUrl().c_str());
+            onFail("Invalid TS target: tstcp:// cannot be part of a fan-out push", true);
+            return;
           }
-          if (tsOut.configureFEC(rows, columns)){
-            // Send Pro-MPEG FEC columns over port number + 2
-            fecColumnSock.SetDestination(target.host, target.getPort() + 2);
-            // Send Pro-MPEG FEC rows over port number + 4
-            fecRowSock.SetDestination(target.host, target.getPort() + 4);
-            sendFEC = true;
-          } else {
-            WARN_MSG("Failed to configure FEC. Running without forward error correction");
+          myConn.open(target.host, target.getPort(), true);
+          if (!myConn){
+            disconnect();
+            streamName = "";
+            userSelect.clear();
+            config->is_active = false;
+            return;
           }
-        }else{
-          WARN_MSG("Unsupported FEC of name '%s'. Running without forward error correction", targetParams.at("fec").c_str());
+          continue;
         }
-      }
-      if (targetParams.count("drop")){
-        dropPercentage = atoi(targetParams.at("drop").c_str());
-      }
-      pushOut = true;
-      if (target.protocol == "tstcp"){
-        pushOut = false;
-        myConn.open(target.host, target.getPort(), true);
-        if (!myConn){
+        targets.push_back(new TSTarget(*it));
+        if (!targets.back()->open(target, params)){
           disconnect();
           streamName = "";
           userSelect.clear();
           config->is_active = false;
           return;
         }
+        pushOut = true;
       }
-      udpSize = 7;
       if (targetParams.count("tracks")){tracks = targetParams["tracks"];}
-      if (targetParams.count("pkts")){udpSize = atoi(targetParams["pkts"].c_str());}
-      packetBuffer.reserve(188 * udpSize);
-      if (target.path.size()){
-        if (!pushSock.bind(0, target.path)){
-          disconnect();
-          streamName = "";
-          userSelect.clear();
-          config->is_active = false;
-          return;
-        }
-      }
-      pushSock.SetDestination(target.host, target.getPort());
-      myConn.setHost(target.host);
       pushing = false;
     }else{
       //No push target? Check if this is a push input or pull output by waiting for data for 5s
@@ -151,7 +233,12 @@ namespace Mist{
     }
   }
 
-  OutTS::~OutTS(){}
+  OutTS::~OutTS(){
+    while (targets.size()){
+      delete targets.front();
+      targets.pop_front();
+    }
+  }
 
   void OutTS::init(Util::Config *cfg){
     Output::init(cfg);
@@ -188,12 +275,14 @@ namespace Mist{
     capa["push_urls"].append("tsudp://*");
     capa["push_urls"].append("tsrtp://*");
     capa["push_urls"].append("tstcp://*");
+    capa["push_fanout"] = true;
 
     JSON::Value opt;
     opt["arg"] = "string";
     opt["default"] = "";
     opt["arg_num"] = 1;
-    opt["help"] = "Target tsudp:// or tsrtp:// or tstcp:// URL to push out towards.";
+    opt["help"] = "Target tsudp:// or tsrtp:// or tstcp:// URL to push out towards. Several tsudp:// "
+                  "or tsrtp:// URLs separated by | are all sent the same data.";
     cfg->addOption("target", opt);
 
     capa["optional"]["datatrack"]["name"] = "MPEG Data track parser";
@@ -219,39 +308,15 @@ namespace Mist{
   void OutTS::initialSeek(bool dryRun){
     // Adds passthrough support to the regular initialSeek function
     if (targetParams.count("passthrough")){selectAllTracks();}
-    Output::initialSeek(dryRun);
+    TSOutput::initialSeek(dryRun);
   }
 
   void OutTS::sendTS(const char *tsData, size_t len){
     if (pushOut){
-      static size_t curFilled = 0;
-      if (curFilled == udpSize){
-        // in MPEG-TS over RTP mode, wrap TS packets in a RTP header
-        if (wrapRTP){
-          // Send RTP packet itself
-          if (rand() % 100 >= dropPercentage){
-            tsOut.sendTS(&pushSock, packetBuffer.c_str(), packetBuffer.size());
-            myConn.addUp(tsOut.getHsize() + tsOut.getPayloadSize());
-          } else {
-            INFO_MSG("Dropping RTP packet in order to simulate packet loss");
-            tsOut.sendNoPacket(packetBuffer.size());
-          }
-          if (sendFEC){
-            // Send FEC packet if available
-            uint64_t bytesSent = 0;
-            tsOut.parseFEC(&fecColumnSock, &fecRowSock, bytesSent, packetBuffer.c_str(), packetBuffer.size());
-            myConn.addUp(bytesSent);
-          }
-        }else{
-          pushSock.SendNow(packetBuffer);
-          myConn.addUp(packetBuffer.size());
-        }
-        packetBuffer.clear();
-        packetBuffer.reserve(udpSize * len);
-        curFilled = 0;
+      for (std::deque<TSTarget *>::iterator it = targets.begin(); it != targets.end(); ++it){
+        if ((*it)->stats.stopped){continue;}
+        myConn.addUp((*it)->send(tsData, len));
       }
-      packetBuffer.append(tsData, len);
-      curFilled++;
     }else{
       myConn.SendNow(tsData, len);
       if (!myConn){
@@ -265,12 +330,24 @@ namespace Mist{
     if (!pushOut) { return Output::getConnectedHost(); }
     std::string hostname;
     uint32_t port;
-    pushSock.GetDestination(hostname, port);
+    targets.front()->pushSock.GetDestination(hostname, port);
     return hostname;
   }
   std::string OutTS::getConnectedBinHost(){
     if (!pushOut) { return Output::getConnectedBinHost(); }
-    return pushSock.getBinDestination();
+    return targets.front()->pushSock.getBinDestination();
+  }
+
+  void OutTS::fanOutStatus(JSON::Value &status){
+    for (std::deque<TSTarget *>::iterator it = targets.begin(); it != targets.end(); ++it){
+      (*it)->stats.fillStatus(status.append());
+    }
+  }
+
+  void OutTS::stopTarget(size_t idx){
+    if (idx >= targets.size()){return;}
+    targets[idx]->stats.stopped = true;
+    targets[idx]->stats.active = false;
   }
 
   bool OutTS::listenMode(){return !(config->getString("target").size());}
@@ -2,6 +2,29 @@
 #include <mist/ts_stream.h>
 #include <mist/rtp.h>
 namespace Mist{
+  /// A single tsudp:// or tsrtp:// destination, with its own socket and RTP/FEC state.
+  class TSTarget{
+  public:
+    TSTarget(const std::string &tgt);
+    bool open(const HTTP::URL &target, const std::map<std::string, std::string> &params);
+    size_t send(const char *tsData, size_t len);
+    PushTargetStats stats;
+    Socket::UDPConnection pushSock;
+
+  private:
+    TSTarget(const TSTarget &);
+    TSTarget &operator=(const TSTarget &);
+    size_t udpSize;
+    size_t curFilled;
+    bool wrapRTP;
+    bool sendFEC;
+    uint8_t dropPercentage;
+    std::string packetBuffer;
+    Socket::UDPConnection fecColumnSock;
+    Socket::UDPConnection fecRowSock;
+    RTP::Packet tsOut;
+  };
+
   class OutTS : public TSOutput{
   public:
     OutTS(Socket::Connection &conn);
@@ -16,21 +39,15 @@ namespace Mist{
     std::string getConnectedBinHost();
 
   private:
-    size_t udpSize;
     bool pushOut;
-    bool wrapRTP;
-    bool sendFEC;
     void onRTP(void *socket, const char *data, size_t nbytes);
-    std::string packetBuffer;
-    Socket::UDPConnection pushSock;
-    Socket::UDPConnection fecColumnSock;
-    Socket::UDPConnection fecRowSock;
-    uint8_t dropPercentage;
+    std::deque<TSTarget *> targets;
     TS::Stream tsIn;
     std::string getStatsName();
-    RTP::Packet tsOut;
 
   protected:
+    void fanOutStatus(JSON::Value &status);
+    void stopTarget(size_t idx);
     inline virtual bool keepGoing(){
       return config->is_active && (!listenMode() || myConn);
     }
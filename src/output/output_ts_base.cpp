@@ -8,6 +8,44 @@ namespace Mist{
     setBlocking(true);
     sendRepeatingHeaders = 0;
     lastHeaderTime = 0;
+    tsFlushSize = 0;
+    tsBatchLive = false;
+  }
+
+  /// Queues TS packets for sendTS, which is called once tsFlushSize bytes are waiting.
+  /// When tsFlushSize is zero, the packets are passed to sendTS immediately.
+  void TSOutput::bufferTS(const char *tsData, size_t len){
+    if (!tsFlushSize){
+      sendTS(tsData, len);
+      return;
+    }
+    tsBuffer.append(tsData, len);
+    if (tsBuffer.size() >= tsFlushSize){flushTS();}
+  }
+
+  /// Passes all queued TS packets to sendTS in a single call.
+  void TSOutput::flushTS(){
+    if (!tsBuffer.size()){return;}
+    sendTS(tsBuffer, tsBuffer.size());
+    tsBuffer.truncate(0);
+  }
+
+  /// Drops packets still queued for a previous request or position before seeking.
+  void TSOutput::initialSeek(bool dryRun){
+    if (!dryRun){tsBuffer.truncate(0);}
+    TS_BASECLASS::initialSeek(dryRun);
+  }
+
+  bool TSOutput::onFinish(){
+    flushTS();
+    return TS_BASECLASS::onFinish();
+  }
+
+  /// Flushes queued packets when stopping, so they are written before a recording switches files.
+  bool TSOutput::reachedPlannedStop(){
+    if (!TS_BASECLASS::reachedPlannedStop()){return false;}
+    flushTS();
+    return true;
   }
 
   void TSOutput::fillPacket(char const *data, size_t dataLen, bool &firstPack, bool video,
@@ -25,12 +63,12 @@ namespace Mist{
           TS::Packet tmpPack;
           tmpPack.FromPointer(TS::PAT);
           tmpPack.setContinuityCounter(++contPAT);
-          sendTS(tmpPack.checkAndGetBuffer());
-          sendTS(TS::createPMT(selectedTracks, M, ++contPMT));
-          sendTS(TS::createSDT(streamName, ++contSDT));
+          bufferTS(tmpPack.checkAndGetBuffer());
+          bufferTS(TS::createPMT(selectedTracks, M, ++contPMT));
+          bufferTS(TS::createSDT(streamName, ++contSDT));
           packCounter += 3;
         }
-        sendTS(packData.checkAndGetBuffer());
+        bufferTS(packData.checkAndGetBuffer());
         packCounter++;
         packData.clear();
       }
@@ -85,7 +123,8 @@ namespace Mist{
     thisPacket.getString("data", dataPointer, dataLen); // data
 
     if (codec == "rawts"){
-      for (size_t i = 0; i+188 <= dataLen; i+=188){sendTS(dataPointer+i, 188);}
+      for (size_t i = 0; i+188 <= dataLen; i+=188){bufferTS(dataPointer+i, 188);}
+      if (realTime || (M.getLive() && !tsBatchLive)){flushTS();}
       return;
     }
 
@@ -240,5 +279,7 @@ namespace Mist{
       packData.addStuffing();
       fillPacket(0, 0, firstPack, video, keyframe, pkgPid, contPkg);
     }
+    // Paced and live playback write out every access unit, so aggregation adds no latency
+    if (realTime || (M.getLive() && !tsBatchLive)){flushTS();}
   }
 }// namespace Mist
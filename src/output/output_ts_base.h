@@ -8,6 +8,9 @@
 #define TS_BASECLASS Output
 #endif
 
+/// Size at which aggregated TS packets are written out; a whole number of packets close to 64KiB.
+#define TS_FLUSH_SIZE (348 * 188)
+
 namespace Mist{
 
   class TSOutput : public TS_BASECLASS{
@@ -16,11 +19,17 @@ namespace Mist{
     virtual ~TSOutput(){};
     virtual void sendNext();
     virtual void sendTS(const char *tsData, size_t len = 188){};
+    void bufferTS(const char *tsData, size_t len = 188);
+    void flushTS();
+    virtual bool onFinish();
+    virtual bool reachedPlannedStop();
     void fillPacket(char const *data, size_t dataLen, bool &firstPack, bool video, bool keyframe,
                     size_t pkgPid, uint16_t &contPkg);
+    virtual void initialSeek(bool dryRun = false);
     virtual void sendHeader(){
       sentHeader = true;
       packCounter = 0;
+      tsBuffer.truncate(0);
     }
 
   protected:
@@ -35,5 +44,8 @@ namespace Mist{
     uint64_t sendRepeatingHeaders; ///< Amount of ms between PAT/PMT. Zero means do not repeat.
     uint64_t lastHeaderTime;       ///< Timestamp last PAT/PMT were sent.
     uint64_t ts_from;              ///< Starting time to subtract from timestamps
+    size_t tsFlushSize;            ///< Amount of bytes to aggregate before calling sendTS. Zero means one call per packet.
+    bool tsBatchLive;              ///< If true, live data is aggregated like VoD data instead of flushed per access unit.
+    Util::ResizeablePointer tsBuffer; ///< Aggregated TS packets not yet passed to sendTS.
   };
 }// namespace Mist
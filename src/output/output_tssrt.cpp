@@ -6,10 +6,75 @@
 #include <mist/encode.h>
 #include <mist/stream.h>
 #include <mist/triggers.h>
+#include <algorithm>
 
 bool allowStreamNameOverride = true;
 
 namespace Mist{
+  SRTTarget::SRTTarget(const std::string &tgt) : url(tgt), stats(tgt){
+    HTTP::parseVars(url.args, params);
+    nextConnect = 0;
+    backoff = 1000;
+    wasConnected = false;
+    connecting = false;
+  }
+
+  /// Starts a connection attempt, unless the backoff time after the previous failed attempt has
+  /// not passed yet. This does not wait for the handshake; send checks on its progress.
+  void SRTTarget::connect(){
+    if (Util::bootMS() < nextConnect){return;}
+    conn.connect(url.host, url.getPort(), "output", params);
+    if (!conn){
+      retryLater();
+      return;
+    }
+    connecting = true;
+  }
+
+  /// Schedules the next connection attempt after a failed one, backing off exponentially.
+  void SRTTarget::retryLater(){
+    nextConnect = Util::bootMS() + backoff;
+    WARN_MSG("Could not connect to %s, retrying in %" PRIu64 "ms", stats.target.c_str(), backoff);
+    backoff = std::min(backoff * 2, (uint64_t)30000);
+  }
+
+  /// Returns true if this target is connected, finishing a connection attempt in progress once
+  /// its handshake completed or failed.
+  bool SRTTarget::checkConnected(){
+    if (!connecting){return conn;}
+    if (conn.isConnecting()){return false;}
+    connecting = false;
+    if (!conn){
+      retryLater();
+      return false;
+    }
+    if (wasConnected){++stats.reconnects;}
+    wasConnected = true;
+    stats.active = true;
+    return true;
+  }
+
+  /// Sends data to this target, dropping it when the target is unreachable, still connecting or
+  /// cannot keep up. Never blocks, so one slow target does not hold up the others.
+  /// Returns true if the data was accepted for sending.
+  bool SRTTarget::send(const char *data, size_t len){
+    if (!conn){
+      if (stats.active){
+        WARN_MSG("Lost connection to %s", stats.target.c_str());
+        stats.active = false;
+        nextConnect = Util::bootMS() + backoff;
+      }
+      connect();
+    }
+    if (checkConnected() && conn.SendNow(data, len)){
+      stats.bytes += len;
+      backoff = 1000;
+      return true;
+    }
+    ++stats.dropped;
+    return false;
+  }
+
   OutTSSRT::OutTSSRT(Socket::Connection &conn, Socket::SRTConnection & _srtSock) : TSOutput(conn), srtConn(_srtSock){
     // NOTE: conn is useless for SRT, as it uses a different socket type.
     sendRepeatingHeaders = 500; // PAT/PMT every 500ms (DVB spec)
@@ -18,8 +83,39 @@ namespace Mist{
     pushOut = false;
     bootMSOffsetCalculated = false;
     assembler.setLive();
-    // Push output configuration
-    if (config->getString("target").size()){
+    // Output::Output refused the fan-out push already
+    if (!config->is_active){return;}
+    // Fan-out push output configuration: the same data goes to each target, over its own connection
+    if (pushTargets.size()){
+      for (std::deque<std::string>::iterator it = pushTargets.begin(); it != pushTargets.end(); ++it){
+        targets.push_back(new SRTTarget(*it));
+        HTTP::URL &tgt = targets.back()->url;
+        if (tgt.protocol != "srt"){
+          FAIL_MSG("Target %s must begin with srt://, aborting", tgt.getUrl().c_str());
+          onFail("Invalid srt target: doesn't start with srt://", true);
+          return;
+        }
+        if (!tgt.getPort()){
+          FAIL_MSG("Target %s must contain a port, aborting", tgt.getUrl().c_str());
+          onFail("Invalid srt target: missing port", true);
+          return;
+        }
+        std::string mode = Socket::interpretSRTMode(tgt);
+        if (mode != "caller" && mode != "rendezvous"){
+          FAIL_MSG("Target %s is not in caller or rendezvous mode, aborting", tgt.getUrl().c_str());
+          onFail("Invalid srt target: only caller and rendezvous targets can be combined", true);
+          return;
+        }
+      }
+      pushOut = true;
+      for (std::deque<SRTTarget *>::iterator it = targets.begin(); it != targets.end(); ++it){
+        (*it)->connect();
+      }
+      wantRequest = false;
+      parseData = true;
+      initialize();
+    }else if (config->getString("target").size()){
+      // Push output configuration
       target = HTTP::URL(config->getString("target"));
       if (target.protocol != "srt"){
         FAIL_MSG("Target %s must begin with srt://, aborting", target.getUrl().c_str());
@@ -135,10 +231,19 @@ namespace Mist{
   bool OutTSSRT::onFinish(){
     myConn.close();
     srtConn.close();
+    for (std::deque<SRTTarget *>::iterator it = targets.begin(); it != targets.end(); ++it){
+      (*it)->conn.close();
+    }
     return false;
   }
 
-  OutTSSRT::~OutTSSRT(){}
+  OutTSSRT::~OutTSSRT(){
+    while (targets.size()){
+      targets.front()->conn.close();
+      delete targets.front();
+      targets.pop_front();
+    }
+  }
 
   static void addIntOpt(JSON::Value & pp, const std::string & param, const std::string & name, const std::string & help, size_t def = 0){
     pp[param]["name"] = name;
@@ -228,6 +333,7 @@ namespace Mist{
     capa["optional"]["port"]["help"] = "UDP port to listen on";
     config = cfg;
     capa["push_urls"].append("srt://*");
+    capa["push_fanout"] = true;
 
     config->addStandardPushCapabilities(capa);
     JSON::Value & pp = capa["push_parameters"];
@@ -292,7 +398,8 @@ namespace Mist{
     opt["arg"] = "string";
     opt["default"] = "";
     opt["arg_num"] = 1;
-    opt["help"] = "Target srt:// URL to push out towards.";
+    opt["help"] = "Target srt:// URL to push out towards. Several caller or rendezvous srt:// URLs "
+                  "separated by | are all sent the same data.";
     cfg->addOption("target", opt);
 
     capa["optional"]["datatrack"]["name"] = "MPEG Data track parser";
@@ -318,6 +425,15 @@ namespace Mist{
   // Buffers TS packets and sends after 7 are buffered.
   void OutTSSRT::sendTS(const char *tsData, size_t len){
     packetBuffer.append(tsData, len);
+    if (packetBuffer.size() >= 1316 && targets.size()){
+      // A target that is down or cannot keep up drops data instead of holding back the others
+      for (std::deque<SRTTarget *>::iterator it = targets.begin(); it != targets.end(); ++it){
+        if ((*it)->stats.stopped){continue;}
+        if ((*it)->send(packetBuffer, packetBuffer.size())){myConn.addUp(packetBuffer.size());}
+      }
+      packetBuffer.assign(0,0);
+      return;
+    }
     if (packetBuffer.size() >= 1316){//7 whole TS packets
       if (!srtConn){
         if (config->getString("target").size()){
@@ -412,6 +528,10 @@ namespace Mist{
   }
 
   void OutTSSRT::connStats(uint64_t now, Comms::Connections &statComm){
+    if (targets.size()){
+      Output::connStats(now, statComm);
+      return;
+    }
     if (!srtConn){return;}
     statComm.setUp(srtConn.dataUp());
     statComm.setDown(srtConn.dataDown());
@@ -421,6 +541,25 @@ namespace Mist{
     statComm.setPacketRetransmitCount(srtConn.packetRetransmitCount());
   }
 
+  void OutTSSRT::stopTarget(size_t idx){
+    if (idx >= targets.size()){return;}
+    targets[idx]->conn.close();
+    targets[idx]->stats.stopped = true;
+    targets[idx]->stats.active = false;
+  }
+
+  void OutTSSRT::fanOutStatus(JSON::Value &status){
+    for (std::deque<SRTTarget *>::iterator it = targets.begin(); it != targets.end(); ++it){
+      JSON::Value &tgt = status.append();
+      (*it)->stats.fillStatus(tgt);
+      if ((*it)->conn){
+        tgt["pkt_count"] = (*it)->conn.packetCount();
+        tgt["pkt_lost"] = (*it)->conn.packetLostCount();
+        tgt["pkt_retrans"] = (*it)->conn.packetRetransmitCount();
+      }
+    }
+  }
+
 }// namespace Mist
 
 
@@ -490,7 +629,9 @@ int main(int argc, char *argv[]){
     Util::sysSetNrOpenFiles(filelimit);
 
     std::string target = conf.getString("target");
-    if (!mistOut::listenMode() && (!target.size() || Socket::interpretSRTMode(HTTP::URL(target)) != "listener")){
+    // Fan-out targets are never listeners, so they are always handled by a single process
+    bool fanOut = target.size() && Util::getPushTargets(target).size() > 1;
+    if (!mistOut::listenMode() && (!target.size() || fanOut || Socket::interpretSRTMode(HTTP::URL(target)) != "listener")){
       Socket::Connection S(fileno(stdout), fileno(stdin));
       Socket::SRTConnection tmpSock;
       mistOut tmp(S, tmpSock);
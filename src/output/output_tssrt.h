@@ -3,6 +3,30 @@
 #include <mist/socket_srt.h>
 
 namespace Mist{
+  /// A single caller or rendezvous destination of a fan-out SRT push.
+  /// Each target is (re)connected on its own without blocking, backing off exponentially while
+  /// it stays unreachable.
+  class SRTTarget{
+  public:
+    SRTTarget(const std::string &tgt);
+    void connect();
+    bool checkConnected();
+    bool send(const char *data, size_t len);
+    HTTP::URL url;
+    std::map<std::string, std::string> params;
+    Socket::SRTConnection conn;
+    PushTargetStats stats;
+
+  private:
+    SRTTarget(const SRTTarget &);
+    SRTTarget &operator=(const SRTTarget &);
+    uint64_t nextConnect; ///< Util::bootMS() time of the next connection attempt.
+    uint64_t backoff;     ///< Milliseconds to wait after the next failed connection attempt.
+    bool wasConnected;
+    bool connecting; ///< True while the handshake of a connection attempt is in progress.
+    void retryLater();
+  };
+
   class OutTSSRT : public TSOutput{
   public:
     OutTSSRT(Socket::Connection &conn, Socket::SRTConnection & _srtSock);
@@ -17,8 +41,14 @@ namespace Mist{
     virtual bool onFinish();
   protected:
     virtual void connStats(uint64_t now, Comms::Connections &statComm);
-    virtual std::string getConnectedHost(){return srtConn.remotehost;}
-    virtual std::string getConnectedBinHost(){return srtConn.getBinHost();}
+    virtual void fanOutStatus(JSON::Value &status);
+    virtual void stopTarget(size_t idx);
+    virtual std::string getConnectedHost(){
+      return targets.size() ? targets.front()->conn.remotehost : srtConn.remotehost;
+    }
+    virtual std::string getConnectedBinHost(){
+      return targets.size() ? targets.front()->conn.getBinHost() : srtConn.getBinHost();
+    }
     virtual bool dropPushTrack(uint32_t trackId, const std::string & dropReason);
   private:
     HTTP::URL target;
@@ -30,6 +60,7 @@ namespace Mist{
     TS::Stream tsIn;
     TS::Assembler assembler;
     bool bootMSOffsetCalculated;
+    std::deque<SRTTarget *> targets; ///< Targets of a fan-out push; srtConn is unused if there are any.
 
     Socket::SRTConnection & srtConn;
   };
@@ -345,7 +345,7 @@ namespace Mist{
     if (req.method == "OPTIONS"){
       H.setCORSHeaders();
       H.StartResponse("200", "All good", req, myConn);
-      H.Chunkify(0, 0, myConn);
+      H.Chunkify("", 0, myConn);
     }
     if (req.method == "POST"){
       if (req.GetHeader("Content-Type") == "application/sdp"){
@@ -358,7 +358,7 @@ namespace Mist{
           H.setCORSHeaders();
           H.StartResponse("400", "Could not parse", req, myConn);
           H.Chunkify("Failed to parse offer SDP", myConn);
-          H.Chunkify(0, 0, myConn);
+          H.Chunkify("", 0, myConn);
           return;
         }
 
@@ -439,14 +439,14 @@ namespace Mist{
           H.setCORSHeaders();
           H.StartResponse("201", "Created", req, myConn);
           H.Chunkify(sdpAnswer.toString(), myConn);
-          H.Chunkify(0, 0, myConn);
+          H.Chunkify("", 0, myConn);
           myConn.close();
           return;
         }else{
           H.setCORSHeaders();
           H.StartResponse("403", "Not allowed", req, myConn);
           H.Chunkify("Request not allowed", myConn);
-          H.Chunkify(0, 0, myConn);
+          H.Chunkify("", 0, myConn);
           return;
         }
       }
@@ -457,7 +457,7 @@ namespace Mist{
       H.setCORSHeaders();
       H.StartResponse("405", "PATCH not supported", req, myConn);
       H.Chunkify("This endpoint only supports WHIP/WHEP/WISH POST requests or WebSocket connections", myConn);
-      H.Chunkify(0, 0, myConn);
+      H.Chunkify("", 0, myConn);
       return;
     }
 
@@ -465,7 +465,7 @@ namespace Mist{
     H.setCORSHeaders();
     H.StartResponse("405", "Must POST or use websocket", req, myConn);
     H.Chunkify("This endpoint only supports WHIP/WHEP/WISH POST requests or WebSocket connections", myConn);
-    H.Chunkify(0, 0, myConn);
+    H.Chunkify("", 0, myConn);
   }
 
   // This function is executed when we receive a signaling data.
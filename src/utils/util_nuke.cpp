@@ -5,6 +5,8 @@
 #include <mist/procs.h>
 #include <mist/comms.h>
 #include <mist/config.h>
+#include <cstring>
+#include <sys/file.h>
 
 const char * getStateString(uint8_t state){
   switch (state){
@@ -81,6 +83,11 @@ int main(int argc, char **argv){
       std::set<pid_t> checkPids;
       Util::RelAccX stream(streamPage.mapped, false);
       if (stream.isReady()){
+        // Data pages may be stored under a prefix shared with other streams using the same content
+        std::string pagePrefix = argv[1];
+        if (stream.hasField("pageprefix") && strlen(stream.getPointer("pageprefix"))){
+          pagePrefix = stream.getPointer("pageprefix");
+        }
         Util::RelAccX trackList(stream.getPointer("tracks"), false);
         if (trackList.isReady()){
           for (size_t i = 0; i < trackList.getPresent(); i++){
@@ -99,9 +106,10 @@ int main(int argc, char **argv){
                   for (uint64_t j = pages.getDeleted(); j < pages.getEndPos(); j++){
                     char thisPageName[NAME_BUFFER_SIZE];
                     snprintf(thisPageName, NAME_BUFFER_SIZE, SHM_TRACK_DATA,
-                             argv[1], i, (uint32_t)pages.getInt("firstkey", j));
+                             pagePrefix.c_str(), i, (uint32_t)pages.getInt("firstkey", j));
                     IPC::sharedPage p(thisPageName, 0);
-                    p.master = true;
+                    // Leave shared pages alone while another stream's input still holds them
+                    p.master = (!p || !flock(p.handle, LOCK_EX | LOCK_NB));
                   }
                 }
               }
@@ -0,0 +1,144 @@
+#include <mist/bitfields.h>
+#include <mist/encryption.h>
+#include <mist/timing.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#define AES_BENCH_BYTES (64 * 1024 * 1024)
+
+static const char testKey[16] ={0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+                                 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+
+/// Returns a string of len pseudo-random bytes
+static std::string randomData(size_t len){
+  std::string ret(len, 0);
+  for (size_t i = 0; i < len; ++i){ret[i] = rand() % 256;}
+  return ret;
+}
+
+/// Returns a length-prefixed H264 sample holding NAL units of the given sizes, as Fairplay
+/// encryption expects. All units are slices, so each one larger than 48 bytes gets encrypted.
+static std::string h264Sample(const size_t *sizes, size_t count){
+  std::string ret;
+  for (size_t i = 0; i < count; ++i){
+    char len[4];
+    Bit::htobl(len, sizes[i]);
+    ret.append(len, 4);
+    std::string nal = randomData(sizes[i]);
+    nal[0] = (i == 0) ? 0x65 : 0x41;
+    ret.append(nal);
+  }
+  return ret;
+}
+
+/// Checks AES-CBC against the NIST SP 800-38A F.2.1 vector, on whichever backend is active.
+static int checkVector(Encryption::AES &aes){
+  const char plain[32] ={0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e,
+                         0x11, 0x73, 0x93, 0x17, 0x2a, 0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03,
+                         0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51};
+  const char cipher[32] ={0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46, 0xce, 0xe9, 0x8e,
+                          0x9b, 0x12, 0xe9, 0x19, 0x7d, 0x50, 0x86, 0xcb, 0x9b, 0x50, 0x72,
+                          0x19, 0xee, 0x95, 0xdb, 0x11, 0x3a, 0x91, 0x76, 0x78, 0xb2};
+  char ivec[16];
+  for (size_t i = 0; i < 16; ++i){ivec[i] = i;}
+  char out[32];
+  if (!aes.encryptBlockCBC(ivec, plain, out, 32) || memcmp(out, cipher, 32) || memcmp(ivec, cipher + 16, 16)){
+    std::cerr << "CBC test vector mismatch (accelerated: " << aes.isAccelerated() << ")" << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+/// Encrypts random data of many lengths with both backends and compares the results.
+static int compareBackends(Encryption::AES &fast, Encryption::AES &slow){
+  int failures = 0;
+  for (size_t i = 0; i < 2000 && failures < 10; ++i){
+    size_t len = rand() % 3000;
+    uint64_t ivec = ((uint64_t)rand() << 32) | rand();
+    std::string data = randomData(len);
+    if (fast.encryptBlockCTR(ivec, data) != slow.encryptBlockCTR(ivec, data)){
+      std::cerr << "CTR mismatch for " << len << " bytes" << std::endl;
+      ++failures;
+    }
+    data.resize(len & ~(size_t)15);
+    char ivA[16], ivB[16];
+    for (size_t j = 0; j < 16; ++j){ivA[j] = ivB[j] = rand();}
+    if (fast.encryptBlockCBC(ivA, data) != slow.encryptBlockCBC(ivB, data) || memcmp(ivA, ivB, 16)){
+      std::cerr << "CBC mismatch for " << data.size() << " bytes" << std::endl;
+      ++failures;
+    }
+    size_t sizes[3];
+    sizes[0] = rand() % 2000 + 1;
+    sizes[1] = rand() % 60 + 1;
+    sizes[2] = rand() % 5000 + 1;
+    std::string sample = h264Sample(sizes, 3);
+    std::string outA(sample.size(), 0), outB(sample.size(), 0);
+    for (size_t j = 0; j < 16; ++j){ivA[j] = ivB[j] = rand();}
+    if (!fast.encryptH264BlockFairplay(ivA, sample.data(), (char *)outA.data(), sample.size()) ||
+        !slow.encryptH264BlockFairplay(ivB, sample.data(), (char *)outB.data(), sample.size()) ||
+        outA != outB || memcmp(ivA, ivB, 16)){
+      std::cerr << "Fairplay mismatch for NAL units of " << sizes[0] << ", " << sizes[1] << " and "
+                << sizes[2] << " bytes" << std::endl;
+      ++failures;
+    }
+  }
+  return failures;
+}
+
+/// Encrypts AES_BENCH_BYTES worth of samples of the given size and prints the throughput.
+static void bench(Encryption::AES &aes, const char *name, size_t sampleSize){
+  std::string data = randomData(sampleSize);
+  std::string out(sampleSize, 0);
+  size_t nalSizes[1] ={sampleSize - 4};
+  std::string sample = h264Sample(nalSizes, 1);
+  size_t loops = AES_BENCH_BYTES / sampleSize;
+  char ivec[16] ={0};
+
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < loops; ++i){aes.encryptBlockCTR(i, data.data(), (char *)out.data(), sampleSize);}
+  uint64_t ctrTime = Util::getMicros(start);
+
+  start = Util::getMicros();
+  for (size_t i = 0; i < loops; ++i){
+    aes.encryptBlockCBC(ivec, data.data(), (char *)out.data(), sampleSize & ~(size_t)15);
+  }
+  uint64_t cbcTime = Util::getMicros(start);
+
+  start = Util::getMicros();
+  for (size_t i = 0; i < loops; ++i){
+    aes.encryptH264BlockFairplay(ivec, sample.data(), (char *)out.data(), sampleSize);
+  }
+  uint64_t fpTime = Util::getMicros(start);
+
+  std::cout << name << ", " << sampleSize << " byte samples: CTR "
+            << (ctrTime ? (uint64_t)loops * sampleSize / ctrTime : 0) << " MB/s, CBC "
+            << (cbcTime ? (uint64_t)loops * sampleSize / cbcTime : 0) << " MB/s, Fairplay "
+            << (fpTime ? (uint64_t)loops * sampleSize / fpTime : 0) << " MB/s" << std::endl;
+}
+
+/// Usage: aes_test [bench]
+/// Checks both AES backends against a known vector and against each other. With an argument,
+/// also compares their throughput on sample sizes typical for a 1080p stream.
+int main(int argc, char **argv){
+  Util::printDebugLevel = 0;
+  srand(42);
+  Encryption::AES fast, slow;
+  fast.setEncryptKey(testKey);
+  slow.setEncryptKey(testKey);
+  slow.setAccelerated(false);
+  if (!fast.isAccelerated()){std::cout << "AES-NI not available, only testing mbedtls" << std::endl;}
+
+  int failures = checkVector(fast) + checkVector(slow);
+  failures += compareBackends(fast, slow);
+  if (failures || argc < 2){return failures;}
+
+  // An I-frame, a P-frame and an AAC frame of a ~6Mbps 1080p30 stream
+  size_t sizes[3] ={150000, 20000, 400};
+  for (size_t i = 0; i < 3; ++i){
+    if (fast.isAccelerated()){bench(fast, "AES-NI", sizes[i]);}
+    bench(slow, "mbedtls", sizes[i]);
+  }
+  return 0;
+}
@@ -0,0 +1,164 @@
+#include <mist/bitfields.h>
+#include <mist/nal.h>
+#include <mist/timing.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+/// Straightforward start code search, used as the reference
+static const char *naiveScan(const char *data, uint32_t dataSize){
+  for (uint32_t i = 0; i + 2 < dataSize; ++i){
+    if (!data[i] && !data[i + 1] && data[i + 2] == 1){return data + i;}
+  }
+  return 0;
+}
+
+/// The skip-ahead byte-wise scanner nalu::scanAnnexB used before, for comparison
+static const char *scalarScan(const char *data, uint32_t dataSize){
+  const char *offset = data;
+  const char *maxData = data + dataSize - 2;
+  while (offset < maxData){
+    if (offset[2] > 1){
+      offset += 3;
+      continue;
+    }
+    if (!offset[2]){
+      ++offset;
+      continue;
+    }
+    if (!offset[0] && !offset[1]){return offset;}
+    offset += 3;
+  }
+  return 0;
+}
+
+/// Returns random bytes with lots of zeroes and ones, so that partial start codes are common.
+static std::string nastyData(size_t len){
+  std::string ret(len, 0);
+  for (size_t i = 0; i < len; ++i){
+    int r = rand() % 8;
+    ret[i] = (r < 4) ? 0 : ((r < 6) ? 1 : rand() % 256);
+  }
+  return ret;
+}
+
+/// Appends a NAL unit of the given type and size with random contents to both an Annex B and a
+/// length-prefixed stream. Emulation prevention is applied, and the unit ends in a non-zero byte.
+static void addNal(std::string &annexB, std::string &sized, char type, size_t size, bool longCode){
+  std::string nal(1, type);
+  while (nal.size() < size - 1){
+    char c = (rand() % 16) ? rand() % 256 : 0;
+    size_t n = nal.size();
+    if (n >= 2 && !nal[n - 1] && !nal[n - 2] && (unsigned char)c <= 3){nal += (char)3;}
+    nal += c;
+  }
+  nal += (char)0x80;
+  annexB.append(longCode ? "\000\000\000\001" : "\000\000\001", longCode ? 4 : 3);
+  annexB.append(nal);
+  char len[4];
+  Bit::htobl(len, nal.size());
+  sized.append(len, 4);
+  sized.append(nal);
+}
+
+/// Builds an access unit like a 4K encoder at 20 Mbps/30fps would: an access unit delimiter,
+/// SPS and PPS on keyframes, and the picture split into 8 slices.
+static void addAccessUnit(std::string &annexB, std::string &sized, bool keyframe){
+  size_t frameSize = keyframe ? 400000 : 70000;
+  addNal(annexB, sized, 0x09, 2, true);
+  if (keyframe){
+    addNal(annexB, sized, 0x67, 30, true);
+    addNal(annexB, sized, 0x68, 8, true);
+  }
+  for (size_t i = 0; i < 8; ++i){addNal(annexB, sized, keyframe ? 0x65 : 0x41, frameSize / 8, false);}
+}
+
+static int verifyScan(){
+  int failures = 0;
+  std::string buf = nastyData(4096);
+  for (size_t i = 0; i < 5000 && failures < 10; ++i){
+    uint32_t off = rand() % 64;
+    uint32_t len = rand() % (buf.size() - off);
+    if (i % 4 == 0){
+      // Mostly non-zero data with a single start code somewhere, often near the end
+      std::string clean(len, 0x55);
+      if (len >= 3){
+        size_t back = rand() % ((i % 8) ? std::min(len - 2, 3u) : len - 2);
+        memcpy((char *)clean.data() + len - 3 - back, "\000\000\001", 3);
+      }
+      if (nalu::scanAnnexB(clean.data(), len) != naiveScan(clean.data(), len)){
+        std::cerr << "Single start code mismatch for " << len << " bytes" << std::endl;
+        ++failures;
+      }
+      continue;
+    }
+    const char *d = buf.data() + off;
+    if (nalu::scanAnnexB(d, len) != naiveScan(d, len)){
+      std::cerr << "Scan mismatch for " << len << " bytes at offset " << off << std::endl;
+      ++failures;
+    }
+  }
+  return failures;
+}
+
+static int verifyConvert(){
+  std::string annexB, sized;
+  addAccessUnit(annexB, sized, true);
+  addAccessUnit(annexB, sized, false);
+  // 3-byte start codes become 4-byte sizes, so the output can be larger than the input
+  char *result = (char *)malloc(sized.size());
+  unsigned long resLen = nalu::fromAnnexB(annexB.data(), annexB.size(), result);
+  int failures = (resLen != sized.size() || memcmp(result, sized.data(), resLen)) ? 1 : 0;
+  if (failures){std::cerr << "fromAnnexB output mismatch" << std::endl;}
+  free(result);
+  return failures;
+}
+
+/// Usage: annexb_test [bench]
+/// Checks the start code scanner against a naive search and fromAnnexB against a known
+/// conversion. With an argument, also measures both on two seconds of 4K video.
+int main(int argc, char **argv){
+  srand(42);
+  int failures = verifyScan() + verifyConvert();
+  if (failures || argc < 2){return failures;}
+
+  std::string annexB, sized;
+  for (size_t i = 0; i < 60; ++i){addAccessUnit(annexB, sized, !(i % 30));}
+  size_t nals = 0;
+  uint64_t start = Util::getMicros();
+  for (size_t loop = 0; loop < 10; ++loop){
+    const char *p = annexB.data();
+    const char *end = p + annexB.size();
+    while ((p = scalarScan(p, end - p))){
+      p += 3;
+      ++nals;
+    }
+  }
+  uint64_t naiveTime = Util::getMicros(start);
+  start = Util::getMicros();
+  for (size_t loop = 0; loop < 10; ++loop){
+    const char *p = annexB.data();
+    const char *end = p + annexB.size();
+    while ((p = nalu::scanAnnexB(p, end - p))){
+      p += 3;
+      --nals;
+    }
+  }
+  uint64_t scanTime = Util::getMicros(start);
+  if (nals){
+    std::cerr << "Scanners found a different amount of start codes" << std::endl;
+    return 1;
+  }
+  char *result = (char *)malloc(sized.size());
+  start = Util::getMicros();
+  for (size_t loop = 0; loop < 10; ++loop){nalu::fromAnnexB(annexB.data(), annexB.size(), result);}
+  uint64_t convTime = Util::getMicros(start);
+  free(result);
+  size_t bytes = annexB.size() * 10;
+  std::cout << "Byte-wise scan: " << (naiveTime ? bytes / naiveTime : 0) << " MB/s, scanAnnexB: "
+            << (scanTime ? bytes / scanTime : 0) << " MB/s, fromAnnexB: " << (convTime ? bytes / convTime : 0)
+            << " MB/s" << std::endl;
+  return 0;
+}
@@ -0,0 +1,158 @@
+#include <mist/bitstream.h>
+#include <mist/h264.h>
+#include <mist/nal.h>
+#include <mist/timing.h>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+
+/// Reads count bits starting at bit pos one at a time, used as the reference
+static uint64_t refBits(const std::string &d, size_t pos, size_t count){
+  uint64_t ret = 0;
+  for (size_t i = 0; i < count; ++i, ++pos){
+    ret = (ret << 1) | (((unsigned char)d[pos >> 3] >> (7 - (pos & 7))) & 1);
+  }
+  return ret;
+}
+
+/// Straightforward emulation prevention removal, used as the reference
+static std::string naiveRBSP(const std::string &d){
+  std::string ret;
+  for (size_t i = 0; i < d.size(); ++i){
+    if (i + 2 < d.size() && !d[i] && !d[i + 1] && d[i + 2] == 3){
+      ret.append(d, i, 2);
+      i += 2;
+    }else{
+      ret += d[i];
+    }
+  }
+  return ret;
+}
+
+/// Returns random bytes with lots of zeroes and threes, so that emulation prevention is common.
+static std::string nastyData(size_t len){
+  std::string ret(len, 0);
+  for (size_t i = 0; i < len; ++i){
+    int r = rand() % 8;
+    ret[i] = (r < 4) ? 0 : ((r < 6) ? 3 : rand() % 256);
+  }
+  return ret;
+}
+
+static int verifyReads(){
+  int failures = 0;
+  std::string d = nastyData(512);
+  for (size_t i = 0; i < 10000 && failures < 10; ++i){
+    size_t pos = rand() % (d.size() * 8);
+    size_t count = rand() % 65;
+    if (pos + count > d.size() * 8){continue;}
+    Utils::bitstream bs;
+    bs.append(d);
+    bs.skip(pos);
+    uint64_t got = bs.peek(count);
+    if (got != refBits(d, pos, count) || bs.get(count) != got || bs.size() != d.size() * 8 - pos - count){
+      std::cerr << "Read mismatch for " << count << " bits at bit " << pos << std::endl;
+      ++failures;
+    }
+  }
+  return failures;
+}
+
+static int verifyGolomb(){
+  int failures = 0;
+  Utils::bitWriter bw;
+  std::deque<int64_t> vals;
+  for (size_t i = 0; i < 2000; ++i){
+    int64_t v = rand() % ((i % 3) ? 16 : 0x7FFFFFFF);
+    if (i % 2){v = -v;}
+    vals.push_back(v);
+    if (i % 2){
+      bw.appendExpGolomb(v);
+    }else{
+      bw.appendUExpGolomb(v);
+    }
+  }
+  Utils::bitstream bs;
+  bs.append(bw.str());
+  for (size_t i = 0; i < vals.size() && failures < 10; ++i){
+    int64_t got = (i % 2) ? bs.peekExpGolomb() : (int64_t)bs.peekUExpGolomb();
+    int64_t read = (i % 2) ? bs.getExpGolomb() : (int64_t)bs.getUExpGolomb();
+    int64_t want = vals[i];
+    if (got != want || read != want){
+      std::cerr << "Exp-Golomb mismatch at value " << i << ": " << read << " != " << want << std::endl;
+      ++failures;
+    }
+  }
+  // Only zero bits left: nothing to decode
+  Utils::bitstream zeros;
+  zeros.append(std::string(4, 0));
+  if (zeros.getUExpGolomb() != (uint64_t)-1){
+    std::cerr << "Exp-Golomb on zero bits did not fail" << std::endl;
+    ++failures;
+  }
+  return failures;
+}
+
+static int verifyRBSP(){
+  int failures = 0;
+  std::string d = nastyData(4096);
+  for (size_t i = 0; i < 1000 && failures < 10; ++i){
+    size_t off = rand() % 64;
+    size_t len = rand() % (d.size() - off);
+    std::string in = d.substr(off, len);
+    Utils::bitstream bs;
+    bs.append("\377", 1);
+    bs.appendRBSP(in.data(), in.size());
+    std::string want = naiveRBSP(in);
+    bool ok = nalu::removeEmulationPrevention(in) == want && bs.size() == (want.size() + 1) * 8;
+    bs.skip(8);
+    for (size_t j = 0; ok && j < want.size(); ++j){ok = (bs.get(8) == (unsigned char)want[j]);}
+    if (!ok){
+      std::cerr << "Emulation prevention removal mismatch for " << len << " bytes" << std::endl;
+      ++failures;
+    }
+  }
+  return failures;
+}
+
+/// Usage: bitstream_test [bench]
+/// Checks bit reads, Exp-Golomb decoding and emulation prevention removal against bit-at-a-time
+/// references, and SPS and slice header parsing against known values. With an argument, parses
+/// the headers many times and prints how long that took.
+int main(int argc, char **argv){
+  srand(42);
+  bool bench = argc > 1;
+  int failures = verifyReads() + verifyGolomb() + verifyRBSP();
+  if (failures){return failures;}
+
+  // 1080p High profile SPS and a P slice with emulation prevention in its payload
+  const char sps[] = "\x67\x64\x00\x28\xac\xd9\x40\x78\x02\x27\xe5\x84\x00\x00\x03\x00\x04\x00\x00\x03"
+                     "\x00\xf0\x3c\x60\xc6\x58";
+  std::string slice("\x41\x9a\x24\x6c\x41\x8f", 6);
+  slice += nastyData(2000);
+  size_t loops = bench ? 100000 : 10;
+  uint64_t check = 0;
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < loops; ++i){
+    h264::sequenceParameterSet s(sps, sizeof(sps) - 1);
+    check += s.getCharacteristics().width;
+  }
+  uint64_t spsTime = Util::getMicros(start);
+  start = Util::getMicros();
+  for (size_t i = 0; i < loops / 10; ++i){
+    h264::codedSliceUnit c(slice.data(), slice.size());
+    check += c.sliceType;
+  }
+  uint64_t sliceTime = Util::getMicros(start);
+  // The SPS is 1920 pixels wide and the slice is a P slice (type 5)
+  if (check != loops * 1920 + (loops / 10) * 5){
+    std::cerr << "Unexpected parse results" << std::endl;
+    return 1;
+  }
+  if (!bench){return 0;}
+  std::cout << "SPS parse: " << (spsTime * 1000 / loops) << " ns, 2 KB slice header parse: "
+            << (sliceTime * 10000 / loops) << " ns" << std::endl;
+  return 0;
+}
@@ -0,0 +1,110 @@
+#include <mist/checksum.h>
+#include <mist/timing.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#define CRC_BENCH_BYTES (32 * 1024 * 1024)
+
+/// Bit-at-a-time MPEG-2 CRC32, straight from the definition
+static unsigned int crcReference(unsigned int crc, const char *data, size_t len){
+  for (size_t i = 0; i < len; ++i){
+    crc ^= (unsigned int)(unsigned char)data[i] << 24;
+    for (size_t j = 0; j < 8; ++j){crc = (crc << 1) ^ ((crc & 0x80000000u) ? 0x04C11DB7u : 0);}
+  }
+  return crc;
+}
+
+/// Byte-at-a-time table MPEG-2 CRC32, as checksum::crc32c used to be implemented
+static unsigned int crcBytewise(unsigned int crc, const char *data, size_t len){
+  static unsigned int table[256];
+  if (!table[1]){
+    for (unsigned int i = 0; i < 256; ++i){
+      unsigned int c = i << 24;
+      for (size_t j = 0; j < 8; ++j){c = (c << 1) ^ ((c & 0x80000000u) ? 0x04C11DB7u : 0);}
+      table[i] = c;
+    }
+  }
+  while (len--){crc = table[(unsigned char)*(data++) ^ (crc >> 24)] ^ (crc << 8);}
+  return crc;
+}
+
+static std::string randomData(size_t len){
+  std::string ret(len, 0);
+  for (size_t i = 0; i < len; ++i){ret[i] = rand() % 256;}
+  return ret;
+}
+
+/// Checks every implementation against the reference for many lengths, offsets and start values.
+static int verify(){
+  int failures = 0;
+  if (checksum::crc32c(0xFFFFFFFFu, "123456789", 9) != 0x0376E6E7u){
+    std::cerr << "Check value mismatch" << std::endl;
+    ++failures;
+  }
+  std::string buf = randomData(20000);
+  for (size_t i = 0; i < 800 && failures < 10; ++i){
+    size_t len = (i < 600) ? i : rand() % 16000;
+    size_t off = rand() % 16;
+    unsigned int init = (i % 3) ? rand() : ((i % 2) ? 0xFFFFFFFFu : 0);
+    const char *d = buf.data() + off;
+    unsigned int expect = crcReference(init, d, len);
+    unsigned int slice = checksum::crc32cSlice8(init, d, len);
+    unsigned int fold = checksum::crc32cFold(init, d, len);
+    unsigned int swapped = checksum::crc32(__builtin_bswap32(init), d, len);
+    if (slice != expect || fold != expect || checksum::crc32c(init, d, len) != expect ||
+        swapped != __builtin_bswap32(expect)){
+      std::cerr << "Mismatch for " << len << " bytes at offset " << off << ": expected " << std::hex
+                << expect << ", slicing-by-8 " << slice << ", folding " << fold << ", swapped "
+                << swapped << std::dec << std::endl;
+      ++failures;
+    }
+    // Feed the same data in random pieces through the streaming API
+    checksum::CRC32 stream(init);
+    size_t pos = 0;
+    while (pos < len){
+      size_t piece = std::min(len - pos, (size_t)(rand() % 300));
+      stream.update(d + pos, piece);
+      pos += piece;
+    }
+    if (stream.value() != expect){
+      std::cerr << "Streaming mismatch for " << len << " bytes" << std::endl;
+      ++failures;
+    }
+  }
+  return failures;
+}
+
+typedef unsigned int (*crcFunc)(unsigned int, const char *, size_t);
+
+/// Prints the throughput of f over CRC_BENCH_BYTES in pieces of len bytes.
+static void bench(crcFunc f, const char *name, size_t len){
+  std::string data = randomData(len);
+  size_t loops = CRC_BENCH_BYTES / len;
+  unsigned int crc = 0;
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < loops; ++i){crc ^= f(0xFFFFFFFFu, data.data(), len);}
+  uint64_t time = Util::getMicros(start);
+  std::cout << name << ", " << len << " bytes: " << (time ? (uint64_t)loops * len / time : 0)
+            << " MB/s, " << (loops ? time * 1000 / loops : 0) << "ns per call (" << std::hex << crc
+            << std::dec << ")" << std::endl;
+}
+
+/// Usage: crc_test [bench]
+/// Checks the CRC32 implementations against a bitwise reference. With an argument, also compares
+/// their speed on a PAT/PMT-sized section, a PES-sized buffer and an Ogg page.
+int main(int argc, char **argv){
+  srand(42);
+  int failures = verify();
+  if (failures || argc < 2){return failures;}
+  if (!checksum::hasCRCFold()){std::cout << "PCLMULQDQ not available, folding uses slicing-by-8" << std::endl;}
+  size_t sizes[3] ={180, 4096, 65307};
+  for (size_t i = 0; i < 3; ++i){
+    bench(crcBytewise, "bytewise", sizes[i]);
+    bench(checksum::crc32cSlice8, "slicing-by-8", sizes[i]);
+    bench(checksum::crc32cFold, "folding", sizes[i]);
+  }
+  return 0;
+}
@@ -0,0 +1,145 @@
+#include <mist/dtsc.h>
+#include <mist/timing.h>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#define IMAGE_HOURS 10
+#define IMAGE_KEY_MS 2000
+
+/// Builds a 10-hour audio/video VoD header in memory, like an MP4 input would
+class DTSC_Image : public DTSC::Meta{
+public:
+  DTSC_Image() : DTSC::Meta(){
+    reInit("", true);
+    uint64_t duration = IMAGE_HOURS * 3600000ull;
+    size_t keys = duration / IMAGE_KEY_MS;
+    size_t vid = addTrack(keys / 5 + 10, keys + 10, duration / 40 + 10, keys / 15 + 10);
+    setType(vid, "video");
+    setCodec(vid, "H264");
+    setInit(vid, std::string("\001\144\000\037\377\341", 6));
+    setWidth(vid, 1920);
+    setHeight(vid, 1080);
+    setFpks(vid, 25000);
+    setID(vid, 1);
+    size_t aud = addTrack(keys / 5 + 10, keys + 10, duration / 40 + 10, keys / 15 + 10);
+    setType(aud, "audio");
+    setCodec(aud, "AAC");
+    setRate(aud, 48000);
+    setChannels(aud, 2);
+    setSize(aud, 16);
+    setID(aud, 2);
+    setVod(true);
+    for (uint64_t t = 0; t < duration; t += 40){
+      update(t, 0, vid, 5000 + (t % 7) * 100, t * 100, (t % IMAGE_KEY_MS) == 0);
+      update(t + 5, 0, aud, 300, t * 100 + 8000, (t % IMAGE_KEY_MS) == 0);
+    }
+    // Page table, as Input::parseHeader would create it
+    for (size_t i = 0; i < 2; ++i){
+      Util::RelAccX &tPages = pages(i);
+      DTSC::Keys k(getKeys(i));
+      for (size_t j = 0; j < k.getEndValid(); j += 15){
+        size_t p = tPages.getEndPos();
+        tPages.addRecords(1);
+        tPages.setInt("firstkey", j, p);
+        tPages.setInt("firsttime", k.getTime(j), p);
+        tPages.setInt("keycount", 15, p);
+        tPages.setInt("avail", p % 2, p);
+      }
+    }
+  }
+};
+
+/// Returns the number of differences found between the two headers
+static int compare(const DTSC::Meta &a, const DTSC::Meta &b){
+  int failures = 0;
+  std::set<size_t> tracks = a.getValidTracks();
+  if (tracks != b.getValidTracks()){
+    std::cerr << "Track lists differ" << std::endl;
+    return 1;
+  }
+  for (std::set<size_t>::iterator it = tracks.begin(); it != tracks.end(); ++it){
+    if (a.getType(*it) != b.getType(*it) || a.getCodec(*it) != b.getCodec(*it) || a.getInit(*it) != b.getInit(*it) ||
+        a.getID(*it) != b.getID(*it) || a.getFirstms(*it) != b.getFirstms(*it) || a.getLastms(*it) != b.getLastms(*it)){
+      std::cerr << "Track " << *it << " properties differ" << std::endl;
+      ++failures;
+    }
+    DTSC::Keys ka(a.getKeys(*it)), kb(b.getKeys(*it));
+    if (ka.getEndValid() != kb.getEndValid()){
+      std::cerr << "Track " << *it << " key counts differ" << std::endl;
+      ++failures;
+      continue;
+    }
+    for (size_t i = ka.getFirstValid(); i < ka.getEndValid(); ++i){
+      if (ka.getTime(i) != kb.getTime(i) || ka.getSize(i) != kb.getSize(i) || ka.getParts(i) != kb.getParts(i) ||
+          ka.getBpos(i) != kb.getBpos(i)){
+        std::cerr << "Track " << *it << " key " << i << " differs" << std::endl;
+        ++failures;
+        break;
+      }
+    }
+  }
+  return failures;
+}
+
+int main(int argc, char **argv){
+  std::string dtshName = "/tmp/dtsc_image_test.dtsh";
+  std::string imageName = "/tmp/dtsc_image_test.dtsm";
+  DTSC_Image M;
+  M.toFile(dtshName);
+  if (!M.toImage(imageName)){
+    std::cerr << "Could not write memory image" << std::endl;
+    return 1;
+  }
+
+  uint64_t start = Util::getMicros();
+  DTSC::Meta fromDTSH("", dtshName);
+  uint64_t dtshTime = Util::getMicros(start);
+
+  DTSC::Meta fromImage;
+  start = Util::getMicros();
+  if (!fromImage.reInitFromImage("", imageName)){
+    std::cerr << "Could not load memory image" << std::endl;
+    return 1;
+  }
+  uint64_t imageTime = Util::getMicros(start);
+
+  int failures = compare(M, fromDTSH) + compare(M, fromImage);
+  // Page tables are stored in the image, but nothing may be marked as loaded
+  for (size_t i = 0; i < 2; ++i){
+    const Util::RelAccX &pa = M.pages(i);
+    const Util::RelAccX &pb = fromImage.pages(i);
+    if (pa.getEndPos() != pb.getEndPos()){
+      std::cerr << "Page counts differ" << std::endl;
+      ++failures;
+      continue;
+    }
+    for (size_t j = pb.getDeleted(); j < pb.getEndPos(); ++j){
+      if (pb.getInt("avail", j) || pa.getInt("firstkey", j) != pb.getInt("firstkey", j)){
+        std::cerr << "Page " << j << " of track " << i << " differs" << std::endl;
+        ++failures;
+        break;
+      }
+    }
+  }
+
+  // Images that do not match this build must be rejected
+  FILE *f = fopen(imageName.c_str(), "r+b");
+  if (f){
+    uint32_t badVersion = DTSM_VERSION + 1;
+    fseek(f, 4, SEEK_SET);
+    fwrite(&badVersion, 4, 1, f);
+    fclose(f);
+  }
+  DTSC::Meta rejected;
+  if (rejected.reInitFromImage("", imageName)){
+    std::cerr << "Image with wrong version was accepted" << std::endl;
+    ++failures;
+  }
+
+  std::cerr << DTSC::Keys(M.getKeys(0)).getEndValid() << " keys per track: DTSH parsed in " << dtshTime
+            << "us, memory image loaded in " << imageTime << "us" << std::endl;
+  remove(dtshName.c_str());
+  remove(imageName.c_str());
+  return failures;
+}
@@ -0,0 +1,178 @@
+#include <mist/dtsc.h>
+#include <mist/timing.h>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#define LOOKUP_KEYS 5000
+#define LOOKUP_KEYS_BENCH 100000
+#define LOOKUP_KEYS_PER_PAGE 10
+#define LOOKUP_ITERATIONS 500
+
+/// Exposes the track internals, and holds the original linear-scan lookups so the indexed
+/// versions in DTSC::Meta can be verified and benchmarked against them.
+class DTSC_Lookup : public DTSC::Meta{
+public:
+  size_t trkId;
+  DTSC::Track *trkPtr;
+  DTSC_Lookup(size_t keyCount) : DTSC::Meta(){
+    reInit("", true);
+    trkId = addTrack(keyCount, keyCount + 1000, 3 * keyCount, keyCount / LOOKUP_KEYS_PER_PAGE, true);
+    trkPtr = &(tracks.at(trkId));
+    setType(trkId, "video");
+  }
+
+  /// Adds count keys of 2-3 parts each, with semi-random durations
+  void addKeys(size_t count){
+    for (size_t i = 0; i < count; ++i){
+      uint64_t t = getLastms(trkId) + 40;
+      update(t, 0, trkId, 1000, 0, true);
+      size_t parts = rand() % 2 + 1;
+      for (size_t j = 0; j < parts; ++j){update(t + 40 * (j + 1) + rand() % 30, 0, trkId, 100, 0, false);}
+    }
+  }
+
+  /// Drops the given amount of keys from the start of the ring, without touching the pages
+  void dropKeys(size_t count){
+    Util::RelAccX &keys = trkPtr->keys;
+    for (size_t i = 0; i < count; ++i){
+      trkPtr->parts.deleteRecords(keys.getInt(trkPtr->keyPartsField, keys.getDeleted()));
+      keys.deleteRecords(1);
+    }
+  }
+
+  /// Builds the page table like Input::parseHeader does, marking every third page unavailable
+  void addPages(){
+    Util::RelAccX &keys = trkPtr->keys;
+    Util::RelAccX &pages = trkPtr->pages;
+    for (uint64_t k = keys.getDeleted(); k < keys.getEndPos(); k += LOOKUP_KEYS_PER_PAGE){
+      uint64_t p = pages.getEndPos();
+      pages.addRecords(1);
+      pages.setInt("firstkey", k, p);
+      pages.setInt("firsttime", keys.getInt(trkPtr->keyTimeField, k), p);
+      pages.setInt("keycount", LOOKUP_KEYS_PER_PAGE, p);
+      pages.setInt("avail", (p % 3) ? 1 : 0, p);
+    }
+  }
+
+  uint32_t linearKeyIndexForTime(uint64_t timestamp) const{
+    DTSC::Keys keys(trkPtr->keys);
+    uint32_t firstKey = keys.getFirstValid();
+    uint32_t endKey = keys.getEndValid();
+    for (size_t i = firstKey; i < endKey; i++){
+      if (keys.getTime(i) + keys.getDuration(i) > timestamp){return i;}
+    }
+    return endKey;
+  }
+
+  size_t linearPageNumberForTime(uint64_t time) const{
+    const Util::RelAccX &pages = trkPtr->pages;
+    uint32_t res = pages.getStartPos();
+    for (uint64_t i = res; i < pages.getEndPos(); ++i){
+      if (pages.getInt("avail", i) == 0){continue;}
+      if (pages.getInt("firsttime", i) > time){break;}
+      res = i;
+    }
+    return pages.getInt("firstkey", res);
+  }
+
+  size_t linearPageNumberForKey(uint64_t keyNum) const{
+    const Util::RelAccX &pages = trkPtr->pages;
+    size_t res = pages.getStartPos();
+    for (size_t i = pages.getStartPos(); i < pages.getEndPos(); ++i){
+      if (pages.getInt("avail", i) == 0){continue;}
+      if (pages.getInt("firstkey", i) > keyNum){break;}
+      res = i;
+    }
+    return pages.getInt("firstkey", res);
+  }
+
+  size_t linearKeyNumForTime(uint64_t time) const{
+    const DTSC::Track &trk = *trkPtr;
+    const Util::RelAccX &keys = trk.keys;
+    const Util::RelAccX &parts = trk.parts;
+    if (!keys.getEndPos()){return INVALID_KEY_NUM;}
+    size_t res = keys.getDeleted();
+    for (size_t i = res; i < keys.getEndPos(); i++){
+      if (keys.getInt(trk.keyTimeField, i) > time){
+        if (keys.getInt(trk.keyFirstPartField, i) > parts.getStartPos()){
+          uint64_t dur = parts.getInt(trk.partDurationField, keys.getInt(trk.keyFirstPartField, i) - 1);
+          if (keys.getInt(trk.keyTimeField, i) - dur < time){res = i;}
+        }
+        continue;
+      }
+      res = i;
+    }
+    return res;
+  }
+};
+
+/// Usage: dtsc_lookup_test [bench]
+/// Without arguments, only verifies the lookups on a small track. With an argument, uses a large
+/// track and also times the lookups against the linear scans.
+int main(int argc, char **argv){
+  srand(42);
+  bool bench = argc > 1;
+  size_t keyCount = bench ? LOOKUP_KEYS_BENCH : LOOKUP_KEYS;
+  DTSC_Lookup M(keyCount);
+  // Fill the ring, drop the start and refill so the key ring wraps around
+  M.addKeys(keyCount);
+  M.dropKeys(keyCount / 4);
+  M.addKeys(keyCount / 4);
+  M.addPages();
+  size_t trk = M.trkId;
+  uint64_t firstms = M.getFirstms(trk);
+  uint64_t range = M.getLastms(trk) - firstms + 2000;
+  DTSC::Keys keys(M.keys(trk));
+  std::cerr << "Track has keys " << keys.getFirstValid() << "-" << keys.getEndValid() << " ("
+            << firstms << "-" << M.getLastms(trk) << "ms), " << M.pages(trk).getEndPos() << " pages" << std::endl;
+
+  uint64_t times[LOOKUP_ITERATIONS];
+  uint64_t keyNums[LOOKUP_ITERATIONS];
+  for (size_t i = 0; i < LOOKUP_ITERATIONS; ++i){
+    times[i] = firstms + (((uint64_t)rand() << 16) ^ rand()) % range;
+    if (i < 10){times[i] = (i < 5) ? i : M.getLastms(trk) + i;}
+    keyNums[i] = (((uint64_t)rand() << 16) ^ rand()) % (keys.getEndValid() + 20);
+  }
+
+  int failures = 0;
+  for (size_t i = 0; i < LOOKUP_ITERATIONS; ++i){
+    if (M.getKeyIndexForTime(trk, times[i]) != M.linearKeyIndexForTime(times[i])){
+      std::cerr << "getKeyIndexForTime mismatch at " << times[i] << std::endl;
+      ++failures;
+    }
+    if (keys.getIndexForTime(times[i]) != M.linearKeyIndexForTime(times[i])){
+      std::cerr << "Keys::getIndexForTime mismatch at " << times[i] << std::endl;
+      ++failures;
+    }
+    if (M.getKeyNumForTime(trk, times[i]) != M.linearKeyNumForTime(times[i])){
+      std::cerr << "getKeyNumForTime mismatch at " << times[i] << std::endl;
+      ++failures;
+    }
+    if (M.getPageNumberForTime(trk, times[i]) != M.linearPageNumberForTime(times[i])){
+      std::cerr << "getPageNumberForTime mismatch at " << times[i] << std::endl;
+      ++failures;
+    }
+    if (M.getPageNumberForKey(trk, keyNums[i]) != M.linearPageNumberForKey(keyNums[i])){
+      std::cerr << "getPageNumberForKey mismatch at " << keyNums[i] << std::endl;
+      ++failures;
+    }
+  }
+  if (failures || !bench){return failures;}
+
+  // Benchmark: the linear scans are what these lookups used to be
+  size_t sink = 0;
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < LOOKUP_ITERATIONS; ++i){
+    sink += M.linearKeyNumForTime(times[i]) + M.linearPageNumberForTime(times[i]);
+  }
+  uint64_t linear = Util::getMicros(start);
+  start = Util::getMicros();
+  for (size_t i = 0; i < LOOKUP_ITERATIONS; ++i){
+    sink += M.getKeyNumForTime(trk, times[i]) + M.getPageNumberForTime(trk, times[i]);
+  }
+  uint64_t indexed = Util::getMicros(start);
+  std::cerr << LOOKUP_ITERATIONS << " key+page lookups over " << keys.getValidCount() << " keys: linear "
+            << linear << "us, indexed " << indexed << "us (" << (sink & 1) << ")" << std::endl;
+  return 0;
+}
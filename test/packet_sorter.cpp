@@ -0,0 +1,125 @@
+#include <mist/stream.h>
+#include <mist/timing.h>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+
+#define SORTER_PACKETS 20000
+#define SORTER_PACKETS_BENCH 2000000
+
+/// The ordered set that Util::packetSorter used in sync mode before it became a heap.
+/// Kept here so the heap can be verified and benchmarked against it.
+class setSorter{
+public:
+  std::set<Util::sortedPageInfo> buffer;
+  const Util::sortedPageInfo *begin() const{return &*buffer.begin();}
+  void insert(const Util::sortedPageInfo &pInfo){buffer.insert(pInfo);}
+  void replaceFirst(const Util::sortedPageInfo &pInfo){
+    buffer.erase(buffer.begin());
+    buffer.insert(pInfo);
+  }
+};
+
+/// Returns the next packet for the track of cur, with a semi-random duration per track
+static Util::sortedPageInfo nextPacket(const Util::sortedPageInfo &cur){
+  Util::sortedPageInfo res = cur;
+  res.time += 10 + (cur.tid * 7 + cur.time) % 33;
+  res.offset += 100;
+  ++res.partIndex;
+  return res;
+}
+
+/// Plays out packets over the given amount of tracks through both sorters, like
+/// Output::prepareNext does. Returns the amount of ordering differences found.
+static int runTracks(size_t tracks){
+  Util::packetSorter heap;
+  setSorter reference;
+  for (size_t i = 0; i < tracks; ++i){
+    Util::sortedPageInfo p;
+    p.tid = i;
+    p.time = rand() % 1000;
+    p.offset = 0;
+    p.partIndex = 0;
+    p.ghostPacket = false;
+    heap.insert(p);
+    reference.insert(p);
+  }
+  // A duplicate insert must be ignored, like the set did
+  heap.insert(*heap.begin());
+  if (heap.size() != tracks){
+    std::cerr << "Duplicate packet was inserted" << std::endl;
+    return 1;
+  }
+
+  int failures = 0;
+  for (size_t i = 0; i < SORTER_PACKETS; ++i){
+    if (heap.begin()->tid != reference.begin()->tid || heap.begin()->time != reference.begin()->time){
+      std::cerr << tracks << " tracks: order differs at packet " << i << std::endl;
+      ++failures;
+      break;
+    }
+    Util::sortedPageInfo next = nextPacket(*heap.begin());
+    heap.replaceFirst(next);
+    reference.replaceFirst(next);
+  }
+  // Dropping a track must remove it without disturbing the order of the others
+  heap.dropTrack(tracks / 2);
+  if (heap.hasEntry(tracks / 2) || heap.size() != tracks - 1){
+    std::cerr << tracks << " tracks: dropTrack failed" << std::endl;
+    ++failures;
+  }
+  uint64_t lastTime = 0;
+  while (heap.size()){
+    if (heap.begin()->time < lastTime){
+      std::cerr << tracks << " tracks: out of order after dropTrack" << std::endl;
+      ++failures;
+      break;
+    }
+    lastTime = heap.begin()->time;
+    heap.dropTrack(heap.begin()->tid);
+  }
+  return failures;
+}
+
+/// Times the same amount of packets through both implementations.
+static int benchTracks(size_t tracks){
+  int failures = 0;
+  Util::packetSorter benchHeap;
+  setSorter benchSet;
+  for (size_t i = 0; i < tracks; ++i){
+    Util::sortedPageInfo p;
+    p.tid = i;
+    p.time = i;
+    p.offset = 0;
+    p.partIndex = 0;
+    p.ghostPacket = false;
+    benchHeap.insert(p);
+    benchSet.insert(p);
+  }
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < SORTER_PACKETS_BENCH; ++i){benchSet.replaceFirst(nextPacket(*benchSet.begin()));}
+  uint64_t setTime = Util::getMicros(start);
+  start = Util::getMicros();
+  for (size_t i = 0; i < SORTER_PACKETS_BENCH; ++i){benchHeap.replaceFirst(nextPacket(*benchHeap.begin()));}
+  uint64_t heapTime = Util::getMicros(start);
+  if (benchHeap.begin()->time != benchSet.begin()->time){
+    std::cerr << tracks << " tracks: benchmark results differ" << std::endl;
+    ++failures;
+  }
+  std::cerr << tracks << " tracks: " << SORTER_PACKETS_BENCH << " packets in " << setTime << "us with a set, "
+            << heapTime << "us with the heap (" << (setTime * 1000 / SORTER_PACKETS_BENCH) << " vs "
+            << (heapTime * 1000 / SORTER_PACKETS_BENCH) << " ns/packet)" << std::endl;
+  return failures;
+}
+
+/// Usage: packet_sorter_test [bench]
+/// Without arguments, only verifies the heap against the set. With an argument, also times both.
+int main(int argc, char **argv){
+  srand(42);
+  int failures = 0;
+  size_t trackCounts[3] = {2, 8, 64};
+  for (size_t i = 0; i < 3; ++i){failures += runTracks(trackCounts[i]);}
+  if (failures || argc < 2){return failures;}
+  for (size_t i = 0; i < 3; ++i){failures += benchTracks(trackCounts[i]);}
+  return failures;
+}
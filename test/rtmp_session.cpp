@@ -0,0 +1,100 @@
+#include <mist/rtmpchunks.h>
+#include <mist/socket.h>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define SESSION_MESSAGES 200
+
+/// Packs the i-th message of connection conn, which uses its own chunk size and timestamps
+static std::string packMessage(int conn, size_t i){
+  if (!i){
+    RTMPStream::chunk_snd_max = conn ? 128 : 4096;
+    return RTMPStream::SendCTL(1, RTMPStream::chunk_snd_max);
+  }
+  std::string data(50 + (i * 97 + conn * 1013) % 9000, (char)('a' + (i + conn) % 26));
+  if (i % 17 == 0){return RTMPStream::SendChunk(3, 20, 0, data);}
+  return RTMPStream::SendMedia(8 + (i % 2), (unsigned char *)data.data(), data.size(), i * (conn ? 40 : 33));
+}
+
+/// Packs all messages of one connection on its own, as a process handling a single peer would
+static std::string packAlone(int conn){
+  RTMPStream::Session session;
+  session.swap();
+  std::string ret;
+  for (size_t i = 0; i < SESSION_MESSAGES; ++i){ret += packMessage(conn, i);}
+  session.swap();
+  return ret;
+}
+
+/// Parses all chunks in data, returning the concatenated payloads of the complete messages
+static std::string parseAll(const std::string &data, RTMPStream::Session &session){
+  Socket::Buffer buf;
+  buf.append(data);
+  RTMPStream::Chunk next;
+  std::string ret;
+  session.swap();
+  while (next.Parse(buf)){
+    if (next.msg_type_id == 1){RTMPStream::chunk_rec_max = ntohl(*(uint32_t *)next.data.data());}
+    ret += next.data;
+  }
+  session.swap();
+  return ret;
+}
+
+/// Packs and parses the chunks of two RTMP connections interleaved, each with its own session, and
+/// checks that both come out exactly as when each connection is handled on its own.
+int main(int argc, char **argv){
+  std::string expect[2] ={packAlone(0), packAlone(1)};
+  RTMPStream::Session sessions[2];
+  std::string got[2];
+  for (size_t i = 0; i < SESSION_MESSAGES; ++i){
+    for (int conn = 0; conn < 2; ++conn){
+      sessions[conn].swap();
+      got[conn] += packMessage(conn, i);
+      sessions[conn].swap();
+    }
+  }
+  int failures = 0;
+  for (int conn = 0; conn < 2; ++conn){
+    if (got[conn] != expect[conn]){
+      std::cerr << "Connection " << conn << ": interleaved packing differs from packing alone" << std::endl;
+      ++failures;
+    }
+  }
+  if (expect[0] == expect[1]){
+    std::cerr << "Both connections packed the same data" << std::endl;
+    ++failures;
+  }
+
+  // Parse both streams in small interleaved pieces, so chunks are split across reads
+  RTMPStream::Session readers[2];
+  std::string parsed[2];
+  size_t pos[2] ={0, 0};
+  Socket::Buffer bufs[2];
+  RTMPStream::Chunk next;
+  while (pos[0] < got[0].size() || pos[1] < got[1].size()){
+    for (int conn = 0; conn < 2; ++conn){
+      size_t len = std::min(got[conn].size() - pos[conn], (size_t)(1 + rand() % 700));
+      bufs[conn].append(got[conn].substr(pos[conn], len));
+      pos[conn] += len;
+      readers[conn].swap();
+      while (next.Parse(bufs[conn])){
+        if (next.msg_type_id == 1){RTMPStream::chunk_rec_max = ntohl(*(uint32_t *)next.data.data());}
+        parsed[conn] += next.data;
+      }
+      readers[conn].swap();
+    }
+  }
+  for (int conn = 0; conn < 2; ++conn){
+    RTMPStream::Session alone;
+    if (parsed[conn] != parseAll(expect[conn], alone)){
+      std::cerr << "Connection " << conn << ": interleaved parsing differs from parsing alone" << std::endl;
+      ++failures;
+    }
+  }
+  if (failures){std::cerr << failures << " failures" << std::endl;}
+  return failures;
+}
@@ -0,0 +1,147 @@
+#include <mist/defines.h>
+#include <mist/shared_memory.h>
+#include <mist/timing.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define BENCH_PACKET_SIZE 1000
+
+/// Returns the page table size of the calling process in KiB, as reported by the kernel.
+static uint64_t pageTableKiB(){
+  uint64_t res = 0;
+  FILE *status = fopen("/proc/self/status", "r");
+  if (!status){return 0;}
+  char line[256];
+  while (fgets(line, sizeof(line), status)){
+    if (!strncmp(line, "VmPTE:", 6)){res = strtoull(line + 6, 0, 10);}
+  }
+  fclose(status);
+  return res;
+}
+
+/// Per-reader results, sent back to the benchmark process over a pipe
+struct readerResult{
+  uint64_t pteKiB;
+  uint64_t firstNs;
+  uint64_t secondNs;
+  uint64_t packets;
+  uint64_t errors;
+};
+
+/// Maps the data page like an output would, and reads a value from every packet twice: the
+/// first pass includes faulting the page into this process, the second is the steady state.
+static readerResult readPage(const std::string &name){
+  readerResult res;
+  memset(&res, 0, sizeof(res));
+  uint64_t pteBefore = pageTableKiB();
+  IPC::sharedPage page(name, 0, false, false);
+  if (!page){
+    res.errors = 1;
+    return res;
+  }
+  for (int pass = 0; pass < 2; ++pass){
+    uint64_t start = Util::getMicros();
+    uint64_t packets = 0;
+    for (uint64_t off = 0; off + BENCH_PACKET_SIZE <= DEFAULT_DATA_PAGE_SIZE; off += BENCH_PACKET_SIZE){
+      uint64_t val;
+      memcpy(&val, page.mapped + off, sizeof(val));
+      if (val != off){++res.errors;}
+      ++packets;
+    }
+    uint64_t ns = Util::getMicros(start) * 1000;
+    if (pass){
+      res.secondNs = ns;
+    }else{
+      res.firstNs = ns;
+    }
+    res.packets = packets;
+  }
+  uint64_t pteAfter = pageTableKiB();
+  res.pteKiB = (pteAfter > pteBefore) ? pteAfter - pteBefore : 0;
+  return res;
+}
+
+/// Creates a data page with the given MIST_HUGEPAGES setting and benchmarks it with the
+/// given amount of concurrent readers. Returns the amount of errors encountered.
+static int runMode(const char *mode, size_t readers){
+  if (mode){
+    setenv("MIST_HUGEPAGES", mode, 1);
+  }else{
+    unsetenv("MIST_HUGEPAGES");
+  }
+  char name[NAME_BUFFER_SIZE];
+  snprintf(name, NAME_BUFFER_SIZE, "MstDataHugeBench%d@0_0", getpid());
+  IPC::sharedPage page(name, DEFAULT_DATA_PAGE_SIZE, true);
+  if (!page){
+    std::cerr << "Could not create data page " << name << std::endl;
+    return 1;
+  }
+  for (uint64_t off = 0; off + BENCH_PACKET_SIZE <= DEFAULT_DATA_PAGE_SIZE; off += BENCH_PACKET_SIZE){
+    memcpy(page.mapped + off, &off, sizeof(off));
+  }
+
+  int fds[2];
+  if (pipe(fds)){return 1;}
+  size_t started = 0;
+  for (size_t i = 0; i < readers; ++i){
+    pid_t pid = fork();
+    if (pid == 0){
+      close(fds[0]);
+      readerResult res = readPage(name);
+      ssize_t w = write(fds[1], &res, sizeof(res));
+      _exit(w == sizeof(res) ? 0 : 1);
+    }
+    if (pid > 0){++started;}
+  }
+  close(fds[1]);
+
+  readerResult total;
+  memset(&total, 0, sizeof(total));
+  size_t received = 0;
+  readerResult res;
+  while (read(fds[0], &res, sizeof(res)) == sizeof(res)){
+    total.pteKiB += res.pteKiB;
+    total.firstNs += res.firstNs;
+    total.secondNs += res.secondNs;
+    total.packets += res.packets;
+    total.errors += res.errors;
+    ++received;
+  }
+  close(fds[0]);
+  while (waitpid(-1, 0, 0) > 0){}
+  if (received != started || !received){total.errors += 1 + started - received;}
+
+  std::cout << (mode ? mode : "regular") << ": " << IPC::hugePageStats.hugetlb << " hugetlbfs, "
+            << IPC::hugePageStats.thp << " THP, " << IPC::hugePageStats.fallback << " fallback; "
+            << received << " readers used " << total.pteKiB << " KiB of page tables, "
+            << (total.packets ? total.firstNs / total.packets : 0) << "ns/packet on first read, "
+            << (total.packets ? total.secondNs / total.packets : 0) << "ns/packet after" << std::endl;
+  page.master = true;
+  return total.errors;
+}
+
+/// Usage: shm_hugepages_test [readers [hugetlbfs mount]]
+/// Compares regular, THP and (if a mount is given) hugetlbfs backed data pages.
+int main(int argc, char **argv){
+  Util::printDebugLevel = 0;
+  size_t readers = (argc > 1) ? atoi(argv[1]) : 500;
+  const char *modes[3] = {0, "thp", (argc > 2) ? argv[2] : 0};
+  size_t modeCount = (argc > 2) ? 3 : 2;
+  int errors = 0;
+  for (size_t i = 0; i < modeCount; ++i){
+    // Each mode runs in its own process, as the MIST_HUGEPAGES setting is read only once
+    pid_t pid = fork();
+    if (pid == 0){_exit(runMode(modes[i], readers) ? 1 : 0);}
+    int status = 1;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status)){
+      std::cerr << "Benchmark for " << (modes[i] ? modes[i] : "regular") << " pages failed" << std::endl;
+      ++errors;
+    }
+  }
+  return errors;
+}
@@ -0,0 +1,146 @@
+#include <mist/socket.h>
+#include <mist/timing.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#define BUFFER_ITERATIONS 5000
+#define BUFFER_ITERATIONS_BENCH 2000000
+
+/// Returns a string of len pseudo-random bytes, with a newline every now and then
+static std::string randomData(size_t len){
+  std::string ret(len, 0);
+  for (size_t i = 0; i < len; ++i){ret[i] = (rand() % 16) ? ('a' + rand() % 26) : '\n';}
+  return ret;
+}
+
+/// Runs a random mix of operations on a Socket::Buffer, checking every result against a plain
+/// std::string holding what the buffer should contain. Returns the amount of mismatches.
+static int fuzz(){
+  Socket::Buffer B;
+  std::string model;
+  int failures = 0;
+  for (size_t i = 0; i < BUFFER_ITERATIONS && failures < 10; ++i){
+    size_t count = rand() % 3000;
+    switch (rand() % 9){
+    case 0:
+    case 1:{
+      std::string d = randomData(count);
+      B.append(d);
+      model.append(d);
+    }break;
+    case 2:{
+      // Receive straight into the free space, like Socket::Connection::iread does
+      size_t space = count + 1;
+      char *dest = B.space(space);
+      if (!dest || space < count + 1){
+        std::cerr << "space() returned " << space << " bytes, wanted " << count + 1 << std::endl;
+        ++failures;
+        break;
+      }
+      std::string d = randomData(count);
+      memcpy(dest, d.data(), count);
+      B.commit(count);
+      model.append(d);
+    }break;
+    case 3:{
+      std::string d = randomData(count % 100);
+      B.prepend(d);
+      model.insert(0, d);
+    }break;
+    case 4:{
+      if (count > model.size()){count = model.size();}
+      const char *view = B.peek(count);
+      if (count && (!view || model.compare(0, count, view, count))){
+        std::cerr << "peek(" << count << ") mismatch" << std::endl;
+        ++failures;
+      }
+      B.consume(count);
+      model.erase(0, count);
+    }break;
+    case 5:{
+      std::string d = B.remove(count);
+      if (count > model.size()){
+        if (d.size()){
+          std::cerr << "remove(" << count << ") of " << model.size() << " bytes returned data" << std::endl;
+          ++failures;
+        }
+        break;
+      }
+      if (d != model.substr(0, count)){
+        std::cerr << "remove(" << count << ") mismatch" << std::endl;
+        ++failures;
+      }
+      model.erase(0, count);
+    }break;
+    case 6:{
+      if (count > model.size()){count = model.size();}
+      if (B.copy(count) != model.substr(0, count)){
+        std::cerr << "copy(" << count << ") mismatch" << std::endl;
+        ++failures;
+      }
+    }break;
+    case 7:{
+      // Line-based reading, partially consuming the element like the HTTP parser does
+      std::string &line = B.get();
+      size_t end = model.find('\n');
+      std::string expect = (end == std::string::npos) ? model : model.substr(0, end + 1);
+      if (line != expect){
+        std::cerr << "get() mismatch" << std::endl;
+        ++failures;
+      }
+      size_t drop = line.size() ? rand() % (line.size() + 1) : 0;
+      line.erase(0, drop);
+      model.erase(0, drop);
+    }break;
+    case 8:{
+      size_t end = model.find('\n');
+      if (B.bytesToSplit() != ((end == std::string::npos) ? 0 : end + 1)){
+        std::cerr << "bytesToSplit() mismatch" << std::endl;
+        ++failures;
+      }
+    }break;
+    }
+    if (B.bytes(0xFFFFFFFFul) != model.size() || (B.size() != 0) != (model.size() != 0)){
+      std::cerr << "Size mismatch after " << i << " operations: " << B.bytes(0xFFFFFFFFul) << " != " << model.size() << std::endl;
+      ++failures;
+    }
+    // Keep the buffer from growing without bounds
+    if (model.size() > 100000){
+      Socket::Buffer copy(B);
+      if (copy.remove(model.size()) != model){
+        std::cerr << "Copied buffer mismatch" << std::endl;
+        ++failures;
+      }
+      B.clear();
+      model.clear();
+    }
+  }
+  return failures;
+}
+
+/// Usage: socket_buffer_test [bench]
+/// Without arguments, only checks the buffer against a model. With an argument, also times it.
+int main(int argc, char **argv){
+  srand(42);
+  int failures = fuzz();
+  if (failures || argc < 2){return failures;}
+
+  // Benchmark: 188-byte packets arriving in 1316-byte reads, as an MPEG-TS push would
+  Socket::Buffer B;
+  B.splitter.clear();
+  std::string read = randomData(1316);
+  uint64_t bytes = 0;
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < BUFFER_ITERATIONS_BENCH; ++i){
+    B.append(read);
+    while (B.available(188)){
+      bytes += B.peek(188)[0] ? 188 : 0;
+      B.consume(188);
+    }
+  }
+  uint64_t time = Util::getMicros(start);
+  std::cerr << bytes / 188 << " packets peeked and consumed in " << time << "us" << std::endl;
+  return 0;
+}
@@ -0,0 +1,404 @@
+#include <mist/bitfields.h>
+#include <mist/checksum.h>
+#include <mist/timing.h>
+#include <mist/tinythread.h>
+#include <mist/ts_packet.h>
+#include <mist/ts_stream.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sched.h>
+#include <string>
+
+#define VIDEO_PID 0x100
+#define AUDIO_PID 0x101
+
+/// Cuts a PES packet into TS packets, padding the last one with an adaptation field.
+static void addPES(std::string &ts, uint16_t pid, uint8_t &cc, const std::string &pes){
+  for (size_t pos = 0; pos < pes.size();){
+    char pkt[188];
+    size_t payload = std::min(pes.size() - pos, (size_t)184);
+    size_t hdr = 4;
+    pkt[0] = 0x47;
+    pkt[1] = (pos ? 0 : 0x40) | (pid >> 8);
+    pkt[2] = pid & 0xFF;
+    pkt[3] = (payload < 184 ? 0x30 : 0x10) | (cc++ & 0x0F);
+    if (payload < 184){
+      size_t afLen = 183 - payload;
+      pkt[4] = afLen;
+      if (afLen){
+        pkt[5] = 0;
+        memset(pkt + 6, 0xFF, afLen - 1);
+      }
+      hdr += 1 + afLen;
+    }
+    memcpy(pkt + hdr, pes.data() + pos, payload);
+    ts.append(pkt, 188);
+    pos += payload;
+  }
+}
+
+/// Adds the default PAT and a PMT announcing an H264 and an AAC track.
+static void addTables(std::string &ts, uint8_t &pmtCC){
+  ts.append(TS::PAT, 188);
+  char pmt[188];
+  memset(pmt, 0xFF, 188);
+  const char head[] = "\x47\x50\x00\x10\x00\x02\xB0\x17\x00\x01\xC1\x00\x00\xE1\x00\xF0\x00"
+                      "\x1B\xE1\x00\xF0\x00\x0F\xE1\x01\xF0\x00";
+  memcpy(pmt, head, sizeof(head) - 1);
+  pmt[3] = 0x10 | (pmtCC++ & 0x0F);
+  Bit::htobl(pmt + 27, checksum::crc32(0xFFFFFFFF, pmt + 5, 22));
+  ts.append(pmt, 188);
+}
+
+/// Returns random bytes that never form a start code or emulation prevention sequence.
+static std::string sliceData(size_t len){
+  std::string ret(len, 0);
+  for (size_t i = 0; i < len; ++i){ret[i] = 1 + rand() % 255;}
+  return ret;
+}
+
+struct Expected{
+  size_t videoFrames;
+  size_t keyFrames;
+  size_t audioFrames;
+  uint64_t lastVideoTime;
+};
+
+/// Builds seconds of 30 fps 1080p H264 at roughly the given bitrate, with 44.1 kHz AAC audio in
+/// PES packets of 4 frames each.
+static std::string buildStream(size_t seconds, size_t kbps, Expected &exp){
+  const char sps[] = "\x67\x64\x00\x28\xac\xd9\x40\x78\x02\x27\xe5\x84\x00\x00\x03\x00\x04\x00\x00\x03"
+                     "\x00\xf0\x3c\x60\xc6\x58";
+  std::string init("\x12\x10", 2);
+  std::string ts;
+  uint8_t pmtCC = 0, videoCC = 0, audioCC = 0;
+  memset(&exp, 0, sizeof(exp));
+  size_t audioDone = 0;
+  for (size_t frame = 0; frame < seconds * 30; ++frame){
+    uint64_t ms = frame * 100 / 3;
+    bool key = !(frame % 30);
+    if (key){addTables(ts, pmtCC);}
+    std::string es("\000\000\000\001\011\360", 6);
+    if (key){
+      es.append("\000\000\000\001", 4);
+      es.append(sps, sizeof(sps) - 1);
+      es.append("\000\000\000\001\150\353\343\313\042\300", 10);
+    }
+    es.append("\000\000\001", 3);
+    es += (char)(key ? 0x65 : 0x41);
+    es += (char)(key ? 0x88 : 0x9A);
+    es += sliceData((key ? 4 : 1) * kbps * 1000 / 8 / 40);
+    std::string pes;
+    TS::Packet::getPESVideoLeadIn(pes, 0, ms * 90, 0, true);
+    pes += es;
+    addPES(ts, VIDEO_PID, videoCC, pes);
+    ++exp.videoFrames;
+    if (key){++exp.keyFrames;}
+    exp.lastVideoTime = ms;
+
+    // Audio up to the current video time
+    while (audioDone * 1024 * 1000 / 44100 <= ms){
+      std::string aes;
+      for (size_t i = 0; i < 4; ++i){
+        std::string frameData = sliceData(200 + rand() % 200);
+        aes += TS::getAudioHeader(frameData.size(), init) + frameData;
+      }
+      pes.clear();
+      TS::Packet::getPESAudioLeadIn(pes, aes.size(), audioDone * 1024 * 90000 / 44100, 0);
+      pes += aes;
+      addPES(ts, AUDIO_PID, audioCC, pes);
+      audioDone += 4;
+      exp.audioFrames += 4;
+    }
+  }
+  return ts;
+}
+
+/// Counts a demuxed packet.
+static void countPacket(Expected &got, DTSC::Packet &pack, size_t &bytes){
+  if (!pack){return;}
+  char *data;
+  size_t len;
+  pack.getString("data", data, len);
+  bytes += len;
+  if (pack.getTrackId() == VIDEO_PID){
+    ++got.videoFrames;
+    if (pack.getFlag("keyframe")){++got.keyFrames;}
+    got.lastVideoTime = pack.getTime();
+  }else{
+    ++got.audioFrames;
+  }
+}
+
+/// Demuxes the whole stream, counting the packets that come out of it.
+static Expected demux(TS::Stream &s, const std::string &ts, size_t &bytes){
+  Expected got;
+  memset(&got, 0, sizeof(got));
+  bytes = 0;
+  DTSC::Packet pack;
+  for (size_t i = 0; i + 188 <= ts.size(); i += 188){
+    s.parse((char *)ts.data() + i, i);
+    while (s.hasPacketOnEachTrack()){
+      s.getEarliestPacket(pack);
+      countPacket(got, pack, bytes);
+    }
+  }
+  s.finish();
+  while (s.hasPacket()){
+    s.getEarliestPacket(pack);
+    countPacket(got, pack, bytes);
+  }
+  return got;
+}
+
+/// A parse thread that demuxes one track from the tables and packets in its ring.
+struct RingConsumer{
+  TS::PacketRing ring;
+  size_t pid;
+  bool producerDone;
+  Expected got;
+  size_t bytes;
+};
+
+static void consumeRing(void *arg){
+  RingConsumer &c = *(RingConsumer *)arg;
+  TS::Stream s;
+  s.setThreaded(false);
+  DTSC::Packet pack;
+  while (true){
+    bool done = __atomic_load_n(&c.producerDone, __ATOMIC_ACQUIRE);
+    const char *packets;
+    size_t count = c.ring.peek(packets);
+    for (size_t i = 0; i < count; ++i){
+      s.add((char *)packets + i * 188);
+      size_t pid = ((packets[i * 188 + 1] & 0x1F) << 8) | (unsigned char)packets[i * 188 + 2];
+      if (pid != c.pid){s.parse(pid);}
+    }
+    if (count){
+      c.ring.consume(count);
+    }else if (done){
+      break;
+    }else{
+      sched_yield();
+    }
+    s.parse(c.pid);
+    while (s.hasPacket(c.pid)){
+      s.getPacket(c.pid, pack);
+      countPacket(c.got, pack, c.bytes);
+    }
+  }
+  s.finish();
+  while (s.hasPacket(c.pid)){
+    s.getPacket(c.pid, pack);
+    countPacket(c.got, pack, c.bytes);
+  }
+}
+
+/// Checks that a full ring drops the packet that does not fit and everything after it up to the
+/// next unit start, and nothing else.
+static int verifyRingDrops(){
+  TS::PacketRing ring(4);
+  char pkt[188];
+  memset(pkt, 0, 188);
+  pkt[0] = 0x47;
+  bool ok = true;
+  for (size_t i = 0; i < 4; ++i){
+    pkt[1] = i ? 0 : 0x40;
+    ok &= ring.write(pkt);
+  }
+  pkt[1] = 0;
+  ok &= !ring.write(pkt);
+  const char *packets;
+  ok &= !ring.peek(packets);
+  ring.publish();
+  ok &= (ring.size() == 4 && ring.peek(packets) == 4);
+  ring.consume(4);
+  ok &= !ring.write(pkt);
+  pkt[1] = 0x40;
+  ok &= ring.write(pkt);
+  ok &= (ring.getWritten() == 5 && ring.getDropped() == 2 && ring.getPeak() == 4);
+  // The unit start that ends the drop is preceded by a transport error marker
+  ring.publish();
+  ok &= (ring.peek(packets) == 2 && (packets[1] & 0x80) && !(packets[189] & 0x80) && (packets[189] & 0x40));
+  if (!ok){std::cerr << "Packet ring did not follow its drop policy" << std::endl;}
+
+  // A PAT/PMT copy interleaved while a data PID drops must not end the drop of that PID
+  TS::PacketRing mixed(4);
+  char data[188];
+  memset(data, 0, 188);
+  data[0] = 0x47;
+  bool mixedOk = true;
+  for (size_t i = 0; i < 4; ++i){
+    data[1] = (i ? 0 : 0x40) | (VIDEO_PID >> 8);
+    data[2] = VIDEO_PID & 0xFF;
+    mixedOk &= mixed.write(data);
+  }
+  data[1] = VIDEO_PID >> 8;
+  mixedOk &= !mixed.write(data);
+  mixed.publish();
+  mixed.consume(mixed.peek(packets));
+  mixedOk &= mixed.write(TS::PAT);
+  mixedOk &= !mixed.write(data);
+  data[1] = 0x40 | (VIDEO_PID >> 8);
+  mixedOk &= mixed.write(data);
+  mixedOk &= (mixed.getWritten() == 6 && mixed.getDropped() == 2);
+  if (!mixedOk){std::cerr << "Packet ring resumed a dropping PID at another PID's unit start" << std::endl;}
+  return (ok && mixedOk) ? 0 : 1;
+}
+
+/// Feeds the video track through a small ring whose consumer stalls in the middle of a frame.
+/// The frame the ring dropped the end of must be discarded, and every other frame must come out.
+static int verifyRingDemux(const std::string &ts, const Expected &exp){
+  TS::PacketRing ring(16);
+  TS::Stream s;
+  s.setThreaded(false);
+  Expected got;
+  memset(&got, 0, sizeof(got));
+  size_t bytes = 0;
+  DTSC::Packet pack;
+  size_t videoStarts = 0, sinceStart = 0;
+  bool stall = false;
+  for (size_t i = 0; i + 188 <= ts.size(); i += 188){
+    const char *pkt = ts.data() + i;
+    size_t pid = ((pkt[1] & 0x1F) << 8) | (unsigned char)pkt[2];
+    if (pid != VIDEO_PID && pid != 0 && pid != 0x1000){continue;}
+    if (pid == VIDEO_PID){
+      if (pkt[1] & 0x40){
+        ++videoStarts;
+        sinceStart = 0;
+      }
+      // Stop reading a few packets into the fourth frame, until the ring overflows
+      if (videoStarts == 4 && ++sinceStart == 5){stall = true;}
+    }
+    if (!ring.write(pkt)){stall = false;}
+    if (stall){continue;}
+    ring.publish();
+    const char *packets;
+    size_t count;
+    while ((count = ring.peek(packets))){
+      for (size_t j = 0; j < count; ++j){
+        s.add((char *)packets + j * 188);
+        size_t p = ((packets[j * 188 + 1] & 0x1F) << 8) | (unsigned char)packets[j * 188 + 2];
+        if (p != VIDEO_PID){s.parse(p);}
+      }
+      ring.consume(count);
+    }
+    s.parse(VIDEO_PID);
+    while (s.hasPacket(VIDEO_PID)){
+      s.getPacket(VIDEO_PID, pack);
+      countPacket(got, pack, bytes);
+    }
+  }
+  s.finish();
+  while (s.hasPacket(VIDEO_PID)){
+    s.getPacket(VIDEO_PID, pack);
+    countPacket(got, pack, bytes);
+  }
+  if (!ring.getDropped() || got.videoFrames != exp.videoFrames - 1 || got.keyFrames != exp.keyFrames){
+    std::cerr << "Ring that dropped part of a frame gave " << got.videoFrames << "/" << exp.videoFrames - 1
+              << " video frames after " << ring.getDropped() << " dropped packets" << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+/// Routes the stream into one ring per track, each drained and demuxed by its own thread.
+/// The producer waits for room instead of dropping, so every frame must come out.
+static Expected demuxRings(const std::string &ts, size_t &bytes){
+  RingConsumer consumers[2];
+  consumers[0].pid = VIDEO_PID;
+  consumers[1].pid = AUDIO_PID;
+  tthread::thread *threads[2];
+  for (size_t i = 0; i < 2; ++i){
+    consumers[i].producerDone = false;
+    memset(&consumers[i].got, 0, sizeof(Expected));
+    consumers[i].bytes = 0;
+    threads[i] = new tthread::thread(consumeRing, consumers + i);
+  }
+  for (size_t i = 0; i + 188 <= ts.size(); i += 188){
+    const char *pkt = ts.data() + i;
+    size_t pid = ((pkt[1] & 0x1F) << 8) | (unsigned char)pkt[2];
+    for (size_t j = 0; j < 2; ++j){
+      if (pid == consumers[j].pid || pid == 0 || pid == 0x1000){consumers[j].ring.write(pkt);}
+    }
+    // Publish every 7 packets, like a typical UDP datagram, then wait for room for the next 7
+    if (i % (188 * 7) == 188 * 6){
+      for (size_t j = 0; j < 2; ++j){
+        consumers[j].ring.publish();
+        while (consumers[j].ring.size() > consumers[j].ring.capacity() - 7){sched_yield();}
+      }
+    }
+  }
+  Expected got;
+  memset(&got, 0, sizeof(got));
+  bytes = 0;
+  for (size_t i = 0; i < 2; ++i){
+    consumers[i].ring.publish();
+    __atomic_store_n(&consumers[i].producerDone, true, __ATOMIC_RELEASE);
+    threads[i]->join();
+    delete threads[i];
+    got.videoFrames += consumers[i].got.videoFrames;
+    got.keyFrames += consumers[i].got.keyFrames;
+    got.audioFrames += consumers[i].got.audioFrames;
+    got.lastVideoTime = std::max(got.lastVideoTime, consumers[i].got.lastVideoTime);
+    bytes += consumers[i].bytes;
+    if (consumers[i].ring.getDropped()){
+      std::cerr << "Packet ring dropped packets while the producer waited for room" << std::endl;
+    }
+  }
+  return got;
+}
+
+/// Usage: ts_demux_test [bench]
+/// Demuxes a generated transport stream with and without locking, and with a packet ring and
+/// thread per track, and checks that every frame comes out. With an argument, uses a larger
+/// stream and prints the demux throughput of each.
+int main(int argc, char **argv){
+  srand(42);
+  bool bench = argc > 1;
+  Expected exp;
+  std::string ts = bench ? buildStream(10, 20000, exp) : buildStream(2, 2000, exp);
+
+  TS::Stream locked;
+  size_t bytes = 0;
+  uint64_t start = Util::getMicros();
+  Expected got = demux(locked, ts, bytes);
+  uint64_t lockedTime = Util::getMicros(start);
+  if (got.videoFrames != exp.videoFrames || got.keyFrames != exp.keyFrames ||
+      got.audioFrames != exp.audioFrames || got.lastVideoTime != exp.lastVideoTime){
+    std::cerr << "Demuxed " << got.videoFrames << "/" << exp.videoFrames << " video frames, "
+              << got.keyFrames << "/" << exp.keyFrames << " keyframes, " << got.audioFrames << "/"
+              << exp.audioFrames << " audio frames, last video at " << got.lastVideoTime << "/"
+              << exp.lastVideoTime << " ms" << std::endl;
+    return 1;
+  }
+
+  TS::Stream single;
+  single.setThreaded(false);
+  size_t singleBytes = 0;
+  start = Util::getMicros();
+  got = demux(single, ts, singleBytes);
+  uint64_t singleTime = Util::getMicros(start);
+  if (got.videoFrames != exp.videoFrames || got.audioFrames != exp.audioFrames || singleBytes != bytes){
+    std::cerr << "Single-threaded demux gave different results" << std::endl;
+    return 1;
+  }
+
+  if (verifyRingDrops() || verifyRingDemux(ts, exp)){return 1;}
+  size_t ringBytes = 0;
+  start = Util::getMicros();
+  got = demuxRings(ts, ringBytes);
+  uint64_t ringTime = Util::getMicros(start);
+  if (got.videoFrames != exp.videoFrames || got.keyFrames != exp.keyFrames ||
+      got.audioFrames != exp.audioFrames || got.lastVideoTime != exp.lastVideoTime || ringBytes != bytes){
+    std::cerr << "Demuxing through packet rings gave different results" << std::endl;
+    return 1;
+  }
+  if (!bench){return 0;}
+  std::cout << "Demuxed " << ts.size() / 1000000 << " MB: " << (lockedTime ? ts.size() / lockedTime : 0)
+            << " MB/s locked, " << (singleTime ? ts.size() / singleTime : 0) << " MB/s single-threaded, "
+            << (ringTime ? ts.size() / ringTime : 0) << " MB/s through a thread per track" << std::endl;
+  return 0;
+}
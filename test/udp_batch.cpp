@@ -0,0 +1,136 @@
+#include <mist/defines.h>
+#include <mist/socket.h>
+#include <mist/timing.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define BENCH_DGRAM_SIZE 1316
+#define TEST_PACKETS 2000
+
+/// Receives packets on the given port until none arrive for 500ms, or count have been received.
+/// Checks that each packet is BENCH_DGRAM_SIZE bytes and carries the next sequence number.
+/// Writes the amount of in-order packets and the microseconds spent to the pipe.
+static void receiver(int port, size_t count, int pipeFd){
+  Socket::UDPConnection udp;
+  udp.bind(port, "127.0.0.1");
+  udp.setBlocking(false);
+  if (getenv("BENCH_GRO")){udp.enableGRO();}
+  uint64_t res[3] = {0, 0, 0};
+  ssize_t w = write(pipeFd, res, sizeof(uint64_t)); // signal readiness
+  uint64_t start = 0, lastData = Util::bootMS();
+  while (res[0] + res[2] < count && Util::bootMS() - lastData < 500){
+    bool got = false;
+    while (udp.Receive()){
+      if (!start){start = Util::getMicros();}
+      got = true;
+      uint32_t seq;
+      memcpy(&seq, udp.data, sizeof(seq));
+      if (udp.data.size() != BENCH_DGRAM_SIZE || seq < res[0] + res[2]){
+        ++res[2];
+      }else{
+        res[2] += seq - (res[0] + res[2]);
+        ++res[0];
+      }
+    }
+    if (got){
+      lastData = Util::bootMS();
+    }else{
+      Util::usleep(50);
+    }
+  }
+  res[1] = start ? Util::getMicros(start) : 0;
+  w = write(pipeFd, res, sizeof(res));
+  _exit(w == sizeof(res) ? 0 : 1);
+}
+
+/// Sends count numbered packets to the receiver on port, in the given mode:
+/// 0 = one SendNow per packet, 1 = sendBatched, 2 = segmented SendNow.
+/// Sets lost to the amount of packets lost, damaged or out of order, and returns the amount of
+/// packets received in order. When benchmarking, bursts are only lightly paced and the send and
+/// receive rates are printed; otherwise every burst gets time to drain, so nothing should be lost.
+static size_t runMode(int mode, int port, size_t count, bool bench, size_t &lost){
+  const char *names[3] = {"single", "sendmmsg", "segmented"};
+  int fds[2];
+  if (pipe(fds)){return 0;}
+  pid_t pid = fork();
+  if (!pid){
+    close(fds[0]);
+    receiver(port, count, fds[1]);
+  }
+  close(fds[1]);
+  uint64_t res[3];
+  if (read(fds[0], res, sizeof(uint64_t)) != sizeof(uint64_t)){return 0;}
+  Util::sleep(50);
+
+  Socket::UDPConnection udp;
+  udp.SetDestination("127.0.0.1", port);
+  std::string burst(BENCH_DGRAM_SIZE * 64, 0);
+  uint64_t start = Util::getMicros();
+  for (size_t i = 0; i < count; i += 64){
+    size_t n = (count - i < 64) ? count - i : 64;
+    for (size_t j = 0; j < n; ++j){
+      uint32_t seq = i + j;
+      memcpy((char *)burst.data() + j * BENCH_DGRAM_SIZE, &seq, sizeof(seq));
+    }
+    switch (mode){
+    case 0:
+      for (size_t j = 0; j < n; ++j){udp.SendNow(burst.data() + j * BENCH_DGRAM_SIZE, BENCH_DGRAM_SIZE);}
+      break;
+    case 1:
+      for (size_t j = 0; j < n; ++j){udp.sendBatched(burst.data() + j * BENCH_DGRAM_SIZE, BENCH_DGRAM_SIZE);}
+      udp.flush();
+      break;
+    case 2: udp.SendNow(burst.data(), n * BENCH_DGRAM_SIZE, BENCH_DGRAM_SIZE); break;
+    }
+    if (!bench){
+      Util::usleep(2000);
+    }else if ((i / 64) % 8 == 7){
+      // Don't overrun the receiver too badly; this is a throughput test, not a loss test
+      Util::usleep(200);
+    }
+  }
+  uint64_t sendTime = Util::getMicros(start);
+  memset(res, 0, sizeof(res));
+  ssize_t r = read(fds[0], res, sizeof(res));
+  close(fds[0]);
+  waitpid(pid, 0, 0);
+  if (r != sizeof(res)){return 0;}
+  lost = res[2];
+  if (!bench){return res[0];}
+  std::cout << names[mode] << (getenv("BENCH_GRO") ? "+GRO" : "") << ": sent " << count << " packets at "
+            << (sendTime ? count * 1000000 / sendTime : 0) << " pkt/s, received " << res[0] << " in order ("
+            << res[2] << " lost or out of order) at " << (res[1] ? res[0] * 1000000 / res[1] : 0) << " pkt/s" << std::endl;
+  return res[0];
+}
+
+/// Usage: udp_batch_test [packets]
+/// Sends TEST_PACKETS paced datagrams over loopback with each send method, with and without GRO
+/// on the receiver. One SendNow per packet and sendBatched must deliver every packet intact and in
+/// order; segmented sends must deliver at least half of them.
+/// Given a packet count, benchmarks the send methods with that many packets instead, printing
+/// the rates. Sender and receiver each run single-threaded in their own process.
+int main(int argc, char **argv){
+  Util::printDebugLevel = 0;
+  bool bench = (argc > 1);
+  size_t count = bench ? atoi(argv[1]) : TEST_PACKETS;
+  int port = 20000 + getpid() % 20000;
+  int errors = 0;
+  for (int gro = 0; gro < 2; ++gro){
+    if (gro){setenv("BENCH_GRO", "1", 1);}
+    for (int mode = 0; mode < 3; ++mode){
+      size_t lost = 0;
+      size_t got = runMode(mode, port, count, bench, lost);
+      if (bench){continue;}
+      if (mode < 2 ? (got != count || lost) : got < count / 2){
+        std::cerr << "Mode " << mode << (gro ? " with GRO" : "") << ": " << got << "/" << count
+                  << " packets arrived intact and in order, " << lost << " lost or out of order" << std::endl;
+        ++errors;
+      }
+    }
+  }
+  return errors;
+}